@@ -0,0 +1,552 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+using namespace chrono;
+
+// half the surface area of a box given by its corners,
+// all the heuristic needs to compare splits
+static inline float _halfArea(const float* lo, const float* hi)
+{
+	float dx = hi[0] - lo[0];
+	float dy = hi[1] - lo[1];
+	float dz = hi[2] - lo[2];
+
+	return dx * dy + dy * dz + dz * dx;
+}
+
+// fminf/fmaxf handle NaNs and can't always compile down
+// to a single instruction, which the build loops feel
+static inline float _min(float a, float b)
+{
+	return (a < b ? a : b);
+}
+
+static inline float _max(float a, float b)
+{
+	return (a > b ? a : b);
+}
+
+static inline void _grow(float* lo, float* hi, const AABB& box)
+{
+	lo[0] = _min(lo[0], box.center.x - box.extents.x);
+	lo[1] = _min(lo[1], box.center.y - box.extents.y);
+	lo[2] = _min(lo[2], box.center.z - box.extents.z);
+	hi[0] = _max(hi[0], box.center.x + box.extents.x);
+	hi[1] = _max(hi[1], box.center.y + box.extents.y);
+	hi[2] = _max(hi[2], box.center.z + box.extents.z);
+}
+
+static inline float _axis(const Vec3& v, int axis)
+{
+	return (axis == 0 ? v.x : (axis == 1 ? v.y : v.z));
+}
+
+// which of the BVH_BINS bins a centroid falls in along
+// an axis spanning 'lo' onwards, 'scale' bins per unit
+static inline int _bin(float c, float lo, float scale)
+{
+	int bin = (int)((c - lo) * scale);
+	return (bin < BVH_BINS - 1 ? bin : BVH_BINS - 1);
+}
+
+// distance along a ray to where it enters a box, or -1 if
+// it misses it or only reaches it past 'max_distance'
+static inline float _slab(const float* lo, const float* hi, const float* origin, const float* inv_dir, float max_distance)
+{
+	float t_near = 0.0f, t_far = max_distance;
+
+	int a;
+	for(a = 0; a < 3; a ++)
+	{
+		float t0 = (lo[a] - origin[a]) * inv_dir[a];
+		float t1 = (hi[a] - origin[a]) * inv_dir[a];
+
+		t_near = _max(t_near, _min(t0, t1));
+		t_far = _min(t_far, _max(t0, t1));
+	}
+
+	return (t_near <= t_far ? t_near : -1.0f);
+}
+
+BVH::BVH()
+{
+	this->depth = 0;
+	this->build_ms = 0.0;
+}
+
+// partitions items [start, end) around the median of their
+// centroids along 'axis'
+void BVH::splitMedian(int start, int end, int axis, int* middle)
+{
+	*middle = (start + end) / 2;
+
+	nth_element(this->items.begin() + start, this->items.begin() + *middle, this->items.begin() + end,
+		[&](const BVHItem& a, const BVHItem& b) { return _axis(a.box.center, axis) < _axis(b.box.center, axis); });
+}
+
+// builds the node over items [start, end) and everything
+// under it, returning its index. The items are binned by
+// centroid along all three axes and split where the
+// children's areas times their item counts are smallest,
+// which keeps big and small items apart. Items are moved
+// rather than indexed, so each pass reads them in order
+int BVH::buildNode(int start, int end, int level)
+{
+	int node = (int)this->nodes.size();
+	this->nodes.push_back(BVHNode());
+
+	if(level > this->depth)
+		this->depth = level;
+
+	BVHItem* items = this->items.data();
+
+	float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	float c_lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, c_hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+	int i, a, b;
+	for(i = start; i < end; i ++)
+	{
+		_grow(lo, hi, items[i].box);
+
+		const Vec3& c = items[i].box.center;
+		for(a = 0; a < 3; a ++)
+		{
+			c_lo[a] = _min(c_lo[a], _axis(c, a));
+			c_hi[a] = _max(c_hi[a], _axis(c, a));
+		}
+	}
+
+	BVHNode& n = this->nodes[node];
+	for(a = 0; a < 3; a ++)
+	{
+		n.min[a] = lo[a];
+		n.max[a] = hi[a];
+	}
+
+	int count = end - start;
+	if(count <= BVH_LEAF_SIZE)
+	{
+		n.index = start;
+		n.count = count;
+		return node;
+	}
+
+	int widest = 0;
+	for(a = 1; a < 3; a ++)
+	{
+		if(c_hi[a] - c_lo[a] > c_hi[widest] - c_lo[widest])
+			widest = a;
+	}
+
+	int middle = start;
+
+	// every centroid in the same spot, any split will do
+	if(c_hi[widest] <= c_lo[widest])
+		middle = (start + end) / 2;
+
+	else if(level >= BVH_SAH_DEPTH)
+		this->splitMedian(start, end, widest, &middle);
+
+	else
+	{
+		int bin_counts[3][BVH_BINS];
+		float bin_lo[3][BVH_BINS][3], bin_hi[3][BVH_BINS][3];
+		float scale[3];
+
+		for(a = 0; a < 3; a ++)
+		{
+			float extent = c_hi[a] - c_lo[a];
+			scale[a] = (extent > 0.0f ? (float)BVH_BINS / extent : 0.0f);
+
+			for(b = 0; b < BVH_BINS; b ++)
+			{
+				bin_counts[a][b] = 0;
+				bin_lo[a][b][0] = bin_lo[a][b][1] = bin_lo[a][b][2] = FLT_MAX;
+				bin_hi[a][b][0] = bin_hi[a][b][1] = bin_hi[a][b][2] = -FLT_MAX;
+			}
+		}
+
+		for(i = start; i < end; i ++)
+		{
+			const AABB& box = items[i].box;
+
+			for(a = 0; a < 3; a ++)
+			{
+				b = _bin(_axis(box.center, a), c_lo[a], scale[a]);
+
+				bin_counts[a][b] ++;
+				_grow(bin_lo[a][b], bin_hi[a][b], box);
+			}
+		}
+
+		// sweeps each axis from the right, then from the
+		// left, pricing the split after every bin
+		float best_cost = FLT_MAX;
+		int best_axis = -1, best_split = 0;
+
+		for(a = 0; a < 3; a ++)
+		{
+			if(scale[a] == 0.0f)
+				continue;
+
+			float right_cost[BVH_BINS];
+			float r_lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, r_hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+			int right_count = 0;
+
+			for(b = BVH_BINS - 1; b > 0; b --)
+			{
+				int k;
+				for(k = 0; k < 3; k ++)
+				{
+					r_lo[k] = _min(r_lo[k], bin_lo[a][b][k]);
+					r_hi[k] = _max(r_hi[k], bin_hi[a][b][k]);
+				}
+
+				right_count += bin_counts[a][b];
+				right_cost[b] = (right_count > 0 ? _halfArea(r_lo, r_hi) * right_count : 0.0f);
+			}
+
+			float l_lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, l_hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+			int left_count = 0;
+
+			for(b = 1; b < BVH_BINS; b ++)
+			{
+				int k;
+				for(k = 0; k < 3; k ++)
+				{
+					l_lo[k] = _min(l_lo[k], bin_lo[a][b - 1][k]);
+					l_hi[k] = _max(l_hi[k], bin_hi[a][b - 1][k]);
+				}
+
+				left_count += bin_counts[a][b - 1];
+
+				if(left_count == 0 || left_count == count)
+					continue;
+
+				float cost = _halfArea(l_lo, l_hi) * left_count + right_cost[b];
+
+				if(cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = a;
+					best_split = b;
+				}
+			}
+		}
+
+		if(best_axis >= 0)
+		{
+			float axis_lo = c_lo[best_axis], axis_scale = scale[best_axis];
+			int split = best_split, axis = best_axis;
+
+			middle = (int)(partition(items + start, items + end, [&](const BVHItem& item)
+				{ return _bin(_axis(item.box.center, axis), axis_lo, axis_scale) < split; }) - items);
+		}
+		else
+			this->splitMedian(start, end, widest, &middle);
+	}
+
+	// the left child is always the very next node
+	this->buildNode(start, middle, level + 1);
+	int right = this->buildNode(middle, end, level + 1);
+
+	this->nodes[node].index = right;
+	this->nodes[node].count = 0;
+
+	return node;
+}
+
+// builds the tree over 'boxes', replacing what was there.
+// Queries return indices into 'boxes'
+void BVH::build(const vector<AABB>& boxes)
+{
+	time_point<steady_clock> start = steady_clock::now();
+
+	int count = (int)boxes.size();
+
+	this->nodes.clear();
+	this->nodes.reserve(count > 0 ? 2 * (count / BVH_LEAF_SIZE) + 1 : 0);
+
+	this->items.resize(count);
+
+	int i;
+	for(i = 0; i < count; i ++)
+	{
+		this->items[i].box = boxes[i];
+		this->items[i].index = i;
+	}
+
+	this->depth = 0;
+
+	if(count > 0)
+		this->buildNode(0, count, 1);
+
+	duration<double, milli> elapsed = steady_clock::now() - start;
+	this->build_ms = elapsed.count();
+}
+
+void BVH::clear()
+{
+	this->nodes.clear();
+	this->items.clear();
+	this->depth = 0;
+}
+
+// fills 'out' with every item not entirely outside the
+// frustum, in tree order. Each node carries down the
+// planes its parent wasn't already entirely inside of,
+// so whole subtrees inside the frustum aren't tested
+int BVH::frustum(const Frustum& frustum, vector<int>& out)
+{
+	out.clear();
+
+	if(this->nodes.empty())
+		return 0;
+
+	int stack[BVH_STACK_SIZE];
+	int masks[BVH_STACK_SIZE];
+	int top = 0;
+
+	stack[top] = 0;
+	masks[top ++] = (1 << FRUSTUM_PLANES) - 1;
+
+	while(top > 0)
+	{
+		top --;
+
+		const BVHNode& n = this->nodes[stack[top]];
+		int node = stack[top], mask = masks[top];
+
+		bool outside = false;
+
+		int p;
+		for(p = 0; p < FRUSTUM_PLANES && !outside; p ++)
+		{
+			if(!(mask & (1 << p)))
+				continue;
+
+			const float* pl = frustum.planes[p];
+
+			// the corners furthest along and against the normal
+			float far_d = pl[3], near_d = pl[3];
+
+			int a;
+			for(a = 0; a < 3; a ++)
+			{
+				far_d += pl[a] * (pl[a] >= 0.0f ? n.max[a] : n.min[a]);
+				near_d += pl[a] * (pl[a] >= 0.0f ? n.min[a] : n.max[a]);
+			}
+
+			if(far_d < 0.0f)
+				outside = true;
+
+			else if(near_d >= 0.0f)
+				mask &= ~(1 << p);
+		}
+
+		if(outside)
+			continue;
+
+		if(n.count == 0)
+		{
+			stack[top] = n.index;
+			masks[top ++] = mask;
+			stack[top] = node + 1;
+			masks[top ++] = mask;
+			continue;
+		}
+
+		int i;
+		for(i = n.index; i < n.index + n.count; i ++)
+		{
+			const AABB& box = this->items[i].box;
+			bool inside = true;
+
+			for(p = 0; p < FRUSTUM_PLANES && inside; p ++)
+			{
+				if(!(mask & (1 << p)))
+					continue;
+
+				const float* pl = frustum.planes[p];
+
+				float d = pl[0] * box.center.x + pl[1] * box.center.y + pl[2] * box.center.z + pl[3];
+				float r = fabsf(pl[0]) * box.extents.x + fabsf(pl[1]) * box.extents.y + fabsf(pl[2]) * box.extents.z;
+
+				inside = (d + r >= 0.0f);
+			}
+
+			if(inside)
+				out.push_back(this->items[i].index);
+		}
+	}
+
+	return (int)out.size();
+}
+
+// returns the nearest item whose box the ray from 'origin'
+// along 'direction' hits within 'max_distance' (in units of
+// 'direction'), or -1. 'distance' gets how far along it was.
+// Nearer children are visited first, and anything starting
+// past the best hit so far is skipped
+int BVH::raycast(const Vec3& origin, const Vec3& direction, float max_distance, float* distance)
+{
+	if(this->nodes.empty())
+		return -1;
+
+	float o[3] = {origin.x, origin.y, origin.z};
+	float inv_dir[3] = {
+		(direction.x != 0.0f ? 1.0f / direction.x : FLT_MAX),
+		(direction.y != 0.0f ? 1.0f / direction.y : FLT_MAX),
+		(direction.z != 0.0f ? 1.0f / direction.z : FLT_MAX)
+	};
+
+	float best = max_distance;
+	int hit = -1;
+
+	int stack[BVH_STACK_SIZE];
+	float entries[BVH_STACK_SIZE];
+	int top = 0;
+
+	float t = _slab(this->nodes[0].min, this->nodes[0].max, o, inv_dir, best);
+	if(t >= 0.0f)
+	{
+		stack[top] = 0;
+		entries[top ++] = t;
+	}
+
+	while(top > 0)
+	{
+		top --;
+
+		if(entries[top] >= best)
+			continue;
+
+		int node = stack[top];
+		const BVHNode& n = this->nodes[node];
+
+		if(n.count == 0)
+		{
+			float t_left = _slab(this->nodes[node + 1].min, this->nodes[node + 1].max, o, inv_dir, best);
+			float t_right = _slab(this->nodes[n.index].min, this->nodes[n.index].max, o, inv_dir, best);
+
+			int first = node + 1, second = n.index;
+
+			// the nearer child goes on top
+			if(t_right >= 0.0f && (t_left < 0.0f || t_right < t_left))
+			{
+				swap(first, second);
+				swap(t_left, t_right);
+			}
+
+			if(t_right >= 0.0f)
+			{
+				stack[top] = second;
+				entries[top ++] = t_right;
+			}
+
+			if(t_left >= 0.0f)
+			{
+				stack[top] = first;
+				entries[top ++] = t_left;
+			}
+			continue;
+		}
+
+		int i;
+		for(i = n.index; i < n.index + n.count; i ++)
+		{
+			const AABB& box = this->items[i].box;
+
+			float lo[3] = {box.center.x - box.extents.x, box.center.y - box.extents.y, box.center.z - box.extents.z};
+			float hi[3] = {box.center.x + box.extents.x, box.center.y + box.extents.y, box.center.z + box.extents.z};
+
+			t = _slab(lo, hi, o, inv_dir, best);
+
+			if(t >= 0.0f && t < best)
+			{
+				best = t;
+				hit = this->items[i].index;
+			}
+		}
+	}
+
+	if(hit >= 0 && distance != NULL)
+		*distance = best;
+
+	return hit;
+}
+
+// fills 'out' with every item whose box overlaps 'range',
+// in tree order
+int BVH::query(const AABB& range, vector<int>& out)
+{
+	out.clear();
+
+	if(this->nodes.empty())
+		return 0;
+
+	float lo[3] = {range.center.x - range.extents.x, range.center.y - range.extents.y, range.center.z - range.extents.z};
+	float hi[3] = {range.center.x + range.extents.x, range.center.y + range.extents.y, range.center.z + range.extents.z};
+
+	int stack[BVH_STACK_SIZE];
+	int top = 0;
+
+	stack[top ++] = 0;
+
+	while(top > 0)
+	{
+		int node = stack[-- top];
+		const BVHNode& n = this->nodes[node];
+
+		if(n.min[0] > hi[0] || n.max[0] < lo[0] || n.min[1] > hi[1] ||
+		   n.max[1] < lo[1] || n.min[2] > hi[2] || n.max[2] < lo[2])
+			continue;
+
+		if(n.count == 0)
+		{
+			stack[top ++] = n.index;
+			stack[top ++] = node + 1;
+			continue;
+		}
+
+		int i;
+		for(i = n.index; i < n.index + n.count; i ++)
+		{
+			const AABB& box = this->items[i].box;
+
+			if(fabsf(box.center.x - range.center.x) <= box.extents.x + range.extents.x &&
+			   fabsf(box.center.y - range.center.y) <= box.extents.y + range.extents.y &&
+			   fabsf(box.center.z - range.center.z) <= box.extents.z + range.extents.z)
+				out.push_back(this->items[i].index);
+		}
+	}
+
+	return (int)out.size();
+}
+
+// number of items in the tree
+int BVH::getCount()
+{
+	return (int)this->items.size();
+}
+
+int BVH::getNodeCount()
+{
+	return (int)this->nodes.size();
+}
+
+// levels from the root to the deepest leaf
+int BVH::getDepth()
+{
+	return this->depth;
+}
+
+// milliseconds the last 'build' took
+double BVH::getBuildTime()
+{
+	return this->build_ms;
+}
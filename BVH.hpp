@@ -0,0 +1,77 @@
+#ifndef BVH_HPP__
+#define BVH_HPP__
+
+#include "FrustumCuller.hpp"
+#include "VectorMath.hpp"
+
+#include <vector>
+
+// most items a leaf holds, and how many bins each
+// axis is split into when looking for the cheapest split
+#define BVH_LEAF_SIZE 4
+#define BVH_BINS 16
+
+// past this depth nodes are split at the median instead
+// of by area, which keeps the tree (and the traversal
+// stack) shallow even for badly clustered items
+#define BVH_SAH_DEPTH 32
+#define BVH_STACK_SIZE 64
+
+using namespace std;
+
+// one node of the flattened tree, 32 bytes so two share
+// a cache line. A node's left child is the node right
+// after it; 'index' is its right child, or the first of
+// 'count' items for a leaf
+struct BVHNode {
+
+	float min[3];
+	int index;
+
+	float max[3];
+	int count;
+};
+
+// one item's box and where it was in the list the tree
+// was built from
+struct BVHItem {
+
+	AABB box;
+	int index;
+};
+
+// a bounding volume hierarchy over a set of boxes (such
+// as every instance in a scene), built top down by the
+// surface area heuristic over binned centroids. Answers
+// frustum, ray and range queries in about log(n) rather
+// than testing every box. Items are sorted into tree order
+// as it's built, so each leaf's boxes sit together
+class BVH {
+
+	private:
+		vector<BVHNode> nodes;
+		vector<BVHItem> items;
+
+		int depth;
+		double build_ms;
+
+		int buildNode(int start, int end, int level);
+		void splitMedian(int start, int end, int axis, int* middle);
+
+	public:
+		BVH();
+
+		void build(const vector<AABB>& boxes);
+		void clear();
+
+		int frustum(const Frustum& frustum, vector<int>& out);
+		int raycast(const Vec3& origin, const Vec3& direction, float max_distance, float* distance);
+		int query(const AABB& range, vector<int>& out);
+
+		int getCount();
+		int getNodeCount();
+		int getDepth();
+		double getBuildTime();
+};
+
+#endif
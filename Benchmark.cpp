@@ -0,0 +1,682 @@
+#include "Benchmark.hpp"
+#include "PngDecoder.hpp"
+#include "FrustumCuller.hpp"
+#include "OcclusionBuffer.hpp"
+#include "BVH.hpp"
+
+#include <SOIL/SOIL.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cfloat>
+#include <cmath>
+
+#define PNG_BENCH_RUNS 5
+#define PNG_BENCH_LARGE_RUNS 2
+#define PNG_BENCH_LARGE_SIZE 8192
+
+#define CULL_BENCH_RUNS 20
+#define CULL_BENCH_FIELD 2000.0f
+
+#define OCCLUSION_BENCH_RUNS 20
+#define OCCLUSION_BENCH_WALL 50.0f
+#define OCCLUSION_BENCH_DEPTH 100.0f
+
+#define BVH_BENCH_QUERIES 1000
+#define BVH_BENCH_CHECKED 100000
+#define BVH_BENCH_RANGE 20.0f
+
+#define LZ_HASH_BITS 15
+#define LZ_WINDOW 32768
+#define LZ_MAX_MATCH 258
+
+using namespace std;
+using namespace chrono;
+
+static const char* png_bench_files[] = {
+	"res/box.png", "res/wall.png", "res/wall1.png",
+	"res/lake1_bk.png", "res/lake1_dn.png", "res/lake1_ft.png",
+	"res/lake1_lf.png", "res/lake1_rt.png", "res/lake1_up.png"
+};
+
+// LSB-first bit packer for the deflate stream
+struct BitWriter {
+
+	vector<unsigned char>* out;
+	unsigned int bits;
+	int num_bits;
+};
+
+static void _putBits(BitWriter* w, unsigned int value, int count)
+{
+	w->bits |= value << w->num_bits;
+	w->num_bits += count;
+
+	while(w->num_bits >= 8)
+	{
+		w->out->push_back((unsigned char)(w->bits & 255));
+		w->bits >>= 8;
+		w->num_bits -= 8;
+	}
+}
+
+// Huffman codes are packed most significant bit first
+static void _putCode(BitWriter* w, unsigned int code, int count)
+{
+	unsigned int reversed = 0;
+
+	int i;
+	for(i = 0; i < count; i ++)
+		reversed |= ((code >> i) & 1) << (count - 1 - i);
+
+	_putBits(w, reversed, count);
+}
+
+// writes a literal/length symbol with the fixed Huffman code
+static void _putSymbol(BitWriter* w, int symbol)
+{
+	if(symbol < 144)
+		_putCode(w, 0x30 + symbol, 8);
+	else if(symbol < 256)
+		_putCode(w, 0x190 + symbol - 144, 9);
+	else if(symbol < 280)
+		_putCode(w, symbol - 256, 7);
+	else
+		_putCode(w, 0xC0 + symbol - 280, 8);
+}
+
+static void _putMatch(BitWriter* w, int length, int distance)
+{
+	static const int length_base[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const int dist_base[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+	};
+
+	int i = 28;
+	while(length_base[i] > length)
+		i --;
+
+	int extra = (i < 8 || i == 28 ? 0 : (i - 4) / 4);
+	_putSymbol(w, 257 + i);
+	_putBits(w, length - length_base[i], extra);
+
+	i = 29;
+	while(dist_base[i] > distance)
+		i --;
+
+	extra = (i < 4 ? 0 : (i - 2) / 2);
+	_putCode(w, i, 5);
+	_putBits(w, distance - dist_base[i], extra);
+}
+
+// compresses 'data' into a zlib stream using a single
+// fixed-Huffman block and greedy LZ77 matching. Good
+// enough to produce realistic test files, it is not
+// meant to compete with a real encoder
+static void _deflate(const unsigned char* data, size_t len, vector<unsigned char>& out)
+{
+	BitWriter w;
+	w.out = &out;
+	w.bits = 0;
+	w.num_bits = 0;
+
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	_putBits(&w, 1, 1);
+	_putBits(&w, 1, 2);
+
+	vector<long long> head(1 << LZ_HASH_BITS, -1);
+
+	size_t i = 0;
+	while(i < len)
+	{
+		int best = 0;
+		long long candidate = -1;
+
+		if(i + 3 <= len)
+		{
+			unsigned int hash = ((data[i] << 16) | (data[i + 1] << 8) | data[i + 2]) * 2654435761u >> (32 - LZ_HASH_BITS);
+
+			candidate = head[hash];
+			head[hash] = (long long)i;
+		}
+
+		if(candidate >= 0 && (long long)i - candidate <= LZ_WINDOW)
+		{
+			size_t limit = (len - i < LZ_MAX_MATCH ? len - i : LZ_MAX_MATCH);
+
+			while((size_t)best < limit && data[candidate + best] == data[i + best])
+				best ++;
+		}
+
+		if(best >= 3)
+		{
+			_putMatch(&w, best, (int)(i - candidate));
+			i += best;
+		}
+		else
+			_putSymbol(&w, data[i ++]);
+	}
+
+	_putSymbol(&w, 256);
+	_putBits(&w, 0, 7);
+
+	unsigned int a = 1, b = 0;
+	for(i = 0; i < len; i ++)
+	{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	unsigned int adler = (b << 16) | a;
+	for(i = 0; i < 4; i ++)
+		out.push_back((unsigned char)(adler >> (24 - i * 8)));
+}
+
+static unsigned int _crc32(const unsigned char* data, size_t len, unsigned int crc)
+{
+	static unsigned int table[256];
+	static bool init = false;
+
+	if(!init)
+	{
+		unsigned int n;
+		for(n = 0; n < 256; n ++)
+		{
+			unsigned int c = n;
+
+			int k;
+			for(k = 0; k < 8; k ++)
+				c = (c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1);
+
+			table[n] = c;
+		}
+		init = true;
+	}
+
+	crc = ~crc;
+
+	size_t i;
+	for(i = 0; i < len; i ++)
+		crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void _writeChunk(FILE* fp, const char* type, const unsigned char* data, size_t len)
+{
+	unsigned char header[8] = {
+		(unsigned char)(len >> 24), (unsigned char)(len >> 16), (unsigned char)(len >> 8), (unsigned char)len,
+		(unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3]
+	};
+
+	unsigned int crc = _crc32(header + 4, 4, 0);
+	crc = _crc32(data, len, crc);
+
+	unsigned char footer[4] = {
+		(unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc
+	};
+
+	fwrite(header, 1, 8, fp);
+	fwrite(data, 1, len, fp);
+	fwrite(footer, 1, 4, fp);
+}
+
+// writes a synthetic 8-bit RGB or RGBA test image: smooth
+// gradients with some noise, every row using a different
+// filter type so all of the unfiltering paths get timed
+static bool _writeTestPNG(string filename, int size, int channels)
+{
+	size_t row_bytes = (size_t)size * channels;
+	vector<unsigned char> raw((row_bytes + 1) * size);
+	vector<unsigned char> prev(row_bytes, 0), cur(row_bytes);
+
+	unsigned int seed = 12345;
+
+	int x, y;
+	for(y = 0; y < size; y ++)
+	{
+		for(x = 0; x < size; x ++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			int noise = (int)((seed >> 16) & 15);
+
+			unsigned char* p = &cur[(size_t)x * channels];
+			p[0] = (unsigned char)(((x >> 4) + noise) & 255);
+			p[1] = (unsigned char)(((y >> 4) + noise) & 255);
+			p[2] = (unsigned char)(((x + y) >> 5) & 255);
+
+			if(channels == 4)
+				p[3] = (unsigned char)(255 - ((x ^ y) >> 6 & 63));
+		}
+
+		int filter = y % 5;
+		unsigned char* line = &raw[(row_bytes + 1) * y];
+		line[0] = (unsigned char)filter;
+
+		size_t i;
+		for(i = 0; i < row_bytes; i ++)
+		{
+			int a = (i >= (size_t)channels ? cur[i - channels] : 0);
+			int b = prev[i];
+			int c = (i >= (size_t)channels ? prev[i - channels] : 0);
+			int predicted = 0;
+
+			if(filter == 1)
+				predicted = a;
+			else if(filter == 2)
+				predicted = b;
+			else if(filter == 3)
+				predicted = (a + b) >> 1;
+			else if(filter == 4)
+			{
+				int p = a + b - c;
+				int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+				predicted = (pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+			}
+
+			line[i + 1] = (unsigned char)(cur[i] - predicted);
+		}
+		prev.swap(cur);
+	}
+
+	vector<unsigned char> compressed;
+	_deflate(&raw[0], raw.size(), compressed);
+
+	FILE* fp = fopen(filename.c_str(), "wb");
+	if(fp == NULL)
+		return false;
+
+	static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+	unsigned char header[13] = {
+		(unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size,
+		(unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size,
+		8, (unsigned char)(channels == 4 ? 6 : 2), 0, 0, 0
+	};
+
+	fwrite(signature, 1, 8, fp);
+	_writeChunk(fp, "IHDR", header, 13);
+	_writeChunk(fp, "IDAT", &compressed[0], compressed.size());
+	_writeChunk(fp, "IEND", NULL, 0);
+
+	fclose(fp);
+	return true;
+}
+
+// times SOIL_load_image against PngDecoder on one file,
+// checking that both produce the same RGBA pixels
+static void _benchmarkFile(string filename, int runs)
+{
+	double soil_ms = 0.0, png_ms = 0.0;
+	bool match = true;
+
+	int run;
+	for(run = 0; run < runs; run ++)
+	{
+		int sw = 0, sh = 0, pw = 0, ph = 0;
+
+		time_point<steady_clock> start = steady_clock::now();
+		unsigned char* soil = SOIL_load_image(filename.c_str(), &sw, &sh, 0, SOIL_LOAD_RGBA);
+		duration<double, milli> elapsed = steady_clock::now() - start;
+
+		soil_ms += elapsed.count();
+
+		start = steady_clock::now();
+		unsigned char* png = PngDecoder::load(filename, &pw, &ph);
+		elapsed = steady_clock::now() - start;
+
+		png_ms += elapsed.count();
+
+		if(soil == NULL || png == NULL)
+		{
+			cout << "Failed to load " << filename << endl;
+			match = false;
+		}
+		else if(sw != pw || sh != ph || memcmp(soil, png, (size_t)sw * sh * 4) != 0)
+			match = false;
+
+		if(soil != NULL)
+			SOIL_free_image_data(soil);
+
+		free(png);
+	}
+
+	soil_ms /= runs;
+	png_ms /= runs;
+
+	printf("%-28s SOIL %9.2f ms   PngDecoder %9.2f ms   %5.2fx   %s\n", filename.c_str(), soil_ms, png_ms,
+		   (png_ms > 0.0 ? soil_ms / png_ms : 0.0), (match ? "identical" : "MISMATCH"));
+}
+
+// decodes the project's textures and two synthetic
+// 8K images with both SOIL and PngDecoder
+void benchmarkPNG()
+{
+	size_t i;
+	for(i = 0; i < sizeof(png_bench_files) / sizeof(png_bench_files[0]); i ++)
+		_benchmarkFile(png_bench_files[i], PNG_BENCH_RUNS);
+
+	const char* large[2] = {"bench_8k_rgb.png", "bench_8k_rgba.png"};
+
+	for(i = 0; i < 2; i ++)
+	{
+		if(!_writeTestPNG(large[i], PNG_BENCH_LARGE_SIZE, (i == 0 ? 3 : 4)))
+		{
+			cout << "Failed to write " << large[i] << endl;
+			continue;
+		}
+
+		_benchmarkFile(large[i], PNG_BENCH_LARGE_RUNS);
+		remove(large[i]);
+	}
+}
+
+// times FrustumCuller on 'count' random boxes spread over a
+// square field around a camera looking along it, checking
+// the result against the one-at-a-time Frustum test
+static void _benchmarkCullCount(int count)
+{
+	FrustumCuller culler;
+	vector<AABB> boxes(count);
+
+	srand(count);
+
+	int i;
+	for(i = 0; i < count; i ++)
+	{
+		float x = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD;
+		float y = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD * 0.1f;
+		float z = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD;
+
+		float size = 1.0f + 4.0f * (float)rand() / RAND_MAX;
+
+		boxes[i] = AABB(Vec3(x - size, y - size, z - size), Vec3(x + size, y + size, z + size));
+		culler.add(boxes[i], Sphere(boxes[i].center, boxes[i].extents.length()));
+	}
+
+	Mat4 projection = Mat4::perspective(45.0f, 4.0f / 3.0f, 0.1f, CULL_BENCH_FIELD * 0.5f);
+	Frustum frustum = Frustum::fromMatrix(projection * Mat4::rotate(30.0f, 0.0f, 1.0f, 0.0f));
+
+	vector<int> visible;
+	double total_ms = 0.0;
+
+	int run;
+	for(run = 0; run < CULL_BENCH_RUNS; run ++)
+	{
+		time_point<steady_clock> start = steady_clock::now();
+		culler.cull(frustum, visible);
+		duration<double, milli> elapsed = steady_clock::now() - start;
+
+		total_ms += elapsed.count();
+	}
+
+	bool match = true;
+	int next = 0;
+
+	for(i = 0; i < count && match; i ++)
+	{
+		if(frustum.contains(boxes[i]))
+			match = (next < (int)visible.size() && visible[next ++] == i);
+	}
+	match = match && (next == (int)visible.size());
+
+	printf("%9d instances   %8.3f ms   %9d visible   %9d culled   %s\n", count, total_ms / CULL_BENCH_RUNS,
+		   culler.getVisibleCount(), culler.getCulledCount(), (match ? "identical" : "MISMATCH"));
+}
+
+// frustum culls 10K to 1M instances
+void benchmarkCulling()
+{
+	int count;
+	for(count = 10000; count <= 1000000; count *= 10)
+		_benchmarkCullCount(count);
+}
+
+// times OcclusionBuffer on 'count' random boxes in front
+// of a camera, half of its view blocked by a row of walls
+// with gaps between them. Every box it hides has to be
+// entirely behind the walls
+static void _benchmarkOcclusionCount(int count)
+{
+	FrustumCuller culler;
+	OcclusionBuffer occlusion;
+
+	srand(count);
+
+	int i, j;
+	for(i = 0; i < count; i ++)
+	{
+		float x = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD;
+		float y = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD * 0.1f;
+		float z = -(float)rand() / RAND_MAX * CULL_BENCH_FIELD * 0.5f;
+
+		float size = 1.0f + 4.0f * (float)rand() / RAND_MAX;
+
+		AABB box(Vec3(x - size, y - size, z - size), Vec3(x + size, y + size, z + size));
+		culler.add(box, Sphere(box.center, box.extents.length()));
+	}
+
+	// 0.1 units thick, like res/wall.obj
+	AABB wall(Vec3(-OCCLUSION_BENCH_WALL * 0.5f, -OCCLUSION_BENCH_WALL * 0.5f, -0.05f),
+			  Vec3(OCCLUSION_BENCH_WALL * 0.5f, OCCLUSION_BENCH_WALL * 0.5f, 0.05f));
+
+	for(i = -4; i < 4; i ++)
+	{
+		for(j = -2; j < 2; j ++)
+		{
+			float x = ((float)i + 0.5f) * OCCLUSION_BENCH_WALL * 1.05f;
+			float y = ((float)j + 0.5f) * OCCLUSION_BENCH_WALL;
+
+			occlusion.addQuad(wall, Mat4::translate(x, y, -OCCLUSION_BENCH_DEPTH));
+		}
+	}
+
+	Mat4 projection = Mat4::perspective(45.0f, 2.0f, 0.1f, CULL_BENCH_FIELD * 0.5f);
+	Frustum frustum = Frustum::fromMatrix(projection);
+
+	vector<int> visible;
+	double raster_ms = 0.0, test_ms = 0.0;
+	int in_view = 0;
+
+	int run;
+	for(run = 0; run < OCCLUSION_BENCH_RUNS; run ++)
+	{
+		in_view = culler.cull(frustum, visible);
+
+		occlusion.render(projection);
+		occlusion.cull(&culler, visible);
+
+		raster_ms += occlusion.getRasterTime();
+		test_ms += occlusion.getTestTime();
+	}
+
+	vector<char> kept(count, 0);
+	for(i = 0; i < (int)visible.size(); i ++)
+		kept[visible[i]] = 1;
+
+	bool match = true;
+	for(i = 0; i < count && match; i ++)
+	{
+		AABB box = culler.getBox(i);
+
+		if(!kept[i] && frustum.contains(box))
+			match = (box.center.z + box.extents.z < -OCCLUSION_BENCH_DEPTH);
+	}
+
+	printf("%9d instances   raster %6.3f ms   test %8.3f ms   %9d in view   %9d hidden   %s\n", count,
+		   raster_ms / OCCLUSION_BENCH_RUNS, test_ms / OCCLUSION_BENCH_RUNS, in_view,
+		   occlusion.getOccludedCount(), (match ? "behind the walls" : "MISMATCH"));
+}
+
+// occlusion culls 1K to 1M instances
+void benchmarkOcclusion()
+{
+	int count;
+	for(count = 1000; count <= 1000000; count *= 10)
+		_benchmarkOcclusionCount(count);
+}
+
+// a random point in the benchmark field, flattened on y
+static Vec3 _randomPoint()
+{
+	float x = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD;
+	float y = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD * 0.1f;
+	float z = ((float)rand() / RAND_MAX - 0.5f) * CULL_BENCH_FIELD;
+
+	return Vec3(x, y, z);
+}
+
+// times building a BVH over 'count' random boxes, then
+// frustum, ray and range queries against it. Frustum
+// queries are checked against (and timed next to)
+// FrustumCuller; rays and ranges against testing every
+// box, up to BVH_BENCH_CHECKED boxes
+static void _benchmarkBVHCount(int count)
+{
+	vector<AABB> boxes(count);
+	FrustumCuller culler;
+
+	srand(count);
+
+	int i, j;
+	for(i = 0; i < count; i ++)
+	{
+		Vec3 p = _randomPoint();
+		float size = 1.0f + 4.0f * (float)rand() / RAND_MAX;
+
+		boxes[i] = AABB(p - Vec3(size, size, size), p + Vec3(size, size, size));
+		culler.add(boxes[i], Sphere(boxes[i].center, boxes[i].extents.length()));
+	}
+
+	BVH tree;
+	tree.build(boxes);
+
+	Mat4 projection = Mat4::perspective(45.0f, 4.0f / 3.0f, 0.1f, CULL_BENCH_FIELD * 0.5f);
+	Frustum frustum = Frustum::fromMatrix(projection * Mat4::rotate(30.0f, 0.0f, 1.0f, 0.0f));
+
+	vector<int> found, expected;
+	double tree_ms = 0.0, flat_ms = 0.0;
+
+	int run, runs = (count >= 1000000 ? 3 : CULL_BENCH_RUNS);
+	for(run = 0; run < runs; run ++)
+	{
+		time_point<steady_clock> start = steady_clock::now();
+		tree.frustum(frustum, found);
+		duration<double, milli> elapsed = steady_clock::now() - start;
+		tree_ms += elapsed.count();
+
+		start = steady_clock::now();
+		culler.cull(frustum, expected);
+		elapsed = steady_clock::now() - start;
+		flat_ms += elapsed.count();
+	}
+
+	sort(found.begin(), found.end());
+	bool match = (found == expected);
+
+	// rays start around the middle of the field, where
+	// the boxes are, and head off in any direction
+	double ray_ms = 0.0, range_ms = 0.0;
+	int hits = 0, in_range = 0;
+
+	for(i = 0; i < BVH_BENCH_QUERIES; i ++)
+	{
+		Vec3 origin = _randomPoint() * 0.1f;
+		Vec3 direction = (_randomPoint() - origin).normalize();
+
+		float distance = 0.0f;
+
+		time_point<steady_clock> start = steady_clock::now();
+		int hit = tree.raycast(origin, direction, FLT_MAX, &distance);
+		duration<double, milli> elapsed = steady_clock::now() - start;
+		ray_ms += elapsed.count();
+
+		hits += (hit >= 0 ? 1 : 0);
+
+		if(count <= BVH_BENCH_CHECKED)
+		{
+			float best = FLT_MAX;
+
+			for(j = 0; j < count; j ++)
+			{
+				const AABB& b = boxes[j];
+				float t_near = 0.0f, t_far = FLT_MAX;
+
+				float o[3] = {origin.x, origin.y, origin.z}, d[3] = {direction.x, direction.y, direction.z};
+				float lo[3] = {b.center.x - b.extents.x, b.center.y - b.extents.y, b.center.z - b.extents.z};
+				float hi[3] = {b.center.x + b.extents.x, b.center.y + b.extents.y, b.center.z + b.extents.z};
+
+				int a;
+				for(a = 0; a < 3; a ++)
+				{
+					float inv = (d[a] != 0.0f ? 1.0f / d[a] : FLT_MAX);
+					float t0 = (lo[a] - o[a]) * inv, t1 = (hi[a] - o[a]) * inv;
+
+					t_near = max(t_near, min(t0, t1));
+					t_far = min(t_far, max(t0, t1));
+				}
+
+				if(t_near <= t_far && t_near < best)
+					best = t_near;
+			}
+
+			match = match && (hit >= 0 ? best == distance : best == FLT_MAX);
+		}
+
+		Vec3 center = _randomPoint();
+		AABB range(center - Vec3(BVH_BENCH_RANGE, BVH_BENCH_RANGE, BVH_BENCH_RANGE),
+				   center + Vec3(BVH_BENCH_RANGE, BVH_BENCH_RANGE, BVH_BENCH_RANGE));
+
+		start = steady_clock::now();
+		tree.query(range, found);
+		elapsed = steady_clock::now() - start;
+		range_ms += elapsed.count();
+
+		in_range += (int)found.size();
+
+		if(count <= BVH_BENCH_CHECKED)
+		{
+			expected.clear();
+
+			for(j = 0; j < count; j ++)
+			{
+				const AABB& b = boxes[j];
+
+				if(fabsf(b.center.x - range.center.x) <= b.extents.x + range.extents.x &&
+				   fabsf(b.center.y - range.center.y) <= b.extents.y + range.extents.y &&
+				   fabsf(b.center.z - range.center.z) <= b.extents.z + range.extents.z)
+					expected.push_back(j);
+			}
+
+			sort(found.begin(), found.end());
+			match = match && (found == expected);
+		}
+	}
+
+	printf("%9d instances   build %9.2f ms (%8d nodes, depth %2d)   frustum %8.3f ms (flat %8.3f ms)   "
+		   "ray %7.2f us (%4d hits)   range %7.2f us (%6d found)   %s\n", count, tree.getBuildTime(),
+		   tree.getNodeCount(), tree.getDepth(), tree_ms / runs, flat_ms / runs,
+		   ray_ms * 1000.0 / BVH_BENCH_QUERIES, hits, range_ms * 1000.0 / BVH_BENCH_QUERIES, in_range,
+		   (match ? (count <= BVH_BENCH_CHECKED ? "identical" : "identical frustum") : "MISMATCH"));
+}
+
+// builds and queries BVHs over 1K to 10M instances
+void benchmarkBVH()
+{
+	int count;
+	for(count = 1000; count <= 10000000; count *= 10)
+		_benchmarkBVHCount(count);
+}
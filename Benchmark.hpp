@@ -0,0 +1,12 @@
+#ifndef BENCHMARK_HPP__
+#define BENCHMARK_HPP__
+
+// command line benchmark modes, run from main
+// in place of the test world
+
+void benchmarkPNG();
+void benchmarkCulling();
+void benchmarkOcclusion();
+void benchmarkBVH();
+
+#endif
@@ -38,28 +38,16 @@ bool Camera::picked(Model* model, Shader* shader, double distance)
 
 	shader->begin();
 
-	glPushMatrix();
+	Mat4 projection = Mat4::perspective(45.0f, (float)viewport[2] / (float)viewport[3], 0.1f, (float)distance) *
+					  Mat4::ortho(0.0f, 8.0f, 0.0f, 8.0f, 0.1f, (float)distance);
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	
-	shader->setProjectionMatrix();
-	
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-
-	gluPerspective(45.0, (double)viewport[2] / (double)viewport[3], 0.1, distance);
-	glOrtho(0.0, 8.0, 0.0, 8.0, 0.1, distance);
-
-	this->doRotate();
-	this->doTranslate();
+	shader->setProjectionMatrix(projection);
+	shader->setCameraMatrix(this->getViewMatrix());
 
 	model->select(shader);
 
 	glReadPixels(viewport[2] / 2, viewport[3] / 2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, res);
 	hit = (unsigned int)(res[0]);
-
-	glPopMatrix();
 	
 	shader->end();
 
@@ -104,23 +92,25 @@ void Camera::rotate(float dtheta, float dphi)
 		this->phi = -AZIMUTH_RANGE;
 }
 
-// wraps 'glTranslatef' into a Camera object
-// function (used primarily for neatness)
-void Camera::doTranslate()
+// builds the camera's look rotation from its
+// horizontal and vertical rotation values (theta
+// and phi, respectively), without the translation.
+// Used on its own for the skybox
+Mat4 Camera::getRotationMatrix()
 {
-	glTranslatef(this->x, this->y, this->z);
+	float rad = (this->theta * M_PI) / 180.0;
+
+	Quat turn = Quat::axisAngle(this->theta, Vec3(0.0f, 1.0f, 0.0f));
+	Quat tilt = Quat::axisAngle(-(this->phi), Vec3(cos(rad), 0.0f, sin(rad)));
+
+	return Mat4::fromQuat(turn * tilt);
 }
 
-// performs necessary 'glRotatef' calculations
-// based on the camera's horizontal and
-// vertical rotation values (theta and phi,
-// respectively)
-void Camera::doRotate()
+// builds the full view matrix, the look rotation
+// followed by the camera's translation
+Mat4 Camera::getViewMatrix()
 {
-	float rad = (this->theta * M_PI) / 180.0;
-
-	glRotatef(this->theta, 0.0f, 1.0f, 0.0f);
-	glRotatef(-(this->phi), cos(rad), 0.0f, sin(rad));
+	return this->getRotationMatrix() * Mat4::translate(this->x, this->y, this->z);
 }
 
 // returns the camera's 'X' position
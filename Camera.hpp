@@ -1,6 +1,7 @@
 #ifndef CAMERA_HPP__
 #define CAMERA_HPP__
 
+#include "VectorMath.hpp"
 #include "Model.hpp"
 #include "Shader.hpp"
 
@@ -23,8 +24,8 @@ class Camera {
 
 		void rotate(float dtheta, float dphi);
 
-		void doTranslate(void);
-		void doRotate(void);
+		Mat4 getRotationMatrix();
+		Mat4 getViewMatrix();
 
 		float getX();
 		float getY();
@@ -0,0 +1,145 @@
+#include "DeferredRenderer.hpp"
+
+#include <GL/glew.h>
+
+// binds a texture to one of the DEFERRED_*_ID units
+static void _bindTexture(int unit, unsigned int texture)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+// loads the G-buffer, lighting and composite programs.
+// The composite draw makes its triangle from the vertex
+// index, but still needs some vertex array bound
+DeferredRenderer::DeferredRenderer(UniformBlocks* blocks)
+{
+	this->geometry = new Shader("res/main.vs", "res/gbuffer.fs", blocks);
+	this->lighting = new Shader("res/deferred.cs", blocks);
+	this->compositing = new Shader("res/composite.vs", "res/composite.fs", blocks);
+
+	this->lighting->setUniformi(UNIFORM_ID(DEFERRED_ALBEDO_STR), DEFERRED_ALBEDO_ID);
+	this->lighting->setUniformi(UNIFORM_ID(DEFERRED_NORMAL_STR), DEFERRED_NORMAL_ID);
+	this->lighting->setUniformi(UNIFORM_ID(DEFERRED_MATERIAL_STR), DEFERRED_MATERIAL_ID);
+	this->lighting->setUniformi(UNIFORM_ID(DEFERRED_DEPTH_STR), DEFERRED_DEPTH_ID);
+	this->lighting->setUniformi(UNIFORM_ID(TEXTURE_SHADOW_CASCADES_STR), TEXTURE_SHADOW_CASCADES_ID);
+	this->lighting->setUniformi(UNIFORM_ID(TEXTURE_SHADOW_CUBES_STR), TEXTURE_SHADOW_CUBES_ID);
+
+	this->compositing->setUniformi(UNIFORM_ID(DEFERRED_LIT_STR), DEFERRED_LIT_ID);
+	this->compositing->setUniformi(UNIFORM_ID(DEFERRED_MATERIAL_STR), DEFERRED_MATERIAL_ID);
+	this->compositing->setUniformi(UNIFORM_ID(DEFERRED_DEPTH_STR), DEFERRED_DEPTH_ID);
+
+	glGenVertexArrays(1, &(this->vao));
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+	delete this->geometry;
+	delete this->lighting;
+	delete this->compositing;
+
+	glDeleteVertexArrays(1, &(this->vao));
+}
+
+// starts drawing into the G-buffer bound as the current
+// framebuffer (albedo, normal, material in that order),
+// clearing it first unless it's being drawn over again.
+// Blending is off, since each target holds one surface
+void DeferredRenderer::beginGeometry(bool clear)
+{
+	if(clear)
+	{
+		float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		unsigned int none[4] = { 0, 0, 0, 0 };
+		float far = 1.0f;
+
+		glClearBufferfv(GL_COLOR, 0, zero);
+		glClearBufferfv(GL_COLOR, 1, zero);
+		glClearBufferuiv(GL_COLOR, 2, none);
+		glClearBufferfv(GL_DEPTH, 0, &far);
+	}
+
+	glDisable(GL_BLEND);
+	this->geometry->begin();
+}
+
+void DeferredRenderer::endGeometry()
+{
+	this->geometry->end();
+	glEnable(GL_BLEND);
+}
+
+// lights every pixel of the G-buffer into 'output' (an
+// RGBA8 texture of 'width' by 'height'), with the point
+// lights bound to LIGHT_RECORDS_BINDING and the materials
+// to DRAW_RECORDS_BINDING. 'view' and 'projection' are
+// what the G-buffer was drawn with
+void DeferredRenderer::light(const GBuffer& gbuffer, unsigned int output, int width, int height, const Mat4& view, const Mat4& projection)
+{
+	Mat4 inv_view_proj = (projection * view).inverse();
+	Mat4 inv_projection = projection.inverse();
+
+	this->lighting->begin();
+
+	this->lighting->setProjectionMatrix(projection);
+	this->lighting->setCameraMatrix(view);
+
+	this->lighting->setUniformMatrix4(UNIFORM_ID(DEFERRED_INV_VIEW_PROJ_STR), inv_view_proj.m);
+	this->lighting->setUniformMatrix4(UNIFORM_ID(DEFERRED_INV_PROJECTION_STR), inv_projection.m);
+
+	_bindTexture(DEFERRED_ALBEDO_ID, gbuffer.albedo);
+	_bindTexture(DEFERRED_NORMAL_ID, gbuffer.normal);
+	_bindTexture(DEFERRED_MATERIAL_ID, gbuffer.material);
+	_bindTexture(DEFERRED_DEPTH_ID, gbuffer.depth);
+
+	glBindImageTexture(DEFERRED_OUTPUT_IMAGE, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+	this->lighting->dispatch((width + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE,
+							 (height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE);
+
+	this->lighting->end();
+
+	_bindTexture(DEFERRED_ALBEDO_ID, 0);
+	_bindTexture(DEFERRED_NORMAL_ID, 0);
+	_bindTexture(DEFERRED_MATERIAL_ID, 0);
+	_bindTexture(DEFERRED_DEPTH_ID, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// draws the lit image over whatever is in the current
+// framebuffer (the skybox), blended like the forward path,
+// writing the G-buffer's depth wherever something was drawn
+void DeferredRenderer::composite(const GBuffer& gbuffer, unsigned int lit)
+{
+	int depth_func = GL_LEQUAL;
+	glGetIntegerv(GL_DEPTH_FUNC, &depth_func);
+	glDepthFunc(GL_ALWAYS);
+
+	this->compositing->begin();
+
+	_bindTexture(DEFERRED_LIT_ID, lit);
+	_bindTexture(DEFERRED_MATERIAL_ID, gbuffer.material);
+	_bindTexture(DEFERRED_DEPTH_ID, gbuffer.depth);
+
+	glBindVertexArray(this->vao);
+
+	this->compositing->flush();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindVertexArray(0);
+
+	_bindTexture(DEFERRED_LIT_ID, 0);
+	_bindTexture(DEFERRED_MATERIAL_ID, 0);
+	_bindTexture(DEFERRED_DEPTH_ID, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	this->compositing->end();
+	glDepthFunc(depth_func);
+}
+
+// the program to draw the scene with between
+// 'beginGeometry' and 'endGeometry'
+Shader* DeferredRenderer::getGeometryShader()
+{
+	return this->geometry;
+}
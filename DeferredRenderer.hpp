@@ -0,0 +1,69 @@
+#ifndef DEFERREDRENDERER_HPP__
+#define DEFERREDRENDERER_HPP__
+
+#include "UniformBlocks.hpp"
+#include "VectorMath.hpp"
+#include "Shader.hpp"
+
+// must match local_size_x/y in res/deferred.cs
+#define DEFERRED_TILE_SIZE 16
+
+// texture units the G-buffer and the lit image are read
+// from, past the ones the scene's shaders use
+#define DEFERRED_ALBEDO_ID 6
+#define DEFERRED_NORMAL_ID 7
+#define DEFERRED_MATERIAL_ID 8
+#define DEFERRED_DEPTH_ID 9
+#define DEFERRED_LIT_ID 10
+
+// image unit res/deferred.cs writes the lit pixels to
+#define DEFERRED_OUTPUT_IMAGE 0
+
+#define DEFERRED_ALBEDO_STR "gAlbedo"
+#define DEFERRED_NORMAL_STR "gNormal"
+#define DEFERRED_MATERIAL_STR "gMaterial"
+#define DEFERRED_DEPTH_STR "gDepth"
+#define DEFERRED_LIT_STR "litColor"
+#define DEFERRED_INV_VIEW_PROJ_STR "inv_view_proj"
+#define DEFERRED_INV_PROJECTION_STR "inv_projection"
+
+// the textures one frame's surfaces are written to:
+// color (RGBA8), normal (RGBA16F), material ID (R32UI,
+// 0 where nothing was drawn) and depth
+struct GBuffer {
+
+	unsigned int albedo;
+	unsigned int normal;
+	unsigned int material;
+	unsigned int depth;
+};
+
+// shades the scene once per pixel instead of once per
+// fragment drawn. The scene is first drawn into a G-buffer
+// with res/gbuffer.fs, then res/deferred.cs lights it tile
+// by tile, each tile only going through the lights that
+// reach what was drawn in it, and the result is drawn over
+// the skybox with its depth, for anything drawn after it
+class DeferredRenderer {
+
+	private:
+		Shader* geometry;
+		Shader* lighting;
+		Shader* compositing;
+
+		unsigned int vao;
+
+	public:
+		DeferredRenderer(UniformBlocks* blocks);
+		~DeferredRenderer();
+
+		void beginGeometry(bool clear);
+		void endGeometry();
+
+		void light(const GBuffer& gbuffer, unsigned int output, int width, int height, const Mat4& view, const Mat4& projection);
+		void composite(const GBuffer& gbuffer, unsigned int lit);
+
+		Shader* getGeometryShader();
+};
+
+#endif
@@ -0,0 +1,599 @@
+#include "FrameGraph.hpp"
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <cstdio>
+
+// bytes a texel of a transient texture's format takes
+static int _texelBytes(unsigned int format)
+{
+	switch(format)
+	{
+		case GL_R8:
+			return 1;
+
+		case GL_RG8:
+		case GL_R16F:
+		case GL_DEPTH_COMPONENT16:
+			return 2;
+
+		case GL_RGBA16F:
+		case GL_RG32F:
+			return 8;
+
+		case GL_RGBA32F:
+			return 16;
+
+		default:
+			return 4;
+	}
+}
+
+static bool _isDepthFormat(unsigned int format)
+{
+	return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 ||
+		   format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH24_STENCIL8;
+}
+
+// the barrier bits that make an image or storage
+// write visible to a later access of this kind
+static unsigned int _barrierBits(int access, int type)
+{
+	unsigned int bits = 0;
+
+	if(access & ACCESS_ATTACHMENT)
+		bits |= GL_FRAMEBUFFER_BARRIER_BIT;
+
+	if(access & ACCESS_TEXTURE)
+		bits |= GL_TEXTURE_FETCH_BARRIER_BIT;
+
+	if(access & ACCESS_IMAGE)
+		bits |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+
+	if(access & ACCESS_STORAGE)
+		bits |= GL_SHADER_STORAGE_BARRIER_BIT;
+
+	if(access & ACCESS_INDIRECT)
+		bits |= GL_COMMAND_BARRIER_BIT;
+
+	if(access & ACCESS_COPY)
+		bits |= (type == RESOURCE_TEXTURE ? GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT : GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	return bits;
+}
+
+FrameGraph::FrameGraph()
+{
+	this->frame = 0;
+}
+
+FrameGraph::~FrameGraph()
+{
+	int i;
+	for(i = 0; i < (int)this->passes.size(); i ++)
+	{
+		glDeleteQueries(GRAPH_TIMER_FRAMES, this->passes[i].queries);
+
+		if(this->passes[i].fbo != 0)
+			glDeleteFramebuffers(1, &(this->passes[i].fbo));
+	}
+
+	for(i = 0; i < (int)this->textures.size(); i ++)
+		glDeleteTextures(1, &(this->textures[i].texture));
+}
+
+// declares a texture that only lives for part of a frame.
+// Its memory is given out by 'compile', and may be shared
+// with other transient textures of the same size and format
+int FrameGraph::addTexture(string name, int width, int height, unsigned int format)
+{
+	GraphResource resource;
+
+	resource.name = name;
+	resource.type = RESOURCE_TEXTURE;
+	resource.imported = false;
+	resource.output = false;
+	resource.handle = 0;
+	resource.width = width;
+	resource.height = height;
+	resource.format = format;
+	resource.physical = -1;
+	resource.first_pass = -1;
+	resource.last_pass = -1;
+	resource.pending = 0;
+
+	this->resources.push_back(resource);
+	return (int)this->resources.size() - 1;
+}
+
+// declares a texture owned outside the graph, such as the
+// window's framebuffer (0). Imported resources are always
+// outputs, since whoever owns them may read them later
+int FrameGraph::importTexture(string name, unsigned int texture)
+{
+	int resource = this->addTexture(name, 0, 0, 0);
+
+	this->resources[resource].imported = true;
+	this->resources[resource].output = true;
+	this->resources[resource].handle = texture;
+
+	return resource;
+}
+
+// declares a buffer (or set of buffers) owned outside the graph
+int FrameGraph::importBuffer(string name, unsigned int buffer)
+{
+	int resource = this->importTexture(name, buffer);
+	this->resources[resource].type = RESOURCE_BUFFER;
+
+	return resource;
+}
+
+// adds a pass, run by 'execute' after the ones added
+// before it. Its reads and writes are declared next
+int FrameGraph::addPass(string name, function<void()> execute)
+{
+	GraphPass pass;
+
+	pass.name = name;
+	pass.execute = execute;
+	pass.side_effects = false;
+	pass.culled = false;
+	pass.fbo = 0;
+	pass.width = 0;
+	pass.height = 0;
+	pass.barrier = 0;
+	pass.gpu_ms = 0.0;
+
+	glGenQueries(GRAPH_TIMER_FRAMES, pass.queries);
+
+	int i;
+	for(i = 0; i < GRAPH_TIMER_FRAMES; i ++)
+		pass.issued[i] = false;
+
+	this->passes.push_back(pass);
+	return (int)this->passes.size() - 1;
+}
+
+// 'access' is a mask of the ACCESS_ values
+void FrameGraph::read(int pass, int resource, int access)
+{
+	GraphAccess use;
+	use.resource = resource;
+	use.access = access;
+
+	this->passes[pass].reads.push_back(use);
+}
+
+// a pass drawing into a transient texture writes it
+// with ACCESS_ATTACHMENT, and gets a framebuffer for it
+void FrameGraph::write(int pass, int resource, int access)
+{
+	GraphAccess use;
+	use.resource = resource;
+	use.access = access;
+
+	this->passes[pass].writes.push_back(use);
+}
+
+// keeps a pass that does something outside the graph
+// (such as a CPU readback) even if nothing reads its writes
+void FrameGraph::setSideEffects(int pass, bool side_effects)
+{
+	this->passes[pass].side_effects = side_effects;
+}
+
+// marks whether a resource is wanted at the end of the
+// frame. Passes that contribute to no output are culled
+void FrameGraph::setOutput(int resource, bool output)
+{
+	this->resources[resource].output = output;
+}
+
+// walks the passes backwards from the outputs, keeping a
+// pass only if something later needs what it writes. A
+// kept pass needs what it reads, and also what was in its
+// writes before it, since it may draw over them
+void FrameGraph::cull()
+{
+	vector<bool> needed(this->resources.size());
+
+	int i, j;
+	for(i = 0; i < (int)this->resources.size(); i ++)
+		needed[i] = this->resources[i].output;
+
+	for(i = (int)this->passes.size() - 1; i >= 0; i --)
+	{
+		GraphPass& pass = this->passes[i];
+		bool keep = pass.side_effects;
+
+		for(j = 0; j < (int)pass.writes.size() && !keep; j ++)
+			keep = needed[pass.writes[j].resource];
+
+		pass.culled = !keep;
+
+		if(!keep)
+			continue;
+
+		for(j = 0; j < (int)pass.reads.size(); j ++)
+			needed[pass.reads[j].resource] = true;
+
+		for(j = 0; j < (int)pass.writes.size(); j ++)
+			needed[pass.writes[j].resource] = true;
+	}
+}
+
+// finds each transient texture's first and last use among
+// the kept passes, then hands out real textures in order
+// of first use, reusing one of the same size and format
+// when whatever had it was last used by an earlier pass
+void FrameGraph::allocate()
+{
+	int i, j, k;
+	for(i = 0; i < (int)this->resources.size(); i ++)
+	{
+		this->resources[i].first_pass = -1;
+		this->resources[i].last_pass = -1;
+		this->resources[i].physical = -1;
+	}
+
+	for(i = 0; i < (int)this->passes.size(); i ++)
+	{
+		GraphPass& pass = this->passes[i];
+		if(pass.culled)
+			continue;
+
+		for(j = 0; j < (int)(pass.reads.size() + pass.writes.size()); j ++)
+		{
+			int r = (j < (int)pass.reads.size() ? pass.reads[j].resource : pass.writes[j - pass.reads.size()].resource);
+			GraphResource& resource = this->resources[r];
+
+			if(resource.first_pass < 0)
+				resource.first_pass = i;
+
+			resource.last_pass = i;
+		}
+	}
+
+	for(i = 0; i < (int)this->textures.size(); i ++)
+		this->textures[i].busy_until = -1;
+
+	for(i = 0; i < (int)this->passes.size(); i ++)
+	{
+		for(j = 0; j < (int)this->resources.size(); j ++)
+		{
+			GraphResource& resource = this->resources[j];
+
+			if(resource.imported || resource.first_pass != i)
+				continue;
+
+			for(k = 0; k < (int)this->textures.size(); k ++)
+			{
+				GraphTexture& texture = this->textures[k];
+
+				if(texture.width == resource.width && texture.height == resource.height &&
+				   texture.format == resource.format && texture.busy_until < i)
+					break;
+			}
+
+			if(k == (int)this->textures.size())
+			{
+				GraphTexture texture;
+				texture.width = resource.width;
+				texture.height = resource.height;
+				texture.format = resource.format;
+
+				glGenTextures(1, &(texture.texture));
+				glBindTexture(GL_TEXTURE_2D, texture.texture);
+				glTexStorage2D(GL_TEXTURE_2D, 1, resource.format, resource.width, resource.height);
+
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				glBindTexture(GL_TEXTURE_2D, 0);
+
+				this->textures.push_back(texture);
+			}
+
+			this->textures[k].busy_until = resource.last_pass;
+			resource.physical = k;
+		}
+	}
+}
+
+// (re)makes a pass's framebuffer if the textures behind
+// its transient attachments changed since the last compile
+void FrameGraph::makeFramebuffer(GraphPass& pass)
+{
+	vector<unsigned int> attached;
+
+	int i;
+	for(i = 0; i < (int)pass.writes.size(); i ++)
+	{
+		GraphResource& resource = this->resources[pass.writes[i].resource];
+
+		if((pass.writes[i].access & ACCESS_ATTACHMENT) && !(resource.imported))
+			attached.push_back(this->textures[resource.physical].texture);
+	}
+
+	if(attached == pass.attached)
+		return;
+
+	if(pass.fbo != 0)
+		glDeleteFramebuffers(1, &(pass.fbo));
+
+	pass.fbo = 0;
+	pass.attached = attached;
+
+	if(attached.empty())
+		return;
+
+	int previous = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+	glGenFramebuffers(1, &(pass.fbo));
+	glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
+
+	unsigned int buffers[8];
+	int colors = 0;
+
+	for(i = 0; i < (int)pass.writes.size(); i ++)
+	{
+		GraphResource& resource = this->resources[pass.writes[i].resource];
+
+		if(!(pass.writes[i].access & ACCESS_ATTACHMENT) || resource.imported)
+			continue;
+
+		unsigned int texture = this->textures[resource.physical].texture;
+
+		pass.width = resource.width;
+		pass.height = resource.height;
+
+		if(_isDepthFormat(resource.format))
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+
+		else if(colors < 8)
+		{
+			buffers[colors] = GL_COLOR_ATTACHMENT0 + colors;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, buffers[colors], GL_TEXTURE_2D, texture, 0);
+			colors ++;
+		}
+	}
+
+	if(colors > 0)
+		glDrawBuffers(colors, buffers);
+	else
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cout << "Failed to complete framebuffer for pass " << pass.name << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+// culls passes, places transient textures and makes the
+// framebuffers. Cheap enough to run every frame, and has
+// to be rerun whenever an output changes
+void FrameGraph::compile()
+{
+	this->cull();
+	this->allocate();
+
+	int i;
+	for(i = 0; i < (int)this->passes.size(); i ++)
+	{
+		if(!(this->passes[i].culled))
+			this->makeFramebuffer(this->passes[i]);
+	}
+}
+
+// the barriers a pass needs before it runs: the bits
+// still owed for the resources it touches, for the ways
+// it touches them. Writes made through images or storage
+// buffers owe every bit, and each barrier issued pays off
+// its bits for every resource at once
+unsigned int FrameGraph::barrierFor(int pass)
+{
+	GraphPass& p = this->passes[pass];
+	unsigned int bits = 0;
+
+	int i;
+	for(i = 0; i < (int)p.reads.size(); i ++)
+	{
+		GraphResource& resource = this->resources[p.reads[i].resource];
+		bits |= resource.pending & _barrierBits(p.reads[i].access, resource.type);
+	}
+
+	for(i = 0; i < (int)p.writes.size(); i ++)
+	{
+		GraphResource& resource = this->resources[p.writes[i].resource];
+		bits |= resource.pending & _barrierBits(p.writes[i].access, resource.type);
+	}
+
+	return bits;
+}
+
+// picks up a pass's GPU time from the query issued
+// GRAPH_TIMER_FRAMES frames ago, if it's finished
+void FrameGraph::readTimer(GraphPass& pass, int slot)
+{
+	if(!(pass.issued[slot]))
+		return;
+
+	int available = 0;
+	glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if(!available)
+		return;
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &elapsed);
+
+	pass.gpu_ms = (double)elapsed / 1000000.0;
+	pass.issued[slot] = false;
+}
+
+// runs the passes 'compile' kept, in the order they were
+// added. Passes with transient attachments run with their
+// framebuffer bound and the viewport covering it
+void FrameGraph::execute()
+{
+	int slot = this->frame % GRAPH_TIMER_FRAMES;
+
+	int i, j;
+	for(i = 0; i < (int)this->passes.size(); i ++)
+	{
+		GraphPass& pass = this->passes[i];
+		if(pass.culled)
+			continue;
+
+		this->readTimer(pass, slot);
+
+		pass.barrier = this->barrierFor(i);
+		if(pass.barrier != 0)
+		{
+			glMemoryBarrier(pass.barrier);
+
+			for(j = 0; j < (int)this->resources.size(); j ++)
+				this->resources[j].pending &= ~(pass.barrier);
+		}
+
+		int previous = 0, viewport[4];
+		if(pass.fbo != 0)
+		{
+			glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+			glGetIntegerv(GL_VIEWPORT, viewport);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
+			glViewport(0, 0, pass.width, pass.height);
+		}
+
+		glBeginQuery(GL_TIME_ELAPSED, pass.queries[slot]);
+		pass.execute();
+		glEndQuery(GL_TIME_ELAPSED);
+
+		pass.issued[slot] = true;
+
+		if(pass.fbo != 0)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, previous);
+			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		}
+
+		for(j = 0; j < (int)pass.writes.size(); j ++)
+		{
+			if(pass.writes[j].access & (ACCESS_IMAGE | ACCESS_STORAGE))
+				this->resources[pass.writes[j].resource].pending = GL_ALL_BARRIER_BITS;
+		}
+	}
+
+	this->frame ++;
+}
+
+// lists the passes in order, with whether they were
+// culled, their GPU time, the barrier issued before them
+// and which real texture each transient resource got
+void FrameGraph::print()
+{
+	int i, j;
+	for(i = 0; i < (int)this->passes.size(); i ++)
+	{
+		GraphPass& pass = this->passes[i];
+
+		if(pass.culled)
+		{
+			printf("  %s: culled\n", pass.name.c_str());
+			continue;
+		}
+
+		printf("  %s: %.3f ms, barrier 0x%x", pass.name.c_str(), pass.gpu_ms, pass.barrier);
+
+		for(j = 0; j < (int)pass.writes.size(); j ++)
+		{
+			GraphResource& resource = this->resources[pass.writes[j].resource];
+
+			if(!(resource.imported))
+				printf(", %s -> texture %d", resource.name.c_str(), resource.physical);
+		}
+		printf("\n");
+	}
+
+	printf("  transient textures: %lld KB, %lld KB allocated\n",
+		this->getTransientBytes() / 1024, this->getAllocatedBytes() / 1024);
+}
+
+// the GL texture behind a resource: the imported name,
+// or the real texture a transient one was given
+unsigned int FrameGraph::getTexture(int resource)
+{
+	GraphResource& r = this->resources[resource];
+
+	if(r.imported)
+		return r.handle;
+
+	if(r.physical < 0)
+		return 0;
+
+	return this->textures[r.physical].texture;
+}
+
+int FrameGraph::getPassCount()
+{
+	return (int)this->passes.size();
+}
+
+string FrameGraph::getPassName(int pass)
+{
+	return this->passes[pass].name;
+}
+
+bool FrameGraph::isCulled(int pass)
+{
+	return this->passes[pass].culled;
+}
+
+// milliseconds the pass took on the GPU, a few frames ago
+double FrameGraph::getPassTime(int pass)
+{
+	return this->passes[pass].gpu_ms;
+}
+
+// the barrier bits issued before the pass last ran
+unsigned int FrameGraph::getPassBarrier(int pass)
+{
+	return this->passes[pass].barrier;
+}
+
+// bytes the transient textures used this frame
+// would take up if each had its own memory
+long long FrameGraph::getTransientBytes()
+{
+	long long bytes = 0;
+
+	int i;
+	for(i = 0; i < (int)this->resources.size(); i ++)
+	{
+		GraphResource& resource = this->resources[i];
+
+		if(!(resource.imported) && resource.physical >= 0)
+			bytes += (long long)resource.width * resource.height * _texelBytes(resource.format);
+	}
+	return bytes;
+}
+
+// bytes of the textures actually made for them
+long long FrameGraph::getAllocatedBytes()
+{
+	long long bytes = 0;
+
+	int i;
+	for(i = 0; i < (int)this->textures.size(); i ++)
+		bytes += (long long)this->textures[i].width * this->textures[i].height * _texelBytes(this->textures[i].format);
+
+	return bytes;
+}
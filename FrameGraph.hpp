@@ -0,0 +1,148 @@
+#ifndef FRAMEGRAPH_HPP__
+#define FRAMEGRAPH_HPP__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// how a pass uses a resource, which decides the barriers
+// needed between it and the pass that last wrote it
+#define ACCESS_ATTACHMENT 1
+#define ACCESS_TEXTURE 2
+#define ACCESS_IMAGE 4
+#define ACCESS_STORAGE 8
+#define ACCESS_INDIRECT 16
+#define ACCESS_COPY 32
+
+#define RESOURCE_TEXTURE 0
+#define RESOURCE_BUFFER 1
+
+// frames a pass's timer query gets to finish
+// before it's read back, so reading never stalls
+#define GRAPH_TIMER_FRAMES 3
+
+using namespace std;
+
+// a texture or buffer passes read and write. Imported
+// ones belong to someone else (such as the window's
+// framebuffer); transient textures only exist between
+// their first and last use in a frame, and share memory
+// with others whose uses don't overlap
+struct GraphResource {
+
+	string name;
+	int type;
+	bool imported;
+	bool output;
+
+	unsigned int handle;
+	int width;
+	int height;
+	unsigned int format;
+
+	int physical;
+	int first_pass;
+	int last_pass;
+
+	// barrier bits still owed to readers
+	// of the last image/storage write
+	unsigned int pending;
+};
+
+// one use of a resource by a pass
+struct GraphAccess {
+
+	int resource;
+	int access;
+};
+
+struct GraphPass {
+
+	string name;
+	function<void()> execute;
+
+	vector<GraphAccess> reads;
+	vector<GraphAccess> writes;
+
+	bool side_effects;
+	bool culled;
+
+	// the framebuffer for its transient attachments,
+	// the textures it was made with and their size
+	unsigned int fbo;
+	vector<unsigned int> attached;
+	int width;
+	int height;
+
+	unsigned int barrier;
+
+	unsigned int queries[GRAPH_TIMER_FRAMES];
+	bool issued[GRAPH_TIMER_FRAMES];
+	double gpu_ms;
+};
+
+// a real texture backing one or more transient resources
+struct GraphTexture {
+
+	unsigned int texture;
+	int width;
+	int height;
+	unsigned int format;
+	int busy_until;
+};
+
+// describes a frame as passes that declare what they
+// read and write, instead of a fixed sequence of calls.
+// 'compile' drops passes nothing needed depends on, gives
+// transient textures their memory (reusing it between
+// resources whose lifetimes don't overlap), and makes a
+// framebuffer for each pass drawing into them. 'execute'
+// runs the rest in order, issuing a memory barrier only
+// where a pass reads what an earlier one wrote through an
+// image or storage buffer, and times each one on the GPU
+class FrameGraph {
+
+	private:
+		vector<GraphPass> passes;
+		vector<GraphResource> resources;
+		vector<GraphTexture> textures;
+
+		int frame;
+
+		void cull();
+		void allocate();
+		void makeFramebuffer(GraphPass& pass);
+		unsigned int barrierFor(int pass);
+		void readTimer(GraphPass& pass, int slot);
+
+	public:
+		FrameGraph();
+		~FrameGraph();
+
+		int addTexture(string name, int width, int height, unsigned int format);
+		int importTexture(string name, unsigned int texture);
+		int importBuffer(string name, unsigned int buffer);
+
+		int addPass(string name, function<void()> execute);
+		void read(int pass, int resource, int access);
+		void write(int pass, int resource, int access);
+		void setSideEffects(int pass, bool side_effects);
+		void setOutput(int resource, bool output);
+
+		void compile();
+		void execute();
+		void print();
+
+		unsigned int getTexture(int resource);
+
+		int getPassCount();
+		string getPassName(int pass);
+		bool isCulled(int pass);
+		double getPassTime(int pass);
+		unsigned int getPassBarrier(int pass);
+
+		long long getTransientBytes();
+		long long getAllocatedBytes();
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "FrameRing.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#define FRAME_RING_WAIT_NS 1000000000ull
+
+using namespace chrono;
+
+// creates and persistently maps a buffer holding
+// FRAME_RING_FRAMES partitions of 'frame_size' bytes.
+// Allocations are aligned for binding as uniform or
+// storage buffer ranges, which covers indirect commands
+FrameRing::FrameRing(int frame_size)
+{
+	int ubo_alignment = 0, ssbo_alignment = 0;
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+
+	this->alignment = 16;
+	if(ubo_alignment > this->alignment)
+		this->alignment = ubo_alignment;
+
+	if(ssbo_alignment > this->alignment)
+		this->alignment = ssbo_alignment;
+
+	// every partition starts on an aligned offset
+	this->frame_size = (frame_size + this->alignment - 1) / this->alignment * this->alignment;
+
+	// the first 'beginFrame' moves on to partition 0
+	this->frame = FRAME_RING_FRAMES - 1;
+	this->head = 0;
+
+	memset(this->fences, 0, sizeof(this->fences));
+
+	this->bytes_written = 0;
+	this->frame_bytes = 0;
+	this->peak_bytes = 0;
+	this->stalls = 0;
+	this->overflows = 0;
+	this->stall_ms = 0.0;
+
+	unsigned int flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	int size = this->frame_size * FRAME_RING_FRAMES;
+
+	glGenBuffers(1, &(this->buffer));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+
+	this->mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if(this->mapped == NULL)
+		cout << "Failed to map frame ring buffer" << endl;
+}
+
+// waits for every frame still in flight,
+// then unmaps and frees the buffer
+FrameRing::~FrameRing()
+{
+	int i;
+	for(i = 0; i < FRAME_RING_FRAMES; i ++)
+	{
+		if(this->fences[i] == 0)
+			continue;
+
+		glClientWaitSync(this->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_RING_WAIT_NS);
+		glDeleteSync(this->fences[i]);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &(this->buffer));
+}
+
+// moves on to the next partition, first waiting for the
+// GPU to finish the frame that last wrote to it. With the
+// GPU less than FRAME_RING_FRAMES - 1 frames behind this
+// returns right away; otherwise it counts as a stall
+void FrameRing::beginFrame()
+{
+	this->frame = (this->frame + 1) % FRAME_RING_FRAMES;
+	this->head = 0;
+
+	GLsync fence = this->fences[this->frame];
+	if(fence == 0)
+		return;
+
+	GLenum status = glClientWaitSync(fence, 0, 0);
+
+	if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+	{
+		time_point<high_resolution_clock> start = high_resolution_clock::now();
+
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_RING_WAIT_NS);
+
+		duration<double, milli> elapsed = high_resolution_clock::now() - start;
+
+		this->stalls ++;
+		this->stall_ms += elapsed.count();
+	}
+
+	glDeleteSync(fence);
+	this->fences[this->frame] = 0;
+}
+
+// fences the commands that read from this frame's
+// partition, after everything using it was issued
+void FrameRing::endFrame()
+{
+	if(this->fences[this->frame] != 0)
+		glDeleteSync(this->fences[this->frame]);
+
+	this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	this->frame_bytes = this->head;
+	if(this->head > this->peak_bytes)
+		this->peak_bytes = this->head;
+}
+
+// returns mapped memory for 'bytes' bytes in this frame's
+// partition, and in 'offset' where it sits in the buffer
+// (for binding it, or as an indirect offset). Returns NULL
+// if the partition is full; nothing is ever overwritten
+// before the GPU is done with it
+unsigned char* FrameRing::allocate(int bytes, int* offset)
+{
+	if(this->mapped == NULL || bytes <= 0)
+		return NULL;
+
+	int start = (this->head + this->alignment - 1) / this->alignment * this->alignment;
+
+	if(start + bytes > this->frame_size)
+	{
+		this->overflows ++;
+		return NULL;
+	}
+
+	this->head = start + bytes;
+	this->bytes_written += bytes;
+
+	*offset = this->frame * this->frame_size + start;
+	return this->mapped + *offset;
+}
+
+// copies 'bytes' bytes of 'data' into this frame's
+// partition, returning their offset or -1 if full
+int FrameRing::upload(const void* data, int bytes)
+{
+	int offset;
+	unsigned char* dest = this->allocate(bytes, &offset);
+
+	if(dest == NULL)
+		return -1;
+
+	memcpy(dest, data, bytes);
+	return offset;
+}
+
+unsigned int FrameRing::getBuffer()
+{
+	return this->buffer;
+}
+
+// bytes in each of the FRAME_RING_FRAMES partitions
+int FrameRing::getFrameSize()
+{
+	return this->frame_size;
+}
+
+// total bytes handed out since the ring was made
+long long FrameRing::getBytesWritten()
+{
+	return this->bytes_written;
+}
+
+// bytes of its partition the last frame used,
+// alignment padding included
+int FrameRing::getFrameBytes()
+{
+	return this->frame_bytes;
+}
+
+// the most any one frame has used
+int FrameRing::getPeakBytes()
+{
+	return this->peak_bytes;
+}
+
+// returns how many times 'beginFrame' had to
+// wait on the GPU to reuse a partition
+int FrameRing::getStalls()
+{
+	return this->stalls;
+}
+
+// allocations that didn't fit in their frame
+int FrameRing::getOverflows()
+{
+	return this->overflows;
+}
+
+// milliseconds spent in those waits
+double FrameRing::getStallTime()
+{
+	return this->stall_ms;
+}
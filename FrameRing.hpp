@@ -0,0 +1,62 @@
+#ifndef FRAMERING_HPP__
+#define FRAMERING_HPP__
+
+#include <GL/glew.h>
+
+// frames the CPU can write ahead of the GPU. Each one
+// gets its own partition of the ring
+#define FRAME_RING_FRAMES 3
+
+using namespace std;
+
+// a persistently mapped buffer split into one partition
+// per frame in flight, for data rewritten every frame
+// (indirect commands, visible lists, uniform blocks).
+// Space is handed out by bumping an offset through the
+// current partition, and a partition is only reused once
+// the fence placed at the end of its frame has passed,
+// so writes never wait on an implicit sync in the driver
+class FrameRing {
+
+	private:
+		unsigned int buffer;
+		unsigned char* mapped;
+
+		int frame_size;
+		int alignment;
+
+		int frame;
+		int head;
+
+		GLsync fences[FRAME_RING_FRAMES];
+
+		long long bytes_written;
+		int frame_bytes;
+		int peak_bytes;
+
+		int stalls;
+		int overflows;
+		double stall_ms;
+
+	public:
+		FrameRing(int frame_size);
+		~FrameRing();
+
+		void beginFrame();
+		void endFrame();
+
+		unsigned char* allocate(int bytes, int* offset);
+		int upload(const void* data, int bytes);
+
+		unsigned int getBuffer();
+		int getFrameSize();
+
+		long long getBytesWritten();
+		int getFrameBytes();
+		int getPeakBytes();
+		int getStalls();
+		int getOverflows();
+		double getStallTime();
+};
+
+#endif
@@ -0,0 +1,352 @@
+#include "FrustumCuller.hpp"
+#include "Parallel.hpp"
+#include "Simd.hpp"
+
+#include <cstring>
+#include <cmath>
+
+// pulls the planes out of the rows of a view-projection
+// matrix (Gribb & Hartmann): each is the last row plus
+// or minus one of the others
+Frustum Frustum::fromMatrix(const Mat4& view_projection)
+{
+	Frustum f;
+	const float* m = view_projection.m;
+
+	int i, j;
+	for(i = 0; i < 3; i ++)
+	{
+		for(j = 0; j < 4; j ++)
+		{
+			f.planes[i * 2][j] = m[j * 4 + 3] + m[j * 4 + i];
+			f.planes[i * 2 + 1][j] = m[j * 4 + 3] - m[j * 4 + i];
+		}
+	}
+
+	for(i = 0; i < FRUSTUM_PLANES; i ++)
+	{
+		float* p = f.planes[i];
+		float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+
+		if(len > 0.0f)
+		{
+			p[0] /= len;
+			p[1] /= len;
+			p[2] /= len;
+			p[3] /= len;
+		}
+	}
+
+	return f;
+}
+
+// true unless the box is entirely behind one of the planes
+bool Frustum::contains(const AABB& box) const
+{
+	int i;
+	for(i = 0; i < FRUSTUM_PLANES; i ++)
+	{
+		const float* p = this->planes[i];
+
+		float d = p[0] * box.center.x + p[1] * box.center.y + p[2] * box.center.z + p[3];
+		float r = fabsf(p[0]) * box.extents.x + fabsf(p[1]) * box.extents.y + fabsf(p[2]) * box.extents.z;
+
+		if(d + r < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+bool Frustum::contains(const Sphere& sphere) const
+{
+	int i;
+	for(i = 0; i < FRUSTUM_PLANES; i ++)
+	{
+		const float* p = this->planes[i];
+
+		if(p[0] * sphere.center.x + p[1] * sphere.center.y + p[2] * sphere.center.z + p[3] < -sphere.radius)
+			return false;
+	}
+
+	return true;
+}
+
+FrustumCuller::FrustumCuller()
+{
+	this->visible_count = 0;
+	this->culled_count = 0;
+}
+
+// adds an instance's world space bounds, returning its index
+int FrustumCuller::add(const AABB& box, const Sphere& sphere)
+{
+	this->cx.push_back(box.center.x);
+	this->cy.push_back(box.center.y);
+	this->cz.push_back(box.center.z);
+	this->ex.push_back(box.extents.x);
+	this->ey.push_back(box.extents.y);
+	this->ez.push_back(box.extents.z);
+
+	this->spheres.push_back(sphere);
+
+	return (int)this->spheres.size() - 1;
+}
+
+// updates the bounds of an instance that moved
+void FrustumCuller::set(int index, const AABB& box, const Sphere& sphere)
+{
+	this->cx[index] = box.center.x;
+	this->cy[index] = box.center.y;
+	this->cz[index] = box.center.z;
+	this->ex[index] = box.extents.x;
+	this->ey[index] = box.extents.y;
+	this->ez[index] = box.extents.z;
+
+	this->spheres[index] = sphere;
+}
+
+void FrustumCuller::clear()
+{
+	this->cx.clear();
+	this->cy.clear();
+	this->cz.clear();
+	this->ex.clear();
+	this->ey.clear();
+	this->ez.clear();
+
+	this->spheres.clear();
+}
+
+// tests instances [start, end) and writes the indices
+// of those at least partly inside to 'out', returning
+// how many there were. A box is outside a plane when
+// its center's distance plus its projected radius is
+// still negative. Doesn't touch the counts 'cull' keeps,
+// so separate ranges can be culled from several threads
+int FrustumCuller::cullRange(const Frustum& frustum, int start, int end, int* out)
+{
+	const float* cx = this->cx.data();
+	const float* cy = this->cy.data();
+	const float* cz = this->cz.data();
+	const float* ex = this->ex.data();
+	const float* ey = this->ey.data();
+	const float* ez = this->ez.data();
+
+	int i = start, count = 0, p;
+
+#if defined(__AVX__)
+	__m256 planes[FRUSTUM_PLANES][4];
+	__m256 abs_planes[FRUSTUM_PLANES][3];
+
+	for(p = 0; p < FRUSTUM_PLANES; p ++)
+	{
+		planes[p][0] = _mm256_set1_ps(frustum.planes[p][0]);
+		planes[p][1] = _mm256_set1_ps(frustum.planes[p][1]);
+		planes[p][2] = _mm256_set1_ps(frustum.planes[p][2]);
+		planes[p][3] = _mm256_set1_ps(frustum.planes[p][3]);
+
+		abs_planes[p][0] = _mm256_set1_ps(fabsf(frustum.planes[p][0]));
+		abs_planes[p][1] = _mm256_set1_ps(fabsf(frustum.planes[p][1]));
+		abs_planes[p][2] = _mm256_set1_ps(fabsf(frustum.planes[p][2]));
+	}
+
+	__m256 zero = _mm256_setzero_ps();
+
+	for(; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(cx + i);
+		__m256 y = _mm256_loadu_ps(cy + i);
+		__m256 z = _mm256_loadu_ps(cz + i);
+		__m256 hx = _mm256_loadu_ps(ex + i);
+		__m256 hy = _mm256_loadu_ps(ey + i);
+		__m256 hz = _mm256_loadu_ps(ez + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for(p = 0; p < FRUSTUM_PLANES; p ++)
+		{
+			__m256 d = _madd8(planes[p][0], x, planes[p][3]);
+			d = _madd8(planes[p][1], y, d);
+			d = _madd8(planes[p][2], z, d);
+
+			d = _madd8(abs_planes[p][0], hx, d);
+			d = _madd8(abs_planes[p][1], hy, d);
+			d = _madd8(abs_planes[p][2], hz, d);
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+
+			// most boxes are rejected by the first few planes
+			if(_mm256_movemask_ps(inside) == 0)
+				break;
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		while(mask != 0)
+		{
+			out[count ++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+#elif defined(__SSE__)
+	__m128 planes[FRUSTUM_PLANES][4];
+	__m128 abs_planes[FRUSTUM_PLANES][3];
+
+	for(p = 0; p < FRUSTUM_PLANES; p ++)
+	{
+		planes[p][0] = _mm_set1_ps(frustum.planes[p][0]);
+		planes[p][1] = _mm_set1_ps(frustum.planes[p][1]);
+		planes[p][2] = _mm_set1_ps(frustum.planes[p][2]);
+		planes[p][3] = _mm_set1_ps(frustum.planes[p][3]);
+
+		abs_planes[p][0] = _mm_set1_ps(fabsf(frustum.planes[p][0]));
+		abs_planes[p][1] = _mm_set1_ps(fabsf(frustum.planes[p][1]));
+		abs_planes[p][2] = _mm_set1_ps(fabsf(frustum.planes[p][2]));
+	}
+
+	__m128 zero = _mm_setzero_ps();
+
+	for(; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(cx + i);
+		__m128 y = _mm_loadu_ps(cy + i);
+		__m128 z = _mm_loadu_ps(cz + i);
+		__m128 hx = _mm_loadu_ps(ex + i);
+		__m128 hy = _mm_loadu_ps(ey + i);
+		__m128 hz = _mm_loadu_ps(ez + i);
+
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+
+		for(p = 0; p < FRUSTUM_PLANES; p ++)
+		{
+			__m128 d = _mm_add_ps(_mm_mul_ps(planes[p][0], x), planes[p][3]);
+			d = _mm_add_ps(d, _mm_mul_ps(planes[p][1], y));
+			d = _mm_add_ps(d, _mm_mul_ps(planes[p][2], z));
+
+			d = _mm_add_ps(d, _mm_mul_ps(abs_planes[p][0], hx));
+			d = _mm_add_ps(d, _mm_mul_ps(abs_planes[p][1], hy));
+			d = _mm_add_ps(d, _mm_mul_ps(abs_planes[p][2], hz));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+
+			if(_mm_movemask_ps(inside) == 0)
+				break;
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		while(mask != 0)
+		{
+			out[count ++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	// whatever's left over (or everything, without SIMD)
+	for(; i < end; i ++)
+	{
+		bool inside = true;
+
+		for(p = 0; p < FRUSTUM_PLANES && inside; p ++)
+		{
+			const float* pl = frustum.planes[p];
+
+			float d = pl[0] * cx[i] + pl[1] * cy[i] + pl[2] * cz[i] + pl[3];
+			float r = fabsf(pl[0]) * ex[i] + fabsf(pl[1]) * ey[i] + fabsf(pl[2]) * ez[i];
+
+			inside = (d + r >= 0.0f);
+		}
+
+		if(inside)
+			out[count ++] = i;
+	}
+
+	return count;
+}
+
+// fills 'visible' with the indices of every instance not
+// entirely outside the frustum, in increasing order. Large
+// sets are split into blocks culled on all cores, each
+// writing into its own part of a scratch list before the
+// parts are packed together
+int FrustumCuller::cull(const Frustum& frustum, vector<int>& visible)
+{
+	int count = (int)this->spheres.size();
+
+	// only grows, so it isn't cleared again every frame
+	if((int)this->scratch.size() < count)
+		this->scratch.resize(count);
+
+	if(count <= CULL_BLOCK_SIZE)
+		this->visible_count = (count > 0 ? this->cullRange(frustum, 0, count, this->scratch.data()) : 0);
+	else
+	{
+		int blocks = (count + CULL_BLOCK_SIZE - 1) / CULL_BLOCK_SIZE;
+		this->block_counts.resize(blocks);
+
+		int* out = this->scratch.data();
+		int* block_counts = this->block_counts.data();
+
+		parallelFor(blocks, [&](int first, int last)
+		{
+			int b;
+			for(b = first; b < last; b ++)
+			{
+				int start = b * CULL_BLOCK_SIZE;
+				int end = (start + CULL_BLOCK_SIZE < count ? start + CULL_BLOCK_SIZE : count);
+
+				block_counts[b] = this->cullRange(frustum, start, end, out + start);
+			}
+		});
+
+		int b, total = 0;
+		for(b = 0; b < blocks; b ++)
+		{
+			int start = b * CULL_BLOCK_SIZE;
+
+			if(total != start)
+				memmove(out + total, out + start, block_counts[b] * sizeof(int));
+
+			total += block_counts[b];
+		}
+		this->visible_count = total;
+	}
+
+	visible.assign(this->scratch.begin(), this->scratch.begin() + this->visible_count);
+	this->culled_count = count - this->visible_count;
+
+	return this->visible_count;
+}
+
+// rebuilds an instance's box from the separate arrays
+AABB FrustumCuller::getBox(int index)
+{
+	AABB box;
+	box.center = Vec3(this->cx[index], this->cy[index], this->cz[index]);
+	box.extents = Vec3(this->ex[index], this->ey[index], this->ez[index]);
+
+	return box;
+}
+
+// returns an instance's world space bounding sphere
+const Sphere& FrustumCuller::getSphere(int index)
+{
+	return this->spheres[index];
+}
+
+int FrustumCuller::getCount()
+{
+	return (int)this->spheres.size();
+}
+
+// number of instances inside the frustum at the last cull
+int FrustumCuller::getVisibleCount()
+{
+	return this->visible_count;
+}
+
+// number of instances culled at the last cull
+int FrustumCuller::getCulledCount()
+{
+	return this->culled_count;
+}
@@ -0,0 +1,67 @@
+#ifndef FRUSTUMCULLER_HPP__
+#define FRUSTUMCULLER_HPP__
+
+#include "VectorMath.hpp"
+
+#include <vector>
+
+#define FRUSTUM_PLANES 6
+
+// instances are culled in blocks of this many when
+// spread over threads, so small scenes stay on one
+#define CULL_BLOCK_SIZE 16384
+
+using namespace std;
+
+// the six planes (a, b, c, d) of a view-projection
+// matrix's frustum, normalized and pointing inwards
+struct Frustum {
+
+	float planes[FRUSTUM_PLANES][4];
+
+	static Frustum fromMatrix(const Mat4& view_projection);
+
+	bool contains(const AABB& box) const;
+	bool contains(const Sphere& sphere) const;
+};
+
+// world space bounds of a set of instances, kept as
+// separate arrays per component (structure of arrays)
+// so they can be tested against a frustum 4 or 8 at a
+// time with SSE/AVX
+class FrustumCuller {
+
+	private:
+		vector<float> cx;
+		vector<float> cy;
+		vector<float> cz;
+		vector<float> ex;
+		vector<float> ey;
+		vector<float> ez;
+
+		vector<Sphere> spheres;
+
+		vector<int> block_counts;
+		vector<int> scratch;
+
+		int visible_count;
+		int culled_count;
+
+	public:
+		FrustumCuller();
+
+		int add(const AABB& box, const Sphere& sphere);
+		void set(int index, const AABB& box, const Sphere& sphere);
+		void clear();
+
+		int cull(const Frustum& frustum, vector<int>& visible);
+		int cullRange(const Frustum& frustum, int start, int end, int* out);
+
+		AABB getBox(int index);
+		const Sphere& getSphere(int index);
+		int getCount();
+		int getVisibleCount();
+		int getCulledCount();
+};
+
+#endif
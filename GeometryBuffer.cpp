@@ -0,0 +1,173 @@
+#include "GeometryBuffer.hpp"
+
+#include <GL/glew.h>
+
+#include <cstring>
+#include <cmath>
+#include <map>
+
+// orders vertices by their raw bytes,
+// used to find duplicates when indexing
+struct VertexLess {
+
+	bool operator()(const MeshVertex& a, const MeshVertex& b) const
+	{
+		return memcmp(&a, &b, sizeof(MeshVertex)) < 0;
+	}
+};
+
+// creates the shared vertex and index buffers that
+// every static mesh is suballocated from, so meshes
+// can be drawn together without rebinding anything,
+// and the VAO that reads them
+GeometryBuffer::GeometryBuffer()
+{
+	this->dirty = false;
+
+	glGenBuffers(1, &(this->vbo));
+	glGenBuffers(1, &(this->ibo));
+
+	this->vao = new VertexArray(MESH_LAYOUT);
+	this->vao->setVertexBuffer(VERTEX_BINDING, this->vbo);
+	this->vao->setIndexBuffer(this->ibo);
+}
+
+GeometryBuffer::~GeometryBuffer()
+{
+	delete this->vao;
+
+	glDeleteBuffers(1, &(this->vbo));
+	glDeleteBuffers(1, &(this->ibo));
+}
+
+// appends a mesh given as a plain triangle list. Identical
+// vertices are merged and the mesh is stored indexed, with
+// indices relative to its own first vertex (drawn with its
+// 'base_vertex'). Returns the mesh's ID
+int GeometryBuffer::addMesh(const MeshVertex* vertices, int vertex_count)
+{
+	map<MeshVertex, unsigned int, VertexLess> unique;
+	MeshRange range;
+
+	range.first_index = (int)this->indices.size();
+	range.index_count = vertex_count;
+	range.base_vertex = (int)this->vertices.size();
+
+	int i;
+	for(i = 0; i < vertex_count; i ++)
+	{
+		map<MeshVertex, unsigned int, VertexLess>::iterator it = unique.find(vertices[i]);
+
+		if(it == unique.end())
+		{
+			unsigned int index = (unsigned int)unique.size();
+
+			unique[vertices[i]] = index;
+			this->vertices.push_back(vertices[i]);
+			this->indices.push_back(index);
+		}
+		else
+			this->indices.push_back(it->second);
+	}
+
+	range.vertex_count = (int)unique.size();
+
+	// local bounds, used to cull each copy of the mesh. The
+	// sphere is centered on the box and just wide enough
+	// for the furthest vertex
+	Vec3 lo(INFINITY, INFINITY, INFINITY);
+	Vec3 hi(-INFINITY, -INFINITY, -INFINITY);
+
+	for(i = 0; i < vertex_count; i ++)
+	{
+		lo = Vec3(fminf(lo.x, vertices[i].x), fminf(lo.y, vertices[i].y), fminf(lo.z, vertices[i].z));
+		hi = Vec3(fmaxf(hi.x, vertices[i].x), fmaxf(hi.y, vertices[i].y), fmaxf(hi.z, vertices[i].z));
+	}
+
+	if(vertex_count == 0)
+		lo = hi = Vec3();
+
+	range.box = AABB(lo, hi);
+	range.sphere = Sphere(range.box.center, 0.0f);
+
+	for(i = 0; i < vertex_count; i ++)
+	{
+		float dist = (Vec3(vertices[i].x, vertices[i].y, vertices[i].z) - range.box.center).length();
+		range.sphere.radius = fmaxf(range.sphere.radius, dist);
+	}
+
+	this->meshes.push_back(range);
+	this->dirty = true;
+
+	return (int)this->meshes.size() - 1;
+}
+
+MeshRange* GeometryBuffer::getMesh(int mesh)
+{
+	return &(this->meshes[mesh]);
+}
+
+// expands a mesh back into the plain triangle list it was
+// added as, appending it to 'out'
+void GeometryBuffer::getTriangles(int mesh, vector<MeshVertex>& out)
+{
+	MeshRange& range = this->meshes[mesh];
+
+	int i;
+	for(i = 0; i < range.index_count; i ++)
+		out.push_back(this->vertices[range.base_vertex + this->indices[range.first_index + i]]);
+}
+
+// copies every mesh to the GPU. The index buffer goes
+// through a generic target so whichever VAO happens to
+// be bound doesn't pick it up
+void GeometryBuffer::upload()
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, this->vertices.size() * sizeof(MeshVertex),
+				 (this->vertices.empty() ? NULL : &(this->vertices[0])), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->ibo);
+	glBufferData(GL_COPY_WRITE_BUFFER, this->indices.size() * sizeof(unsigned int),
+				 (this->indices.empty() ? NULL : &(this->indices[0])), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	this->dirty = false;
+}
+
+// uploads any meshes added since the last upload,
+// done lazily the first time the buffers are used
+void GeometryBuffer::update()
+{
+	if(this->dirty)
+		this->upload();
+}
+
+// binds the VAO, which already holds the shared
+// buffers and the layout of MeshVertex
+void GeometryBuffer::bind()
+{
+	this->update();
+	this->vao->bind();
+}
+
+void GeometryBuffer::unbind()
+{
+	this->vao->unbind();
+}
+
+unsigned int GeometryBuffer::getVertexBuffer()
+{
+	return this->vbo;
+}
+
+unsigned int GeometryBuffer::getIndexBuffer()
+{
+	return this->ibo;
+}
+
+int GeometryBuffer::getNumMeshes()
+{
+	return (int)this->meshes.size();
+}
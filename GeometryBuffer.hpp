@@ -0,0 +1,58 @@
+#ifndef GEOMETRYBUFFER_HPP__
+#define GEOMETRYBUFFER_HPP__
+
+#include "VertexLayout.hpp"
+#include "VertexArray.hpp"
+#include "VectorMath.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// where one mesh lives inside the shared buffers
+struct MeshRange {
+
+	int first_index;
+	int index_count;
+	int base_vertex;
+	int vertex_count;
+
+	AABB box;
+	Sphere sphere;
+};
+
+class GeometryBuffer {
+
+	private:
+		unsigned int vbo;
+		unsigned int ibo;
+
+		bool dirty;
+
+		VertexArray* vao;
+
+		vector<MeshVertex> vertices;
+		vector<unsigned int> indices;
+		vector<MeshRange> meshes;
+
+		void upload();
+
+	public:
+		GeometryBuffer();
+		~GeometryBuffer();
+
+		int addMesh(const MeshVertex* vertices, int vertex_count);
+		MeshRange* getMesh(int mesh);
+		void getTriangles(int mesh, vector<MeshVertex>& out);
+
+		void update();
+		void bind();
+		void unbind();
+
+		unsigned int getVertexBuffer();
+		unsigned int getIndexBuffer();
+
+		int getNumMeshes();
+};
+
+#endif
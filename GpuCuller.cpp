@@ -0,0 +1,302 @@
+#include "GpuCuller.hpp"
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+// creates the buffers the cull passes work in. 'program'
+// is the compute program loaded from res/cull.cs
+GpuCuller::GpuCuller(Shader* program)
+{
+	this->program = program;
+	this->object_count = 0;
+	this->draw_count = 0;
+	this->record_size = 0;
+	this->hiz = NULL;
+	this->retested = false;
+
+	this->indirect_count = (GLEW_ARB_indirect_parameters == GL_TRUE);
+
+	if(!this->indirect_count)
+		cout << "ARB_indirect_parameters not supported, culled draws use plain MDI" << endl;
+
+	glGenBuffers(1, &(this->object_buffer));
+	glGenBuffers(1, &(this->draw_buffer));
+	glGenBuffers(1, &(this->command_buffer));
+	glGenBuffers(1, &(this->visible_buffer));
+	glGenBuffers(1, &(this->compact_command_buffer));
+	glGenBuffers(1, &(this->compact_record_buffer));
+	glGenBuffers(1, &(this->compact_count_buffer));
+
+	unsigned int zero = 0;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->compact_count_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), &zero, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	this->program->begin();
+	this->program->setUniformi(UNIFORM_ID(CULL_HIZ_STR), HIZ_TEXTURE_ID);
+	this->program->end();
+}
+
+GpuCuller::~GpuCuller()
+{
+	glDeleteBuffers(1, &(this->object_buffer));
+	glDeleteBuffers(1, &(this->draw_buffer));
+	glDeleteBuffers(1, &(this->command_buffer));
+	glDeleteBuffers(1, &(this->visible_buffer));
+	glDeleteBuffers(1, &(this->compact_command_buffer));
+	glDeleteBuffers(1, &(this->compact_record_buffer));
+	glDeleteBuffers(1, &(this->compact_count_buffer));
+}
+
+// uploads every object's bounds, and sizes the visible
+// list to hold all of them. Only needed when objects
+// are added or move
+void GpuCuller::setObjects(const vector<CullObject>& objects)
+{
+	this->object_count = (int)objects.size();
+
+	if(objects.empty())
+		return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->object_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(CullObject), &(objects[0]), GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->visible_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(int), NULL, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// uploads the draws and sizes the command buffers for
+// them. 'record_size' is the size in bytes of one draw's
+// record, which the compact pass copies as it is
+void GpuCuller::setDraws(const vector<CullDraw>& draws, int record_size)
+{
+	this->draw_count = (int)draws.size();
+	this->record_size = record_size;
+
+	this->first_objects.resize(draws.size());
+
+	int i;
+	for(i = 0; i < (int)draws.size(); i ++)
+		this->first_objects[i] = draws[i].first_object;
+
+	if(draws.empty())
+		return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->draw_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(CullDraw), &(draws[0]), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->command_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->compact_command_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->compact_record_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * record_size, NULL, GL_DYNAMIC_COPY);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// binds every buffer the cull passes use
+void GpuCuller::bindBuffers(unsigned int record_buffer)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_OBJECTS_BINDING, this->object_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAWS_BINDING, this->draw_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMANDS_BINDING, this->command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_VISIBLE_BINDING, this->visible_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_RECORDS_BINDING, record_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMPACT_COMMANDS_BINDING, this->compact_command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMPACT_RECORDS_BINDING, this->compact_record_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMPACT_COUNT_BINDING, this->compact_count_buffer);
+}
+
+// points the occlusion test at the pyramid, if there's
+// one built yet, and the view-projection it was built with
+void GpuCuller::bindPyramid()
+{
+	bool occlusion = (this->hiz != NULL && this->hiz->isBuilt());
+
+	this->program->setUniformi(UNIFORM_ID(CULL_OCCLUSION_STR), (occlusion ? 1 : 0));
+
+	if(occlusion)
+	{
+		this->program->setUniformMatrix4(UNIFORM_ID(CULL_OCCLUSION_VP_STR), this->hiz->getViewProjection().m);
+		this->hiz->bind();
+	}
+}
+
+// runs one pass with an invocation per item, waiting
+// for its writes before anything after reads them
+void GpuCuller::runPass(int pass, int count)
+{
+	this->program->setUniformi(UNIFORM_ID(CULL_PASS_STR), pass);
+	this->program->dispatch((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE);
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// runs the cull passes: reset every draw's command to
+// zero instances, test each object against the frustum,
+// its draw's distance and (with a pyramid set) the last
+// depth pyramid built, then compact the non-empty draws.
+// 'record_buffer' holds one record per draw. The CPU only
+// sets a few uniforms and dispatches, however many
+// objects there are. The command and storage barriers
+// before drawing them are up to the caller
+void GpuCuller::cull(const Frustum& frustum, const Vec3& eye, unsigned int record_buffer)
+{
+	if(this->object_count == 0 || this->draw_count == 0)
+		return;
+
+	float eye_pos[3] = { eye.x, eye.y, eye.z };
+
+	this->program->begin();
+
+	this->program->setUniformfv(UNIFORM_ID(CULL_PLANES_STR), &(frustum.planes[0][0]), FRUSTUM_PLANES * 4);
+	this->program->setUniformfv(UNIFORM_ID(CULL_EYE_STR), eye_pos, 3);
+	this->program->setUniformi(UNIFORM_ID(CULL_OBJECT_COUNT_STR), this->object_count);
+	this->program->setUniformi(UNIFORM_ID(CULL_DRAW_COUNT_STR), this->draw_count);
+	this->program->setUniformi(UNIFORM_ID(CULL_RECORD_WORDS_STR), this->record_size / (int)sizeof(unsigned int));
+
+	this->bindBuffers(record_buffer);
+	this->bindPyramid();
+
+	this->retested = false;
+
+	this->runPass(CULL_PASS_RESET, this->draw_count);
+	this->runPass(CULL_PASS_OBJECTS, this->object_count);
+
+	if(this->indirect_count)
+		this->runPass(CULL_PASS_COMPACT, this->draw_count);
+
+	this->program->end();
+}
+
+// the second phase of occlusion culling, run once the
+// objects kept by 'cull' are drawn and the pyramid is
+// rebuilt from their depth: the objects 'cull' found
+// hidden behind the last pyramid are tested against
+// the new one, and the ones it shows are left for
+// 'draw'. Their slots follow the first phase's in each
+// draw's run of the visible list
+void GpuCuller::retest(unsigned int record_buffer)
+{
+	if(this->object_count == 0 || this->draw_count == 0)
+		return;
+
+	this->program->begin();
+
+	this->bindBuffers(record_buffer);
+	this->bindPyramid();
+
+	this->retested = true;
+
+	this->runPass(CULL_PASS_CONTINUE, this->draw_count);
+
+	if(this->hiz != NULL && this->hiz->isBuilt())
+		this->runPass(CULL_PASS_RETEST, this->object_count);
+
+	if(this->indirect_count)
+		this->runPass(CULL_PASS_COMPACT, this->draw_count);
+
+	this->program->end();
+}
+
+// culls against a depth pyramid as well as the frustum
+// (NULL to stop). It's up to the caller to build it
+// from each frame's depth between 'cull' and 'retest'
+void GpuCuller::setOcclusion(HiZPyramid* hiz)
+{
+	this->hiz = hiz;
+}
+
+// submits the draws left by the last 'cull', with the
+// drawing program, geometry and object transforms already
+// bound. Binds the visible list and the draw records the
+// commands index with gl_DrawID
+void GpuCuller::draw(unsigned int record_buffer)
+{
+	if(this->object_count == 0 || this->draw_count == 0)
+		return;
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_OBJECTS_BINDING, this->visible_buffer);
+
+	if(this->indirect_count)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORDS_BINDING, this->compact_record_buffer);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->compact_command_buffer);
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, this->compact_count_buffer);
+
+		glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, 0, this->draw_count, 0);
+
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	}
+	else
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORDS_BINDING, record_buffer);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->command_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, this->draw_count, 0);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// reads back the uncompacted commands of the last pass
+void GpuCuller::readCommands(vector<DrawElementsIndirectCommand>& commands)
+{
+	commands.resize(this->draw_count);
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->command_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->draw_count * sizeof(DrawElementsIndirectCommand), &(commands[0]));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// reads back how many objects the last 'cull' and 'retest'
+// kept, from how far into its run of the visible list each
+// draw got. Waits for the GPU, so it's only meant for
+// stats and checking the results
+int GpuCuller::readVisibleCount()
+{
+	if(this->draw_count == 0)
+		return 0;
+
+	vector<DrawElementsIndirectCommand> commands;
+	this->readCommands(commands);
+
+	int i, count = 0;
+	for(i = 0; i < this->draw_count; i ++)
+		count += (int)(commands[i].base_instance - this->first_objects[i] + commands[i].instance_count);
+
+	return count;
+}
+
+// reads back how many objects the last 'retest' found
+// had come into view, which 'cull' had left out
+int GpuCuller::readRetestedCount()
+{
+	if(this->draw_count == 0 || !this->retested)
+		return 0;
+
+	vector<DrawElementsIndirectCommand> commands;
+	this->readCommands(commands);
+
+	int i, count = 0;
+	for(i = 0; i < this->draw_count; i ++)
+		count += (int)commands[i].instance_count;
+
+	return count;
+}
+
+// true if draws are compacted and submitted with
+// glMultiDrawElementsIndirectCount
+bool GpuCuller::hasIndirectCount()
+{
+	return this->indirect_count;
+}
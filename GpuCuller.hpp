@@ -0,0 +1,142 @@
+#ifndef GPUCULLER_HPP__
+#define GPUCULLER_HPP__
+
+#include "FrustumCuller.hpp"
+#include "HiZPyramid.hpp"
+#include "VectorMath.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+// must match local_size_x in res/cull.cs. One dispatch
+// covers up to 65535 groups of this many objects
+#define CULL_GROUP_SIZE 256
+
+// the passes of res/cull.cs, picked with CULL_PASS_STR
+#define CULL_PASS_RESET 0
+#define CULL_PASS_OBJECTS 1
+#define CULL_PASS_COMPACT 2
+#define CULL_PASS_CONTINUE 3
+#define CULL_PASS_RETEST 4
+
+#define CULL_PASS_STR "cull_pass"
+#define CULL_PLANES_STR "planes"
+#define CULL_EYE_STR "eye"
+#define CULL_OBJECT_COUNT_STR "object_count"
+#define CULL_DRAW_COUNT_STR "draw_count"
+#define CULL_RECORD_WORDS_STR "record_words"
+#define CULL_OCCLUSION_STR "occlusion"
+#define CULL_OCCLUSION_VP_STR "occlusion_vp"
+#define CULL_HIZ_STR "hiz"
+
+#define CULL_OBJECTS_BINDING 0
+#define CULL_DRAWS_BINDING 1
+#define CULL_COMMANDS_BINDING 2
+#define CULL_VISIBLE_BINDING 3
+#define CULL_RECORDS_BINDING 4
+#define CULL_COMPACT_COMMANDS_BINDING 5
+#define CULL_COMPACT_RECORDS_BINDING 6
+#define CULL_COMPACT_COUNT_BINDING 7
+
+using namespace std;
+
+// layout GL reads indirect indexed draws in
+struct DrawElementsIndirectCommand {
+
+	unsigned int count;
+	unsigned int instance_count;
+	unsigned int first_index;
+	int base_vertex;
+	unsigned int base_instance;
+};
+
+// world space box of one object and the draw it
+// belongs to, as read by res/cull.cs. 'occluded' is
+// set by the cull passes for the objects to retest
+struct CullObject {
+
+	float center[3];
+	int draw;
+
+	float extents[3];
+	int occluded;
+};
+
+// one draw's mesh and the slots of the visible list
+// its objects are written to (starting at 'first_object'),
+// as read by res/cull.cs. Objects further than
+// 'max_distance' from the eye are dropped (0 = no limit)
+struct CullDraw {
+
+	unsigned int index_count;
+	unsigned int first_index;
+	int base_vertex;
+	unsigned int first_object;
+
+	float max_distance;
+	int padding[3];
+};
+
+// culls a batch's objects in a compute shader and
+// leaves the surviving draws on the GPU, so the CPU
+// side of a frame doesn't grow with the object count.
+// Each object that passes adds itself to its draw's
+// instance count and slot in the visible list; draws
+// left with instances are then compacted, along with
+// their draw records, for glMultiDrawElementsIndirectCount.
+// Without ARB_indirect_parameters every draw is submitted
+// with plain MDI instead, the empty ones drawing nothing.
+// With a depth pyramid set, objects are also culled in two
+// phases: against the last pyramid built (from the last
+// frame's depth) in 'cull', then the ones that hid are
+// tested again against the pyramid of what 'cull' kept in
+// 'retest', so anything that came into view still gets
+// drawn that frame
+class GpuCuller {
+
+	private:
+		Shader* program;
+
+		unsigned int object_buffer;
+		unsigned int draw_buffer;
+		unsigned int command_buffer;
+		unsigned int visible_buffer;
+		unsigned int compact_command_buffer;
+		unsigned int compact_record_buffer;
+		unsigned int compact_count_buffer;
+
+		int object_count;
+		int draw_count;
+		int record_size;
+
+		vector<unsigned int> first_objects;
+
+		HiZPyramid* hiz;
+		bool retested;
+		bool indirect_count;
+
+		void bindBuffers(unsigned int record_buffer);
+		void bindPyramid();
+		void runPass(int pass, int count);
+
+		void readCommands(vector<DrawElementsIndirectCommand>& commands);
+
+	public:
+		GpuCuller(Shader* program);
+		~GpuCuller();
+
+		void setObjects(const vector<CullObject>& objects);
+		void setDraws(const vector<CullDraw>& draws, int record_size);
+
+		void setOcclusion(HiZPyramid* hiz);
+
+		void cull(const Frustum& frustum, const Vec3& eye, unsigned int record_buffer);
+		void retest(unsigned int record_buffer);
+		void draw(unsigned int record_buffer);
+
+		int readVisibleCount();
+		int readRetestedCount();
+		bool hasIndirectCount();
+};
+
+#endif
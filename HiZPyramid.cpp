@@ -0,0 +1,138 @@
+#include "HiZPyramid.hpp"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+
+// creates the depth copy and the pyramid for a 'width'
+// by 'height' depth buffer. 'program' is the compute
+// program loaded from res/hiz.cs
+HiZPyramid::HiZPyramid(int width, int height, Shader* program)
+{
+	this->program = program;
+	this->width = width;
+	this->height = height;
+	this->built = false;
+
+	this->levels = 1;
+	while((max(width, height) >> this->levels) > 0)
+		this->levels ++;
+
+	glGenTextures(1, &(this->depth_texture));
+	glBindTexture(GL_TEXTURE_2D, this->depth_texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &(this->pyramid));
+	glBindTexture(GL_TEXTURE_2D, this->pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, this->levels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	this->program->begin();
+	this->program->setUniformi(UNIFORM_ID(HIZ_DEPTH_STR), HIZ_DEPTH_TEXTURE_ID);
+	this->program->end();
+}
+
+HiZPyramid::~HiZPyramid()
+{
+	glDeleteTextures(1, &(this->depth_texture));
+	glDeleteTextures(1, &(this->pyramid));
+}
+
+// copies the depth buffer of the bound read framebuffer
+// and reduces it level by level, each texel taking the
+// farthest of the 2x2 (or 3 wide, next to an odd edge)
+// texels under it. 'view_projection' is what the depth
+// was rendered with, for testing against it later. The
+// caller issues the texture fetch barrier before sampling
+// it (the frame graph does, for passes that read it)
+void HiZPyramid::build(const Mat4& view_projection)
+{
+	glActiveTexture(GL_TEXTURE0 + HIZ_DEPTH_TEXTURE_ID);
+	glBindTexture(GL_TEXTURE_2D, this->depth_texture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, this->width, this->height);
+
+	this->reduce(this->depth_texture, view_projection);
+}
+
+// the same, reading a depth texture (such as a G-buffer's)
+// directly instead of copying the bound framebuffer's
+void HiZPyramid::build(const Mat4& view_projection, unsigned int depth)
+{
+	this->reduce(depth, view_projection);
+}
+
+// builds every level of the pyramid from 'depth'
+void HiZPyramid::reduce(unsigned int depth, const Mat4& view_projection)
+{
+	glActiveTexture(GL_TEXTURE0 + HIZ_DEPTH_TEXTURE_ID);
+	glBindTexture(GL_TEXTURE_2D, depth);
+
+	this->program->begin();
+
+	int level;
+	for(level = 0; level < this->levels; level ++)
+	{
+		int level_width = max(this->width >> level, 1);
+		int level_height = max(this->height >> level, 1);
+
+		if(level > 0)
+			glBindImageTexture(HIZ_SRC_IMAGE, this->pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+
+		glBindImageTexture(HIZ_DST_IMAGE, this->pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		this->program->setUniformi(UNIFORM_ID(HIZ_LEVEL_STR), level);
+		this->program->dispatch((level_width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+								(level_height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	this->program->end();
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	this->view_projection = view_projection;
+	this->built = true;
+}
+
+// binds the pyramid to HIZ_TEXTURE_ID for the cull passes
+void HiZPyramid::bind()
+{
+	glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_ID);
+	glBindTexture(GL_TEXTURE_2D, this->pyramid);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// false until the first 'build', when there's
+// no depth to test anything against yet
+bool HiZPyramid::isBuilt()
+{
+	return this->built;
+}
+
+// the view-projection the pyramid's depth was rendered with
+const Mat4& HiZPyramid::getViewProjection()
+{
+	return this->view_projection;
+}
+
+int HiZPyramid::getWidth()
+{
+	return this->width;
+}
+
+int HiZPyramid::getHeight()
+{
+	return this->height;
+}
+
+int HiZPyramid::getLevels()
+{
+	return this->levels;
+}
@@ -0,0 +1,60 @@
+#ifndef HIZPYRAMID_HPP__
+#define HIZPYRAMID_HPP__
+
+#include "VectorMath.hpp"
+#include "Shader.hpp"
+
+// must match local_size_x/y in res/hiz.cs
+#define HIZ_GROUP_SIZE 8
+
+// texture unit the pyramid is sampled from by res/cull.cs,
+// and the one the depth copy is read from by res/hiz.cs
+#define HIZ_TEXTURE_ID 4
+#define HIZ_DEPTH_TEXTURE_ID 5
+
+#define HIZ_LEVEL_STR "hiz_level"
+#define HIZ_DEPTH_STR "depth"
+
+#define HIZ_SRC_IMAGE 0
+#define HIZ_DST_IMAGE 1
+
+// a mip chain over a frame's depth buffer where each
+// texel holds the farthest depth of the pixels under it,
+// so a box whose nearest depth is behind the few texels
+// covering it at a coarse enough level is hidden. Built
+// in a compute shader (res/hiz.cs) from a copy of the
+// depth buffer, one dispatch per level
+class HiZPyramid {
+
+	private:
+		Shader* program;
+
+		unsigned int depth_texture;
+		unsigned int pyramid;
+
+		int width;
+		int height;
+		int levels;
+
+		bool built;
+		Mat4 view_projection;
+
+		void reduce(unsigned int depth, const Mat4& view_projection);
+
+	public:
+		HiZPyramid(int width, int height, Shader* program);
+		~HiZPyramid();
+
+		void build(const Mat4& view_projection);
+		void build(const Mat4& view_projection, unsigned int depth);
+		void bind();
+
+		bool isBuilt();
+		const Mat4& getViewProjection();
+
+		int getWidth();
+		int getHeight();
+		int getLevels();
+};
+
+#endif
@@ -0,0 +1,861 @@
+#include "IndirectBatch.hpp"
+
+#include "Parallel.hpp"
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+using namespace chrono;
+
+// creates an empty batch of draws over the meshes
+// of one GeometryBuffer, all submitted with a single
+// glMultiDrawElementsIndirect call
+IndirectBatch::IndirectBatch(GeometryBuffer* geometry)
+{
+	this->geometry = geometry;
+	this->textured = NULL;
+	this->vtex = NULL;
+	this->objects_dirty = false;
+	this->draws_dirty = false;
+
+	this->culler = new FrustumCuller();
+	this->occluders = NULL;
+	this->frustum_count = 0;
+	this->occluded_count = 0;
+	this->record_threads = 0;
+	this->record_ms = 0.0;
+
+	this->tree = NULL;
+	this->tree_dirty = false;
+	this->gpu_culler = NULL;
+	this->ring = NULL;
+	this->static_version = 0;
+
+	glGenBuffers(1, &(this->command_buffer));
+	glGenBuffers(1, &(this->record_buffer));
+	glGenBuffers(1, &(this->object_buffer));
+	glGenBuffers(1, &(this->visible_buffer));
+	glGenBuffers(1, &(this->draw_record_buffer));
+}
+
+IndirectBatch::~IndirectBatch()
+{
+	delete this->culler;
+	delete this->gpu_culler;
+	delete this->tree;
+
+	glDeleteBuffers(1, &(this->command_buffer));
+	glDeleteBuffers(1, &(this->record_buffer));
+	glDeleteBuffers(1, &(this->object_buffer));
+	glDeleteBuffers(1, &(this->visible_buffer));
+	glDeleteBuffers(1, &(this->draw_record_buffer));
+}
+
+// every draw in the batch shares the texture bindings:
+// one 2D texture for regular models and one virtual
+// texture for virtual ones. Models that need anything
+// else have to go in a separate batch
+bool IndirectBatch::checkTextures(Model* model)
+{
+	VirtualTexture* vtex = model->getVirtualTexture();
+
+	if(vtex != NULL)
+	{
+		if(this->vtex != NULL && this->vtex != vtex)
+			return false;
+
+		this->vtex = vtex;
+		return true;
+	}
+
+	if(this->textured != NULL && this->textured->getTexture() != model->getTexture())
+		return false;
+
+	this->textured = model;
+	return true;
+}
+
+// records the mesh, material and flags of a new draw, with
+// the textures of 'model'. Its objects are added right after
+// it, so every draw's objects sit together starting at
+// 'first_object'
+int IndirectBatch::addDraw(Model* model, int mesh, Material* material)
+{
+	BatchDraw draw;
+	memset(&draw, 0, sizeof(BatchDraw));
+
+	VirtualTexture* vtex = model->getVirtualTexture();
+
+	draw.mesh = mesh;
+	draw.texture = (vtex != NULL ? (1 << (KEY_TEXTURE_BITS - 1)) | vtex->getID() : model->getTexture());
+	draw.first_object = (int)this->objects.size();
+	draw.max_distance = 0.0f;
+
+	memcpy(draw.record.ambient, material->getAmbient(), 3 * sizeof(float));
+	memcpy(draw.record.diffuse, material->getDiffuse(), 3 * sizeof(float));
+	memcpy(draw.record.specular, material->getSpecular(), 3 * sizeof(float));
+
+	draw.record.specular[3] = material->getShininess();
+	draw.record.flags = (vtex != NULL ? DRAW_FLAG_VIRTUAL : 0);
+	draw.record.draw = (int)this->draws.size();
+
+	this->draws.push_back(draw);
+	this->draws_dirty = true;
+
+	return (int)this->draws.size() - 1;
+}
+
+// adds an object, along with its world space bounds
+void IndirectBatch::addObject(int draw, const InstanceData& data)
+{
+	MeshRange* range = this->geometry->getMesh(this->draws[draw].mesh);
+
+	Mat4 transform;
+	memcpy(transform.m, data.model, sizeof(transform.m));
+
+	this->culler->add(range->box.transform(transform), range->sphere.transform(transform));
+
+	this->all_objects.push_back((int)this->objects.size());
+	this->objects.push_back(data);
+	this->object_draws.push_back(draw);
+
+	this->objects_dirty = true;
+	this->tree_dirty = true;
+
+	if(this->draws[draw].dynamic)
+		this->dynamic_objects.push_back((int)this->objects.size() - 1);
+	else
+		this->static_version ++;
+}
+
+// adds a single model, drawn where it currently is.
+// Returns the draw's index, or -1 if the model can't
+// share this batch's textures
+int IndirectBatch::add(Model* model, Material* material)
+{
+	if(!this->checkTextures(model))
+	{
+		cout << "Model textures don't match the rest of the batch" << endl;
+		return -1;
+	}
+
+	int draw = this->addDraw(model, model->getMesh(), material);
+	this->addObject(draw, InstanceBuffer::makeInstance(model->getTransform()));
+
+	return draw;
+}
+
+// adds one draw covering every instance in 'instances'
+int IndirectBatch::add(Model* model, Material* material, InstanceBuffer* instances)
+{
+	if(!this->checkTextures(model))
+	{
+		cout << "Model textures don't match the rest of the batch" << endl;
+		return -1;
+	}
+
+	int draw = this->addDraw(model, model->getMesh(), material);
+	vector<InstanceData>& data = instances->getInstances();
+
+	int i;
+	for(i = 0; i < (int)data.size(); i ++)
+		this->addObject(draw, data[i]);
+
+	return draw;
+}
+
+// adds one draw per merged mesh of a built StaticBatch,
+// textured like 'model', each with a single untransformed
+// object so it's still culled by its own bounds. Returns
+// the first draw's index, or -1
+int IndirectBatch::add(Model* model, Material* material, StaticBatch* statics)
+{
+	if(!this->checkTextures(model))
+	{
+		cout << "Model textures don't match the rest of the batch" << endl;
+		return -1;
+	}
+
+	InstanceData identity = InstanceBuffer::makeInstance(Mat4::identity());
+	int first = -1;
+
+	int i;
+	for(i = 0; i < statics->getClusterCount(); i ++)
+	{
+		int draw = this->addDraw(model, statics->getClusterMesh(i), material);
+		this->addObject(draw, identity);
+
+		if(first < 0)
+			first = draw;
+	}
+
+	return first;
+}
+
+void IndirectBatch::setPicked(int draw, bool picked)
+{
+	int flags = this->draws[draw].record.flags;
+
+	if(picked)
+		flags |= DRAW_FLAG_PICKED;
+	else
+		flags &= ~DRAW_FLAG_PICKED;
+
+	if(flags != this->draws[draw].record.flags)
+	{
+		this->draws[draw].record.flags = flags;
+		this->draws_dirty = true;
+	}
+}
+
+// sets how far from the camera a draw's objects are
+// still drawn when culling on the GPU (0 = no limit)
+void IndirectBatch::setDrawDistance(int draw, float distance)
+{
+	this->draws[draw].max_distance = distance;
+	this->draws_dirty = true;
+}
+
+// marks a draw's objects as ones that may move (or not)
+void IndirectBatch::setDynamic(int draw, bool dynamic)
+{
+	if(this->draws[draw].dynamic == dynamic)
+		return;
+
+	this->draws[draw].dynamic = dynamic;
+	this->static_version ++;
+
+	// kept in object order, so each draw's objects stay
+	// next to each other for 'buildCommands'
+	this->dynamic_objects.clear();
+
+	int i;
+	for(i = 0; i < (int)this->objects.size(); i ++)
+	{
+		if(this->draws[this->object_draws[i]].dynamic)
+			this->dynamic_objects.push_back(i);
+	}
+}
+
+// moves an object, updating its bounds. Moving an object
+// of a draw that isn't dynamic invalidates anything cached
+// from the static draws (see 'getStaticVersion')
+void IndirectBatch::setObject(int object, const InstanceData& data)
+{
+	int draw = this->object_draws[object];
+	MeshRange* range = this->geometry->getMesh(this->draws[draw].mesh);
+
+	Mat4 transform;
+	memcpy(transform.m, data.model, sizeof(transform.m));
+
+	this->culler->set(object, range->box.transform(transform), range->sphere.transform(transform));
+	this->objects[object] = data;
+
+	this->objects_dirty = true;
+	this->tree_dirty = true;
+
+	if(!(this->draws[draw].dynamic))
+		this->static_version ++;
+}
+
+// also drops the objects hidden behind what was last
+// drawn into 'occluders' when queueing (NULL to stop)
+void IndirectBatch::setOccluders(OcclusionBuffer* occluders)
+{
+	this->occluders = occluders;
+}
+
+// finds the objects in view through a BVH over their
+// bounds instead of testing every one of them (false to
+// go back to testing them all)
+void IndirectBatch::setSpatialIndex(bool enabled)
+{
+	delete this->tree;
+	this->tree = (enabled ? new BVH() : NULL);
+	this->tree_dirty = enabled;
+}
+
+// culls and records the objects for 'queue' on this many
+// worker threads, each into its own list (0 to do it all
+// on the calling thread, as before)
+void IndirectBatch::setRecordThreads(int threads)
+{
+	this->record_threads = (threads > 0 ? threads : 0);
+}
+
+// writes the commands, draw records and visible list of
+// each submit into 'ring' instead of re-specifying the
+// batch's buffers every time (NULL to go back to that)
+void IndirectBatch::setFrameRing(FrameRing* ring)
+{
+	this->ring = ring;
+}
+
+// rebuilds the BVH if objects were added since it was built
+void IndirectBatch::updateTree()
+{
+	if(!this->tree_dirty)
+		return;
+
+	vector<AABB> boxes(this->objects.size());
+
+	int i;
+	for(i = 0; i < (int)boxes.size(); i ++)
+		boxes[i] = this->culler->getBox(i);
+
+	this->tree->build(boxes);
+	this->tree_dirty = false;
+}
+
+// culls the objects against the view frustum (and the
+// occluders, if set) and submits the rest to 'queue' as
+// opaque draws, keyed by program, draw (mesh + material),
+// texture and distance along the view direction of the
+// object's bounds. Split over worker threads if set with
+// 'setRecordThreads'
+void IndirectBatch::queue(RenderQueue* queue, Shader* shader, const Mat4& view, const Mat4& projection)
+{
+	time_point<steady_clock> start = steady_clock::now();
+
+	Frustum frustum = Frustum::fromMatrix(projection * view);
+	int program = (int)shader->getProgram();
+
+	if(this->record_threads > 0)
+		this->queueParallel(queue, frustum, program, view);
+	else
+	{
+		int count;
+
+		if(this->tree != NULL)
+		{
+			this->updateTree();
+			count = this->tree->frustum(frustum, this->visible);
+		}
+		else
+			count = this->culler->cull(frustum, this->visible);
+
+		this->frustum_count = count;
+
+		if(this->occluders != NULL)
+			count = this->occluders->cull(this->culler, this->visible);
+
+		this->occluded_count = this->frustum_count - count;
+
+		queue->reserve(queue->getCount() + count);
+		this->recordKeys(queue, this->visible.data(), count, program, view);
+	}
+
+	duration<double, milli> elapsed = steady_clock::now() - start;
+	this->record_ms = elapsed.count();
+}
+
+// submits 'objects' to 'queue', keyed by program, draw,
+// texture and view depth of the center of each object's
+// bounds. Static batch clusters are baked in world space
+// with an identity transform, so their origins say
+// nothing about where they are
+void IndirectBatch::recordKeys(RenderQueue* queue, const int* objects, int count, int program, const Mat4& view)
+{
+	int i;
+	for(i = 0; i < count; i ++)
+	{
+		int object = objects[i];
+
+		Vec3 center = this->culler->getBox(object).center;
+		BatchDraw& draw = this->draws[this->object_draws[object]];
+
+		float depth = -(view.m[2] * center.x + view.m[6] * center.y + view.m[10] * center.z + view.m[14]);
+
+		queue->submit(RenderQueue::makeKey(PASS_OPAQUE, program, this->object_draws[object], draw.texture, depth), object);
+	}
+}
+
+// one worker's part of 'queueParallel': culls objects
+// [start, end) (or, with a BVH, that range of what it
+// found) and records the survivors into its own list
+void IndirectBatch::recordRange(RecordList& list, const Frustum& frustum, int start, int end, int program, const Mat4& view)
+{
+	list.queue.clear();
+
+	if(this->tree != NULL)
+		list.visible.assign(this->visible.begin() + start, this->visible.begin() + end);
+	else
+	{
+		list.visible.resize(end - start);
+
+		int count = (end > start ? this->culler->cullRange(frustum, start, end, list.visible.data()) : 0);
+		list.visible.resize(count);
+	}
+
+	int count = (int)list.visible.size();
+	list.frustum_count = count;
+
+	if(this->occluders != NULL)
+	{
+		int i, kept = 0;
+		for(i = 0; i < count; i ++)
+		{
+			if(this->occluders->isVisible(this->culler->getBox(list.visible[i])))
+				list.visible[kept ++] = list.visible[i];
+		}
+		count = kept;
+	}
+
+	list.occluded_count = list.frustum_count - count;
+
+	list.queue.reserve(count);
+	this->recordKeys(&(list.queue), list.visible.data(), count, program, view);
+}
+
+// splits culling and recording over 'record_threads'
+// workers, each filling its own list, then appends the
+// lists to 'queue' in worker order, which is the order a
+// single thread would have queued them in. A BVH is still
+// walked on this thread, and the workers split what it finds
+void IndirectBatch::queueParallel(RenderQueue* queue, const Frustum& frustum, int program, const Mat4& view)
+{
+	int workers = this->record_threads;
+	int count = (int)this->objects.size();
+
+	if(this->tree != NULL)
+	{
+		this->updateTree();
+		count = this->tree->frustum(frustum, this->visible);
+	}
+
+	this->lists.resize(workers);
+
+	parallelFor(workers, workers, [&](int first, int last)
+	{
+		int w;
+		for(w = first; w < last; w ++)
+			this->recordRange(this->lists[w], frustum, (count * w) / workers, (count * (w + 1)) / workers, program, view);
+	});
+
+	int w, total = 0;
+	this->frustum_count = 0;
+	this->occluded_count = 0;
+
+	for(w = 0; w < workers; w ++)
+	{
+		total += this->lists[w].queue.getCount();
+		this->frustum_count += this->lists[w].frustum_count;
+		this->occluded_count += this->lists[w].occluded_count;
+	}
+
+	queue->reserve(queue->getCount() + total);
+
+	for(w = 0; w < workers; w ++)
+		queue->append(&(this->lists[w].queue));
+}
+
+// moves culling over to a compute shader (loaded from
+// res/cull.cs), drawn with 'cullOnGpu' and 'renderGpuCulled'.
+// Passing NULL goes back to culling on the CPU only
+void IndirectBatch::setGpuCulling(Shader* program)
+{
+	delete this->gpu_culler;
+	this->gpu_culler = NULL;
+
+	if(program == NULL)
+		return;
+
+	this->gpu_culler = new GpuCuller(program);
+
+	this->objects_dirty = true;
+	this->draws_dirty = true;
+}
+
+// culls every object on the GPU, leaving the draw
+// commands there for 'renderGpuCulled'. Must be called
+// outside of any other program's begin/end
+void IndirectBatch::cullOnGpu(const Mat4& view, const Mat4& projection)
+{
+	if(this->gpu_culler == NULL)
+		return;
+
+	this->uploadObjects();
+	this->uploadDraws();
+
+	// the camera sits at the view's translation undone
+	// by its rotation (the rotation's transpose)
+	const float* m = view.m;
+	Vec3 eye(-(m[0] * m[12] + m[1] * m[13] + m[2] * m[14]),
+			 -(m[4] * m[12] + m[5] * m[13] + m[6] * m[14]),
+			 -(m[8] * m[12] + m[9] * m[13] + m[10] * m[14]));
+
+	this->gpu_culler->cull(Frustum::fromMatrix(projection * view), eye, this->draw_record_buffer);
+}
+
+// also culls objects hidden behind 'hiz' on the GPU (NULL
+// to stop). Each frame then goes: 'cullOnGpu', draw, build
+// the pyramid from the depth so far, 'retestOnGpu', draw
+void IndirectBatch::setOcclusion(HiZPyramid* hiz)
+{
+	if(this->gpu_culler != NULL)
+		this->gpu_culler->setOcclusion(hiz);
+}
+
+// leaves the objects 'cullOnGpu' found hidden behind the
+// last pyramid, but the new one shows, for the next
+// 'renderGpuCulled'
+void IndirectBatch::retestOnGpu()
+{
+	if(this->gpu_culler != NULL)
+		this->gpu_culler->retest(this->draw_record_buffer);
+}
+
+// culls the objects on the CPU without queueing them,
+// returning how many are visible. Used to check the
+// GPU's results, so draw distances aren't applied
+int IndirectBatch::countVisible(const Mat4& view, const Mat4& projection)
+{
+	return this->culler->cull(Frustum::fromMatrix(projection * view), this->visible);
+}
+
+// uploads the object transforms if they changed, along
+// with their bounds when culling on the GPU
+void IndirectBatch::uploadObjects()
+{
+	if(!this->objects_dirty || this->objects.empty())
+		return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->object_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, this->objects.size() * sizeof(InstanceData), &(this->objects[0]), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if(this->gpu_culler != NULL)
+	{
+		vector<CullObject> bounds(this->objects.size());
+
+		int i;
+		for(i = 0; i < (int)bounds.size(); i ++)
+		{
+			AABB box = this->culler->getBox(i);
+
+			bounds[i].center[0] = box.center.x;
+			bounds[i].center[1] = box.center.y;
+			bounds[i].center[2] = box.center.z;
+			bounds[i].extents[0] = box.extents.x;
+			bounds[i].extents[1] = box.extents.y;
+			bounds[i].extents[2] = box.extents.z;
+
+			bounds[i].draw = this->object_draws[i];
+			bounds[i].occluded = 0;
+		}
+		this->gpu_culler->setObjects(bounds);
+	}
+	this->objects_dirty = false;
+}
+
+// uploads one record per draw, indexed by draw rather than
+// by command, for the GPU cull passes to pick from and for
+// 'bindMaterials'. Culling on the GPU also needs each draw's
+// mesh and objects. Only done if any of them changed
+void IndirectBatch::uploadDraws()
+{
+	if(!this->draws_dirty || this->draws.empty())
+		return;
+
+	vector<DrawRecord> draw_records(this->draws.size());
+	vector<CullDraw> cull_draws(this->draws.size());
+
+	int i;
+	for(i = 0; i < (int)this->draws.size(); i ++)
+	{
+		MeshRange* range = this->geometry->getMesh(this->draws[i].mesh);
+
+		memset(&(cull_draws[i]), 0, sizeof(CullDraw));
+		cull_draws[i].index_count = (unsigned int)range->index_count;
+		cull_draws[i].first_index = (unsigned int)range->first_index;
+		cull_draws[i].base_vertex = range->base_vertex;
+		cull_draws[i].first_object = (unsigned int)this->draws[i].first_object;
+		cull_draws[i].max_distance = this->draws[i].max_distance;
+
+		draw_records[i] = this->draws[i].record;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->draw_record_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draw_records.size() * sizeof(DrawRecord), &(draw_records[0]), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if(this->gpu_culler != NULL)
+		this->gpu_culler->setDraws(cull_draws, sizeof(DrawRecord));
+
+	this->draws_dirty = false;
+}
+
+// sets the shader state, textures and buffers
+// every draw in the batch shares
+void IndirectBatch::beginDraw(Shader* shader)
+{
+	shader->setDrawMode(DRAW_MODE_INDIRECT);
+
+	if(this->vtex != NULL)
+		shader->setVirtualTexture(this->vtex);
+
+	if(this->textured != NULL)
+		this->textured->bindTexture();
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_RECORDS_BINDING, this->object_buffer);
+
+	this->geometry->bind();
+	shader->flush();
+}
+
+void IndirectBatch::endDraw(Shader* shader)
+{
+	this->geometry->unbind();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	shader->setDrawMode(DRAW_MODE_SINGLE);
+}
+
+// turns a list of objects into indirect commands, one per
+// run of consecutive objects sharing a draw. Each command's
+// base instance is where its run starts in the list, which
+// the vertex shader uses to find its objects
+void IndirectBatch::buildCommands(vector<int>& visible)
+{
+	this->commands.clear();
+	this->records.clear();
+
+	int count = (int)visible.size();
+	int i, start = 0;
+
+	for(i = 1; i <= count; i ++)
+	{
+		int draw = this->object_draws[visible[start]];
+
+		if(i < count && this->object_draws[visible[i]] == draw)
+			continue;
+
+		MeshRange* range = this->geometry->getMesh(this->draws[draw].mesh);
+
+		DrawElementsIndirectCommand command;
+		command.count = (unsigned int)range->index_count;
+		command.instance_count = (unsigned int)(i - start);
+		command.first_index = (unsigned int)range->first_index;
+		command.base_vertex = range->base_vertex;
+		command.base_instance = (unsigned int)start;
+
+		this->commands.push_back(command);
+		this->records.push_back(this->draws[draw].record);
+
+		start = i;
+	}
+}
+
+// uploads this frame's commands, draw records and object
+// list (and the object transforms, if they changed), then
+// submits every draw with one call. The shaders look up
+// their draw record with gl_DrawID and their transform
+// through the object list
+void IndirectBatch::submit(Shader* shader, vector<int>& visible)
+{
+	if(visible.empty())
+		return;
+
+	this->buildCommands(visible);
+	int count = (int)this->commands.size();
+
+	int command_bytes = count * sizeof(DrawElementsIndirectCommand);
+	int record_bytes = count * sizeof(DrawRecord);
+	int visible_bytes = (int)visible.size() * sizeof(int);
+
+	int command_offset = -1, record_offset = -1, visible_offset = -1;
+
+	// with a frame ring the lists are written straight into
+	// mapped memory. If this frame's partition is full they
+	// go through the batch's own buffers instead
+	if(this->ring != NULL)
+	{
+		command_offset = this->ring->upload(&(this->commands[0]), command_bytes);
+		record_offset = this->ring->upload(&(this->records[0]), record_bytes);
+		visible_offset = this->ring->upload(&(visible[0]), visible_bytes);
+	}
+
+	bool ring = (command_offset >= 0 && record_offset >= 0 && visible_offset >= 0);
+
+	if(!ring)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->record_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, record_bytes, &(this->records[0]), GL_STREAM_DRAW);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->visible_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, visible_bytes, &(visible[0]), GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	this->uploadObjects();
+	this->beginDraw(shader);
+
+	if(ring)
+	{
+		unsigned int buffer = this->ring->getBuffer();
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_RECORDS_BINDING, buffer, record_offset, record_bytes);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, VISIBLE_OBJECTS_BINDING, buffer, visible_offset, visible_bytes);
+	}
+	else
+	{
+		command_offset = 0;
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->command_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, command_bytes, &(this->commands[0]), GL_STREAM_DRAW);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORDS_BINDING, this->record_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_OBJECTS_BINDING, this->visible_buffer);
+	}
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(size_t)command_offset, count, 0);
+
+	this->endDraw(shader);
+}
+
+// draws every object, in the order they were added
+void IndirectBatch::render(Shader* shader)
+{
+	this->submit(shader, this->all_objects);
+}
+
+// draws the objects in a sorted queue filled by 'queue'
+void IndirectBatch::render(Shader* shader, RenderQueue* queue)
+{
+	this->submit(shader, queue->getItems());
+}
+
+// draws whatever the last 'cullOnGpu' (or 'retestOnGpu')
+// left visible, without the CPU touching any per-object
+// data
+void IndirectBatch::renderGpuCulled(Shader* shader)
+{
+	if(this->gpu_culler == NULL)
+		return;
+
+	this->beginDraw(shader);
+	this->gpu_culler->draw(this->draw_record_buffer);
+	this->endDraw(shader);
+}
+
+// draws the objects of either the static or the dynamic
+// draws that are inside 'view_projection's frustum, such
+// as into a shadow map. Returns how many were drawn. The
+// dynamic ones are tested from their own list, so drawing
+// them costs nothing per static object
+int IndirectBatch::renderCasters(Shader* shader, const Mat4& view_projection, bool dynamic)
+{
+	Frustum frustum = Frustum::fromMatrix(view_projection);
+	int i, kept = 0;
+
+	if(dynamic)
+	{
+		this->casters.resize(this->dynamic_objects.size());
+
+		for(i = 0; i < (int)this->dynamic_objects.size(); i ++)
+		{
+			if(frustum.contains(this->culler->getBox(this->dynamic_objects[i])))
+				this->casters[kept ++] = this->dynamic_objects[i];
+		}
+	}
+	else
+	{
+		int count = (int)this->objects.size();
+		this->casters.resize(count);
+
+		if(count > 0)
+			count = this->culler->cullRange(frustum, 0, count, this->casters.data());
+
+		for(i = 0; i < count; i ++)
+		{
+			if(!(this->draws[this->object_draws[this->casters[i]]].dynamic))
+				this->casters[kept ++] = this->casters[i];
+		}
+	}
+
+	this->casters.resize(kept);
+	this->submit(shader, this->casters);
+
+	return kept;
+}
+
+// binds every draw's record to DRAW_RECORDS_BINDING in
+// draw order, for passes that look materials up by the
+// draw index a G-buffer stored rather than by gl_DrawID
+void IndirectBatch::bindMaterials()
+{
+	this->uploadDraws();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORDS_BINDING, this->draw_record_buffer);
+}
+
+// changes whenever the static draws' objects do, so
+// anything cached from them knows to redraw
+int IndirectBatch::getStaticVersion()
+{
+	return this->static_version;
+}
+
+// returns the number of model + material pairs
+int IndirectBatch::getDrawCount()
+{
+	return (int)this->draws.size();
+}
+
+int IndirectBatch::getObjectCount()
+{
+	return (int)this->objects.size();
+}
+
+// objects inside the frustum at the last 'queue'
+int IndirectBatch::getVisibleCount()
+{
+	return this->frustum_count;
+}
+
+// objects culled at the last 'queue'
+int IndirectBatch::getCulledCount()
+{
+	return (int)this->objects.size() - this->frustum_count;
+}
+
+// objects in the frustum the occluders hid at the last 'queue'
+int IndirectBatch::getOccludedCount()
+{
+	return this->occluded_count;
+}
+
+// milliseconds the last 'queue' took to cull and record
+double IndirectBatch::getRecordTime()
+{
+	return this->record_ms;
+}
+
+// returns the number of indirect commands last submitted
+int IndirectBatch::getCommandCount()
+{
+	return (int)this->commands.size();
+}
+
+// objects kept by the last 'cullOnGpu' and 'retestOnGpu'.
+// Reads back from the GPU, so it's only meant for stats
+int IndirectBatch::getGpuVisibleCount()
+{
+	if(this->gpu_culler == NULL)
+		return 0;
+
+	return this->gpu_culler->readVisibleCount();
+}
+
+// objects the last 'retestOnGpu' found had come into view
+int IndirectBatch::getGpuRetestedCount()
+{
+	if(this->gpu_culler == NULL)
+		return 0;
+
+	return this->gpu_culler->readRetestedCount();
+}
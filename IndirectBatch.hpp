@@ -0,0 +1,170 @@
+#ifndef INDIRECTBATCH_HPP__
+#define INDIRECTBATCH_HPP__
+
+#include "GeometryBuffer.hpp"
+#include "FrustumCuller.hpp"
+#include "OcclusionBuffer.hpp"
+#include "BVH.hpp"
+#include "GpuCuller.hpp"
+#include "InstanceBuffer.hpp"
+#include "StaticBatch.hpp"
+#include "FrameRing.hpp"
+#include "RenderQueue.hpp"
+#include "Material.hpp"
+#include "Shader.hpp"
+#include "Model.hpp"
+
+#include <vector>
+
+#define DRAW_FLAG_VIRTUAL 1
+#define DRAW_FLAG_PICKED 2
+
+using namespace std;
+
+// per-draw data fetched by the shaders through
+// gl_DrawID, laid out to match the std430 block
+// in main.vs/main.fs. 'draw' is the draw's index in
+// the batch, which res/gbuffer.fs writes out as the
+// material ID (plus one, leaving 0 for nothing drawn)
+struct DrawRecord {
+
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+
+	int flags;
+	int draw;
+	int padding[2];
+};
+
+// one model + material pair added to the batch. Dynamic
+// draws are the ones whose objects move (with 'setObject'),
+// which shadow maps redraw every frame rather than keep cached
+struct BatchDraw {
+
+	int mesh;
+	int texture;
+	int first_object;
+	float max_distance;
+	bool dynamic;
+
+	DrawRecord record;
+};
+
+// one worker's share of the recording done by 'queue':
+// the objects it found visible and the draws it queued
+// for them, merged with the others' on the GL thread
+struct RecordList {
+
+	RenderQueue queue;
+	vector<int> visible;
+
+	int frustum_count;
+	int occluded_count;
+};
+
+class IndirectBatch {
+
+	private:
+		GeometryBuffer* geometry;
+
+		Model* textured;
+		VirtualTexture* vtex;
+
+		unsigned int command_buffer;
+		unsigned int record_buffer;
+		unsigned int object_buffer;
+		unsigned int visible_buffer;
+
+		bool objects_dirty;
+		bool draws_dirty;
+
+		FrustumCuller* culler;
+		OcclusionBuffer* occluders;
+		vector<int> visible;
+		int frustum_count;
+		int occluded_count;
+
+		vector<RecordList> lists;
+		int record_threads;
+		double record_ms;
+
+		BVH* tree;
+		bool tree_dirty;
+
+		GpuCuller* gpu_culler;
+		unsigned int draw_record_buffer;
+
+		FrameRing* ring;
+
+		vector<BatchDraw> draws;
+		vector<InstanceData> objects;
+		vector<int> object_draws;
+		vector<int> all_objects;
+		vector<int> dynamic_objects;
+		vector<int> casters;
+		int static_version;
+
+		vector<DrawElementsIndirectCommand> commands;
+		vector<DrawRecord> records;
+
+		bool checkTextures(Model* model);
+		int addDraw(Model* model, int mesh, Material* material);
+		void addObject(int draw, const InstanceData& data);
+
+		void updateTree();
+		void recordKeys(RenderQueue* queue, const int* objects, int count, int program, const Mat4& view);
+		void recordRange(RecordList& list, const Frustum& frustum, int start, int end, int program, const Mat4& view);
+		void queueParallel(RenderQueue* queue, const Frustum& frustum, int program, const Mat4& view);
+		void uploadObjects();
+		void uploadDraws();
+
+		void beginDraw(Shader* shader);
+		void endDraw(Shader* shader);
+
+		void buildCommands(vector<int>& visible);
+		void submit(Shader* shader, vector<int>& visible);
+
+	public:
+		IndirectBatch(GeometryBuffer* geometry);
+		~IndirectBatch();
+
+		int add(Model* model, Material* material);
+		int add(Model* model, Material* material, InstanceBuffer* instances);
+		int add(Model* model, Material* material, StaticBatch* statics);
+
+		void setPicked(int draw, bool picked);
+		void setDrawDistance(int draw, float distance);
+		void setDynamic(int draw, bool dynamic);
+		void setObject(int object, const InstanceData& data);
+		void setOccluders(OcclusionBuffer* occluders);
+		void setSpatialIndex(bool enabled);
+		void setFrameRing(FrameRing* ring);
+		void setRecordThreads(int threads);
+		void queue(RenderQueue* queue, Shader* shader, const Mat4& view, const Mat4& projection);
+
+		void setGpuCulling(Shader* program);
+		void setOcclusion(HiZPyramid* hiz);
+		void cullOnGpu(const Mat4& view, const Mat4& projection);
+		void retestOnGpu();
+		int countVisible(const Mat4& view, const Mat4& projection);
+
+		void render(Shader* shader);
+		void render(Shader* shader, RenderQueue* queue);
+		void renderGpuCulled(Shader* shader);
+		int renderCasters(Shader* shader, const Mat4& view_projection, bool dynamic);
+		void bindMaterials();
+
+		int getDrawCount();
+		int getObjectCount();
+		int getCommandCount();
+		int getVisibleCount();
+		int getCulledCount();
+		int getOccludedCount();
+		double getRecordTime();
+		int getGpuVisibleCount();
+		int getGpuRetestedCount();
+		int getStaticVersion();
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "InstanceBuffer.hpp"
+
+#include <GL/glew.h>
+
+#include <cstring>
+
+// fills in the model and normal matrices for one instance
+static void _setInstance(InstanceData& data, const Mat4& transform)
+{
+	float normal[9];
+	transform.normalMatrix(normal);
+
+	memcpy(data.model, transform.m, sizeof(data.model));
+
+	int i;
+	for(i = 0; i < 3; i ++)
+	{
+		data.normal[i * 4] = normal[i * 3];
+		data.normal[i * 4 + 1] = normal[i * 3 + 1];
+		data.normal[i * 4 + 2] = normal[i * 3 + 2];
+		data.normal[i * 4 + 3] = 0.0f;
+	}
+}
+
+// creates an empty set of instances, used to draw many
+// copies of one Model with a single instanced draw call
+InstanceBuffer::InstanceBuffer()
+{
+	this->uploaded = 0;
+	glGenBuffers(1, &(this->vbo));
+
+	this->vao = new VertexArray(INSTANCED_MESH_LAYOUT);
+	this->vao->setVertexBuffer(INSTANCE_BINDING, this->vbo);
+	this->attached = NULL;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	delete this->vao;
+	glDeleteBuffers(1, &(this->vbo));
+}
+
+// adds an instance and returns its index. The
+// change isn't visible until 'upload' is called
+int InstanceBuffer::add(const Mat4& transform)
+{
+	InstanceData data;
+	_setInstance(data, transform);
+
+	this->instances.push_back(data);
+	return (int)this->instances.size() - 1;
+}
+
+// moves an existing instance
+void InstanceBuffer::set(int index, const Mat4& transform)
+{
+	_setInstance(this->instances[index], transform);
+}
+
+void InstanceBuffer::clear()
+{
+	this->instances.clear();
+}
+
+// copies the instance data to the GPU, only needed
+// after instances were added or moved
+void InstanceBuffer::upload()
+{
+	this->uploaded = (int)this->instances.size();
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, this->uploaded * sizeof(InstanceData),
+				 (this->uploaded > 0 ? &(this->instances[0]) : NULL), GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// binds the VAO that reads the mesh attributes from
+// 'geometry' and the per-instance matrices from this
+// buffer. Its buffers are only attached the first time
+// (or when drawn over a different GeometryBuffer)
+void InstanceBuffer::bind(GeometryBuffer* geometry)
+{
+	geometry->update();
+
+	if(this->attached != geometry)
+	{
+		this->vao->setVertexBuffer(VERTEX_BINDING, geometry->getVertexBuffer());
+		this->vao->setIndexBuffer(geometry->getIndexBuffer());
+
+		this->attached = geometry;
+	}
+	this->vao->bind();
+}
+
+void InstanceBuffer::unbind()
+{
+	this->vao->unbind();
+}
+
+// returns the number of instances last uploaded
+int InstanceBuffer::getCount()
+{
+	return this->uploaded;
+}
+
+// returns the instances as kept on the CPU
+vector<InstanceData>& InstanceBuffer::getInstances()
+{
+	return this->instances;
+}
+
+// builds the per-instance data for one transform
+InstanceData InstanceBuffer::makeInstance(const Mat4& transform)
+{
+	InstanceData data;
+	_setInstance(data, transform);
+
+	return data;
+}
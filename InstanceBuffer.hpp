@@ -0,0 +1,42 @@
+#ifndef INSTANCEBUFFER_HPP__
+#define INSTANCEBUFFER_HPP__
+
+#include "GeometryBuffer.hpp"
+#include "VertexLayout.hpp"
+#include "VertexArray.hpp"
+#include "VectorMath.hpp"
+
+#include <vector>
+
+using namespace std;
+
+class InstanceBuffer {
+
+	private:
+		unsigned int vbo;
+		int uploaded;
+
+		VertexArray* vao;
+		GeometryBuffer* attached;
+
+		vector<InstanceData> instances;
+
+	public:
+		InstanceBuffer();
+		~InstanceBuffer();
+
+		int add(const Mat4& transform);
+		void set(int index, const Mat4& transform);
+		void clear();
+		void upload();
+
+		void bind(GeometryBuffer* geometry);
+		void unbind();
+
+		int getCount();
+		vector<InstanceData>& getInstances();
+
+		static InstanceData makeInstance(const Mat4& transform);
+};
+
+#endif
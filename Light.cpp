@@ -12,6 +12,8 @@ Light::Light(float x, float y, float z)
 	this->pos[0] = x;
 	this->pos[1] = y;
 	this->pos[2] = z;
+
+	this->radius = 0.0f;
 }
 
 // frees each array for the Light object
@@ -50,6 +52,13 @@ void Light::setDiffuse(float r, float g, float b)
 	this->diffuse[2] = b;
 }
 
+// sets the distance at which the light fades out
+// completely (0, the default, never fades)
+void Light::setRadius(float radius)
+{
+	this->radius = radius;
+}
+
 // returns the Light object's specular color array
 float* Light::getSpecular()
 {
@@ -73,3 +82,9 @@ float* Light::getPos()
 {
 	return this->pos;
 }
+
+// returns the distance the light reaches (0 = unbounded)
+float Light::getRadius()
+{
+	return this->radius;
+}
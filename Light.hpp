@@ -9,6 +9,8 @@ class Light {
 		float* specular;
 		float* pos;
 
+		float radius;
+
 	public:
 		Light(float x, float y, float z);
 		~Light();
@@ -16,11 +18,13 @@ class Light {
 		void setSpecular(float r, float g, float b);
 		void setAmbient(float r, float g, float b);
 		void setDiffuse(float r, float g, float b);
+		void setRadius(float radius);
 
 		float* getSpecular();
 		float* getAmbient();
 		float* getDiffuse();
-		float* getPos();				
+		float* getPos();
+		float getRadius();
 };
 
 #endif
@@ -0,0 +1,127 @@
+#include "LightBuffer.hpp"
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+
+#include <cstring>
+
+// the std430 block starts with the count, padded
+// out to where the first record is aligned
+struct LightBufferHeader {
+
+	int count;
+	int padding[3];
+};
+
+// copies a light's position, reach and colors into its record
+static void _setRecord(LightRecord& record, Light* light)
+{
+	memset(&record, 0, sizeof(LightRecord));
+
+	memcpy(record.pos, light->getPos(), 3 * sizeof(float));
+	memcpy(record.diffuse, light->getDiffuse(), 3 * sizeof(float));
+	memcpy(record.specular, light->getSpecular(), 3 * sizeof(float));
+
+	record.radius = light->getRadius();
+	record.shadow = -1;
+}
+
+// creates an empty set of lights
+LightBuffer::LightBuffer()
+{
+	glGenBuffers(1, &(this->buffer));
+	this->dirty = true;
+}
+
+LightBuffer::~LightBuffer()
+{
+	glDeleteBuffers(1, &(this->buffer));
+}
+
+// adds a copy of 'light' and returns its index. Changing
+// the Light afterwards needs a 'set' to show up
+int LightBuffer::add(Light* light)
+{
+	LightRecord record;
+	_setRecord(record, light);
+
+	this->lights.push_back(record);
+	this->dirty = true;
+
+	return (int)this->lights.size() - 1;
+}
+
+// updates a light from 'light', keeping its shadow
+void LightBuffer::set(int index, Light* light)
+{
+	int shadow = this->lights[index].shadow;
+
+	_setRecord(this->lights[index], light);
+	this->lights[index].shadow = shadow;
+
+	this->dirty = true;
+}
+
+// sets which of the shadow maps' cubes a light's
+// shadows are in (-1 for none)
+void LightBuffer::setShadow(int index, int shadow)
+{
+	this->lights[index].shadow = shadow;
+	this->dirty = true;
+}
+
+// drops every light from 'count' on
+void LightBuffer::truncate(int count)
+{
+	if(count < (int)this->lights.size())
+	{
+		this->lights.resize(count);
+		this->dirty = true;
+	}
+}
+
+void LightBuffer::clear()
+{
+	this->lights.clear();
+	this->dirty = true;
+}
+
+// writes the count and every record into the buffer
+void LightBuffer::upload()
+{
+	LightBufferHeader header;
+	memset(&header, 0, sizeof(LightBufferHeader));
+	header.count = (int)this->lights.size();
+
+	int bytes = (int)(this->lights.size() * sizeof(LightRecord));
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(LightBufferHeader) + bytes, NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(LightBufferHeader), &header);
+
+	if(bytes > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(LightBufferHeader), bytes, &(this->lights[0]));
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	this->dirty = false;
+}
+
+// binds the lights to LIGHT_RECORDS_BINDING, uploading
+// them first if any were added or changed since
+void LightBuffer::bind()
+{
+	if(this->dirty)
+		this->upload();
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_RECORDS_BINDING, this->buffer);
+}
+
+int LightBuffer::getCount()
+{
+	return (int)this->lights.size();
+}
+
+LightRecord& LightBuffer::getLight(int index)
+{
+	return this->lights[index];
+}
@@ -0,0 +1,53 @@
+#ifndef LIGHTBUFFER_HPP__
+#define LIGHTBUFFER_HPP__
+
+#include "Light.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// one point light as read by the shaders, laid out to
+// match the std430 LightRecords block in res/main.fs
+// and res/deferred.cs. A radius of 0 never fades.
+// 'shadow' is the light's cube in the shadow maps,
+// or -1 if it doesn't cast shadows
+struct LightRecord {
+
+	float pos[3];
+	float radius;
+	float diffuse[3];
+	int shadow;
+	float specular[4];
+};
+
+// point lights kept in a shader storage buffer, so there
+// can be any number of them. The count is stored in front of
+// the records, so shaders need no uniform to match it
+class LightBuffer {
+
+	private:
+		unsigned int buffer;
+		bool dirty;
+
+		vector<LightRecord> lights;
+
+		void upload();
+
+	public:
+		LightBuffer();
+		~LightBuffer();
+
+		int add(Light* light);
+		void set(int index, Light* light);
+		void setShadow(int index, int shadow);
+		void truncate(int count);
+		void clear();
+
+		void bind();
+
+		int getCount();
+		LightRecord& getLight(int index);
+};
+
+#endif
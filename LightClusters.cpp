@@ -0,0 +1,420 @@
+#include "LightClusters.hpp"
+#include "Parallel.hpp"
+#include "Simd.hpp"
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+
+using namespace chrono;
+
+// where padding lanes are put, so far away
+// they never touch a cluster
+#define CLUSTER_PAD_POSITION 1e18f
+
+// creates the cluster buffers for a 'width' by 'height'
+// view. Clusters are only usable after 'setProjection'
+LightClusters::LightClusters(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	this->znear = 0.0f;
+	this->zfar = 0.0f;
+
+	this->enabled = true;
+	this->assign_ms = 0.0;
+	this->max_lights = 0;
+
+	memset(&(this->header), 0, sizeof(ClusterHeader));
+
+	this->min_x.resize(CLUSTER_COUNT);
+	this->min_y.resize(CLUSTER_COUNT);
+	this->min_z.resize(CLUSTER_COUNT);
+	this->max_x.resize(CLUSTER_COUNT);
+	this->max_y.resize(CLUSTER_COUNT);
+	this->max_z.resize(CLUSTER_COUNT);
+
+	this->slices.resize(CLUSTER_SLICES);
+
+	glGenBuffers(1, &(this->cluster_buffer));
+	glGenBuffers(1, &(this->index_buffer));
+}
+
+LightClusters::~LightClusters()
+{
+	glDeleteBuffers(1, &(this->cluster_buffer));
+	glDeleteBuffers(1, &(this->index_buffer));
+}
+
+// works out every cluster's view space box for a perspective
+// 'projection' with the given near and far planes: the box
+// around the part of its tile's frustum between the depths
+// its slice starts and ends at
+void LightClusters::setProjection(const Mat4& projection, float znear, float zfar)
+{
+	Mat4 inv_projection = projection.inverse();
+
+	this->znear = znear;
+	this->zfar = zfar;
+
+	float log_ratio = logf(zfar / znear);
+
+	this->header.grid[0] = CLUSTER_TILES_X;
+	this->header.grid[1] = CLUSTER_TILES_Y;
+	this->header.grid[2] = CLUSTER_SLICES;
+	this->header.grid[3] = 0;
+
+	this->header.tile_width = (float)this->width / CLUSTER_TILES_X;
+	this->header.tile_height = (float)this->height / CLUSTER_TILES_Y;
+	this->header.slice_scale = CLUSTER_SLICES / log_ratio;
+	this->header.slice_bias = -CLUSTER_SLICES * logf(znear) / log_ratio;
+
+	int x, y, z, i;
+	for(z = 0; z < CLUSTER_SLICES; z ++)
+	{
+		float depths[2];
+		depths[0] = znear * powf(zfar / znear, (float)z / CLUSTER_SLICES);
+		depths[1] = znear * powf(zfar / znear, (float)(z + 1) / CLUSTER_SLICES);
+
+		for(y = 0; y < CLUSTER_TILES_Y; y ++)
+		{
+			for(x = 0; x < CLUSTER_TILES_X; x ++)
+			{
+				int cluster = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+
+				float ndc_x[2] = { (float)x / CLUSTER_TILES_X * 2.0f - 1.0f, (float)(x + 1) / CLUSTER_TILES_X * 2.0f - 1.0f };
+				float ndc_y[2] = { (float)y / CLUSTER_TILES_Y * 2.0f - 1.0f, (float)(y + 1) / CLUSTER_TILES_Y * 2.0f - 1.0f };
+
+				Vec3 lo(HUGE_VALF, HUGE_VALF, HUGE_VALF);
+				Vec3 hi(-HUGE_VALF, -HUGE_VALF, -HUGE_VALF);
+
+				// the tile's four corner rays, cut at both depths
+				for(i = 0; i < 8; i ++)
+				{
+					Vec3 far = inv_projection.projectPoint(Vec3(ndc_x[i & 1], ndc_y[(i >> 1) & 1], 1.0f));
+					Vec3 p = far * (depths[i >> 2] / -far.z);
+
+					lo = Vec3(min(lo.x, p.x), min(lo.y, p.y), min(lo.z, p.z));
+					hi = Vec3(max(hi.x, p.x), max(hi.y, p.y), max(hi.z, p.z));
+				}
+
+				this->min_x[cluster] = lo.x;
+				this->min_y[cluster] = lo.y;
+				this->min_z[cluster] = lo.z;
+				this->max_x[cluster] = hi.x;
+				this->max_y[cluster] = hi.y;
+				this->max_z[cluster] = hi.z;
+			}
+		}
+	}
+}
+
+// with clustering off, every fragment goes through every
+// light, as one cluster covering the whole view
+void LightClusters::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+}
+
+// lists the lights touching each cluster of one slice.
+// Only the lights reaching into the slice's depth range
+// are gathered, then each of its clusters is tested
+// against them 8 (AVX) or 4 (SSE) at a time
+void LightClusters::assignSlice(int slice)
+{
+	ClusterSlice& s = this->slices[slice];
+
+	s.x.clear();
+	s.y.clear();
+	s.z.clear();
+	s.radius.clear();
+	s.lights.clear();
+	s.indices.clear();
+	s.counts.assign(CLUSTERS_PER_SLICE, 0);
+
+	float slice_near = this->znear * powf(this->zfar / this->znear, (float)slice / CLUSTER_SLICES);
+	float slice_far = this->znear * powf(this->zfar / this->znear, (float)(slice + 1) / CLUSTER_SLICES);
+
+	int i;
+	for(i = 0; i < (int)this->view_x.size(); i ++)
+	{
+		float depth = -(this->view_z[i]);
+		float r = this->view_radius[i];
+
+		if(depth + r < slice_near || depth - r > slice_far)
+			continue;
+
+		s.x.push_back(this->view_x[i]);
+		s.y.push_back(this->view_y[i]);
+		s.z.push_back(this->view_z[i]);
+		s.radius.push_back(r);
+		s.lights.push_back(this->bounded[i]);
+	}
+
+	// padded so the SIMD loops never need a tail
+	while(s.x.size() % 8 != 0)
+	{
+		s.x.push_back(CLUSTER_PAD_POSITION);
+		s.y.push_back(CLUSTER_PAD_POSITION);
+		s.z.push_back(CLUSTER_PAD_POSITION);
+		s.radius.push_back(0.0f);
+		s.lights.push_back(-1);
+	}
+
+	int count = (int)s.x.size();
+	const float* lx = s.x.data();
+	const float* ly = s.y.data();
+	const float* lz = s.z.data();
+	const float* lr = s.radius.data();
+
+	int c;
+	for(c = 0; c < CLUSTERS_PER_SLICE; c ++)
+	{
+		int cluster = slice * CLUSTERS_PER_SLICE + c;
+		int start = (int)s.indices.size();
+
+		for(i = 0; i < (int)this->unbounded.size(); i ++)
+			s.indices.push_back(this->unbounded[i]);
+
+		i = 0;
+
+		// the squared distance from each light to the nearest
+		// point of the box, against the light's squared radius
+#if defined(__AVX__)
+		__m256 bx0 = _mm256_set1_ps(this->min_x[cluster]);
+		__m256 by0 = _mm256_set1_ps(this->min_y[cluster]);
+		__m256 bz0 = _mm256_set1_ps(this->min_z[cluster]);
+		__m256 bx1 = _mm256_set1_ps(this->max_x[cluster]);
+		__m256 by1 = _mm256_set1_ps(this->max_y[cluster]);
+		__m256 bz1 = _mm256_set1_ps(this->max_z[cluster]);
+		__m256 zero = _mm256_setzero_ps();
+
+		for(; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(lx + i);
+			__m256 y = _mm256_loadu_ps(ly + i);
+			__m256 z = _mm256_loadu_ps(lz + i);
+			__m256 r = _mm256_loadu_ps(lr + i);
+
+			__m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(bx0, x), _mm256_sub_ps(x, bx1)), zero);
+			__m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(by0, y), _mm256_sub_ps(y, by1)), zero);
+			__m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(bz0, z), _mm256_sub_ps(z, bz1)), zero);
+
+			__m256 d2 = _madd8(dx, dx, _madd8(dy, dy, _mm256_mul_ps(dz, dz)));
+
+			int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(r, r), _CMP_LE_OQ));
+			while(mask != 0)
+			{
+				s.indices.push_back(s.lights[i + __builtin_ctz(mask)]);
+				mask &= mask - 1;
+			}
+		}
+#elif defined(__SSE__)
+		__m128 bx0 = _mm_set1_ps(this->min_x[cluster]);
+		__m128 by0 = _mm_set1_ps(this->min_y[cluster]);
+		__m128 bz0 = _mm_set1_ps(this->min_z[cluster]);
+		__m128 bx1 = _mm_set1_ps(this->max_x[cluster]);
+		__m128 by1 = _mm_set1_ps(this->max_y[cluster]);
+		__m128 bz1 = _mm_set1_ps(this->max_z[cluster]);
+		__m128 zero = _mm_setzero_ps();
+
+		for(; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(lx + i);
+			__m128 y = _mm_loadu_ps(ly + i);
+			__m128 z = _mm_loadu_ps(lz + i);
+			__m128 r = _mm_loadu_ps(lr + i);
+
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(bx0, x), _mm_sub_ps(x, bx1)), zero);
+			__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(by0, y), _mm_sub_ps(y, by1)), zero);
+			__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(bz0, z), _mm_sub_ps(z, bz1)), zero);
+
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(r, r)));
+			while(mask != 0)
+			{
+				s.indices.push_back(s.lights[i + __builtin_ctz(mask)]);
+				mask &= mask - 1;
+			}
+		}
+#endif
+
+		// whatever's left over (everything, without SIMD)
+		for(; i < count; i ++)
+		{
+			float dx = max(max(this->min_x[cluster] - lx[i], lx[i] - this->max_x[cluster]), 0.0f);
+			float dy = max(max(this->min_y[cluster] - ly[i], ly[i] - this->max_y[cluster]), 0.0f);
+			float dz = max(max(this->min_z[cluster] - lz[i], lz[i] - this->max_z[cluster]), 0.0f);
+
+			if(dx * dx + dy * dy + dz * dz <= lr[i] * lr[i])
+				s.indices.push_back(s.lights[i]);
+		}
+
+		s.counts[c] = (int)s.indices.size() - start;
+	}
+}
+
+// puts every light in a single cluster, for when
+// clustering is off
+void LightClusters::assignAll(int count)
+{
+	this->records.assign(2, 0);
+	this->records[1] = (unsigned int)count;
+
+	this->indices.resize(count);
+
+	int i;
+	for(i = 0; i < count; i ++)
+		this->indices[i] = i;
+
+	this->max_lights = count;
+}
+
+// moves the lights into view space and lists the ones
+// touching each cluster, one slice per worker. The slices'
+// lists are then packed one after another in slice order
+void LightClusters::assign(LightBuffer* lights, const Mat4& view)
+{
+	time_point<steady_clock> start = steady_clock::now();
+
+	int count = lights->getCount();
+
+	this->view_x.clear();
+	this->view_y.clear();
+	this->view_z.clear();
+	this->view_radius.clear();
+	this->bounded.clear();
+	this->unbounded.clear();
+
+	if(!(this->enabled))
+		this->assignAll(count);
+	else
+	{
+		int i;
+		for(i = 0; i < count; i ++)
+		{
+			LightRecord& light = lights->getLight(i);
+
+			if(light.radius <= 0.0f)
+			{
+				this->unbounded.push_back(i);
+				continue;
+			}
+
+			Vec3 p = view.transformPoint(Vec3(light.pos[0], light.pos[1], light.pos[2]));
+
+			this->view_x.push_back(p.x);
+			this->view_y.push_back(p.y);
+			this->view_z.push_back(p.z);
+			this->view_radius.push_back(light.radius);
+			this->bounded.push_back(i);
+		}
+
+		parallelFor(CLUSTER_SLICES, [this](int first, int last)
+		{
+			int slice;
+			for(slice = first; slice < last; slice ++)
+				this->assignSlice(slice);
+		});
+
+		this->records.resize(2 * CLUSTER_COUNT);
+		this->indices.clear();
+		this->max_lights = 0;
+
+		int slice, c;
+		for(slice = 0; slice < CLUSTER_SLICES; slice ++)
+		{
+			ClusterSlice& s = this->slices[slice];
+			int offset = (int)this->indices.size();
+
+			for(c = 0; c < CLUSTERS_PER_SLICE; c ++)
+			{
+				int cluster = slice * CLUSTERS_PER_SLICE + c;
+
+				this->records[cluster * 2] = (unsigned int)offset;
+				this->records[cluster * 2 + 1] = (unsigned int)s.counts[c];
+
+				offset += s.counts[c];
+				this->max_lights = max(this->max_lights, s.counts[c]);
+			}
+
+			this->indices.insert(this->indices.end(), s.indices.begin(), s.indices.end());
+		}
+	}
+
+	this->upload();
+
+	duration<double, milli> elapsed = steady_clock::now() - start;
+	this->assign_ms = elapsed.count();
+}
+
+// replaces both buffers' contents, orphaning the old
+// storage so a frame still reading it isn't waited on
+void LightClusters::upload()
+{
+	ClusterHeader grid = this->header;
+
+	// a single cluster, the size of the whole view
+	if(!(this->enabled))
+	{
+		grid.grid[0] = grid.grid[1] = grid.grid[2] = 1;
+		grid.tile_width = (float)this->width;
+		grid.tile_height = (float)this->height;
+		grid.slice_scale = 0.0f;
+		grid.slice_bias = 0.0f;
+	}
+
+	int record_bytes = (int)(this->records.size() * sizeof(unsigned int));
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->cluster_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ClusterHeader) + record_bytes, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(ClusterHeader), &grid);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(ClusterHeader), record_bytes, this->records.data());
+
+	// an empty buffer can't be bound
+	int index_count = max((int)this->indices.size(), 1);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->index_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, index_count * sizeof(int), NULL, GL_STREAM_DRAW);
+
+	if(!(this->indices.empty()))
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->indices.size() * sizeof(int), this->indices.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// binds the cluster records and light index lists for
+// the shaders, at their fixed bindings
+void LightClusters::bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_RECORDS_BINDING, this->cluster_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDICES_BINDING, this->index_buffer);
+}
+
+bool LightClusters::isEnabled()
+{
+	return this->enabled;
+}
+
+// how long the last 'assign' took on the CPU
+double LightClusters::getAssignTime()
+{
+	return this->assign_ms;
+}
+
+// the light indices in all the lists together
+int LightClusters::getIndexCount()
+{
+	return (int)this->indices.size();
+}
+
+// the most lights in any one cluster
+int LightClusters::getMaxLights()
+{
+	return this->max_lights;
+}
@@ -0,0 +1,114 @@
+#ifndef LIGHTCLUSTERS_HPP__
+#define LIGHTCLUSTERS_HPP__
+
+#include "LightBuffer.hpp"
+#include "VectorMath.hpp"
+
+#include <vector>
+
+// the view frustum is split into this many screen tiles
+// across and down, and this many slices in depth, spaced
+// exponentially so near clusters aren't stretched thin
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 12
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+#define CLUSTERS_PER_SLICE (CLUSTER_TILES_X * CLUSTER_TILES_Y)
+
+using namespace std;
+
+// what res/main.fs needs to find a fragment's cluster,
+// in front of the (offset, count) pairs in the cluster
+// buffer. Must match the ClusterRecords block
+struct ClusterHeader {
+
+	int grid[4];
+
+	float tile_width;
+	float tile_height;
+	float slice_scale;
+	float slice_bias;
+};
+
+// one worker's scratch for one depth slice: the lights
+// that reach into it, in view space (structure of arrays,
+// padded to a multiple of 8), and what it assigned
+struct ClusterSlice {
+
+	vector<float> x;
+	vector<float> y;
+	vector<float> z;
+	vector<float> radius;
+	vector<int> lights;
+
+	vector<int> counts;
+	vector<int> indices;
+};
+
+// divides the view frustum into a grid of clusters and
+// lists, for each, the lights whose sphere touches its
+// view space box. The slices are assigned on worker
+// threads, each testing a cluster against 4 or 8 lights
+// at a time with SSE/AVX. The lists are packed into one
+// buffer of light indices, with each cluster's offset and
+// count in another, so a fragment only goes through the
+// lights of its own cluster. Lights without a radius are
+// in every cluster
+class LightClusters {
+
+	private:
+		int width;
+		int height;
+		float znear;
+		float zfar;
+
+		// every cluster's view space box, in cluster order
+		vector<float> min_x;
+		vector<float> min_y;
+		vector<float> min_z;
+		vector<float> max_x;
+		vector<float> max_y;
+		vector<float> max_z;
+
+		vector<float> view_x;
+		vector<float> view_y;
+		vector<float> view_z;
+		vector<float> view_radius;
+		vector<int> bounded;
+		vector<int> unbounded;
+
+		vector<ClusterSlice> slices;
+
+		ClusterHeader header;
+		vector<unsigned int> records;
+		vector<int> indices;
+
+		unsigned int cluster_buffer;
+		unsigned int index_buffer;
+
+		bool enabled;
+		double assign_ms;
+		int max_lights;
+
+		void assignSlice(int slice);
+		void assignAll(int count);
+		void upload();
+
+	public:
+		LightClusters(int width, int height);
+		~LightClusters();
+
+		void setProjection(const Mat4& projection, float znear, float zfar);
+		void setEnabled(bool enabled);
+
+		void assign(LightBuffer* lights, const Mat4& view);
+		void bind();
+
+		bool isEnabled();
+		double getAssignTime();
+		int getIndexCount();
+		int getMaxLights();
+};
+
+#endif
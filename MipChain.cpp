@@ -0,0 +1,365 @@
+#include "MipChain.hpp"
+#include "Parallel.hpp"
+
+#include <thread>
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#define KAISER_RADIUS 3.0f
+#define KAISER_ALPHA 4.0f
+#define LINEAR_STEPS 4096
+
+// conversion tables between 8-bit sRGB and linear
+// values. Filtering is done on linear values so
+// mips don't darken the way they do when sRGB
+// texels are averaged directly
+struct ColorTables {
+
+	float to_linear[256];
+	unsigned char to_srgb[LINEAR_STEPS];
+
+	ColorTables()
+	{
+		int i;
+		for(i = 0; i < 256; i ++)
+		{
+			float c = (float)i / 255.0f;
+			to_linear[i] = (c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f));
+		}
+
+		for(i = 0; i < LINEAR_STEPS; i ++)
+		{
+			float l = (float)i / (float)(LINEAR_STEPS - 1);
+			float c = (l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f);
+
+			to_srgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+		}
+	}
+};
+
+static const ColorTables& _tables()
+{
+	static ColorTables tables;
+	return tables;
+}
+
+// filter weights for every destination texel along
+// one axis. Each texel uses the same number of taps,
+// with source indices already wrapped or clamped
+struct Kernel {
+
+	int taps;
+	vector<int> index;
+	vector<float> weight;
+};
+
+// zeroth order modified Bessel function of the
+// first kind, used by the Kaiser window
+static float _besselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+
+	int k;
+	for(k = 1; k < 16; k ++)
+	{
+		term *= (x / (2.0f * (float)k)) * (x / (2.0f * (float)k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Kaiser windowed sinc, 't' in destination texels
+static float _kaiser(float t)
+{
+	if(fabsf(t) >= KAISER_RADIUS)
+		return 0.0f;
+
+	float sinc = (t == 0.0f ? 1.0f : sinf((float)M_PI * t) / ((float)M_PI * t));
+	float r = t / KAISER_RADIUS;
+
+	return sinc * _besselI0(KAISER_ALPHA * sqrtf(1.0f - r * r)) / _besselI0(KAISER_ALPHA);
+}
+
+// builds the weights for resampling 'src' texels down
+// to 'dest' texels. Works for odd sizes too, where a
+// plain 2x2 average would drop the last row or column
+static void _buildKernel(Kernel& kernel, int src, int dest, int filter, bool wrap)
+{
+	float scale = (float)src / (float)dest;
+	float radius = (filter == MIP_FILTER_BOX ? 0.5f : KAISER_RADIUS) * scale;
+
+	kernel.taps = (int)ceilf(2.0f * radius) + 1;
+	kernel.index.assign(dest * kernel.taps, 0);
+	kernel.weight.assign(dest * kernel.taps, 0.0f);
+
+	int x, j;
+	for(x = 0; x < dest; x ++)
+	{
+		float center = ((float)x + 0.5f) * scale;
+		int first = (int)floorf(center - radius);
+		float total = 0.0f;
+
+		for(j = 0; j < kernel.taps; j ++)
+		{
+			int i = first + j;
+			float w;
+
+			if(filter == MIP_FILTER_BOX)
+			{
+				float lo = fmaxf((float)i, center - radius);
+				float hi = fminf((float)(i + 1), center + radius);
+
+				w = fmaxf(hi - lo, 0.0f);
+			}
+			else
+				w = _kaiser(((float)i + 0.5f - center) / scale);
+
+			if(wrap)
+				i = ((i % src) + src) % src;
+			else
+				i = (i < 0 ? 0 : (i >= src ? src - 1 : i));
+
+			kernel.index[x * kernel.taps + j] = i;
+			kernel.weight[x * kernel.taps + j] = w;
+
+			total += w;
+		}
+
+		for(j = 0; j < kernel.taps; j ++)
+			kernel.weight[x * kernel.taps + j] /= total;
+	}
+}
+
+// acc += src * w over 'n' floats ('n' is always a
+// multiple of four, since rows are RGBA texels)
+static void _accumulateRow(float* acc, const float* src, float w, int n)
+{
+	int i = 0;
+
+#ifdef __AVX__
+	__m256 w8 = _mm256_set1_ps(w);
+	for(; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), w8)));
+#endif
+
+#ifdef __SSE__
+	__m128 w4 = _mm_set1_ps(w);
+	for(; i < n; i += 4)
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(src + i), w4)));
+#else
+	for(; i < n; i ++)
+		acc[i] += src[i] * w;
+#endif
+}
+
+// horizontally resamples one linear RGBA row,
+// one texel (four floats) per SIMD register
+static void _filterRow(float* dest, const float* src, const Kernel& kernel, int width)
+{
+	int x, j;
+	for(x = 0; x < width; x ++)
+	{
+		const int* index = &kernel.index[x * kernel.taps];
+		const float* weight = &kernel.weight[x * kernel.taps];
+
+#ifdef __SSE__
+		__m128 acc = _mm_setzero_ps();
+		for(j = 0; j < kernel.taps; j ++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src + index[j] * 4), _mm_set1_ps(weight[j])));
+
+		_mm_storeu_ps(dest + x * 4, acc);
+#else
+		float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		for(j = 0; j < kernel.taps; j ++)
+		{
+			acc[0] += src[index[j] * 4] * weight[j];
+			acc[1] += src[index[j] * 4 + 1] * weight[j];
+			acc[2] += src[index[j] * 4 + 2] * weight[j];
+			acc[3] += src[index[j] * 4 + 3] * weight[j];
+		}
+		memcpy(dest + x * 4, acc, sizeof(acc));
+#endif
+	}
+}
+
+// converts a row of linear RGBA floats back to 8-bit
+// sRGB (alpha stays linear), clamping any overshoot
+// from the Kaiser filter's negative lobes
+static void _encodeRow(unsigned char* dest, const float* src, int width)
+{
+	const ColorTables& tables = _tables();
+
+	int x, c;
+	for(x = 0; x < width; x ++)
+	{
+		for(c = 0; c < 4; c ++)
+		{
+			float v = src[x * 4 + c];
+			v = (v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v));
+
+			if(c == 3)
+				dest[x * 4 + c] = (unsigned char)(v * 255.0f + 0.5f);
+			else
+				dest[x * 4 + c] = tables.to_srgb[(int)(v * (float)(LINEAR_STEPS - 1) + 0.5f)];
+		}
+	}
+}
+
+// generates a full mip chain for one or more faces
+// (six for cube maps) of the same size. Level 0 of
+// each face points at the caller's image, which must
+// outlive the MipChain. Every level is filtered in
+// linear space from the previous one: rows are
+// resampled vertically with SIMD across the whole
+// row, then horizontally one texel per register,
+// with the rows of all faces split between threads.
+// 'wrap' picks repeat or clamp addressing at edges
+MipChain::MipChain(unsigned char** images, int num_faces, int width, int height, int filter, bool wrap)
+	: MipChain(images, num_faces, width, height, filter, wrap, (int)thread::hardware_concurrency())
+{
+}
+
+// same as above, splitting the rows between at most
+// 'workers' threads. A background loader passes 1 so
+// it doesn't tie up the worker pool the frame uses
+MipChain::MipChain(unsigned char** images, int num_faces, int width, int height, int filter, bool wrap, int workers)
+{
+	const ColorTables& tables = _tables();
+
+	int largest = (width > height ? width : height);
+
+	this->num_levels = 1;
+	while((largest >> this->num_levels) > 0)
+		this->num_levels ++;
+
+	this->faces.resize(num_faces);
+
+	vector<float*> linear(num_faces, (float*)NULL);
+
+	int f;
+	for(f = 0; f < num_faces; f ++)
+	{
+		MipLevel base = {.width=width, .height=height, .data=images[f]};
+		this->faces[f].push_back(base);
+	}
+
+	int level;
+	for(level = 1; level < this->num_levels; level ++)
+	{
+		int sw = this->faces[0][level - 1].width;
+		int sh = this->faces[0][level - 1].height;
+		int dw = (sw > 1 ? sw / 2 : 1);
+		int dh = (sh > 1 ? sh / 2 : 1);
+
+		Kernel horizontal, vertical;
+		_buildKernel(horizontal, sw, dw, filter, wrap);
+		_buildKernel(vertical, sh, dh, filter, wrap);
+
+		vector<float*> next(num_faces, (float*)NULL);
+
+		for(f = 0; f < num_faces; f ++)
+		{
+			next[f] = (float*)malloc(dw * dh * 4 * sizeof(float));
+
+			MipLevel mip = {.width=dw, .height=dh, .data=(unsigned char*)malloc(dw * dh * 4)};
+			this->faces[f].push_back(mip);
+		}
+
+		parallelFor(num_faces * dh, workers, [&](int begin, int end)
+		{
+			float* column = (float*)malloc(sw * 4 * sizeof(float));
+			float* source = (float*)malloc(sw * 4 * sizeof(float));
+
+			int job, j, i;
+			for(job = begin; job < end; job ++)
+			{
+				int face = job / dh;
+				int y = job % dh;
+
+				memset(column, 0, sw * 4 * sizeof(float));
+
+				for(j = 0; j < vertical.taps; j ++)
+				{
+					int row = vertical.index[y * vertical.taps + j];
+					float w = vertical.weight[y * vertical.taps + j];
+
+					if(w == 0.0f)
+						continue;
+
+					const float* src;
+					if(linear[face] != NULL)
+						src = linear[face] + row * sw * 4;
+					else
+					{
+						const unsigned char* texels = this->faces[face][0].data + row * sw * 4;
+						for(i = 0; i < sw * 4; i += 4)
+						{
+							source[i] = tables.to_linear[texels[i]];
+							source[i + 1] = tables.to_linear[texels[i + 1]];
+							source[i + 2] = tables.to_linear[texels[i + 2]];
+							source[i + 3] = (float)texels[i + 3] / 255.0f;
+						}
+						src = source;
+					}
+					_accumulateRow(column, src, w, sw * 4);
+				}
+
+				float* dest = next[face] + y * dw * 4;
+
+				_filterRow(dest, column, horizontal, dw);
+				_encodeRow(this->faces[face][level].data + y * dw * 4, dest, dw);
+			}
+
+			free(column);
+			free(source);
+		});
+
+		for(f = 0; f < num_faces; f ++)
+		{
+			free(linear[f]);
+			linear[f] = next[f];
+		}
+	}
+
+	for(f = 0; f < num_faces; f ++)
+		free(linear[f]);
+}
+
+// frees every generated level (level 0 of
+// each face belongs to the caller)
+MipChain::~MipChain()
+{
+	size_t f, level;
+	for(f = 0; f < this->faces.size(); f ++)
+	{
+		for(level = 1; level < this->faces[f].size(); level ++)
+			free(this->faces[f][level].data);
+	}
+}
+
+// returns a mip level of a face, level 0
+// being the original image
+MipLevel* MipChain::getLevel(int face, int level)
+{
+	return &(this->faces[face][level]);
+}
+
+int MipChain::getNumLevels()
+{
+	return this->num_levels;
+}
+
+int MipChain::getNumFaces()
+{
+	return (int)this->faces.size();
+}
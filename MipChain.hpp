@@ -0,0 +1,37 @@
+#ifndef MIPCHAIN_HPP__
+#define MIPCHAIN_HPP__
+
+#include <vector>
+
+#define MIP_FILTER_BOX 0
+#define MIP_FILTER_KAISER 1
+
+using namespace std;
+
+// a single mip level of one face, as
+// tightly packed 8-bit sRGB RGBA texels
+struct MipLevel {
+
+	int width;
+	int height;
+	unsigned char* data;
+};
+
+class MipChain {
+
+	private:
+		vector<vector<MipLevel> > faces;
+		int num_levels;
+
+	public:
+		MipChain(unsigned char** images, int num_faces, int width, int height, int filter, bool wrap);
+		MipChain(unsigned char** images, int num_faces, int width, int height, int filter, bool wrap, int workers);
+		~MipChain();
+
+		MipLevel* getLevel(int face, int level);
+
+		int getNumLevels();
+		int getNumFaces();
+};
+
+#endif
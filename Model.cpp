@@ -1,6 +1,5 @@
 #include "Model.hpp"
 
-#include <SOIL/SOIL.h>
 #include <GL/glew.h>
 
 #include <cstring>
@@ -10,20 +9,6 @@
 
 #include <iostream>
 
-// used to keep individual values for each
-// vertex neatly packed and organized
-struct Vertex {
-
-	float x;
-	float y;
-	float z;
-	float u;
-	float v;
-	float nx;
-	float ny;
-	float nz;
-};
-
 // sets the number each type of value found
 // in the OBJ file to their respectve pointers
 // (I.E., 'vcount' stores the number of vertices)
@@ -59,7 +44,7 @@ static void _getComponentAmounts(const char* filename, int* vcount, int* tcount,
 }
 
 // loads values from an OBJ file to an array of vertices
-static struct Vertex* _loadOBJ(const char* objfile, float scale, int* amount)
+static struct MeshVertex* _loadOBJ(const char* objfile, float scale, int* amount)
 {
 	struct Point3f {
 
@@ -77,7 +62,7 @@ static struct Vertex* _loadOBJ(const char* objfile, float scale, int* amount)
 	int vsize, tsize, nsize, isize;
 	_getComponentAmounts(objfile, &vsize, &tsize, &nsize, &isize);
 
-	Vertex* vertices = (struct Vertex*)calloc(isize, sizeof(struct Vertex));
+	MeshVertex* vertices = (struct MeshVertex*)calloc(isize, sizeof(struct MeshVertex));
 	Point3f* verts = (struct Point3f*)calloc(vsize, sizeof(struct Point3f));
 	Coord2f* texs = (struct Coord2f*)calloc(tsize, sizeof(struct Coord2f));
 	Point3f* norms = (struct Point3f*)calloc(nsize, sizeof(struct Point3f));
@@ -186,7 +171,7 @@ static struct Vertex* _loadOBJ(const char* objfile, float scale, int* amount)
 		_n.y *= scale;
 		_n.z *= scale;
 
-		Vertex _vertex = {.x=_v.x, .y=_v.y, .z=_v.z, .u=_t.u, .v=1.0f-(_t.v), .nx=_n.x, .ny=_n.y, .nz=_n.z};
+		MeshVertex _vertex = {.x=_v.x, .y=_v.y, .z=_v.z, .u=_t.u, .v=1.0f-(_t.v), .nx=_n.x, .ny=_n.y, .nz=_n.z};
 		vertices[nverts ++] = _vertex;
 	}
 	*amount = nverts;
@@ -202,38 +187,26 @@ static struct Vertex* _loadOBJ(const char* objfile, float scale, int* amount)
 	return vertices;
 }
 
-Model::Model(string objfile, string texfile, float scale)
+// loads an OBJ file into the shared GeometryBuffer and
+// loads the model's texture through the TextureManager
+// (which streams it in over the next few frames)
+Model::Model(string objfile, string texfile, float scale, TextureManager* textures, GeometryBuffer* geometry)
 {
+	this->textures = textures;
+	this->geometry = geometry;
 	this->theta = 0.0f;
 	this->phi = 0.0f;
 	this->x = 0.0f;
 	this->y = 0.0f;
 	this->z = 0.0f;
 
-	glGenTextures(1, &(this->tex));
-	glBindTexture(GL_TEXTURE_2D, this->tex);
-
-	unsigned char* image;
-	int tex_width, tex_height;
-
-	image = SOIL_load_image(texfile.c_str(), &tex_width, &tex_height, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex_width, tex_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	SOIL_free_image_data(image);
-
-	glGenerateMipmapEXT(GL_TEXTURE_2D);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	this->tex = textures->load(texfile);
 
-	struct Vertex* vertices;
-	vertices = _loadOBJ(objfile.c_str(), scale, &(this->draw));
+	int amount;
+	struct MeshVertex* vertices;
+	vertices = _loadOBJ(objfile.c_str(), scale, &amount);
 
-	glGenBuffers(1, &(this->vbo));
-	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-	glBufferData(GL_ARRAY_BUFFER, (this->draw) * sizeof(Vertex), vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	this->mesh = geometry->addMesh(vertices, amount);
 
 	free(vertices);
 
@@ -242,14 +215,17 @@ Model::Model(string objfile, string texfile, float scale)
 
 	this->cloned = false;
 	this->uuid = NONE;
+	this->vtex = NULL;
 }
 
 Model::Model(const Model& source)
 {
-	this->vbo = source.vbo;
+	this->mesh = source.mesh;
 	this->tex = source.tex;
+	this->vtex = source.vtex;
+	this->textures = source.textures;
+	this->geometry = source.geometry;
 	
-	this->draw = source.draw;
 	this->uuid = source.uuid;
 		
 	this->theta = source.theta;
@@ -259,22 +235,22 @@ Model::Model(const Model& source)
 	this->y = source.y;
 	this->z = source.z;
 
+	this->transform = source.transform;
 	this->cloned = true;
 }
 
 Model::~Model()
 {
 	if(!(this->cloned))
-	{
-		glDeleteBuffers(1, &(this->vbo));
-		glDeleteTextures(1, &(this->tex));
-	}
+		this->textures->release(this->tex);
 }
 
 void Model::rotateTo(float theta, float phi)
 {
 	this->theta = theta;
 	this->phi = phi;
+
+	this->updateTransform();
 }
 
 void Model::moveTo(float x, float y, float z)
@@ -282,6 +258,57 @@ void Model::moveTo(float x, float y, float z)
 	this->x = x;
 	this->y = y;
 	this->z = z;
+
+	this->updateTransform();
+}
+
+// rebuilds the model matrix from the position and
+// rotation: a turn of 'theta' about the Y-axis, then
+// a tilt of 'phi' about the horizontal axis 'theta'
+// faces along. Only done when the model moves, not
+// every time it's drawn
+void Model::updateTransform()
+{
+	float rad = (this->theta * M_PI) / 180.0;
+
+	Quat turn = Quat::axisAngle(this->theta, Vec3(0.0f, 1.0f, 0.0f));
+	Quat tilt = Quat::axisAngle(-(this->phi), Vec3(cos(rad), 0.0f, sin(rad)));
+
+	this->transform = Mat4::translate(this->x, this->y, this->z) * Mat4::fromQuat(turn * tilt);
+}
+
+// binds the model's 2D texture to the active texture unit
+void Model::bindTexture()
+{
+	this->textures->bind(this->tex);
+}
+
+int Model::getTexture()
+{
+	return this->tex;
+}
+
+int Model::getMesh()
+{
+	return this->mesh;
+}
+
+VirtualTexture* Model::getVirtualTexture()
+{
+	return this->vtex;
+}
+
+// returns the model matrix
+const Mat4& Model::getTransform()
+{
+	return this->transform;
+}
+
+// makes the model sample a virtual texture (streamed
+// through a TileCache) instead of its own 2D texture
+void Model::setVirtualTexture(VirtualTexture* vtex)
+{
+	this->vtex = vtex;
 }
 
 void Model::setUUID(int uuid)
@@ -321,64 +348,65 @@ int Model::getUUID()
 		
 void Model::render(Shader* shader)
 {
-	glPushMatrix();
-	glTranslatef(this->x, this->y, this->z);
+	shader->setDrawMode(DRAW_MODE_SINGLE);
+	shader->setModelMatrix(this->transform);
+	shader->setVirtualTexture(this->vtex);
 
-	float rad = (this->theta * M_PI) / 180.0;
+	this->geometry->bind();
+	this->textures->bind(this->tex);
 
-	glRotatef(this->theta, 0.0f, 1.0f, 0.0f);
-	glRotatef(-(this->phi), cos(rad), 0.0f, sin(rad));
+	MeshRange* range = this->geometry->getMesh(this->mesh);
+	shader->flush();
 
-	shader->setModelViewMatrix();
+	glDrawElementsBaseVertex(GL_TRIANGLES, range->index_count, GL_UNSIGNED_INT,
+							 (void*)(range->first_index * sizeof(unsigned int)), range->base_vertex);
 
-	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-	glBindTexture(GL_TEXTURE_2D, this->tex);
+	this->geometry->unbind();
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// renders one copy of the model per instance in
+// 'instances' with a single draw call. The model's
+// own position and rotation are ignored
+void Model::renderInstanced(Shader* shader, InstanceBuffer* instances)
+{
+	if(instances->getCount() == 0)
+		return;
+
+	shader->setDrawMode(DRAW_MODE_INSTANCED);
+	shader->setVirtualTexture(this->vtex);
 
-	glEnableVertexAttribArray(NORMAL_ATTR);
-	glEnableVertexAttribArray(POSITION_ATTR);
-	glEnableVertexAttribArray(TEXCOORD_2D_ATTR);
-	glDisableVertexAttribArray(TEXCOORD_CUBE_ATTR);
+	this->textures->bind(this->tex);
+	instances->bind(this->geometry);
 
-	glVertexAttribPointer(POSITION_ATTR, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), NULL);
-	glVertexAttribPointer(TEXCOORD_2D_ATTR, 2, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)offsetof(Vertex, u));
-	glVertexAttribPointer(NORMAL_ATTR, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)offsetof(Vertex, nx));
+	MeshRange* range = this->geometry->getMesh(this->mesh);
+	shader->flush();
 
-	glDrawArrays(GL_TRIANGLES, 0, this->draw);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range->index_count, GL_UNSIGNED_INT,
+									  (void*)(range->first_index * sizeof(unsigned int)),
+									  instances->getCount(), range->base_vertex);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	instances->unbind();
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	glPopMatrix();
+	shader->setDrawMode(DRAW_MODE_SINGLE);
 }
 
 void Model::select(Shader* shader)
 {
 	if(this->uuid == NONE) return;
 
-	shader->setUniformi("uuid", this->uuid);
-
-	glPushMatrix();
-	glTranslatef(this->x, this->y, this->z);
-
-	float rad = (this->theta * M_PI) / 180.0;
-
-	glRotatef(this->theta, 0.0f, 1.0f, 0.0f);
-	glRotatef(-(this->phi), cos(rad), 0.0f, sin(rad));
-
-	shader->setModelViewMatrix();
-
-	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+	shader->setUniformi(UNIFORM_ID(UUID_STR), this->uuid);
 
-	glDisableVertexAttribArray(NORMAL_ATTR);
-	glEnableVertexAttribArray(POSITION_ATTR);
-	glDisableVertexAttribArray(TEXCOORD_2D_ATTR);
-	glDisableVertexAttribArray(TEXCOORD_CUBE_ATTR);
+	shader->setModelMatrix(this->transform);
 
-	glVertexAttribPointer(POSITION_ATTR, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), NULL);
+	this->geometry->bind();
 
-	glDrawArrays(GL_TRIANGLES, 0, this->draw);
+	MeshRange* range = this->geometry->getMesh(this->mesh);
+	shader->flush();
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawElementsBaseVertex(GL_TRIANGLES, range->index_count, GL_UNSIGNED_INT,
+							 (void*)(range->first_index * sizeof(unsigned int)), range->base_vertex);
 
-	glPopMatrix();
+	this->geometry->unbind();
 }
@@ -1,6 +1,10 @@
 #ifndef MODEL_HPP__
 #define MODEL_HPP__
 
+#include "GeometryBuffer.hpp"
+#include "InstanceBuffer.hpp"
+#include "TextureManager.hpp"
+#include "VectorMath.hpp"
 #include "Shader.hpp"
 
 #include <string>
@@ -12,11 +16,14 @@ using namespace std;
 class Model {
 
 	private:
-		unsigned int vbo;
-		unsigned int tex;
+		int mesh;
+		int tex;
+
+		VirtualTexture* vtex;
+		TextureManager* textures;
+		GeometryBuffer* geometry;
 
 		bool cloned;
-		int draw;
 		int uuid;
 
 		float theta;
@@ -25,21 +32,34 @@ class Model {
 		float y;
 		float z;
 
+		Mat4 transform;
+
+		void updateTransform();
+
 	public:
-		Model(string objfile, string texfile, float scale);
+		Model(string objfile, string texfile, float scale, TextureManager* textures, GeometryBuffer* geometry);
 		Model(const Model& source);
 		~Model();
 
 		Model* clone() const { return new Model(*this); }
 
+		void setVirtualTexture(VirtualTexture* vtex);
 		void setUUID(int uuid);
 		int getUUID();
 
 		void rotateTo(float theta, float phi);
 		void moveTo(float x, float y, float z);		
 		void render(Shader* shader);
+		void renderInstanced(Shader* shader, InstanceBuffer* instances);
 		void select(Shader* shader);
 
+		void bindTexture();
+		int getTexture();
+		int getMesh();
+		VirtualTexture* getVirtualTexture();
+
+		const Mat4& getTransform();
+
 		float getTheta();
 		float getPhi();
 		float getX();
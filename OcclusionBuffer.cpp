@@ -0,0 +1,582 @@
+#include "OcclusionBuffer.hpp"
+#include "Parallel.hpp"
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace chrono;
+
+OcclusionBuffer::OcclusionBuffer()
+{
+	this->depth = new float[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+	fill(this->depth, this->depth + OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+
+	this->view_projection = Mat4::identity();
+
+	this->occluded_count = 0;
+	this->raster_ms = 0.0;
+	this->test_ms = 0.0;
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+	delete[] this->depth;
+}
+
+// adds a world space occluder mesh: 'count' vertices
+// forming a triangle list, placed with 'transform'
+void OcclusionBuffer::addOccluder(const Vec3* vertices, int count, const Mat4& transform)
+{
+	int i;
+	for(i = 0; i + 2 < count; i += 3)
+	{
+		this->occluders.push_back(transform.transformPoint(vertices[i]));
+		this->occluders.push_back(transform.transformPoint(vertices[i + 1]));
+		this->occluders.push_back(transform.transformPoint(vertices[i + 2]));
+		this->shared_edges.push_back(0);
+	}
+}
+
+// adds the quad through the middle of a thin box (such as
+// a wall's mesh bounds), across its two widest sides. It
+// sits inside whatever the box holds, so it never hides
+// more than the real mesh would
+void OcclusionBuffer::addQuad(const AABB& box, const Mat4& transform)
+{
+	Vec3 u, v;
+	const Vec3& e = box.extents;
+
+	if(e.x <= e.y && e.x <= e.z)
+	{
+		u = Vec3(0.0f, e.y, 0.0f);
+		v = Vec3(0.0f, 0.0f, e.z);
+	}
+	else if(e.y <= e.z)
+	{
+		u = Vec3(e.x, 0.0f, 0.0f);
+		v = Vec3(0.0f, 0.0f, e.z);
+	}
+	else
+	{
+		u = Vec3(e.x, 0.0f, 0.0f);
+		v = Vec3(0.0f, e.y, 0.0f);
+	}
+
+	Vec3 quad[6] = {
+		box.center - u - v, box.center + u - v, box.center + u + v,
+		box.center - u - v, box.center + u + v, box.center - u + v
+	};
+
+	this->addOccluder(quad, 6, transform);
+
+	// the diagonal (edge 2 of the first triangle, edge 0
+	// of the second) lies inside the quad, so pixels across
+	// it are covered even though neither half covers them
+	int last = (int)this->shared_edges.size() - 1;
+	this->shared_edges[last - 1] = 4;
+	this->shared_edges[last] = 1;
+}
+
+void OcclusionBuffer::clearOccluders()
+{
+	this->occluders.clear();
+	this->shared_edges.clear();
+}
+
+// projects a clip space triangle (x, y, z, w each, all in
+// front of the near plane) onto the buffer and sets up its
+// edges and depth plane, then adds it to the bin of every
+// tile its bounds touch. Either winding is kept, as both
+// sides of a wall hide what's behind it.
+// Rasterizing is conservative: edges are moved in by half
+// a pixel, so only pixels the triangle covers entirely are
+// drawn, and the depth plane is moved back by half a pixel's
+// slope, so each pixel gets the triangle's farthest depth
+// over it. Edges set in 'shared' (bit i for edge i) lie
+// inside a flat polygon the triangle is part of and are
+// left where they are, so the pixels along them are still
+// drawn by one side or the other
+void OcclusionBuffer::setupTriangle(const float* a, const float* b, const float* c, int shared)
+{
+	const float* clip[3] = {a, b, c};
+	float x[3], y[3], z[3];
+
+	int i;
+	for(i = 0; i < 3; i ++)
+	{
+		float inv_w = 1.0f / clip[i][3];
+
+		x[i] = (clip[i][0] * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		y[i] = (clip[i][1] * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+		z[i] = clip[i][2] * inv_w * 0.5f + 0.5f;
+	}
+
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+	// edge on, nothing to hide
+	if(fabsf(area) < 1e-6f)
+		return;
+
+	if(area < 0.0f)
+	{
+		swap(x[1], x[2]);
+		swap(y[1], y[2]);
+		swap(z[1], z[2]);
+		area = -area;
+
+		// edges 0 and 2 trade places
+		shared = (shared & 2) | ((shared & 1) << 2) | ((shared & 4) >> 2);
+	}
+
+	// pixel centers (i + 0.5) inside the bounds, clamped
+	// to the buffer before they're turned into ints
+	float lo_x = max(min(min(x[0], x[1]), x[2]) - 0.5f, 0.0f);
+	float lo_y = max(min(min(y[0], y[1]), y[2]) - 0.5f, 0.0f);
+	float hi_x = min(max(max(x[0], x[1]), x[2]) - 0.5f, (float)(OCCLUSION_WIDTH - 1));
+	float hi_y = min(max(max(y[0], y[1]), y[2]) - 0.5f, (float)(OCCLUSION_HEIGHT - 1));
+
+	RasterTriangle t;
+	t.min_x = (int)ceilf(lo_x);
+	t.min_y = (int)ceilf(lo_y);
+	t.max_x = (int)floorf(hi_x);
+	t.max_y = (int)floorf(hi_y);
+
+	if(t.min_x > t.max_x || t.min_y > t.max_y)
+		return;
+
+	// edge i runs from vertex i to the next, positive
+	// on the side the third vertex is on
+	for(i = 0; i < 3; i ++)
+	{
+		int j = (i + 1) % 3;
+
+		t.edges[i][0] = y[i] - y[j];
+		t.edges[i][1] = x[j] - x[i];
+		t.edges[i][2] = -(t.edges[i][0] * x[i] + t.edges[i][1] * y[i]);
+
+		// at a pixel's center, an edge is at least this far
+		// from its value anywhere else in the pixel
+		if(!(shared & (1 << i)))
+			t.edges[i][2] -= 0.5f * (fabsf(t.edges[i][0]) + fabsf(t.edges[i][1]));
+	}
+
+	float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+
+	t.depth[0] = dzdx;
+	t.depth[1] = dzdy;
+	t.depth[2] = z[0] - dzdx * x[0] - dzdy * y[0] + 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+	int index = (int)this->triangles.size();
+	this->triangles.push_back(t);
+
+	int tx, ty;
+	for(ty = t.min_y / OCCLUSION_TILE_HEIGHT; ty <= t.max_y / OCCLUSION_TILE_HEIGHT; ty ++)
+	{
+		for(tx = t.min_x / OCCLUSION_TILE_WIDTH; tx <= t.max_x / OCCLUSION_TILE_WIDTH; tx ++)
+			this->bins[ty * OCCLUSION_TILES_X + tx].push_back(index);
+	}
+}
+
+// clips a clip space triangle against the near plane
+// (z = -w), leaving nothing, itself, or a fan of two
+// triangles for 'setupTriangle'. The fan's diagonal is
+// shared between its triangles; the edge along the near
+// plane is not
+void OcclusionBuffer::clipTriangle(const float* a, const float* b, const float* c, int shared)
+{
+	const float* in[3] = {a, b, c};
+	float dist[3];
+
+	int i, inside = 0;
+	for(i = 0; i < 3; i ++)
+	{
+		dist[i] = in[i][2] + in[i][3];
+
+		if(dist[i] >= 0.0f)
+			inside ++;
+	}
+
+	if(inside == 0)
+		return;
+
+	if(inside == 3)
+	{
+		this->setupTriangle(a, b, c, shared);
+		return;
+	}
+
+	// whether the edge from each vertex to the next
+	// runs along a shared edge of the input
+	float out[4][4];
+	bool out_shared[4];
+	int count = 0;
+
+	for(i = 0; i < 3; i ++)
+	{
+		int j = (i + 1) % 3;
+
+		if(dist[i] >= 0.0f)
+		{
+			copy(in[i], in[i] + 4, out[count]);
+			out_shared[count] = (shared & (1 << i)) != 0;
+			count ++;
+		}
+
+		// the edge crosses the plane
+		if((dist[i] >= 0.0f) != (dist[j] >= 0.0f))
+		{
+			float t = dist[i] / (dist[i] - dist[j]);
+
+			int k;
+			for(k = 0; k < 4; k ++)
+				out[count][k] = in[i][k] + (in[j][k] - in[i][k]) * t;
+
+			// entering, the edge carries on to in[j];
+			// leaving, it follows the near plane
+			out_shared[count] = (dist[j] >= 0.0f) && (shared & (1 << i)) != 0;
+			count ++;
+		}
+	}
+
+	for(i = 2; i < count; i ++)
+	{
+		int fan = (out_shared[i - 1] ? 2 : 0);
+
+		fan |= (i == 2 ? (out_shared[0] ? 1 : 0) : 1);
+		fan |= (i == count - 1 ? (out_shared[count - 1] ? 4 : 0) : 4);
+
+		this->setupTriangle(out[0], out[i - 1], out[i], fan);
+	}
+}
+
+// clears one tile to the far plane and draws every
+// triangle binned to it, keeping the nearest depth.
+// Edges and depth planes already account for the whole
+// pixel (see 'setupTriangle'), so they're only evaluated
+// at pixel centers here.
+// Tiles don't share any pixels, so each can be drawn
+// on a different thread
+void OcclusionBuffer::rasterizeTile(int tile)
+{
+	int tile_x = (tile % OCCLUSION_TILES_X) * OCCLUSION_TILE_WIDTH;
+	int tile_y = (tile / OCCLUSION_TILES_X) * OCCLUSION_TILE_HEIGHT;
+
+	int x, y;
+	for(y = tile_y; y < tile_y + OCCLUSION_TILE_HEIGHT; y ++)
+	{
+		float* row = this->depth + y * OCCLUSION_WIDTH + tile_x;
+		fill(row, row + OCCLUSION_TILE_WIDTH, 1.0f);
+	}
+
+	vector<int>& bin = this->bins[tile];
+
+	int i;
+	for(i = 0; i < (int)bin.size(); i ++)
+	{
+		const RasterTriangle& t = this->triangles[bin[i]];
+
+		// spans start on a multiple of 8 so they never
+		// run past the end of the tile
+		int min_x = max(t.min_x, tile_x) & ~7;
+		int max_x = min(t.max_x, tile_x + OCCLUSION_TILE_WIDTH - 1);
+		int min_y = max(t.min_y, tile_y);
+		int max_y = min(t.max_y, tile_y + OCCLUSION_TILE_HEIGHT - 1);
+
+		for(y = min_y; y <= max_y; y ++)
+		{
+			float* row = this->depth + y * OCCLUSION_WIDTH;
+			float py = (float)y + 0.5f;
+
+			float r0 = t.edges[0][1] * py + t.edges[0][2];
+			float r1 = t.edges[1][1] * py + t.edges[1][2];
+			float r2 = t.edges[2][1] * py + t.edges[2][2];
+			float rz = t.depth[1] * py + t.depth[2];
+
+			x = min_x;
+
+#if defined(__AVX__)
+			__m256 a0 = _mm256_set1_ps(t.edges[0][0]);
+			__m256 a1 = _mm256_set1_ps(t.edges[1][0]);
+			__m256 a2 = _mm256_set1_ps(t.edges[2][0]);
+			__m256 az = _mm256_set1_ps(t.depth[0]);
+
+			__m256 c0 = _mm256_set1_ps(r0);
+			__m256 c1 = _mm256_set1_ps(r1);
+			__m256 c2 = _mm256_set1_ps(r2);
+			__m256 cz = _mm256_set1_ps(rz);
+
+			__m256 ramp = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+			__m256 zero = _mm256_setzero_ps();
+
+			for(; x <= max_x; x += 8)
+			{
+				__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), ramp);
+
+				// covered where all three edges are non-negative
+				__m256 inside = _mm256_cmp_ps(_madd8(a0, px, c0), zero, _CMP_GE_OQ);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_madd8(a1, px, c1), zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_madd8(a2, px, c2), zero, _CMP_GE_OQ));
+
+				if(_mm256_movemask_ps(inside) == 0)
+					continue;
+
+				__m256 d = _mm256_loadu_ps(row + x);
+				__m256 z = _mm256_min_ps(d, _madd8(az, px, cz));
+
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(d, z, inside));
+			}
+#elif defined(__SSE__)
+			__m128 a0 = _mm_set1_ps(t.edges[0][0]);
+			__m128 a1 = _mm_set1_ps(t.edges[1][0]);
+			__m128 a2 = _mm_set1_ps(t.edges[2][0]);
+			__m128 az = _mm_set1_ps(t.depth[0]);
+
+			__m128 c0 = _mm_set1_ps(r0);
+			__m128 c1 = _mm_set1_ps(r1);
+			__m128 c2 = _mm_set1_ps(r2);
+			__m128 cz = _mm_set1_ps(rz);
+
+			__m128 ramp = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 zero = _mm_setzero_ps();
+
+			for(; x <= max_x; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), ramp);
+
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), c0), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), c1), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), c2), zero));
+
+				if(_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 d = _mm_loadu_ps(row + x);
+				__m128 z = _mm_min_ps(d, _mm_add_ps(_mm_mul_ps(az, px), cz));
+
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, d)));
+			}
+#endif
+
+			// whatever's left over (or everything, without SIMD)
+			for(; x <= max_x; x ++)
+			{
+				float px = (float)x + 0.5f;
+
+				if(t.edges[0][0] * px + r0 >= 0.0f && t.edges[1][0] * px + r1 >= 0.0f &&
+				   t.edges[2][0] * px + r2 >= 0.0f)
+					row[x] = min(row[x], t.depth[0] * px + rz);
+			}
+		}
+	}
+}
+
+// draws every occluder as seen through 'view_projection',
+// replacing what was drawn before. Triangles are projected,
+// clipped and binned to tiles here, then the tiles are
+// rasterized on all cores
+void OcclusionBuffer::render(const Mat4& view_projection)
+{
+	time_point<steady_clock> start = steady_clock::now();
+
+	this->view_projection = view_projection;
+	this->triangles.clear();
+
+	int i;
+	for(i = 0; i < OCCLUSION_TILES; i ++)
+		this->bins[i].clear();
+
+	const float* m = view_projection.m;
+
+	for(i = 0; i + 2 < (int)this->occluders.size(); i += 3)
+	{
+		float clip[3][4];
+
+		int j;
+		for(j = 0; j < 3; j ++)
+		{
+			const Vec3& p = this->occluders[i + j];
+
+			clip[j][0] = m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12];
+			clip[j][1] = m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13];
+			clip[j][2] = m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14];
+			clip[j][3] = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+		}
+
+		this->clipTriangle(clip[0], clip[1], clip[2], this->shared_edges[i / 3]);
+	}
+
+	parallelFor(OCCLUSION_TILES, [&](int first, int last)
+	{
+		int tile;
+		for(tile = first; tile < last; tile ++)
+			this->rasterizeTile(tile);
+	});
+
+	duration<double, milli> elapsed = steady_clock::now() - start;
+	this->raster_ms = elapsed.count();
+}
+
+// true if any pixel of the rectangle is at least as
+// far as 'nearest', so something there could show
+bool OcclusionBuffer::testRect(int min_x, int min_y, int max_x, int max_y, float nearest)
+{
+	int x, y;
+	for(y = min_y; y <= max_y; y ++)
+	{
+		const float* row = this->depth + y * OCCLUSION_WIDTH;
+		x = min_x;
+
+#if defined(__AVX__)
+		__m256 z = _mm256_set1_ps(nearest);
+
+		for(; x + 8 <= max_x + 1; x += 8)
+		{
+			if(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + x), z, _CMP_GE_OQ)) != 0)
+				return true;
+		}
+#elif defined(__SSE__)
+		__m128 z = _mm_set1_ps(nearest);
+
+		for(; x + 4 <= max_x + 1; x += 4)
+		{
+			if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z)) != 0)
+				return true;
+		}
+#endif
+
+		for(; x <= max_x; x ++)
+		{
+			if(row[x] >= nearest)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// tests a world space box against the occluders drawn by
+// the last 'render'. Boxes reaching past the near plane or
+// entirely off the buffer are always visible
+bool OcclusionBuffer::isVisible(const AABB& box)
+{
+	const float* m = this->view_projection.m;
+
+	float lo_x = (float)OCCLUSION_WIDTH, lo_y = (float)OCCLUSION_HEIGHT;
+	float hi_x = 0.0f, hi_y = 0.0f;
+	float nearest = 1.0f;
+
+	int i;
+	for(i = 0; i < 8; i ++)
+	{
+		float px = box.center.x + ((i & 1) ? box.extents.x : -box.extents.x);
+		float py = box.center.y + ((i & 2) ? box.extents.y : -box.extents.y);
+		float pz = box.center.z + ((i & 4) ? box.extents.z : -box.extents.z);
+
+		float cx = m[0] * px + m[4] * py + m[8] * pz + m[12];
+		float cy = m[1] * px + m[5] * py + m[9] * pz + m[13];
+		float cz = m[2] * px + m[6] * py + m[10] * pz + m[14];
+		float cw = m[3] * px + m[7] * py + m[11] * pz + m[15];
+
+		if(cz + cw <= 0.0f)
+			return true;
+
+		float inv_w = 1.0f / cw;
+		float sx = (cx * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float sy = (cy * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+
+		lo_x = min(lo_x, sx);
+		lo_y = min(lo_y, sy);
+		hi_x = max(hi_x, sx);
+		hi_y = max(hi_y, sy);
+		nearest = min(nearest, cz * inv_w * 0.5f + 0.5f);
+	}
+
+	if(hi_x < 0.0f || hi_y < 0.0f || lo_x >= (float)OCCLUSION_WIDTH || lo_y >= (float)OCCLUSION_HEIGHT)
+		return true;
+
+	// every pixel the box touches, not just the centers.
+	// Whatever's off the buffer is out of view anyway
+	lo_x = max(lo_x, 0.0f);
+	lo_y = max(lo_y, 0.0f);
+	hi_x = min(hi_x, (float)(OCCLUSION_WIDTH - 1));
+	hi_y = min(hi_y, (float)(OCCLUSION_HEIGHT - 1));
+
+	return this->testRect((int)lo_x, (int)lo_y, (int)hi_x, (int)hi_y, nearest);
+}
+
+// drops the objects in 'visible' (indices into 'culler',
+// as left by its 'cull') that the occluders hide, keeping
+// the rest in order. Large lists are tested on all cores
+int OcclusionBuffer::cull(FrustumCuller* culler, vector<int>& visible)
+{
+	time_point<steady_clock> start = steady_clock::now();
+
+	int count = (int)visible.size();
+	this->keep.resize(count);
+
+	char* keep = this->keep.data();
+	int* objects = visible.data();
+
+	int blocks = (count + OCCLUSION_TEST_BLOCK - 1) / OCCLUSION_TEST_BLOCK;
+
+	parallelFor(blocks, [&](int first, int last)
+	{
+		int i;
+		for(i = first * OCCLUSION_TEST_BLOCK; i < last * OCCLUSION_TEST_BLOCK && i < count; i ++)
+			keep[i] = (this->isVisible(culler->getBox(objects[i])) ? 1 : 0);
+	});
+
+	int i, kept = 0;
+	for(i = 0; i < count; i ++)
+	{
+		if(keep[i])
+			objects[kept ++] = objects[i];
+	}
+
+	visible.resize(kept);
+	this->occluded_count = count - kept;
+
+	duration<double, milli> elapsed = steady_clock::now() - start;
+	this->test_ms = elapsed.count();
+
+	return kept;
+}
+
+// the buffer's depths, row by row from the bottom
+const float* OcclusionBuffer::getDepth()
+{
+	return this->depth;
+}
+
+// number of occluder triangles added
+int OcclusionBuffer::getOccluderCount()
+{
+	return (int)this->occluders.size() / 3;
+}
+
+// number of triangles the last 'render' drew, after clipping
+int OcclusionBuffer::getTriangleCount()
+{
+	return (int)this->triangles.size();
+}
+
+// objects the last 'cull' found hidden
+int OcclusionBuffer::getOccludedCount()
+{
+	return this->occluded_count;
+}
+
+// milliseconds the last 'render' took
+double OcclusionBuffer::getRasterTime()
+{
+	return this->raster_ms;
+}
+
+// milliseconds the last 'cull' took
+double OcclusionBuffer::getTestTime()
+{
+	return this->test_ms;
+}
@@ -0,0 +1,97 @@
+#ifndef OCCLUSIONBUFFER_HPP__
+#define OCCLUSIONBUFFER_HPP__
+
+#include "FrustumCuller.hpp"
+#include "VectorMath.hpp"
+
+#include <vector>
+
+// size of the depth buffer occluders are drawn into,
+// split into tiles that are rasterized on separate
+// threads. Tile widths must be a multiple of 8
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_WIDTH 64
+#define OCCLUSION_TILE_HEIGHT 32
+
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT)
+#define OCCLUSION_TILES (OCCLUSION_TILES_X * OCCLUSION_TILES_Y)
+
+// boxes are tested in blocks of this many when spread
+// over threads
+#define OCCLUSION_TEST_BLOCK 1024
+
+using namespace std;
+
+// one screen space occluder triangle, set up for
+// rasterizing: three edge functions (a * x + b * y + c,
+// positive at the centers of pixels it covers entirely)
+// and the plane of its farthest depth over each pixel
+struct RasterTriangle {
+
+	float edges[3][3];
+	float depth[3];
+
+	int min_x;
+	int min_y;
+	int max_x;
+	int max_y;
+};
+
+// a small software depth buffer for occlusion culling on
+// the CPU, so nothing waits on the GPU. Simplified occluder
+// meshes (a wall's quad rather than its box) are drawn into
+// it every frame, 8 pixels at a time with AVX (4 with SSE),
+// each tile of the buffer on its own thread. Boxes are then
+// hidden if their nearest depth is behind every pixel of
+// the rectangle they cover. Occluders are rasterized
+// conservatively: a pixel is only written if an occluder
+// covers all of it, with the occluder's farthest depth over
+// it, so a box peeking past a wall's edge stays visible
+class OcclusionBuffer {
+
+	private:
+		float* depth;
+
+		vector<Vec3> occluders;
+		vector<int> shared_edges;
+		vector<RasterTriangle> triangles;
+		vector<int> bins[OCCLUSION_TILES];
+
+		vector<char> keep;
+
+		Mat4 view_projection;
+
+		int occluded_count;
+		double raster_ms;
+		double test_ms;
+
+		void setupTriangle(const float* a, const float* b, const float* c, int shared);
+		void clipTriangle(const float* a, const float* b, const float* c, int shared);
+		void rasterizeTile(int tile);
+
+		bool testRect(int min_x, int min_y, int max_x, int max_y, float nearest);
+
+	public:
+		OcclusionBuffer();
+		~OcclusionBuffer();
+
+		void addOccluder(const Vec3* vertices, int count, const Mat4& transform);
+		void addQuad(const AABB& box, const Mat4& transform);
+		void clearOccluders();
+
+		void render(const Mat4& view_projection);
+
+		bool isVisible(const AABB& box);
+		int cull(FrustumCuller* culler, vector<int>& visible);
+
+		const float* getDepth();
+		int getOccluderCount();
+		int getTriangleCount();
+		int getOccludedCount();
+		double getRasterTime();
+		double getTestTime();
+};
+
+#endif
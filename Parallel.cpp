@@ -0,0 +1,160 @@
+#include "Parallel.hpp"
+
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+// threads kept waiting between calls, so work split up
+// every frame doesn't pay for starting threads each time.
+// The caller and the workers take ranges one at a time
+// until they're all done
+struct WorkerPool {
+
+	vector<thread> threads;
+
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+
+	function<void(int, int)> job;
+	int count;
+	int ranges;
+	int next;
+	int remaining;
+
+	unsigned int generation;
+	bool in_use;
+	bool stopping;
+
+	WorkerPool();
+	~WorkerPool();
+};
+
+static WorkerPool _pool;
+
+// runs ranges of the current job until none are left.
+// Called with the pool locked, which is dropped while
+// each range runs
+static void _runRanges(unique_lock<mutex>& guard)
+{
+	while(_pool.next < _pool.ranges)
+	{
+		int range = _pool.next ++;
+		int count = _pool.count, ranges = _pool.ranges;
+
+		guard.unlock();
+		_pool.job((count * range) / ranges, (count * (range + 1)) / ranges);
+		guard.lock();
+
+		if(-- _pool.remaining == 0)
+			_pool.done.notify_all();
+	}
+}
+
+static void _workerMain()
+{
+	unique_lock<mutex> guard(_pool.lock);
+	unsigned int seen = _pool.generation;
+
+	for(;;)
+	{
+		while(!(_pool.stopping) && _pool.generation == seen)
+			_pool.wake.wait(guard);
+
+		if(_pool.stopping)
+			return;
+
+		seen = _pool.generation;
+		_runRanges(guard);
+	}
+}
+
+WorkerPool::WorkerPool()
+{
+	this->count = 0;
+	this->ranges = 0;
+	this->next = 0;
+	this->remaining = 0;
+	this->generation = 0;
+	this->in_use = false;
+	this->stopping = false;
+}
+
+// wakes every worker to exit, and waits for them
+WorkerPool::~WorkerPool()
+{
+	{
+		unique_lock<mutex> guard(this->lock);
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+
+	int i;
+	for(i = 0; i < (int)this->threads.size(); i ++)
+		this->threads[i].join();
+}
+
+// splits [0, count) into contiguous ranges and
+// runs them on as many threads as there are cores
+void parallelFor(int count, function<void(int, int)> job)
+{
+	parallelFor(count, (int)thread::hardware_concurrency(), job);
+}
+
+// the same, over 'workers' ranges. These run on the pool,
+// or on threads of their own if the pool is already busy
+// (such as when called from inside another job)
+void parallelFor(int count, int workers, function<void(int, int)> job)
+{
+	if(workers < 1)
+		workers = 1;
+
+	if(workers > count)
+		workers = count;
+
+	if(workers <= 1)
+	{
+		job(0, count);
+		return;
+	}
+
+	unique_lock<mutex> guard(_pool.lock);
+
+	if(_pool.in_use)
+	{
+		guard.unlock();
+
+		vector<thread> threads;
+
+		int i;
+		for(i = 0; i < workers; i ++)
+			threads.push_back(thread(job, (count * i) / workers, (count * (i + 1)) / workers));
+
+		for(i = 0; i < workers; i ++)
+			threads[i].join();
+
+		return;
+	}
+
+	// the caller takes ranges too, so one less thread is needed
+	while((int)_pool.threads.size() < workers - 1)
+		_pool.threads.push_back(thread(_workerMain));
+
+	_pool.in_use = true;
+	_pool.job = job;
+	_pool.count = count;
+	_pool.ranges = workers;
+	_pool.next = 0;
+	_pool.remaining = workers;
+	_pool.generation ++;
+
+	_pool.wake.notify_all();
+	_runRanges(guard);
+
+	while(_pool.remaining > 0)
+		_pool.done.wait(guard);
+
+	_pool.job = nullptr;
+	_pool.in_use = false;
+}
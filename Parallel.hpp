@@ -0,0 +1,11 @@
+#ifndef PARALLEL_HPP__
+#define PARALLEL_HPP__
+
+#include <functional>
+
+using namespace std;
+
+void parallelFor(int count, function<void(int, int)> job);
+void parallelFor(int count, int workers, function<void(int, int)> job);
+
+#endif
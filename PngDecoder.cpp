@@ -0,0 +1,1011 @@
+#include "PngDecoder.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ZFAST_BITS 10
+#define ZFAST_MASK ((1 << ZFAST_BITS) - 1)
+
+#define WINDOW_KEEP 32768
+#define WINDOW_SIZE (256 * 1024)
+
+static const unsigned char png_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+static const int length_base[31] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0
+};
+static const int length_extra[31] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0
+};
+static const int dist_base[32] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 0, 0
+};
+static const int dist_extra[32] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0
+};
+static const unsigned char length_order[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// canonical Huffman table for inflate. Codes up to
+// ZFAST_BITS long resolve with a single lookup, longer
+// ones fall back to comparing against 'maxcode'
+struct Huffman {
+
+	unsigned short fast[1 << ZFAST_BITS];
+	unsigned short firstcode[16];
+	int maxcode[17];
+	unsigned short firstsymbol[16];
+	unsigned char size[288];
+	unsigned short value[288];
+};
+
+// reassembles inflated bytes into scanlines, undoes
+// the PNG filters and writes RGBA rows to the output
+struct RowWriter {
+
+	unsigned char* dest;
+	int stride;
+
+	int width;
+	int height;
+	int depth;
+	int color;
+	int channels;
+	int bpp;
+	int rowbytes;
+
+	const unsigned char* palette;
+	const unsigned short* key;
+	bool has_key;
+
+	unsigned char* filtered;
+	unsigned char* raw[2];
+	unsigned char* zero;
+
+	int row;
+	int filled;
+	bool error;
+};
+
+// inflate state: a 64-bit bit buffer over the
+// compacted IDAT data and a sliding output window
+// that's handed to the RowWriter as it fills up
+struct Inflater {
+
+	const unsigned char* in;
+	const unsigned char* in_end;
+	int overrun;
+
+	unsigned long long bits;
+	int num_bits;
+
+	unsigned char* out;
+	int pos;
+	int consumed;
+
+	RowWriter* rows;
+	Huffman lit;
+	Huffman dist;
+};
+
+static unsigned int _readBE32(const unsigned char* p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+static int _bitReverse16(int n)
+{
+	n = ((n & 0xAAAA) >> 1) | ((n & 0x5555) << 1);
+	n = ((n & 0xCCCC) >> 2) | ((n & 0x3333) << 2);
+	n = ((n & 0xF0F0) >> 4) | ((n & 0x0F0F) << 4);
+	n = ((n & 0xFF00) >> 8) | ((n & 0x00FF) << 8);
+
+	return n;
+}
+
+// builds a decoding table from a list of code lengths
+static bool _buildHuffman(Huffman* h, const unsigned char* sizelist, int num)
+{
+	int sizes[17], next_code[16];
+	memset(sizes, 0, sizeof(sizes));
+	memset(h->fast, 0, sizeof(h->fast));
+
+	int i;
+	for(i = 0; i < num; i ++)
+		sizes[sizelist[i]] ++;
+
+	sizes[0] = 0;
+	for(i = 1; i < 16; i ++)
+	{
+		if(sizes[i] > (1 << i))
+			return false;
+	}
+
+	int code = 0, k = 0;
+	for(i = 1; i < 16; i ++)
+	{
+		next_code[i] = code;
+		h->firstcode[i] = (unsigned short)code;
+		h->firstsymbol[i] = (unsigned short)k;
+
+		code += sizes[i];
+		if(sizes[i] && code - 1 >= (1 << i))
+			return false;
+
+		h->maxcode[i] = code << (16 - i);
+		code <<= 1;
+		k += sizes[i];
+	}
+	h->maxcode[16] = 0x10000;
+
+	for(i = 0; i < num; i ++)
+	{
+		int s = sizelist[i];
+		if(s == 0)
+			continue;
+
+		int c = next_code[s] - h->firstcode[s] + h->firstsymbol[s];
+		unsigned short fastv = (unsigned short)((s << 9) | i);
+
+		h->size[c] = (unsigned char)s;
+		h->value[c] = (unsigned short)i;
+
+		if(s <= ZFAST_BITS)
+		{
+			int j = _bitReverse16(next_code[s]) >> (16 - s);
+			while(j < (1 << ZFAST_BITS))
+			{
+				h->fast[j] = fastv;
+				j += (1 << s);
+			}
+		}
+		next_code[s] ++;
+	}
+	return true;
+}
+
+// tops the bit buffer up to at least 57 bits. Reads
+// past the end of the data count as zeros, and are
+// tracked so truncated streams can be detected
+static inline void _fillBits(Inflater* z)
+{
+	while(z->num_bits <= 56)
+	{
+		unsigned long long byte = 0;
+
+		if(z->in < z->in_end)
+			byte = *(z->in ++);
+		else
+			z->overrun ++;
+
+		z->bits |= byte << z->num_bits;
+		z->num_bits += 8;
+	}
+}
+
+static inline unsigned int _getBits(Inflater* z, int n)
+{
+	if(z->num_bits < n)
+		_fillBits(z);
+
+	unsigned int v = (unsigned int)(z->bits & ((1ull << n) - 1));
+	z->bits >>= n;
+	z->num_bits -= n;
+
+	return v;
+}
+
+static inline int _decodeSymbol(Inflater* z, Huffman* h)
+{
+	if(z->num_bits < 16)
+		_fillBits(z);
+
+	int b = h->fast[z->bits & ZFAST_MASK];
+	if(b)
+	{
+		int s = b >> 9;
+		z->bits >>= s;
+		z->num_bits -= s;
+
+		return b & 511;
+	}
+
+	int k = _bitReverse16((int)(z->bits & 0xFFFF));
+
+	int s;
+	for(s = ZFAST_BITS + 1; k >= h->maxcode[s]; s ++);
+
+	if(s >= 16)
+		return -1;
+
+	b = (k >> (16 - s)) - h->firstcode[s] + h->firstsymbol[s];
+	if(b >= 288 || h->size[b] != s)
+		return -1;
+
+	z->bits >>= s;
+	z->num_bits -= s;
+
+	return h->value[b];
+}
+
+#ifdef __SSE2__
+
+template<int bpp> static inline __m128i _loadPixel(const unsigned char* p)
+{
+	int v = 0;
+	memcpy(&v, p, bpp);
+
+	return _mm_cvtsi32_si128(v);
+}
+
+template<int bpp> static inline void _storePixel(unsigned char* p, __m128i v)
+{
+	int t = _mm_cvtsi128_si32(v);
+	memcpy(p, &t, bpp);
+}
+
+// undoes the Sub, Average and Paeth filters for 3 and 4
+// byte pixels, one pixel per register. Each pixel depends
+// on the one to its left, so the parallelism is across
+// the channels of a pixel (and 16-bit lanes for Paeth)
+template<int bpp> static void _unfilterSIMD(int filter, const unsigned char* x, const unsigned char* prev,
+											unsigned char* out, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi8(1);
+	__m128i a = zero, c = zero;
+
+	int i;
+	for(i = 0; i + bpp <= n; i += bpp)
+	{
+		__m128i d = _loadPixel<bpp>(x + i);
+
+		if(filter == 1)
+			a = _mm_add_epi8(d, a);
+
+		else if(filter == 3)
+		{
+			__m128i b = _loadPixel<bpp>(prev + i);
+			__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+
+			a = _mm_add_epi8(d, avg);
+		}
+		else
+		{
+			__m128i b = _loadPixel<bpp>(prev + i);
+
+			__m128i a16 = _mm_unpacklo_epi8(a, zero);
+			__m128i b16 = _mm_unpacklo_epi8(b, zero);
+			__m128i c16 = _mm_unpacklo_epi8(c, zero);
+
+			__m128i p = _mm_sub_epi16(b16, c16);
+			__m128i q = _mm_sub_epi16(a16, c16);
+			__m128i r = _mm_add_epi16(p, q);
+
+			__m128i pa = _mm_max_epi16(p, _mm_sub_epi16(zero, p));
+			__m128i pb = _mm_max_epi16(q, _mm_sub_epi16(zero, q));
+			__m128i pc = _mm_max_epi16(r, _mm_sub_epi16(zero, r));
+
+			__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+			__m128i mask = _mm_cmpeq_epi16(smallest, pb);
+			__m128i nearest = _mm_or_si128(_mm_and_si128(mask, b16), _mm_andnot_si128(mask, c16));
+
+			mask = _mm_cmpeq_epi16(smallest, pa);
+			nearest = _mm_or_si128(_mm_and_si128(mask, a16), _mm_andnot_si128(mask, nearest));
+
+			a = _mm_add_epi8(d, _mm_packus_epi16(nearest, nearest));
+			c = b;
+		}
+		_storePixel<bpp>(out + i, a);
+	}
+}
+
+#endif
+
+// Paeth predictor, picks whichever of left, up and
+// up-left is closest to left + up - up-left
+static inline int _paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+	if(pa <= pb && pa <= pc)
+		return a;
+
+	return (pb <= pc ? b : c);
+}
+
+// undoes a scanline's filter. 'prev' is the previous
+// unfiltered scanline (all zeros for the first row)
+static bool _unfilter(int filter, const unsigned char* x, const unsigned char* prev,
+					  unsigned char* out, int n, int bpp)
+{
+	int i = 0;
+
+	switch(filter)
+	{
+		case 0:
+			memcpy(out, x, n);
+			return true;
+
+		case 2:
+#ifdef __SSE2__
+			for(; i + 16 <= n; i += 16)
+			{
+				__m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(x + i)), _mm_loadu_si128((const __m128i*)(prev + i)));
+				_mm_storeu_si128((__m128i*)(out + i), v);
+			}
+#endif
+			for(; i < n; i ++)
+				out[i] = (unsigned char)(x[i] + prev[i]);
+
+			return true;
+
+		case 1:
+		case 3:
+		case 4:
+#ifdef __SSE2__
+			if(bpp == 4)
+			{
+				_unfilterSIMD<4>(filter, x, prev, out, n);
+				return true;
+			}
+			if(bpp == 3)
+			{
+				_unfilterSIMD<3>(filter, x, prev, out, n);
+				return true;
+			}
+#endif
+			for(i = 0; i < bpp && i < n; i ++)
+			{
+				if(filter == 1)
+					out[i] = x[i];
+				else if(filter == 3)
+					out[i] = (unsigned char)(x[i] + (prev[i] >> 1));
+				else
+					out[i] = (unsigned char)(x[i] + prev[i]);
+			}
+
+			for(; i < n; i ++)
+			{
+				if(filter == 1)
+					out[i] = (unsigned char)(x[i] + out[i - bpp]);
+				else if(filter == 3)
+					out[i] = (unsigned char)(x[i] + ((out[i - bpp] + prev[i]) >> 1));
+				else
+					out[i] = (unsigned char)(x[i] + _paeth(out[i - bpp], prev[i], prev[i - bpp]));
+			}
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+// reads sample 'index' of an unfiltered scanline
+// (any bit depth), returning its full value
+static inline int _sample(const unsigned char* raw, int index, int depth)
+{
+	if(depth == 8)
+		return raw[index];
+
+	if(depth == 16)
+		return (raw[index * 2] << 8) | raw[index * 2 + 1];
+
+	int bit = index * depth;
+	int shift = 8 - depth - (bit & 7);
+
+	return (raw[bit >> 3] >> shift) & ((1 << depth) - 1);
+}
+
+// converts an unfiltered scanline to RGBA8,
+// applying the palette and tRNS color key
+static void _expandRow(RowWriter* w, const unsigned char* raw, unsigned char* out)
+{
+	int x;
+
+	if(w->depth == 8 && w->color == 6)
+	{
+		memcpy(out, raw, w->width * 4);
+		return;
+	}
+
+	if(w->depth == 8 && w->color == 2 && !w->has_key)
+	{
+		for(x = 0; x < w->width; x ++)
+		{
+			out[x * 4] = raw[x * 3];
+			out[x * 4 + 1] = raw[x * 3 + 1];
+			out[x * 4 + 2] = raw[x * 3 + 2];
+			out[x * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	int max = (1 << w->depth) - 1;
+
+	for(x = 0; x < w->width; x ++)
+	{
+		unsigned char* p = out + x * 4;
+		int s = x * w->channels;
+
+		switch(w->color)
+		{
+			case 3:
+				memcpy(p, w->palette + _sample(raw, x, w->depth) * 4, 4);
+				break;
+
+			case 0:
+			{
+				int g = _sample(raw, s, w->depth);
+
+				p[0] = p[1] = p[2] = (unsigned char)((g * 255) / max);
+				p[3] = (w->has_key && g == w->key[0] ? 0 : 255);
+				break;
+			}
+
+			case 4:
+				p[0] = p[1] = p[2] = (unsigned char)(_sample(raw, s, w->depth) * 255 / max);
+				p[3] = (unsigned char)(_sample(raw, s + 1, w->depth) * 255 / max);
+				break;
+
+			case 2:
+			case 6:
+			{
+				int r = _sample(raw, s, w->depth);
+				int g = _sample(raw, s + 1, w->depth);
+				int b = _sample(raw, s + 2, w->depth);
+
+				p[0] = (unsigned char)(r * 255 / max);
+				p[1] = (unsigned char)(g * 255 / max);
+				p[2] = (unsigned char)(b * 255 / max);
+
+				if(w->color == 6)
+					p[3] = (unsigned char)(_sample(raw, s + 3, w->depth) * 255 / max);
+				else
+					p[3] = (w->has_key && r == w->key[0] && g == w->key[1] && b == w->key[2] ? 0 : 255);
+
+				break;
+			}
+		}
+	}
+}
+
+// unfilters one complete scanline (filter byte
+// first) and writes it out as RGBA8
+static void _emitRow(RowWriter* w, const unsigned char* src)
+{
+	unsigned char* out = w->raw[w->row & 1];
+	const unsigned char* prev = (w->row > 0 ? w->raw[(w->row - 1) & 1] : w->zero);
+
+	if(!_unfilter(src[0], src + 1, prev, out, w->rowbytes, w->bpp))
+	{
+		w->error = true;
+		return;
+	}
+
+	_expandRow(w, out, w->dest + (long long)w->row * w->stride);
+	w->row ++;
+}
+
+// splits inflated bytes into scanlines. Whole scanlines
+// are unfiltered straight out of the inflate window,
+// only ones split across a flush are copied first
+static void _feedRows(RowWriter* w, const unsigned char* data, int len)
+{
+	int need = w->rowbytes + 1;
+
+	while(len > 0 && w->row < w->height && !w->error)
+	{
+		if(w->filled == 0 && len >= need)
+		{
+			_emitRow(w, data);
+
+			data += need;
+			len -= need;
+
+			continue;
+		}
+
+		int n = (need - w->filled < len ? need - w->filled : len);
+		memcpy(w->filtered + w->filled, data, n);
+
+		w->filled += n;
+		data += n;
+		len -= n;
+
+		if(w->filled == need)
+		{
+			_emitRow(w, w->filtered);
+			w->filled = 0;
+		}
+	}
+}
+
+// hands everything inflated so far to the RowWriter,
+// then slides the window down to the last 32KB (all
+// that back-references can reach)
+static void _flushWindow(Inflater* z)
+{
+	_feedRows(z->rows, z->out + z->consumed, z->pos - z->consumed);
+	z->consumed = z->pos;
+
+	if(z->pos > WINDOW_KEEP)
+	{
+		memmove(z->out, z->out + z->pos - WINDOW_KEEP, WINDOW_KEEP);
+		z->pos = WINDOW_KEEP;
+		z->consumed = WINDOW_KEEP;
+	}
+}
+
+static bool _inflateStored(Inflater* z)
+{
+	_getBits(z, z->num_bits & 7);
+
+	int len = (int)_getBits(z, 16);
+	int nlen = (int)_getBits(z, 16);
+
+	if((len ^ 0xFFFF) != nlen)
+		return false;
+
+	while(len > 0)
+	{
+		if(z->pos >= WINDOW_SIZE)
+			_flushWindow(z);
+
+		int n = (len < WINDOW_SIZE - z->pos ? len : WINDOW_SIZE - z->pos);
+
+		// bytes already pulled into the bit buffer come first
+		while(n > 0 && z->num_bits >= 8)
+		{
+			z->out[z->pos ++] = (unsigned char)_getBits(z, 8);
+			n --;
+			len --;
+		}
+
+		if(n > z->in_end - z->in)
+			return false;
+
+		memcpy(z->out + z->pos, z->in, n);
+
+		z->in += n;
+		z->pos += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool _inflateCodes(Inflater* z)
+{
+	for(;;)
+	{
+		if(z->pos + 258 > WINDOW_SIZE)
+			_flushWindow(z);
+
+		int sym = _decodeSymbol(z, &(z->lit));
+		if(sym < 0)
+			return false;
+
+		if(sym < 256)
+		{
+			z->out[z->pos ++] = (unsigned char)sym;
+			continue;
+		}
+
+		if(sym == 256)
+			return true;
+
+		sym -= 257;
+		if(sym >= 29)
+			return false;
+
+		int len = length_base[sym] + (int)_getBits(z, length_extra[sym]);
+
+		sym = _decodeSymbol(z, &(z->dist));
+		if(sym < 0 || sym >= 30)
+			return false;
+
+		int d = dist_base[sym] + (int)_getBits(z, dist_extra[sym]);
+		if(d > z->pos)
+			return false;
+
+		unsigned char* dst = z->out + z->pos;
+		const unsigned char* src = dst - d;
+
+		if(d == 1)
+			memset(dst, *src, len);
+
+		else if(d >= len)
+			memcpy(dst, src, len);
+
+		else
+		{
+			int i;
+			for(i = 0; i < len; i ++)
+				dst[i] = src[i];
+		}
+		z->pos += len;
+
+		if(z->overrun > 8)
+			return false;
+	}
+}
+
+static bool _buildDynamic(Inflater* z)
+{
+	unsigned char lens[286 + 32 + 137];
+	unsigned char codelengths[19];
+	Huffman codes;
+
+	int hlit = (int)_getBits(z, 5) + 257;
+	int hdist = (int)_getBits(z, 5) + 1;
+	int hclen = (int)_getBits(z, 4) + 4;
+
+	memset(codelengths, 0, sizeof(codelengths));
+
+	int i;
+	for(i = 0; i < hclen; i ++)
+		codelengths[length_order[i]] = (unsigned char)_getBits(z, 3);
+
+	if(!_buildHuffman(&codes, codelengths, 19))
+		return false;
+
+	int n = 0, total = hlit + hdist;
+	while(n < total)
+	{
+		int c = _decodeSymbol(z, &codes);
+		if(c < 0 || c >= 19)
+			return false;
+
+		if(c < 16)
+		{
+			lens[n ++] = (unsigned char)c;
+			continue;
+		}
+
+		unsigned char fill = 0;
+		if(c == 16)
+		{
+			if(n == 0)
+				return false;
+
+			fill = lens[n - 1];
+			c = (int)_getBits(z, 2) + 3;
+		}
+		else if(c == 17)
+			c = (int)_getBits(z, 3) + 3;
+		else
+			c = (int)_getBits(z, 7) + 11;
+
+		if(n + c > total)
+			return false;
+
+		memset(lens + n, fill, c);
+		n += c;
+	}
+
+	return _buildHuffman(&(z->lit), lens, hlit) && _buildHuffman(&(z->dist), lens + hlit, hdist);
+}
+
+static bool _buildFixed(Inflater* z)
+{
+	unsigned char lens[288];
+	unsigned char dists[32];
+
+	int i;
+	for(i = 0; i < 144; i ++) lens[i] = 8;
+	for(; i < 256; i ++) lens[i] = 9;
+	for(; i < 280; i ++) lens[i] = 7;
+	for(; i < 288; i ++) lens[i] = 8;
+	for(i = 0; i < 32; i ++) dists[i] = 5;
+
+	return _buildHuffman(&(z->lit), lens, 288) && _buildHuffman(&(z->dist), dists, 32);
+}
+
+// inflates a complete zlib stream (the header was
+// already checked), feeding the RowWriter as it goes
+static bool _inflate(Inflater* z)
+{
+	int final;
+	do
+	{
+		final = (int)_getBits(z, 1);
+		int type = (int)_getBits(z, 2);
+
+		bool ok;
+		if(type == 0)
+			ok = _inflateStored(z);
+		else if(type == 1)
+			ok = _buildFixed(z) && _inflateCodes(z);
+		else if(type == 2)
+			ok = _buildDynamic(z) && _inflateCodes(z);
+		else
+			ok = false;
+
+		if(!ok || z->overrun > 8 || z->rows->error)
+			return false;
+	}
+	while(!final);
+
+	_flushWindow(z);
+	return !(z->rows->error);
+}
+
+// reads a PNG file into memory and parses its header
+// chunks. Nothing is decoded until 'decode' is called
+PngDecoder::PngDecoder(string filename)
+{
+	this->file = NULL;
+	this->idat = NULL;
+	this->idat_len = 0;
+	this->width = 0;
+	this->height = 0;
+	this->depth = 0;
+	this->color = 0;
+	this->channels = 0;
+	this->has_key = false;
+	this->valid = false;
+
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if(fp == NULL)
+		return;
+
+	fseek(fp, 0, SEEK_END);
+	long len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if(len > 0)
+	{
+		this->file = (unsigned char*)malloc(len);
+		if(this->file != NULL && fread(this->file, 1, len, fp) == (size_t)len)
+			this->valid = this->parse((int)len);
+	}
+	fclose(fp);
+}
+
+// frees the file contents
+PngDecoder::~PngDecoder()
+{
+	free(this->file);
+}
+
+// walks the chunk list, reading the header, palette
+// and transparency chunks. IDAT payloads are moved
+// down in place so the zlib stream is contiguous.
+// Interlaced images aren't handled (callers fall back
+// to SOIL for those)
+bool PngDecoder::parse(int len)
+{
+	if(len < 8 || memcmp(this->file, png_signature, 8) != 0)
+		return false;
+
+	int i;
+	for(i = 0; i < 256; i ++)
+	{
+		this->palette[i * 4] = 0;
+		this->palette[i * 4 + 1] = 0;
+		this->palette[i * 4 + 2] = 0;
+		this->palette[i * 4 + 3] = 255;
+	}
+
+	bool header = false;
+	int offset = 8;
+
+	while(offset + 12 <= len)
+	{
+		unsigned int chunk_len = _readBE32(this->file + offset);
+		const unsigned char* type = this->file + offset + 4;
+		unsigned char* data = this->file + offset + 8;
+
+		if(chunk_len > (unsigned int)(len - offset - 12))
+			return false;
+
+		if(memcmp(type, "IHDR", 4) == 0)
+		{
+			if(chunk_len != 13)
+				return false;
+
+			this->width = (int)_readBE32(data);
+			this->height = (int)_readBE32(data + 4);
+			this->depth = data[8];
+			this->color = data[9];
+
+			if(data[10] != 0 || data[11] != 0 || data[12] != 0)
+				return false;
+
+			switch(this->color)
+			{
+				case 0: this->channels = 1; break;
+				case 2: this->channels = 3; break;
+				case 3: this->channels = 1; break;
+				case 4: this->channels = 2; break;
+				case 6: this->channels = 4; break;
+				default: return false;
+			}
+
+			bool low = (this->depth == 1 || this->depth == 2 || this->depth == 4);
+			if(this->depth != 8 && this->depth != 16 && !(low && (this->color == 0 || this->color == 3)))
+				return false;
+
+			if(this->color == 3 && this->depth == 16)
+				return false;
+
+			if(this->width <= 0 || this->height <= 0 || this->width > (1 << 24) || this->height > (1 << 24))
+				return false;
+
+			header = true;
+		}
+		else if(memcmp(type, "PLTE", 4) == 0)
+		{
+			unsigned int n = chunk_len / 3;
+			for(i = 0; i < (int)n && i < 256; i ++)
+			{
+				this->palette[i * 4] = data[i * 3];
+				this->palette[i * 4 + 1] = data[i * 3 + 1];
+				this->palette[i * 4 + 2] = data[i * 3 + 2];
+			}
+		}
+		else if(memcmp(type, "tRNS", 4) == 0)
+		{
+			if(this->color == 3)
+			{
+				for(i = 0; i < (int)chunk_len && i < 256; i ++)
+					this->palette[i * 4 + 3] = data[i];
+			}
+			else if(this->color == 0 && chunk_len >= 2)
+			{
+				this->key[0] = (unsigned short)((data[0] << 8) | data[1]);
+				this->has_key = true;
+			}
+			else if(this->color == 2 && chunk_len >= 6)
+			{
+				for(i = 0; i < 3; i ++)
+					this->key[i] = (unsigned short)((data[i * 2] << 8) | data[i * 2 + 1]);
+
+				this->has_key = true;
+			}
+		}
+		else if(memcmp(type, "IDAT", 4) == 0)
+		{
+			if(this->idat == NULL)
+				this->idat = data;
+
+			memmove(this->idat + this->idat_len, data, chunk_len);
+			this->idat_len += (int)chunk_len;
+		}
+		else if(memcmp(type, "IEND", 4) == 0)
+			break;
+
+		offset += 12 + (int)chunk_len;
+	}
+
+	return header && this->idat != NULL && this->idat_len > 2;
+}
+
+// decodes the image as RGBA8 into 'dest', one row every
+// 'stride' bytes. 'dest' can be anything writable,
+// including mapped buffer memory: it is only ever
+// written, front to back, and never read from
+bool PngDecoder::decode(unsigned char* dest, int stride)
+{
+	if(!(this->valid))
+		return false;
+
+	int cmf = this->idat[0], flg = this->idat[1];
+	if((cmf & 15) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 32))
+		return false;
+
+	RowWriter rows;
+
+	rows.dest = dest;
+	rows.stride = stride;
+	rows.width = this->width;
+	rows.height = this->height;
+	rows.depth = this->depth;
+	rows.color = this->color;
+	rows.channels = this->channels;
+	rows.bpp = (this->channels * this->depth + 7) / 8;
+	rows.rowbytes = (int)(((long long)this->width * this->channels * this->depth + 7) / 8);
+	rows.palette = this->palette;
+	rows.key = this->key;
+	rows.has_key = this->has_key;
+	rows.row = 0;
+	rows.filled = 0;
+	rows.error = false;
+
+	rows.filtered = (unsigned char*)malloc(rows.rowbytes + 1);
+	rows.raw[0] = (unsigned char*)malloc(rows.rowbytes);
+	rows.raw[1] = (unsigned char*)malloc(rows.rowbytes);
+	rows.zero = (unsigned char*)calloc(rows.rowbytes, 1);
+
+	Inflater* z = (Inflater*)malloc(sizeof(Inflater));
+	unsigned char* window = (unsigned char*)malloc(WINDOW_SIZE);
+
+	// a header asking for more than there's memory for
+	// fails the decode, so the caller can fall back
+	if(rows.filtered == NULL || rows.raw[0] == NULL || rows.raw[1] == NULL || rows.zero == NULL ||
+	   z == NULL || window == NULL)
+	{
+		free(window);
+		free(z);
+
+		free(rows.filtered);
+		free(rows.raw[0]);
+		free(rows.raw[1]);
+		free(rows.zero);
+
+		return false;
+	}
+
+	z->in = this->idat + 2;
+	z->in_end = this->idat + this->idat_len;
+	z->overrun = 0;
+	z->bits = 0;
+	z->num_bits = 0;
+	z->out = window;
+	z->pos = 0;
+	z->consumed = 0;
+	z->rows = &rows;
+
+	bool ok = _inflate(z) && rows.row == rows.height;
+
+	free(z->out);
+	free(z);
+
+	free(rows.filtered);
+	free(rows.raw[0]);
+	free(rows.raw[1]);
+	free(rows.zero);
+
+	return ok;
+}
+
+// convenience loader, decodes a PNG file into a newly
+// malloc'd RGBA8 buffer. Returns NULL on failure
+unsigned char* PngDecoder::load(string filename, int* width, int* height)
+{
+	PngDecoder decoder(filename);
+	if(!decoder.isValid())
+		return NULL;
+
+	unsigned char* image = (unsigned char*)malloc((size_t)decoder.getWidth() * decoder.getHeight() * 4);
+	if(image == NULL)
+		return NULL;
+
+	if(!decoder.decode(image, decoder.getWidth() * 4))
+	{
+		free(image);
+		return NULL;
+	}
+
+	*width = decoder.getWidth();
+	*height = decoder.getHeight();
+
+	return image;
+}
+
+bool PngDecoder::isValid()
+{
+	return this->valid;
+}
+
+int PngDecoder::getWidth()
+{
+	return this->width;
+}
+
+int PngDecoder::getHeight()
+{
+	return this->height;
+}
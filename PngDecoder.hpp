@@ -0,0 +1,42 @@
+#ifndef PNGDECODER_HPP__
+#define PNGDECODER_HPP__
+
+#include <string>
+
+using namespace std;
+
+class PngDecoder {
+
+	private:
+		unsigned char* file;
+		unsigned char* idat;
+
+		int idat_len;
+		int width;
+		int height;
+		int depth;
+		int color;
+		int channels;
+
+		bool valid;
+
+		unsigned char palette[256 * 4];
+
+		bool has_key;
+		unsigned short key[3];
+
+		bool parse(int len);
+
+	public:
+		PngDecoder(string filename);
+		~PngDecoder();
+
+		bool decode(unsigned char* dest, int stride);
+		static unsigned char* load(string filename, int* width, int* height);
+
+		bool isValid();
+		int getWidth();
+		int getHeight();
+};
+
+#endif
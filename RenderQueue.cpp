@@ -0,0 +1,208 @@
+#include "RenderQueue.hpp"
+
+#include <cstring>
+
+RenderQueue::RenderQueue()
+{
+	this->unsorted_changes = 0;
+	this->sorted_changes = 0;
+}
+
+// quantizes a view depth by keeping the top KEY_DEPTH_BITS
+// of its float bits, which sort the same way the depths
+// do as long as they aren't negative
+static unsigned long long _quantizeDepth(float depth)
+{
+	if(!(depth > 0.0f))
+		return 0;
+
+	unsigned int bits;
+	memcpy(&bits, &depth, sizeof(float));
+
+	return (unsigned long long)(bits >> (32 - KEY_DEPTH_BITS));
+}
+
+// packs a draw's pass, state IDs and view depth into a
+// sort key. IDs are truncated to their field widths
+unsigned long long RenderQueue::makeKey(int pass, int program, int material, int texture, float depth)
+{
+	unsigned long long p = (unsigned long long)(program & ((1 << KEY_PROGRAM_BITS) - 1));
+	unsigned long long m = (unsigned long long)(material & ((1 << KEY_MATERIAL_BITS) - 1));
+	unsigned long long t = (unsigned long long)(texture & ((1 << KEY_TEXTURE_BITS) - 1));
+	unsigned long long d = _quantizeDepth(depth);
+
+	unsigned long long state = (p << (KEY_MATERIAL_BITS + KEY_TEXTURE_BITS)) | (m << KEY_TEXTURE_BITS) | t;
+
+	if(pass == PASS_TRANSPARENT)
+	{
+		d = ((1ULL << KEY_DEPTH_BITS) - 1) - d;
+		return ((unsigned long long)pass << 60) | (d << 36) | (state << 4);
+	}
+
+	return ((unsigned long long)pass << 60) | (state << 28) | (d << 4);
+}
+
+// returns the pass and state IDs of a key, without its depth
+unsigned long long RenderQueue::stateOf(unsigned long long key)
+{
+	unsigned long long pass = key >> 60;
+
+	if(pass == PASS_TRANSPARENT)
+		return (pass << 32) | ((key >> 4) & 0xFFFFFFFFULL);
+
+	return (pass << 32) | ((key >> 28) & 0xFFFFFFFFULL);
+}
+
+void RenderQueue::clear()
+{
+	this->keys.clear();
+	this->items.clear();
+}
+
+void RenderQueue::reserve(int count)
+{
+	this->keys.reserve(count);
+	this->items.reserve(count);
+}
+
+// adds a draw, 'item' being whatever the caller uses to
+// find the draw again (such as an IndirectBatch object)
+void RenderQueue::submit(unsigned long long key, int item)
+{
+	this->keys.push_back(key);
+	this->items.push_back(item);
+}
+
+// adds every draw in 'other' after the ones already
+// here, in the order they were submitted to it
+void RenderQueue::append(RenderQueue* other)
+{
+	this->keys.insert(this->keys.end(), other->keys.begin(), other->keys.end());
+	this->items.insert(this->items.end(), other->items.begin(), other->items.end());
+}
+
+// counts how many times the state changes going
+// through the queue in its current order
+int RenderQueue::countStateChanges()
+{
+	int i, changes = 0;
+	for(i = 1; i < (int)this->keys.size(); i ++)
+	{
+		if(stateOf(this->keys[i]) != stateOf(this->keys[i - 1]))
+			changes ++;
+	}
+
+	return changes;
+}
+
+// sorts the queue by key with an LSD radix sort, one byte
+// per pass. All eight histograms are built in a single
+// sweep, and bytes that are the same for every key (most
+// of the pass and state bytes, usually) are skipped
+void RenderQueue::sort()
+{
+	int count = (int)this->keys.size();
+
+	this->unsorted_changes = this->countStateChanges();
+
+	if(count < 2)
+	{
+		this->sorted_changes = this->unsorted_changes;
+		return;
+	}
+
+	int histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+
+	int i, b;
+	for(i = 0; i < count; i ++)
+	{
+		unsigned long long key = this->keys[i];
+
+		for(b = 0; b < 8; b ++)
+			histograms[b][(key >> (b * 8)) & 0xFF] ++;
+	}
+
+	this->temp_keys.resize(count);
+	this->temp_items.resize(count);
+
+	unsigned long long* src_keys = &(this->keys[0]);
+	unsigned long long* dst_keys = &(this->temp_keys[0]);
+	int* src_items = &(this->items[0]);
+	int* dst_items = &(this->temp_items[0]);
+
+	for(b = 0; b < 8; b ++)
+	{
+		int* histogram = histograms[b];
+		int shift = b * 8;
+
+		if(histogram[(src_keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		int offsets[256], sum = 0;
+		for(i = 0; i < 256; i ++)
+		{
+			offsets[i] = sum;
+			sum += histogram[i];
+		}
+
+		for(i = 0; i < count; i ++)
+		{
+			int dest = offsets[(src_keys[i] >> shift) & 0xFF] ++;
+
+			dst_keys[dest] = src_keys[i];
+			dst_items[dest] = src_items[i];
+		}
+
+		unsigned long long* swap_keys = src_keys;
+		src_keys = dst_keys;
+		dst_keys = swap_keys;
+
+		int* swap_items = src_items;
+		src_items = dst_items;
+		dst_items = swap_items;
+	}
+
+	// an odd number of passes leaves the result in the temporaries
+	if(src_keys != &(this->keys[0]))
+	{
+		this->keys.swap(this->temp_keys);
+		this->items.swap(this->temp_items);
+	}
+
+	this->sorted_changes = this->countStateChanges();
+}
+
+int RenderQueue::getCount()
+{
+	return (int)this->keys.size();
+}
+
+int RenderQueue::getItem(int index)
+{
+	return this->items[index];
+}
+
+unsigned long long RenderQueue::getKey(int index)
+{
+	return this->keys[index];
+}
+
+// returns the items in their current (sorted) order
+vector<int>& RenderQueue::getItems()
+{
+	return this->items;
+}
+
+// state changes the last sorted frame would have
+// had if drawn in submission order
+int RenderQueue::getUnsortedStateChanges()
+{
+	return this->unsorted_changes;
+}
+
+// state changes after sorting
+int RenderQueue::getSortedStateChanges()
+{
+	return this->sorted_changes;
+}
@@ -0,0 +1,61 @@
+#ifndef RENDERQUEUE_HPP__
+#define RENDERQUEUE_HPP__
+
+#include <vector>
+
+#define PASS_OPAQUE 0
+#define PASS_TRANSPARENT 1
+
+#define KEY_PROGRAM_BITS 8
+#define KEY_MATERIAL_BITS 12
+#define KEY_TEXTURE_BITS 12
+#define KEY_DEPTH_BITS 24
+
+using namespace std;
+
+// a list of draws, each tagged with a 64-bit sort key,
+// sorted once per frame so draws sharing state end up
+// next to each other. Opaque keys are laid out as
+//
+//   pass:4 | program:8 | material:12 | texture:12 | depth:24 | 0:4
+//
+// so state changes are minimized first and draws that
+// share state go front-to-back (for early-z). Transparent
+// keys put the inverted depth right after the pass, so
+// they're drawn back-to-front regardless of state
+class RenderQueue {
+
+	private:
+		vector<unsigned long long> keys;
+		vector<int> items;
+
+		vector<unsigned long long> temp_keys;
+		vector<int> temp_items;
+
+		int unsorted_changes;
+		int sorted_changes;
+
+		int countStateChanges();
+
+	public:
+		RenderQueue();
+
+		static unsigned long long makeKey(int pass, int program, int material, int texture, float depth);
+		static unsigned long long stateOf(unsigned long long key);
+
+		void clear();
+		void reserve(int count);
+		void submit(unsigned long long key, int item);
+		void append(RenderQueue* other);
+		void sort();
+
+		int getCount();
+		int getItem(int index);
+		unsigned long long getKey(int index);
+		vector<int>& getItems();
+
+		int getUnsortedStateChanges();
+		int getSortedStateChanges();
+};
+
+#endif
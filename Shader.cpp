@@ -7,6 +7,7 @@
 #include <fstream>
 
 #include <cstdio>
+#include <cstring>
 
 // returns the length of a given file
 static unsigned int getFileLength(ifstream& file)
@@ -58,104 +59,93 @@ static bool loadShaderSource(const char* filename, char** shaderSource, int* len
    	return true;
 }
 
-// loads a vertex shader file and a fragment
-// shader file into a single shader program
-// wrapped in a Shader class object. Errors
-// are checked for and assessed wherever necessary
-// during the loading process, to ensure the
-// resulting shader program will run without issues
-Shader::Shader(string vertfile, string fragfile)
+// replaces the VERTEX_INPUTS_PRAGMA line of a vertex
+// shader with the inputs declared by the vertex layouts,
+// so their locations always match the VAOs
+static void insertVertexInputs(char** shaderSource, int* len)
 {
-	unsigned int vert_shader, frag_shader;
+	string source(*shaderSource, *len);
 
-	vert_shader = glCreateShader(GL_VERTEX_SHADER);
-	frag_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	size_t pos = source.find(VERTEX_INPUTS_PRAGMA);
+	if(pos == string::npos)
+		return;
 
-	char* vertSource;
-	char* fragSource;
+	source.replace(pos, strlen(VERTEX_INPUTS_PRAGMA), declareVertexInputs());
 
-	int flength, vlength;
+	delete[] *shaderSource;
 
-	if(!loadShaderSource(vertfile.c_str(), &vertSource, &vlength))
-		cout << "Failed to load vertex shader!" << endl;
+	*len = (int)source.length();
+	*shaderSource = new char[(*len) + 1];
 
-	if(!loadShaderSource(fragfile.c_str(), &fragSource, &flength))
-		cout << "Failed to load fragment shader!" << endl;
+	memcpy(*shaderSource, source.c_str(), (*len) + 1);
+}
 
-	glShaderSource(vert_shader, 1, &vertSource, &vlength);
-	glShaderSource(frag_shader, 1, &fragSource, &flength);
+// compiles one shader stage from a file, exiting with the
+// compiler's log if it fails. Vertex shaders get their
+// inputs inserted from the vertex layouts first
+static unsigned int compileShader(unsigned int type, string filename)
+{
+	unsigned int shader_id = glCreateShader(type);
+
+	char* source;
+	int length;
+
+	if(!loadShaderSource(filename.c_str(), &source, &length))
+	{
+		cout << "Failed to load shader " << filename << endl;
+		return shader_id;
+	}
 
-	delete[] vertSource;
-	delete[] fragSource;
+	if(type == GL_VERTEX_SHADER)
+		insertVertexInputs(&source, &length);
 
-	glCompileShader(vert_shader);
-	glCompileShader(frag_shader);
+	glShaderSource(shader_id, 1, &source, &length);
+	delete[] source;
+
+	glCompileShader(shader_id);
+
+	int compiled;
+	glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled);
 
-	int compiled, v_comp, f_comp;
-	glGetShaderiv(vert_shader, GL_COMPILE_STATUS, &v_comp);
-	glGetShaderiv(frag_shader, GL_COMPILE_STATUS, &f_comp);
-	
-	compiled = (v_comp && f_comp ? GL_TRUE : GL_FALSE);
 	if(compiled == GL_FALSE)
 	{
 		int blen = 0;	
 		GLsizei slen = 0;
-		
-		if(v_comp == GL_FALSE)
-		{
-			glGetShaderiv(vert_shader, GL_INFO_LOG_LENGTH, &blen);       
-			if(blen > 1)
-			{
- 				char* compiler_log = (char*)malloc(blen);
- 				glGetShaderInfoLog(vert_shader, blen, &slen, compiler_log);
 
- 				cout << "Vertex shader error:\n" << compiler_log << endl;
- 				free(compiler_log);
-
-				exit(1);
-			}
-		}
-		if(!f_comp == GL_FALSE)
+		glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &blen);       
+		if(blen > 1)
 		{
-			glGetShaderiv(frag_shader, GL_INFO_LOG_LENGTH, &blen);       
-			if(blen > 1)
-			{
- 				char* compiler_log = (char*)malloc(blen);
- 				glGetShaderInfoLog(frag_shader, blen, &slen, compiler_log);
+ 			char* compiler_log = (char*)malloc(blen);
+ 			glGetShaderInfoLog(shader_id, blen, &slen, compiler_log);
 
- 				cout << "Fragment shader error:\n" << compiler_log << endl;
- 				free(compiler_log);
+ 			cout << filename << " error:\n" << compiler_log << endl;
+ 			free(compiler_log);
 
-				exit(1);
-			}
+			exit(1);
 		}
 	}
-	this->prog_id = glCreateProgram();
-
-	glAttachShader(this->prog_id, vert_shader);
-	glAttachShader(this->prog_id, frag_shader);
-
-	glBindFragDataLocation(this->prog_id, 0, FRAG_COLOR_STR);
-	glBindAttribLocation(this->prog_id, NORMAL_ATTR, NORMAL_STR);
-	glBindAttribLocation(this->prog_id, POSITION_ATTR, POSITION_STR);
-    glBindAttribLocation(this->prog_id, TEXCOORD_2D_ATTR, TEXCOORD_2D_STR);
-	glBindAttribLocation(this->prog_id, TEXCOORD_CUBE_ATTR, TEXCOORD_CUBE_STR);
+	return shader_id;
+}
 
-	glLinkProgram(this->prog_id);
+// links the attached shaders of a program,
+// exiting with the linker's log if it fails
+static void linkProgram(unsigned int prog_id)
+{
+	glLinkProgram(prog_id);
 
 	int linked;
-	glGetProgramiv(this->prog_id, GL_LINK_STATUS, &linked);
+	glGetProgramiv(prog_id, GL_LINK_STATUS, &linked);
 
 	if(linked == GL_FALSE)
 	{
 		int blen = 0;	
 		GLsizei slen = 0;
 
-		glGetProgramiv(this->prog_id, GL_INFO_LOG_LENGTH, &blen);       
+		glGetProgramiv(prog_id, GL_INFO_LOG_LENGTH, &blen);       
 		if(blen > 1)
 		{
  			char* compiler_log = (char*)malloc(blen);
- 			glGetProgramInfoLog(this->prog_id, blen, &slen, compiler_log);
+ 			glGetProgramInfoLog(prog_id, blen, &slen, compiler_log);
 
  			cout << "Program linking error:\n" << compiler_log << endl;
  			free(compiler_log);
@@ -163,33 +153,73 @@ Shader::Shader(string vertfile, string fragfile)
 			exit(1);
 		}
 	}
+}
+
+// loads a vertex shader file and a fragment
+// shader file into a single shader program
+// wrapped in a Shader class object. Errors
+// are checked for and assessed wherever necessary
+// during the loading process, to ensure the
+// resulting shader program will run without issues.
+// Camera, light and material values are read from
+// 'blocks', which every program shares
+Shader::Shader(string vertfile, string fragfile, UniformBlocks* blocks)
+{
+	this->blocks = blocks;
+
+	unsigned int vert_shader = compileShader(GL_VERTEX_SHADER, vertfile);
+	unsigned int frag_shader = compileShader(GL_FRAGMENT_SHADER, fragfile);
+
+	this->prog_id = glCreateProgram();
+
+	glAttachShader(this->prog_id, vert_shader);
+	glAttachShader(this->prog_id, frag_shader);
+
+	glBindFragDataLocation(this->prog_id, 0, FRAG_COLOR_STR);
+
+	linkProgram(this->prog_id);
+
 	glDetachShader(this->prog_id, vert_shader);
 	glDetachShader(this->prog_id, frag_shader);
 
 	glDeleteShader(vert_shader);
 	glDeleteShader(frag_shader);
 
-	this->begin();
+	this->table = new UniformTable(this->prog_id);
+
+	this->setUniformi(UNIFORM_ID(TEXTURE_SHADOW_CUBES_STR), TEXTURE_SHADOW_CUBES_ID);
+	this->setUniformi(UNIFORM_ID(TEXTURE_SHADOW_CASCADES_STR), TEXTURE_SHADOW_CASCADES_ID);
+	this->setUniformi(UNIFORM_ID(TEXTURE_PHYSICAL_STR), TEXTURE_PHYSICAL_ID);
+	this->setUniformi(UNIFORM_ID(TEXTURE_INDIRECTION_STR), TEXTURE_INDIRECTION_ID);
+	this->setUniformi(UNIFORM_ID(TEXTURE_CUBE_STR), TEXTURE_CUBE_ID);
+	this->setUniformi(UNIFORM_ID(TEXTURE_2D_STR), TEXTURE_2D_ID);
 
-	this->cm_mat_loc = glGetUniformLocation(this->prog_id, CAMERA_MATRIX_STR);
-	this->mv_mat_loc = glGetUniformLocation(this->prog_id, MODELVIEW_MATRIX_STR);
-	this->pr_mat_loc = glGetUniformLocation(this->prog_id, PROJECTION_MATRIX_STR);
-	
-	int tex_cube_loc = glGetUniformLocation(this->prog_id, TEXTURE_CUBE_STR);
-	int tex_2d_loc = glGetUniformLocation(this->prog_id, TEXTURE_2D_STR);
+	this->setUniformi(UNIFORM_ID(DRAW_MODE_STR), DRAW_MODE_SINGLE);
+}
+
+// loads a compute shader file into a program of its
+// own, run with 'dispatch' rather than by drawing
+Shader::Shader(string compfile, UniformBlocks* blocks)
+{
+	this->blocks = blocks;
+
+	unsigned int comp_shader = compileShader(GL_COMPUTE_SHADER, compfile);
+
+	this->prog_id = glCreateProgram();
+	glAttachShader(this->prog_id, comp_shader);
 
-	glUniform1i(tex_cube_loc, TEXTURE_CUBE_ID);
-	glUniform1i(tex_2d_loc, TEXTURE_2D_ID);
+	linkProgram(this->prog_id);
 
-	this->num_lights = 0;
-	this->setUniformi(NUM_LIGHTS_STR, this->num_lights);
+	glDetachShader(this->prog_id, comp_shader);
+	glDeleteShader(comp_shader);
 
-	this->end();
+	this->table = new UniformTable(this->prog_id);
 }
 
 // deletes the loaded shader program for this Shader class object
 Shader::~Shader()
 {
+	delete this->table;
 	glDeleteProgram(this->prog_id);
 }
 
@@ -209,120 +239,155 @@ void Shader::setTexture(int num)
 	glActiveTexture(GL_TEXTURE0 + (unsigned int)num);
 }
 
-// pushes an integer value to the corresponding
-// uniform variable in the active shader set
-void Shader::setUniformi(string name, int value)
+// the setters below take a uniform's hashed name (see
+// UNIFORM_ID) and only record the value; nothing reaches
+// GL until 'flush', and then only if the value changed
+
+// sets an integer (or sampler) uniform
+void Shader::setUniformi(unsigned int id, int value)
+{
+	this->table->set(id, &value, sizeof(int));
+}
+
+// sets a float uniform
+void Shader::setUniformf(unsigned int id, float value)
+{
+	this->table->set(id, &value, sizeof(float));
+}
+
+// sets a vec2 uniform
+void Shader::setUniform2f(unsigned int id, float x, float y)
 {
-	int var_loc = glGetUniformLocation(this->prog_id, name.c_str());
-	glUniform1i(var_loc, value);
+	float value[2] = { x, y };
+	this->table->set(id, value, sizeof(value));
 }
 
-// recursively sets light values in the active
-// shader set based on values from a list of
-// Light class objects
-void Shader::setLighting(Light** lights, int amount)
+// sets a vector or array uniform from 'count' floats
+// (3 for a vec3, 4 * N for a vec4[N], ...)
+void Shader::setUniformfv(unsigned int id, const float* value, int count)
 {
-	int i;
-	for(i = 0; i < amount; i ++)
-		this->setLight(lights[i], i);
+	this->table->set(id, value, count * sizeof(float));
 }
 
-// same as 'setLighting', but sets only from a
-// single Light object
-void Shader::setLight(Light* light, int n)
+// sets a mat3 uniform (column-major)
+void Shader::setUniformMatrix3(unsigned int id, const float* value)
 {
-	char* l_specular =  new char[50];
-	char* l_ambient = new char[50];
-	char* l_diffuse = new char[50];
-	char* l_pos = new char[50];
+	this->table->set(id, value, 9 * sizeof(float));
+}
 
-	if(this->num_lights <= n)
+// sets a mat4 uniform (column-major)
+void Shader::setUniformMatrix4(unsigned int id, const float* value)
+{
+	this->table->set(id, value, 16 * sizeof(float));
+}
+
+// sends the uniforms changed since the last flush,
+// called with the program bound just before drawing
+void Shader::flush()
+{
+	this->table->flush();
+}
+
+// binds a virtual texture's indirection texture and
+// the physical page cache behind it, and sets the
+// values needed to turn texcoords into page lookups.
+// Passing NULL switches back to regular 2D textures
+void Shader::setVirtualTexture(VirtualTexture* vtex)
+{
+	if(vtex == NULL)
 	{
-		this->num_lights = n + 1;
-		this->setUniformi(NUM_LIGHTS_STR, this->num_lights);
+		this->setUniformi(UNIFORM_ID(IS_VIRTUAL_STR), 0);
+		return;
 	}
+	this->setUniformi(UNIFORM_ID(IS_VIRTUAL_STR), 1);
+	this->setUniformi(UNIFORM_ID(VT_ID_STR), vtex->getID());
+	this->setUniformf(UNIFORM_ID(VT_MAX_MIP_STR), (float)(vtex->getNumMips() - 1));
+	this->setUniform2f(UNIFORM_ID(VT_PAGES_STR), (float)vtex->getPagesX(0), (float)vtex->getPagesY(0));
 
-	snprintf(l_specular, 50, "lights[%d].specular", n);
-	snprintf(l_ambient, 50, "lights[%d].ambient", n);
-	snprintf(l_diffuse, 50, "lights[%d].diffuse", n);
-	snprintf(l_pos, 50, "lights[%d].pos", n);
-
-	int l_specular_loc = glGetUniformLocation(this->prog_id, l_specular);
-	int l_ambient_loc = glGetUniformLocation(this->prog_id, l_ambient);
-	int l_diffuse_loc = glGetUniformLocation(this->prog_id, l_diffuse);
-	int l_pos_loc = glGetUniformLocation(this->prog_id, l_pos);
-
-	glUniform3fv(l_specular_loc, 1, light->getSpecular());
-	glUniform3fv(l_ambient_loc, 1, light->getAmbient());
-	glUniform3fv(l_diffuse_loc, 1, light->getDiffuse());
-	glUniform3fv(l_pos_loc, 1, light->getPos());
-
-	delete[] l_specular;
-	delete[] l_ambient;
-	delete[] l_diffuse;
-	delete[] l_pos;
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_INDIRECTION_ID);
+	glBindTexture(GL_TEXTURE_2D, vtex->getIndirection());
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_PHYSICAL_ID);
+	glBindTexture(GL_TEXTURE_2D, vtex->getPhysical());
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_2D_ID);
+}
+
+// sets the SH irradiance coefficients (SH_NUM_COEFFS
+// RGB triples) the ambient term is evaluated from
+void Shader::setIrradiance(float* coeffs)
+{
+	this->blocks->setIrradiance(coeffs);
 }
 
 // sets values for the active shader set based
 // on the values from a Material class object
 void Shader::setMaterial(Material* material)
 {
-	string m_ambient = "material.ambient";
-	string m_diffuse = "material.diffuse";
-	string m_specular = "material.specular";
-	string m_shininess = "material.shininess";
-
-	int m_ambient_loc = glGetUniformLocation(this->prog_id, m_ambient.c_str());
-	int m_diffuse_loc = glGetUniformLocation(this->prog_id, m_diffuse.c_str());
-	int m_specular_loc = glGetUniformLocation(this->prog_id, m_specular.c_str());
-	int m_shininess_loc = glGetUniformLocation(this->prog_id, m_shininess.c_str());
-
-	glUniform3fv(m_ambient_loc, 1, material->getAmbient());
-	glUniform3fv(m_diffuse_loc, 1, material->getDiffuse());
-	glUniform3fv(m_specular_loc, 1, material->getSpecular());
-	glUniform1f(m_shininess_loc, material->getShininess());
+	this->blocks->setMaterial(material);
 }
 
-// sets the view matrix to the active
-// shader program, to be used after world
-// or camera translations but before object
-// translations
-void Shader::setCameraMatrix()
+// sets the view matrix, to be set before any
+// objects are rendered. It's shared by every
+// program through the frame block
+void Shader::setCameraMatrix(const Mat4& view)
 {
-	float* cm_mat = new float[16];
+	this->blocks->setView(view);
+}
+
+// sets an object's model matrix to the active
+// shader program, along with the full model-view-
+// projection matrix and the normal matrix built
+// from it, so the vertex shader has nothing left
+// to compute per vertex
+void Shader::setModelMatrix(const Mat4& model)
+{
+	Mat4 mvp = this->blocks->getViewProjection() * model;
 
-	glGetFloatv(GL_MODELVIEW_MATRIX, cm_mat);
-	glUniformMatrix4fv(this->cm_mat_loc, 1, GL_FALSE, cm_mat);
+	float normal[9];
+	model.normalMatrix(normal);
 
-	delete[] cm_mat;
+	this->setUniformMatrix4(UNIFORM_ID(MODEL_MATRIX_STR), model.m);
+	this->setUniformMatrix4(UNIFORM_ID(MVP_MATRIX_STR), mvp.m);
+	this->setUniformMatrix3(UNIFORM_ID(NORMAL_MATRIX_STR), normal);
 }
 
-// sets the modelview matrix to the active
-// shader program, to be used after translations
-// for the camera and current world object
-// have been done
-void Shader::setModelViewMatrix()
+// sets the projection matrix, to be used before
+// the camera matrix is set. Describes the window's
+// viewport and perspective
+void Shader::setProjectionMatrix(const Mat4& projection)
 {
-	float* mv_mat = new float[16];
-
-	glGetFloatv(GL_MODELVIEW_MATRIX, mv_mat);
-	glUniformMatrix4fv(this->mv_mat_loc, 1, GL_FALSE, mv_mat);
+	this->blocks->setProjection(projection);
+}
 
-	delete[] mv_mat;
+// switches where the shaders take per-object data from:
+// the model matrix uniforms (DRAW_MODE_SINGLE), per-
+// instance matrices read from an InstanceBuffer
+// (DRAW_MODE_INSTANCED), or the per-draw records of an
+// IndirectBatch (DRAW_MODE_INDIRECT)
+void Shader::setDrawMode(int mode)
+{
+	this->setUniformi(UNIFORM_ID(DRAW_MODE_STR), mode);
 }
 
-// sets the projection matrix to the shader program,
-// to be used before anything happens in the modelview
-// matrix mode of the render loop. Describes the window's
-// viewport and 2D perspective
-void Shader::setProjectionMatrix()
+// runs a compute program over 'groups' work groups,
+// flushing its uniforms first. The program must be bound
+void Shader::dispatch(int groups)
 {
-	float* pr_mat = new float[16];
+	this->dispatch(groups, 1);
+}
 
-	glGetFloatv(GL_PROJECTION_MATRIX, pr_mat);
-	glUniformMatrix4fv(this->pr_mat_loc, 1, GL_FALSE, pr_mat);
+// same as above, over a 2D grid of work groups
+void Shader::dispatch(int groups_x, int groups_y)
+{
+	this->flush();
+	glDispatchCompute((unsigned int)groups_x, (unsigned int)groups_y, 1);
+}
 
-	delete[] pr_mat;
+// returns the GL name of the shader program
+unsigned int Shader::getProgram()
+{
+	return this->prog_id;
 }
 
 // unbinds the shader program for this Shader class object
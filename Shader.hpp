@@ -1,62 +1,94 @@
 #ifndef SHADER_HPP__
 #define SHADER_HPP__
 
+#include "SphericalHarmonics.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformTable.hpp"
+#include "VirtualTexture.hpp"
+#include "VertexLayout.hpp"
+#include "VectorMath.hpp"
 #include "Material.hpp"
-#include "Light.hpp"
 
 #include <string>
 
-#define MODELVIEW_MATRIX_STR "modelViewMatrix"
-#define PROJECTION_MATRIX_STR "projMatrix"
-#define CAMERA_MATRIX_STR "viewMatrix"
-
-#define TEXCOORD_CUBE_STR "texcoordCube"
-#define TEXCOORD_2D_STR "texcoord2D"
-#define POSITION_STR "position"
-#define NORMAL_STR "normal"
-
-#define TEXCOORD_CUBE_ATTR 3
-#define TEXCOORD_2D_ATTR 1
-#define POSITION_ATTR 0
-#define NORMAL_ATTR 2
+#define MODEL_MATRIX_STR "modelMatrix"
+#define NORMAL_MATRIX_STR "normalMatrix"
+#define MVP_MATRIX_STR "mvpMatrix"
 
+#define TEXTURE_SHADOW_CUBES_ID 12
+#define TEXTURE_SHADOW_CASCADES_ID 11
+#define TEXTURE_PHYSICAL_ID 3
+#define TEXTURE_INDIRECTION_ID 2
 #define TEXTURE_CUBE_ID 1
 #define TEXTURE_2D_ID 0
 
+#define TEXTURE_SHADOW_CUBES_STR "shadowCubes"
+#define TEXTURE_SHADOW_CASCADES_STR "shadowCascades"
+#define TEXTURE_PHYSICAL_STR "vtPhysical"
+#define TEXTURE_INDIRECTION_STR "vtIndirection"
 #define TEXTURE_CUBE_STR "texCube"
 #define TEXTURE_2D_STR "tex2D"
 
-#define FRAG_COLOR_STR "gl_FragColor"
-#define NUM_LIGHTS_STR "num_lights"
-#define CAMERA_POS_STR "cameraPos"
+#define FRAG_COLOR_STR "fragColor"
 #define IS_SKYBOX_STR "is_skybox"
+#define DRAW_MODE_STR "draw_mode"
 #define PICKED_STR "picked"
+#define UUID_STR "uuid"
+
+#define DRAW_MODE_SINGLE 0
+#define DRAW_MODE_INSTANCED 1
+#define DRAW_MODE_INDIRECT 2
+
+#define DRAW_RECORDS_BINDING 0
+#define OBJECT_RECORDS_BINDING 1
+#define VISIBLE_OBJECTS_BINDING 2
+#define LIGHT_RECORDS_BINDING 3
+#define CLUSTER_RECORDS_BINDING 4
+#define CLUSTER_INDICES_BINDING 5
+
+#define IS_VIRTUAL_STR "is_virtual"
+#define VT_ID_STR "vt_id"
+#define VT_PAGES_STR "vt_pages"
+#define VT_MAX_MIP_STR "vt_max_mip"
+#define VT_BIAS_STR "vt_bias"
 
 using namespace std;
 
 class Shader {
 
 	private:
-		unsigned int mv_mat_loc;
-		unsigned int pr_mat_loc;
-		unsigned int cm_mat_loc;
 		unsigned int prog_id;
 
-		int num_lights;
+		UniformBlocks* blocks;
+		UniformTable* table;
 
 	public:
-		Shader(string vertfile, string fragfile);
+		Shader(string vertfile, string fragfile, UniformBlocks* blocks);
+		Shader(string compfile, UniformBlocks* blocks);
 		~Shader();
 	
-		void setProjectionMatrix();
-		void setModelViewMatrix();
-		void setCameraMatrix();
+		void setProjectionMatrix(const Mat4& projection);
+		void setCameraMatrix(const Mat4& view);
+		void setModelMatrix(const Mat4& model);
+		void setDrawMode(int mode);
 
-		void setLighting(Light** light, int amount);
 		void setMaterial(Material* material);
-		void setLight(Light* light, int n);
+		void setIrradiance(float* coeffs);
+
+		void setVirtualTexture(VirtualTexture* vtex);
+
+		void setUniformi(unsigned int id, int value);
+		void setUniformf(unsigned int id, float value);
+		void setUniform2f(unsigned int id, float x, float y);
+		void setUniformfv(unsigned int id, const float* value, int count);
+		void setUniformMatrix3(unsigned int id, const float* value);
+		void setUniformMatrix4(unsigned int id, const float* value);
+		void flush();
+
+		void dispatch(int groups);
+		void dispatch(int groups_x, int groups_y);
 
-		void setUniformi(string name, int value);
+		unsigned int getProgram();
 		void setTexture(int num);
 
 		void begin();
@@ -0,0 +1,332 @@
+#include "ShadowMaps.hpp"
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+// where each cube face looks from the light, and its up
+// direction, in the order of the GL_TEXTURE_CUBE_MAP_*
+// faces, so what's drawn lines up with cube lookups
+static const float _cube_faces[6][2][3] = {
+	{ { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },
+	{ { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },
+	{ { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+	{ { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } },
+	{ { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },
+	{ { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } }
+};
+
+// makes a depth texture array of 'layers' layers. The ones
+// shaders sample compare against a reference depth, with
+// linear filtering blending 4 results; the caches don't
+static unsigned int _makeDepthArray(unsigned int target, int size, int layers, bool compare)
+{
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(target, texture);
+
+	glTexStorage3D(target, 1, GL_DEPTH_COMPONENT32F, size, size, layers);
+
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, (compare ? GL_LINEAR : GL_NEAREST));
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, (compare ? GL_LINEAR : GL_NEAREST));
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	if(compare)
+	{
+		glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	}
+
+	glBindTexture(target, 0);
+	return texture;
+}
+
+// creates the shadow maps and their caches, along with the
+// programs drawing casters into the cascades (res/shadow.vs,
+// res/cascade.fs) and the cubes (res/shadow.vs/.fs).
+// The sun points straight down until 'setSun'
+ShadowMaps::ShadowMaps(UniformBlocks* blocks)
+{
+	this->blocks = blocks;
+	this->sun_program = new Shader("res/shadow.vs", "res/cascade.fs", blocks);
+	this->cube_program = new Shader("res/shadow.vs", "res/shadow.fs", blocks);
+
+	this->cascades = _makeDepthArray(GL_TEXTURE_2D_ARRAY, SHADOW_CASCADE_SIZE, SHADOW_CASCADES, true);
+	this->cascade_cache = _makeDepthArray(GL_TEXTURE_2D_ARRAY, SHADOW_CASCADE_SIZE, SHADOW_CASCADES, false);
+	this->cubes = _makeDepthArray(GL_TEXTURE_CUBE_MAP_ARRAY, SHADOW_CUBE_SIZE, MAX_SHADOW_CUBES * 6, true);
+	this->cube_cache = _makeDepthArray(GL_TEXTURE_CUBE_MAP_ARRAY, SHADOW_CUBE_SIZE, MAX_SHADOW_CUBES * 6, false);
+
+	// only ever has a depth attachment
+	int previous = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+	glGenFramebuffers(1, &(this->fbo));
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+	this->sun = Vec3(0.0f, -1.0f, 0.0f);
+
+	memset(this->splits, 0, sizeof(this->splits));
+	memset(this->texels, 0, sizeof(this->texels));
+	memset(this->cascade_layers, 0, sizeof(this->cascade_layers));
+	memset(this->cube_layers, 0, sizeof(this->cube_layers));
+
+	this->static_version = -1;
+	this->static_layers = 0;
+	this->restored_layers = 0;
+	this->dynamic_casters = 0;
+}
+
+ShadowMaps::~ShadowMaps()
+{
+	delete this->sun_program;
+	delete this->cube_program;
+
+	glDeleteTextures(1, &(this->cascades));
+	glDeleteTextures(1, &(this->cascade_cache));
+	glDeleteTextures(1, &(this->cubes));
+	glDeleteTextures(1, &(this->cube_cache));
+	glDeleteFramebuffers(1, &(this->fbo));
+}
+
+// sets the direction the sun shines in
+void ShadowMaps::setSun(const Vec3& direction)
+{
+	this->sun = direction.normalize();
+}
+
+// gives light 'index' of 'lights' a cube of shadows,
+// returning which one, or -1 if they're all taken
+int ShadowMaps::addLight(LightBuffer* lights, int index)
+{
+	if((int)this->lights.size() >= MAX_SHADOW_CUBES)
+	{
+		cout << "No shadow cubes left for light " << index << endl;
+		return -1;
+	}
+
+	int cube = (int)this->lights.size();
+
+	this->lights.push_back(index);
+	lights->setShadow(index, cube);
+
+	return cube;
+}
+
+// fits a cascade around the part of the view between two
+// depths: a box around the sphere through its corners,
+// seen from the sun. The sphere's size doesn't depend on
+// where the camera looks, and its center is snapped to a
+// grid in the sun's view, so the matrix only changes when
+// the center crosses a grid line
+Mat4 ShadowMaps::fitCascade(int cascade, float znear, float zfar, const Mat4& inv_view, const Mat4& inv_projection)
+{
+	Vec3 corners[8];
+	Vec3 center(0.0f, 0.0f, 0.0f);
+
+	int i;
+	for(i = 0; i < 8; i ++)
+	{
+		Vec3 far = inv_projection.projectPoint(Vec3((i & 1 ? 1.0f : -1.0f), (i & 2 ? 1.0f : -1.0f), 1.0f));
+		corners[i] = far * ((i & 4 ? zfar : znear) / -far.z);
+		center = center + corners[i] * 0.125f;
+	}
+
+	float radius = 0.0f;
+	for(i = 0; i < 8; i ++)
+		radius = max(radius, (corners[i] - center).length());
+
+	// looking down the sun's direction from the origin
+	Vec3 up = (fabsf(this->sun.y) > 0.99f ? Vec3(0.0f, 0.0f, 1.0f) : Vec3(0.0f, 1.0f, 0.0f));
+	Mat4 sun_view = Mat4::lookAt(Vec3(0.0f, 0.0f, 0.0f), this->sun, up);
+
+	Vec3 c = sun_view.transformPoint(inv_view.transformPoint(center));
+
+	// the box reaches a step past the sphere, so snapping
+	// never leaves any of it uncovered
+	float half = radius * (1.0f + 1.0f / SHADOW_SNAP_STEPS);
+	float texel = 2.0f * half / SHADOW_CASCADE_SIZE;
+	float step = texel * max(floorf(radius / SHADOW_SNAP_STEPS / texel), 1.0f);
+
+	float x = floorf(c.x / step + 0.5f) * step;
+	float y = floorf(c.y / step + 0.5f) * step;
+	float z = floorf(c.z / step + 0.5f) * step;
+
+	this->texels[cascade] = texel;
+
+	return Mat4::ortho(x - half, x + half, y - half, y + half, -z - SHADOW_CASTER_DISTANCE, -z + half) * sun_view;
+}
+
+// brings one layer up to date: redraws its cached static
+// casters if what it's drawn with changed, restores the
+// cache into it if dynamic casters were drawn over it, then
+// draws the dynamic casters in view on top. 'light' is the
+// point light's position and reach (w), or all 0 for the sun,
+// and 'program' the one drawing this kind of layer
+void ShadowMaps::drawLayer(Shader* program, ShadowLayer& layer, const Mat4& view_projection, const float* light, unsigned int texture,
+						   unsigned int cache, int index, int size, IndirectBatch* batch, bool statics_changed)
+{
+	bool moved = (memcmp(layer.view_projection.m, view_projection.m, sizeof(view_projection.m)) != 0 ||
+				  memcmp(layer.light, light, sizeof(layer.light)) != 0);
+
+	unsigned int target = (texture == this->cascades ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_CUBE_MAP_ARRAY);
+
+	program->setUniformMatrix4(UNIFORM_ID(SHADOW_MATRIX_STR), view_projection.m);
+	program->setUniformfv(UNIFORM_ID(SHADOW_LIGHT_STR), light, 4);
+
+	if(moved || statics_changed || !(layer.cached))
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cache, 0, index);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		batch->renderCasters(program, view_projection, false);
+
+		layer.view_projection = view_projection;
+		memcpy(layer.light, light, sizeof(layer.light));
+
+		layer.cached = true;
+		layer.dirty = true;
+		this->static_layers ++;
+	}
+
+	if(layer.dirty)
+	{
+		glCopyImageSubData(cache, target, 0, 0, 0, index, texture, target, 0, 0, 0, index, size, size, 1);
+		this->restored_layers ++;
+	}
+
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, index);
+
+	int count = batch->renderCasters(program, view_projection, true);
+
+	layer.dirty = (count > 0);
+	this->dynamic_casters += count;
+}
+
+// draws this frame's shadows of 'batch' for a camera with
+// 'view' and 'projection' (whose near and far planes are
+// 'znear' and 'zfar'), and passes the cascades on to the
+// light block. Casters are drawn with both sides, since
+// the walls are open meshes
+void ShadowMaps::render(IndirectBatch* batch, LightBuffer* lights, const Mat4& view, const Mat4& projection, float znear, float zfar)
+{
+	bool statics_changed = (batch->getStaticVersion() != this->static_version);
+	this->static_version = batch->getStaticVersion();
+
+	this->static_layers = 0;
+	this->restored_layers = 0;
+	this->dynamic_casters = 0;
+
+	int previous = 0, viewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+	glDisable(GL_CULL_FACE);
+
+	this->sun_program->begin();
+
+	Mat4 inv_view = view.inverse();
+	Mat4 inv_projection = projection.inverse();
+
+	// splits blend even and logarithmic spacing
+	float far = min(SHADOW_DISTANCE, zfar);
+	float start = znear;
+
+	Mat4 matrices[SHADOW_CASCADES];
+	float sun_light[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	Mat4 bias = Mat4::identity();
+	bias.m[0] = bias.m[5] = bias.m[10] = 0.5f;
+	bias.m[12] = bias.m[13] = bias.m[14] = 0.5f;
+
+	glViewport(0, 0, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE);
+
+	int i, face;
+	for(i = 0; i < SHADOW_CASCADES; i ++)
+	{
+		float f = (float)(i + 1) / SHADOW_CASCADES;
+		float split = SHADOW_SPLIT_LAMBDA * znear * powf(far / znear, f) + (1.0f - SHADOW_SPLIT_LAMBDA) * (znear + (far - znear) * f);
+
+		Mat4 view_projection = this->fitCascade(i, start, split, inv_view, inv_projection);
+
+		this->drawLayer(this->sun_program, this->cascade_layers[i], view_projection, sun_light, this->cascades,
+						this->cascade_cache, i, SHADOW_CASCADE_SIZE, batch, statics_changed);
+
+		matrices[i] = bias * view_projection;
+		this->splits[i] = split;
+		start = split;
+	}
+
+	this->sun_program->end();
+	this->cube_program->begin();
+
+	glViewport(0, 0, SHADOW_CUBE_SIZE, SHADOW_CUBE_SIZE);
+
+	for(i = 0; i < (int)this->lights.size(); i ++)
+	{
+		LightRecord& record = lights->getLight(this->lights[i]);
+
+		Vec3 pos(record.pos[0], record.pos[1], record.pos[2]);
+		float reach = (record.radius > 0.0f ? record.radius : SHADOW_CUBE_FAR);
+		float light[4] = { pos.x, pos.y, pos.z, reach };
+
+		Mat4 cube_projection = Mat4::perspective(90.0f, 1.0f, SHADOW_CUBE_NEAR, reach);
+
+		for(face = 0; face < 6; face ++)
+		{
+			Vec3 dir(_cube_faces[face][0][0], _cube_faces[face][0][1], _cube_faces[face][0][2]);
+			Vec3 up(_cube_faces[face][1][0], _cube_faces[face][1][1], _cube_faces[face][1][2]);
+
+			Mat4 view_projection = cube_projection * Mat4::lookAt(pos, pos + dir, up);
+
+			this->drawLayer(this->cube_program, this->cube_layers[i * 6 + face], view_projection, light, this->cubes,
+							this->cube_cache, i * 6 + face, SHADOW_CUBE_SIZE, batch, statics_changed);
+		}
+	}
+
+	this->cube_program->end();
+
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, 0, 0, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glEnable(GL_CULL_FACE);
+
+	this->blocks->setCascades(matrices, this->splits, this->texels);
+}
+
+// binds the cascades and cubes for the scene's shaders
+void ShadowMaps::bind()
+{
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_SHADOW_CASCADES_ID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->cascades);
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_SHADOW_CUBES_ID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, this->cubes);
+
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// layers whose static casters were redrawn last frame
+int ShadowMaps::getStaticLayers()
+{
+	return this->static_layers;
+}
+
+// layers the cache was copied back into last frame
+int ShadowMaps::getRestoredLayers()
+{
+	return this->restored_layers;
+}
+
+// dynamic objects drawn into all the layers last frame
+int ShadowMaps::getDynamicCasters()
+{
+	return this->dynamic_casters;
+}
@@ -0,0 +1,114 @@
+#ifndef SHADOWMAPS_HPP__
+#define SHADOWMAPS_HPP__
+
+#include "IndirectBatch.hpp"
+#include "UniformBlocks.hpp"
+#include "LightBuffer.hpp"
+#include "VectorMath.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+// resolution of each cascade and each cube face
+#define SHADOW_CASCADE_SIZE 1024
+#define SHADOW_CUBE_SIZE 512
+
+// point lights that can cast shadows at once
+#define MAX_SHADOW_CUBES 4
+
+// how far from the camera the cascades reach, and how
+// far their splits lean from even spacing (0) towards
+// logarithmic spacing (1)
+#define SHADOW_DISTANCE 500.0f
+#define SHADOW_SPLIT_LAMBDA 0.75f
+
+// how far towards the sun from the middle of a cascade
+// casters are still drawn into it
+#define SHADOW_CASTER_DISTANCE 1000.0f
+
+// a cascade's center moves in steps of 1/this of its
+// radius, so its matrix (and with it, its cached static
+// casters) only changes every so often as the camera moves
+#define SHADOW_SNAP_STEPS 8
+
+// depth range of cube shadows. Lights without a radius
+// reach SHADOW_CUBE_FAR, which must match shadow_cube_far
+// in main.fs/deferred.cs
+#define SHADOW_CUBE_NEAR 0.5f
+#define SHADOW_CUBE_FAR 1000.0f
+
+#define SHADOW_MATRIX_STR "shadow_matrix"
+#define SHADOW_LIGHT_STR "shadow_light"
+
+using namespace std;
+
+// one cascade or cube face: what it was last drawn with,
+// whether its cached static casters are up to date, and
+// whether dynamic casters were drawn over them since
+struct ShadowLayer {
+
+	Mat4 view_projection;
+	float light[4];
+
+	bool cached;
+	bool dirty;
+};
+
+// shadows for the sun, as SHADOW_CASCADES cascades over
+// growing ranges of view depth, and for up to
+// MAX_SHADOW_CUBES point lights, as cube maps. Each layer
+// (cascade or cube face) keeps the static casters drawn
+// into a cache of its own, which is only redrawn when the
+// layer's matrix, the light or the static objects change.
+// Every frame the cache is copied into the layer (if dynamic
+// casters were drawn over it since) and the dynamic casters
+// in view are drawn on top, so the cost of a frame mostly
+// depends on what moves. Cascade centers snap to a coarse
+// grid, so that the cascades only move now and then
+class ShadowMaps {
+
+	private:
+		UniformBlocks* blocks;
+		Shader* sun_program;
+		Shader* cube_program;
+
+		unsigned int cascades;
+		unsigned int cascade_cache;
+		unsigned int cubes;
+		unsigned int cube_cache;
+		unsigned int fbo;
+
+		Vec3 sun;
+		float splits[SHADOW_CASCADES];
+		float texels[SHADOW_CASCADES];
+
+		ShadowLayer cascade_layers[SHADOW_CASCADES];
+		ShadowLayer cube_layers[MAX_SHADOW_CUBES * 6];
+		vector<int> lights;
+
+		int static_version;
+
+		int static_layers;
+		int restored_layers;
+		int dynamic_casters;
+
+		Mat4 fitCascade(int cascade, float znear, float zfar, const Mat4& inv_view, const Mat4& inv_projection);
+		void drawLayer(Shader* program, ShadowLayer& layer, const Mat4& view_projection, const float* light, unsigned int texture,
+					   unsigned int cache, int index, int size, IndirectBatch* batch, bool statics_changed);
+
+	public:
+		ShadowMaps(UniformBlocks* blocks);
+		~ShadowMaps();
+
+		void setSun(const Vec3& direction);
+		int addLight(LightBuffer* lights, int index);
+
+		void render(IndirectBatch* batch, LightBuffer* lights, const Mat4& view, const Mat4& projection, float znear, float zfar);
+		void bind();
+
+		int getStaticLayers();
+		int getRestoredLayers();
+		int getDynamicCasters();
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SIMD_HPP__
+#define SIMD_HPP__
+
+// the SSE/AVX intrinsics the CPU side vectorizes with,
+// depending on what the build targets, and the helpers
+// shared by the files using them
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifdef __AVX__
+#include <immintrin.h>
+
+// a * b + c, fused when the CPU can
+static inline __m256 _madd8(__m256 a, __m256 b, __m256 c)
+{
+#ifdef __FMA__
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+#endif
@@ -1,6 +1,5 @@
 #include "Skybox.hpp"
 
-#include <SOIL/SOIL.h>
 #include <GL/glew.h>
 
 #include <iostream>
@@ -9,61 +8,73 @@
 
 #define NUM_VERTS 36
 
-// used to keep values packed and
-// neatly organized
-struct Vertex {
-
-	float x;
-	float y;
-	float z;
-	float t;
-	float u;
-	float v;
-};
-
-// only initializes a Vertex struct type defined in this
+// only initializes a SkyboxVertex struct type defined in this
 // file, used primarily for neatness of the code
-static struct Vertex createVertex3d(float x, float y, float z)
+static struct SkyboxVertex createVertex3d(float x, float y, float z)
 {
-	struct Vertex _vertex = {.x=x, .y=y, .z=z, .t=x, .u=y, .v=z};
+	struct SkyboxVertex _vertex = {.x=x, .y=y, .z=z, .t=x, .u=y, .v=z};
 	return _vertex;
 }
 
 // creates a Skybox class object by loading multiple
-// texture files to a cube map texture ID. Also creates
-// a VBO using pre-defined vertices, packed as
-// Vertex structs
+// texture files to a cube map through the
+// TextureManager. Also creates a VBO using
+// pre-defined vertices, packed as Vertex structs,
+// and projects the faces to SH irradiance
 Skybox::Skybox(string left, string right, string top,
-				string bottom, string front, string back)
+				string bottom, string front, string back,
+				TextureManager* textures)
 {
-	glGenTextures(1, &(this->tex));
-	glBindTexture(GL_TEXTURE_CUBE_MAP, this->tex);
+	this->textures = textures;
 
-	const char* filenames[] = {
-		right.c_str(), left.c_str(), top.c_str(), 
-		bottom.c_str(), back.c_str(), front.c_str()
+	string filenames[] = {
+		right, left, top,
+		bottom, back, front
 	};
 
-	int i;
-	for(i = 0; i < 6; i ++)
+	unsigned char* faces[6];
+	bool soil[6];
+	int width = 0, height = 0;
+
+	memset(this->irradiance, 0, sizeof(this->irradiance));
+
+	// the faces are decoded once, for both the cube map
+	// and the irradiance
+	int i, loaded;
+	for(loaded = 0; loaded < 6; loaded ++)
 	{
-		unsigned char* image;
-		int tex_width, tex_height;
+		int face_width = 0, face_height = 0;
+
+		faces[loaded] = TextureManager::loadImage(filenames[loaded], &face_width, &face_height, &(soil[loaded]));
+		if(faces[loaded] == NULL)
+			break;
 
-		image = SOIL_load_image(filenames[i], &tex_width, &tex_height, 0, SOIL_LOAD_RGBA);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (unsigned int)i, 0, GL_RGBA, tex_width, tex_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		SOIL_free_image_data(image);
+		if(loaded > 0 && (face_width != width || face_height != height))
+		{
+			TextureManager::freeImage(faces[loaded], soil[loaded]);
+			break;
+		}
+
+		width = face_width;
+		height = face_height;
 	}
 
-	glGenerateMipmapEXT(GL_TEXTURE_CUBE_MAP);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	if(loaded == 6)
+	{
+		this->tex = textures->loadCube(filenames, faces, width, height);
+		projectIrradiance(faces, width, height, this->irradiance);
+	}
+	else
+	{
+		// reports which face failed
+		this->tex = textures->loadCube(filenames);
+		cout << "Failed to compute skybox irradiance" << endl;
+	}
 
-	struct Vertex* skybox_verts = new struct Vertex[NUM_VERTS]
+	for(i = 0; i < loaded; i ++)
+		TextureManager::freeImage(faces[i], soil[i]);
+
+	struct SkyboxVertex* skybox_verts = new struct SkyboxVertex[NUM_VERTS]
 	{
 		createVertex3d(-1.0,  1.0, -1.0),
 		createVertex3d(-1.0, -1.0, -1.0),
@@ -110,18 +121,22 @@ Skybox::Skybox(string left, string right, string top,
 
 	glGenBuffers(1, &(this->vbo));
 	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-	glBufferData(GL_ARRAY_BUFFER, NUM_VERTS * sizeof(struct Vertex), skybox_verts, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, NUM_VERTS * sizeof(struct SkyboxVertex), skybox_verts, GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+	this->vao = new VertexArray(SKYBOX_LAYOUT);
+	this->vao->setVertexBuffer(VERTEX_BINDING, this->vbo);
+
 	delete[] skybox_verts;
 }
 
-// destroys the Skybox object's VBO and
-// texture ID
+// destroys the Skybox object's VBO and VAO
+// and releases its texture
 Skybox::~Skybox()
 {
+	delete this->vao;
 	glDeleteBuffers(1, &(this->vbo));
-	glDeleteTextures(1, &(this->tex));
+	this->textures->release(this->tex);
 }
 
 // renders the Skybox object to the scene
@@ -135,31 +150,29 @@ void Skybox::render(Shader* shader)
 	glDisable(GL_BLEND);
 	glEnable(GL_TEXTURE_CUBE_MAP);
 
-	glPushMatrix();
 	glDepthMask(GL_FALSE);
 
-	shader->setModelViewMatrix();
-
-	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, this->tex);
-
-	glDisableVertexAttribArray(NORMAL_ATTR);
-	glEnableVertexAttribArray(POSITION_ATTR);
-	glDisableVertexAttribArray(TEXCOORD_2D_ATTR);
-	glEnableVertexAttribArray(TEXCOORD_CUBE_ATTR);
+	shader->setModelMatrix(Mat4::identity());
 
-	glVertexAttribPointer(POSITION_ATTR, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), NULL);
-	glVertexAttribPointer(TEXCOORD_CUBE_ATTR, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)offsetof(Vertex, t));
+	this->vao->bind();
+	this->textures->bind(this->tex);
 
+	shader->flush();
 	glDrawArrays(GL_TRIANGLES, 0, NUM_VERTS);	
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	this->vao->unbind();
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	glDepthMask(GL_TRUE);
-	glPopMatrix();
 
 	glDisable(GL_TEXTURE_CUBE_MAP);
 	glEnable(GL_BLEND);
 	glEnable(GL_TEXTURE_2D);
 }
+
+// returns the SH_NUM_COEFFS RGB irradiance coefficients
+// projected from the cube map, for Shader::setIrradiance
+float* Skybox::getIrradiance()
+{
+	return this->irradiance;
+}
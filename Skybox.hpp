@@ -1,6 +1,9 @@
 #ifndef SKYBOX_HPP__
 #define SKYBOX_HPP__
 
+#include "SphericalHarmonics.hpp"
+#include "TextureManager.hpp"
+#include "VertexArray.hpp"
 #include "Shader.hpp"
 
 #include <string>
@@ -11,14 +14,22 @@ class Skybox {
 
 	private:
 		unsigned int vbo;
-		unsigned int tex;
+		VertexArray* vao;
+		int tex;
+
+		float irradiance[SH_NUM_COEFFS * 3];
+
+		TextureManager* textures;
 
 	public:
 		Skybox(string left, string right, string top,
-				string bottom, string front, string back);
+				string bottom, string front, string back,
+				TextureManager* textures);
 		~Skybox();
 
 		void render(Shader* shader);
+
+		float* getIrradiance();
 };
 
 #endif
@@ -0,0 +1,120 @@
+#include "SphericalHarmonics.hpp"
+#include "Parallel.hpp"
+
+#include <mutex>
+
+#include <cstring>
+#include <cmath>
+
+// cosine lobe convolution per band (Ramamoorthi and
+// Hanrahan), already divided by pi
+static const float band_scale[3] = {1.0f, 2.0f / 3.0f, 0.25f};
+
+// evaluates the 9 real SH basis functions for a unit direction
+static void _basis(float x, float y, float z, float* sh)
+{
+	sh[0] = 0.282095f;
+
+	sh[1] = 0.488603f * y;
+	sh[2] = 0.488603f * z;
+	sh[3] = 0.488603f * x;
+
+	sh[4] = 1.092548f * x * y;
+	sh[5] = 1.092548f * y * z;
+	sh[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	sh[7] = 1.092548f * x * z;
+	sh[8] = 0.546274f * (x * x - y * y);
+}
+
+// direction through the center of a cube map texel, following
+// the face orientation table in the GL spec. 's' and 't' are
+// in [-1, 1], 't' increasing down the image rows
+static void _direction(int face, float s, float t, float* dir)
+{
+	switch(face)
+	{
+		case 0: dir[0] = 1.0f; dir[1] = -t; dir[2] = -s; break;
+		case 1: dir[0] = -1.0f; dir[1] = -t; dir[2] = s; break;
+		case 2: dir[0] = s; dir[1] = 1.0f; dir[2] = t; break;
+		case 3: dir[0] = s; dir[1] = -1.0f; dir[2] = -t; break;
+		case 4: dir[0] = s; dir[1] = -t; dir[2] = 1.0f; break;
+		default: dir[0] = -s; dir[1] = -t; dir[2] = -1.0f; break;
+	}
+}
+
+// every row of every face is weighted by the solid angle
+// its texels cover and summed on its own thread. Texel
+// values are used as they are, the same color space main.fs
+// does its lighting in. The weights are normalized so they
+// add up to exactly 4 pi
+void projectIrradiance(unsigned char** faces, int width, int height, float* coeffs)
+{
+	double total[SH_NUM_COEFFS * 3];
+	double total_weight = 0.0;
+
+	memset(total, 0, sizeof(total));
+
+	mutex lock;
+
+	parallelFor(6 * height, [&](int begin, int end)
+	{
+		double sum[SH_NUM_COEFFS * 3];
+		double weight_sum = 0.0;
+
+		memset(sum, 0, sizeof(sum));
+
+		int row, x, i;
+		for(row = begin; row < end; row ++)
+		{
+			int face = row / height;
+			int y = row % height;
+
+			float t = 2.0f * ((float)y + 0.5f) / (float)height - 1.0f;
+			const unsigned char* texels = faces[face] + (size_t)y * width * 4;
+
+			for(x = 0; x < width; x ++)
+			{
+				float s = 2.0f * ((float)x + 0.5f) / (float)width - 1.0f;
+
+				float dir[3], sh[SH_NUM_COEFFS];
+				_direction(face, s, t, dir);
+
+				float len2 = s * s + t * t + 1.0f;
+				float inv_len = 1.0f / sqrtf(len2);
+				float weight = inv_len / len2;
+
+				_basis(dir[0] * inv_len, dir[1] * inv_len, dir[2] * inv_len, sh);
+
+				float r = texels[x * 4] * (weight / 255.0f);
+				float g = texels[x * 4 + 1] * (weight / 255.0f);
+				float b = texels[x * 4 + 2] * (weight / 255.0f);
+
+				for(i = 0; i < SH_NUM_COEFFS; i ++)
+				{
+					sum[i * 3] += r * sh[i];
+					sum[i * 3 + 1] += g * sh[i];
+					sum[i * 3 + 2] += b * sh[i];
+				}
+				weight_sum += weight;
+			}
+		}
+
+		lock.lock();
+
+		for(i = 0; i < SH_NUM_COEFFS * 3; i ++)
+			total[i] += sum[i];
+
+		total_weight += weight_sum;
+
+		lock.unlock();
+	});
+
+	double norm = (total_weight > 0.0 ? 4.0 * M_PI / total_weight : 0.0);
+
+	int i;
+	for(i = 0; i < SH_NUM_COEFFS * 3; i ++)
+	{
+		int band = (i / 3 == 0 ? 0 : (i / 3 < 4 ? 1 : 2));
+		coeffs[i] = (float)(total[i] * norm * band_scale[band]);
+	}
+}
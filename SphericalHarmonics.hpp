@@ -0,0 +1,13 @@
+#ifndef SPHERICALHARMONICS_HPP__
+#define SPHERICALHARMONICS_HPP__
+
+#define SH_NUM_COEFFS 9
+
+// projects a cube map (six RGBA8 faces of the same size, in
+// GL_TEXTURE_CUBE_MAP_* order) onto the first three bands of
+// spherical harmonics and convolves the result with a cosine
+// lobe. 'coeffs' receives SH_NUM_COEFFS RGB triples that give
+// irradiance / pi when dotted with the basis at a normal
+void projectIrradiance(unsigned char** faces, int width, int height, float* coeffs);
+
+#endif
@@ -0,0 +1,121 @@
+#include "StaticBatch.hpp"
+
+#include <cmath>
+#include <map>
+#include <tuple>
+
+// creates an empty batch whose meshes go into 'geometry'
+StaticBatch::StaticBatch(GeometryBuffer* geometry, float cell_size)
+{
+	this->geometry = geometry;
+	this->cell_size = cell_size;
+	this->baked_bytes = 0;
+}
+
+// adds a copy of 'mesh' placed with 'transform', baked
+// in with the rest on the next 'build'
+int StaticBatch::add(int mesh, const Mat4& transform)
+{
+	StaticInstance instance;
+	instance.mesh = mesh;
+	instance.transform = transform;
+
+	this->instances.push_back(instance);
+
+	return (int)this->instances.size() - 1;
+}
+
+// groups the instances by grid cell and merges each
+// group into one new mesh, its positions and normals
+// transformed the same way the vertex shader would.
+// Meshes from an earlier build stay in the geometry
+// buffer, so this is meant to run once at startup
+void StaticBatch::build()
+{
+	map<tuple<int, int, int>, vector<int> > cells;
+	map<int, vector<MeshVertex> > sources;
+
+	this->clusters.clear();
+	this->baked_bytes = 0;
+
+	int i;
+	for(i = 0; i < (int)this->instances.size(); i ++)
+	{
+		StaticInstance& instance = this->instances[i];
+		AABB box = this->geometry->getMesh(instance.mesh)->box.transform(instance.transform);
+
+		tuple<int, int, int> cell((int)floorf(box.center.x / this->cell_size),
+								  (int)floorf(box.center.y / this->cell_size),
+								  (int)floorf(box.center.z / this->cell_size));
+
+		cells[cell].push_back(i);
+
+		if(sources.find(instance.mesh) == sources.end())
+			this->geometry->getTriangles(instance.mesh, sources[instance.mesh]);
+	}
+
+	map<tuple<int, int, int>, vector<int> >::iterator it;
+	for(it = cells.begin(); it != cells.end(); it ++)
+	{
+		vector<MeshVertex> baked;
+
+		int j;
+		for(j = 0; j < (int)it->second.size(); j ++)
+		{
+			StaticInstance& instance = this->instances[it->second[j]];
+			vector<MeshVertex>& source = sources[instance.mesh];
+
+			float normal[9];
+			instance.transform.normalMatrix(normal);
+
+			int k;
+			for(k = 0; k < (int)source.size(); k ++)
+			{
+				MeshVertex v = source[k];
+				Vec3 p = instance.transform.transformPoint(Vec3(v.x, v.y, v.z));
+
+				v.x = p.x;
+				v.y = p.y;
+				v.z = p.z;
+
+				float nx = source[k].nx, ny = source[k].ny, nz = source[k].nz;
+
+				v.nx = normal[0] * nx + normal[3] * ny + normal[6] * nz;
+				v.ny = normal[1] * nx + normal[4] * ny + normal[7] * nz;
+				v.nz = normal[2] * nx + normal[5] * ny + normal[8] * nz;
+
+				baked.push_back(v);
+			}
+		}
+
+		int mesh = this->geometry->addMesh(&(baked[0]), (int)baked.size());
+		MeshRange* range = this->geometry->getMesh(mesh);
+
+		this->clusters.push_back(mesh);
+		this->baked_bytes += (long long)range->vertex_count * sizeof(MeshVertex) +
+							 (long long)range->index_count * sizeof(unsigned int);
+	}
+}
+
+int StaticBatch::getInstanceCount()
+{
+	return (int)this->instances.size();
+}
+
+// number of merged meshes the last 'build' made
+int StaticBatch::getClusterCount()
+{
+	return (int)this->clusters.size();
+}
+
+// the geometry buffer's ID for a merged mesh
+int StaticBatch::getClusterMesh(int cluster)
+{
+	return this->clusters[cluster];
+}
+
+// vertex and index bytes the merged meshes take up
+long long StaticBatch::getBakedBytes()
+{
+	return this->baked_bytes;
+}
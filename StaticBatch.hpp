@@ -0,0 +1,48 @@
+#ifndef STATICBATCH_HPP__
+#define STATICBATCH_HPP__
+
+#include "GeometryBuffer.hpp"
+#include "VectorMath.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// one copy of a mesh that never moves
+struct StaticInstance {
+
+	int mesh;
+	Mat4 transform;
+};
+
+// bakes instances that never move into world space ahead
+// of time. Instances are grouped by the grid cell (of
+// 'cell_size' units) their bounds are centered in, and
+// each group is merged into a single mesh in the shared
+// GeometryBuffer, so it's culled by its own bounds and
+// drawn as one mesh with no per-instance transform. Costs
+// a copy of the vertices for every instance
+class StaticBatch {
+
+	private:
+		GeometryBuffer* geometry;
+		float cell_size;
+
+		vector<StaticInstance> instances;
+		vector<int> clusters;
+
+		long long baked_bytes;
+
+	public:
+		StaticBatch(GeometryBuffer* geometry, float cell_size);
+
+		int add(int mesh, const Mat4& transform);
+		void build();
+
+		int getInstanceCount();
+		int getClusterCount();
+		int getClusterMesh(int cluster);
+		long long getBakedBytes();
+};
+
+#endif
@@ -0,0 +1,643 @@
+#include "TextureManager.hpp"
+#include "PngDecoder.hpp"
+
+#include <SOIL/SOIL.h>
+
+#include <iostream>
+
+#include <cstdlib>
+
+// returns the number of bytes taken up by the levels
+// of a texture from 'base_level' down to 1x1
+static long long _textureBytes(ManagedTexture& texture, int base_level)
+{
+	int faces = (int)texture.files.size();
+	long long bytes = 0;
+
+	int level;
+	for(level = base_level; level < texture.levels; level ++)
+	{
+		long long w = (texture.width >> level > 0 ? texture.width >> level : 1);
+		long long h = (texture.height >> level > 0 ? texture.height >> level : 1);
+
+		bytes += w * h * 4 * faces;
+	}
+	return bytes;
+}
+
+// creates an immutable RGBA8 texture and sets the
+// sampling parameters Model (repeat, trilinear) and
+// Skybox (clamped, linear) textures expect
+static unsigned int _createTexture(unsigned int target, int levels, int width, int height)
+{
+	unsigned int id;
+
+	glGenTextures(1, &id);
+	glBindTexture(target, id);
+	glTexStorage2D(target, levels, GL_RGBA8, width, height);
+
+	if(target == GL_TEXTURE_CUBE_MAP)
+	{
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	else
+	{
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	glBindTexture(target, 0);
+	return id;
+}
+
+// creates the manager with a byte budget for all of
+// the textures it owns, the 1x1 placeholders that are
+// bound while a texture is evicted and the loader
+// thread that decodes textures being restored
+TextureManager::TextureManager(long long budget, TextureStreamer* streamer)
+{
+	this->streamer = streamer;
+	this->budget = budget;
+	this->resident_bytes = 0;
+	this->evicted_bytes = 0;
+	this->frame = 0;
+	this->next_serial = 0;
+
+	unsigned char grey[4] = {128, 128, 128, 255};
+
+	this->placeholder_2d = _createTexture(GL_TEXTURE_2D, 1, 1, 1);
+	glBindTexture(GL_TEXTURE_2D, this->placeholder_2d);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	this->placeholder_cube = _createTexture(GL_TEXTURE_CUBE_MAP, 1, 1, 1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->placeholder_cube);
+
+	int i;
+	for(i = 0; i < 6; i ++)
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (unsigned int)i, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	this->running = true;
+	this->loader = thread(&TextureManager::loaderMain, this);
+}
+
+// stops the loader thread, then frees anything it
+// decoded that was never streamed in and every
+// texture that's still resident
+TextureManager::~TextureManager()
+{
+	{
+		unique_lock<mutex> guard(this->lock);
+		this->running = false;
+	}
+	this->wake.notify_all();
+	this->loader.join();
+
+	while(!(this->loaded.empty()))
+	{
+		LoadedTexture& result = this->loaded.front();
+
+		if(result.mips != NULL)
+		{
+			delete result.mips;
+
+			int i;
+			for(i = 0; i < result.faces; i ++)
+				freeImage(result.images[i], result.soil[i]);
+		}
+		this->loaded.pop_front();
+	}
+
+	size_t i;
+	for(i = 0; i < this->textures.size(); i ++)
+	{
+		if(this->textures[i].used)
+			this->evict(this->textures[i]);
+	}
+
+	glDeleteTextures(1, &(this->placeholder_2d));
+	glDeleteTextures(1, &(this->placeholder_cube));
+}
+
+// loads a 2D texture and returns a handle for it
+int TextureManager::load(string file)
+{
+	vector<string> files(1, file);
+	return this->add(GL_TEXTURE_2D, files, NULL, 0, 0);
+}
+
+// loads a cube map from six files (in the order of
+// the GL_TEXTURE_CUBE_MAP_* face targets) and
+// returns a handle for it
+int TextureManager::loadCube(string files[6])
+{
+	vector<string> faces(files, files + 6);
+	return this->add(GL_TEXTURE_CUBE_MAP, faces, NULL, 0, 0);
+}
+
+// same as above, from six 'width' x 'height' faces the
+// caller already decoded from 'files' (with 'loadImage')
+// and still owns, so they aren't decoded a second time.
+// The files are only read again to restore the cube map
+// after it was evicted
+int TextureManager::loadCube(string files[6], unsigned char** images, int width, int height)
+{
+	vector<string> faces(files, files + 6);
+	return this->add(GL_TEXTURE_CUBE_MAP, faces, images, width, height);
+}
+
+// registers a texture, reusing a released slot if there
+// is one, and loads it right away, from 'images' if given
+int TextureManager::add(unsigned int target, vector<string>& files, unsigned char** images, int width, int height)
+{
+	ManagedTexture texture;
+
+	texture.id = 0;
+	texture.pending_id = 0;
+	texture.target = target;
+	texture.files = files;
+	texture.width = 0;
+	texture.height = 0;
+	texture.levels = 0;
+	texture.base_level = 0;
+	texture.last_used = this->frame;
+	texture.serial = this->next_serial ++;
+	texture.bytes = 0;
+	texture.pending_bytes = 0;
+	texture.wanted = false;
+	texture.loading = false;
+	texture.used = true;
+
+	if(images != NULL)
+		this->uploadImages(texture, images, width, height);
+	else
+		this->upload(texture);
+
+	size_t i;
+	for(i = 0; i < this->textures.size(); i ++)
+	{
+		if(!(this->textures[i].used))
+		{
+			this->textures[i] = texture;
+			return (int)i;
+		}
+	}
+
+	this->textures.push_back(texture);
+	return (int)this->textures.size() - 1;
+}
+
+// frees a texture and its handle
+void TextureManager::release(int handle)
+{
+	ManagedTexture& texture = this->textures[handle];
+
+	this->evict(texture);
+	texture.used = false;
+}
+
+// decodes an image file as RGBA8, with PngDecoder where
+// possible and SOIL for everything else. 'soil' records
+// which of them allocated the result, for 'freeImage'
+unsigned char* TextureManager::loadImage(string file, int* width, int* height, bool* soil)
+{
+	unsigned char* image = PngDecoder::load(file, width, height);
+	*soil = (image == NULL);
+
+	if(image == NULL)
+		image = SOIL_load_image(file.c_str(), width, height, 0, SOIL_LOAD_RGBA);
+
+	return image;
+}
+
+void TextureManager::freeImage(unsigned char* image, bool soil)
+{
+	if(soil)
+		SOIL_free_image_data(image);
+	else
+		free(image);
+}
+
+// decodes every face of a texture, which have to be
+// the same size for MipChain. Returns false (with
+// nothing left allocated) if any of them fails
+bool TextureManager::decode(vector<string>& files, unsigned char** images, bool* soil, int* width, int* height)
+{
+	int faces = (int)files.size();
+
+	int i;
+	for(i = 0; i < faces; i ++)
+	{
+		int face_width = 0, face_height = 0;
+
+		images[i] = loadImage(files[i], &face_width, &face_height, &(soil[i]));
+		if(images[i] == NULL)
+		{
+			cout << "Failed to load texture " << files[i] << endl;
+
+			while(i > 0)
+			{
+				i --;
+				freeImage(images[i], soil[i]);
+			}
+
+			return false;
+		}
+
+		if(i == 0)
+		{
+			*width = face_width;
+			*height = face_height;
+		}
+		else if(face_width != *width || face_height != *height)
+		{
+			cout << "Failed to load texture " << files[i] << " (not the size of the other faces)" << endl;
+
+			while(i >= 0)
+			{
+				freeImage(images[i], soil[i]);
+				i --;
+			}
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// decodes a texture's files and uploads them with
+// 'uploadImages'. Only used for the first load,
+// restores are decoded by the loader thread
+bool TextureManager::upload(ManagedTexture& texture)
+{
+	int faces = (int)texture.files.size();
+	unsigned char* images[6];
+	bool soil[6];
+	int width = 0, height = 0;
+
+	if(!decode(texture.files, images, soil, &width, &height))
+		return false;
+
+	this->uploadImages(texture, images, width, height);
+
+	int i;
+	for(i = 0; i < faces; i ++)
+		freeImage(images[i], soil[i]);
+
+	return true;
+}
+
+// generates the mips of a texture's decoded faces
+// and streams them in with 'streamLevels'
+void TextureManager::uploadImages(ManagedTexture& texture, unsigned char** images, int width, int height)
+{
+	int faces = (int)texture.files.size();
+
+	bool wrap = (texture.target == GL_TEXTURE_2D);
+	MipChain* mips = new MipChain(images, faces, width, height, MIP_FILTER_KAISER, wrap);
+
+	this->streamLevels(texture, mips);
+
+	delete mips;
+}
+
+// creates a full size copy of a texture and queues its
+// levels on the TextureStreamer. Levels the current copy
+// still holds (everything below the mips it dropped) are
+// copied over on the GPU instead, so only the dropped top
+// levels are streamed. The current copy stays bound until
+// 'swapPending' replaces it with the new one
+void TextureManager::streamLevels(ManagedTexture& texture, MipChain* mips)
+{
+	int faces = mips->getNumFaces();
+	int width = mips->getLevel(0, 0)->width;
+	int height = mips->getLevel(0, 0)->height;
+	int levels = mips->getNumLevels();
+
+	unsigned int id = _createTexture(texture.target, levels, width, height);
+
+	int streamed = levels;
+	int i, level;
+
+	if(texture.id != 0 && texture.width == width && texture.height == height)
+	{
+		streamed = texture.base_level;
+
+		for(level = streamed; level < levels; level ++)
+		{
+			MipLevel* mip = mips->getLevel(0, level);
+
+			glCopyImageSubData(texture.id, texture.target, level - texture.base_level, 0, 0, 0,
+							   id, texture.target, level, 0, 0, 0, mip->width, mip->height, faces);
+		}
+	}
+
+	for(i = 0; i < faces; i ++)
+	{
+		unsigned int target = (faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (unsigned int)i : texture.target);
+
+		for(level = 0; level < streamed; level ++)
+		{
+			MipLevel* mip = mips->getLevel(i, level);
+			this->streamer->upload(id, target, level, mip->width, mip->height, mip->data);
+		}
+	}
+
+	texture.width = width;
+	texture.height = height;
+	texture.levels = levels;
+	texture.pending_id = id;
+	texture.pending_bytes = _textureBytes(texture, 0);
+
+	this->resident_bytes += texture.pending_bytes;
+}
+
+// replaces what is left of a texture with the full
+// copy 'streamLevels' made, once it's all uploaded
+void TextureManager::swapPending(ManagedTexture& texture)
+{
+	if(texture.id != 0)
+	{
+		glDeleteTextures(1, &(texture.id));
+		this->resident_bytes -= texture.bytes;
+	}
+
+	texture.id = texture.pending_id;
+	texture.bytes = texture.pending_bytes;
+	texture.base_level = 0;
+
+	texture.pending_id = 0;
+	texture.pending_bytes = 0;
+}
+
+// frees a texture's top mip level by moving its
+// remaining levels into a smaller texture on the GPU
+void TextureManager::dropMip(ManagedTexture& texture)
+{
+	int base = texture.base_level + 1;
+	int width = (texture.width >> base > 0 ? texture.width >> base : 1);
+	int height = (texture.height >> base > 0 ? texture.height >> base : 1);
+	int depth = (int)texture.files.size();
+
+	unsigned int id = _createTexture(texture.target, texture.levels - base, width, height);
+
+	int level;
+	for(level = 0; level < texture.levels - base; level ++)
+	{
+		int w = (width >> level > 0 ? width >> level : 1);
+		int h = (height >> level > 0 ? height >> level : 1);
+
+		glCopyImageSubData(texture.id, texture.target, level + 1, 0, 0, 0,
+						   id, texture.target, level, 0, 0, 0, w, h, depth);
+	}
+
+	glDeleteTextures(1, &(texture.id));
+
+	long long bytes = _textureBytes(texture, base);
+
+	this->resident_bytes -= texture.bytes - bytes;
+	this->evicted_bytes += texture.bytes - bytes;
+
+	texture.id = id;
+	texture.bytes = bytes;
+	texture.base_level = base;
+}
+
+// frees a texture entirely (along with a copy still
+// being streamed in), it gets reloaded from its
+// files the next time it's bound
+void TextureManager::evict(ManagedTexture& texture)
+{
+	if(texture.pending_id != 0)
+	{
+		this->streamer->cancel(texture.pending_id);
+		glDeleteTextures(1, &(texture.pending_id));
+
+		this->resident_bytes -= texture.pending_bytes;
+		this->evicted_bytes += texture.pending_bytes;
+
+		texture.pending_id = 0;
+		texture.pending_bytes = 0;
+	}
+
+	if(texture.id == 0)
+		return;
+
+	this->streamer->cancel(texture.id);
+	glDeleteTextures(1, &(texture.id));
+
+	this->resident_bytes -= texture.bytes;
+	this->evicted_bytes += texture.bytes;
+
+	texture.id = 0;
+	texture.bytes = 0;
+}
+
+// binds a texture to the active texture unit and marks
+// it as used this frame. Evicted or shrunk textures are
+// flagged to be restored by 'update' (unless that's
+// already underway). Whatever is resident stays bound
+// until the restored copy is complete, or a placeholder
+// if nothing is
+void TextureManager::bind(int handle)
+{
+	ManagedTexture& texture = this->textures[handle];
+
+	texture.last_used = this->frame;
+
+	if((texture.id == 0 || texture.base_level > 0) && !texture.loading && texture.pending_id == 0)
+		texture.wanted = true;
+
+	unsigned int id = texture.id;
+	if(id == 0)
+		id = (texture.target == GL_TEXTURE_CUBE_MAP ? this->placeholder_cube : this->placeholder_2d);
+
+	glBindTexture(texture.target, id);
+}
+
+// called once per frame. Starts streaming a bounded
+// number of textures the loader thread has restored,
+// swaps in restored copies that finished streaming and
+// hands textures that were asked for to the loader.
+// Then brings resident memory back under budget:
+// textures that have gone cold give up their top mips
+// first (largest first), and if that's not enough, the
+// least recently used textures are evicted. Textures
+// used last frame are never touched, nor are ones
+// still being restored
+void TextureManager::update()
+{
+	this->frame ++;
+
+	vector<LoadedTexture> finished;
+	{
+		unique_lock<mutex> guard(this->lock);
+
+		while(!(this->loaded.empty()) && (int)finished.size() < MAX_TEXTURE_RESTORES)
+		{
+			finished.push_back(this->loaded.front());
+			this->loaded.pop_front();
+		}
+	}
+
+	size_t i;
+	int face;
+	for(i = 0; i < finished.size(); i ++)
+	{
+		LoadedTexture& result = finished[i];
+		ManagedTexture& texture = this->textures[result.handle];
+
+		// the handle may have been released (and reused) since
+		if(texture.serial == result.serial)
+			texture.loading = false;
+
+		if(result.mips == NULL)
+			continue;
+
+		if(texture.used && texture.serial == result.serial)
+			this->streamLevels(texture, result.mips);
+
+		delete result.mips;
+
+		for(face = 0; face < result.faces; face ++)
+			freeImage(result.images[face], result.soil[face]);
+	}
+
+	for(i = 0; i < this->textures.size(); i ++)
+	{
+		ManagedTexture& texture = this->textures[i];
+
+		if(texture.used && texture.pending_id != 0 && !(this->streamer->isPending(texture.pending_id)))
+			this->swapPending(texture);
+	}
+
+	{
+		unique_lock<mutex> guard(this->lock);
+
+		for(i = 0; i < this->textures.size(); i ++)
+		{
+			ManagedTexture& texture = this->textures[i];
+			if(!texture.used || !texture.wanted)
+				continue;
+
+			texture.wanted = false;
+			texture.loading = true;
+			texture.last_used = this->frame;
+
+			TextureRequest request;
+			request.handle = (int)i;
+			request.serial = texture.serial;
+			request.target = texture.target;
+			request.files = texture.files;
+
+			this->requests.push_back(request);
+		}
+	}
+	this->wake.notify_one();
+
+	while(this->resident_bytes > this->budget)
+	{
+		int victim = -1;
+
+		for(i = 0; i < this->textures.size(); i ++)
+		{
+			ManagedTexture& texture = this->textures[i];
+			if(!texture.used || texture.id == 0 || texture.loading || texture.pending_id != 0)
+				continue;
+
+			int size = (texture.width > texture.height ? texture.width : texture.height) >> texture.base_level;
+
+			if(this->frame - texture.last_used < TEXTURE_COLD_FRAMES || size <= TEXTURE_MIN_DROP_SIZE)
+				continue;
+
+			if(victim < 0 || texture.bytes > this->textures[victim].bytes)
+				victim = (int)i;
+		}
+
+		if(victim >= 0)
+		{
+			this->dropMip(this->textures[victim]);
+			continue;
+		}
+
+		for(i = 0; i < this->textures.size(); i ++)
+		{
+			ManagedTexture& texture = this->textures[i];
+			if(!texture.used || (texture.id == 0 && texture.pending_id == 0) || texture.last_used >= this->frame - 1)
+				continue;
+
+			if(victim < 0 || texture.last_used < this->textures[victim].last_used)
+				victim = (int)i;
+		}
+
+		if(victim < 0)
+			break;
+
+		this->evict(this->textures[victim]);
+	}
+}
+
+// returns the number of bytes of texture
+// memory currently in use
+long long TextureManager::getResidentBytes()
+{
+	return this->resident_bytes;
+}
+
+// returns the total number of bytes freed so far
+// by dropping mip levels and evicting textures
+long long TextureManager::getEvictedBytes()
+{
+	return this->evicted_bytes;
+}
+
+// loader thread, decodes the files of textures being
+// restored and generates their mips (on this thread
+// alone, so frames keep the worker pool to themselves),
+// then hands them back to the GL thread to stream in
+void TextureManager::loaderMain()
+{
+	for(;;)
+	{
+		TextureRequest request;
+		{
+			unique_lock<mutex> guard(this->lock);
+
+			while(this->running && this->requests.empty())
+				this->wake.wait(guard);
+
+			if(!(this->running))
+				return;
+
+			request = this->requests.front();
+			this->requests.pop_front();
+		}
+
+		LoadedTexture result;
+		result.handle = request.handle;
+		result.serial = request.serial;
+		result.faces = (int)request.files.size();
+		result.mips = NULL;
+
+		int width = 0, height = 0;
+		if(decode(request.files, result.images, result.soil, &width, &height))
+		{
+			bool wrap = (request.target == GL_TEXTURE_2D);
+			result.mips = new MipChain(result.images, result.faces, width, height, MIP_FILTER_KAISER, wrap, 1);
+		}
+
+		{
+			unique_lock<mutex> guard(this->lock);
+			this->loaded.push_back(result);
+		}
+	}
+}
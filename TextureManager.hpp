@@ -0,0 +1,130 @@
+#ifndef TEXTUREMANAGER_HPP__
+#define TEXTUREMANAGER_HPP__
+
+#include "TextureStreamer.hpp"
+#include "MipChain.hpp"
+
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+#define TEXTURE_COLD_FRAMES 120
+#define TEXTURE_MIN_DROP_SIZE 64
+#define MAX_TEXTURE_RESTORES 1
+
+using namespace std;
+
+// bookkeeping for one texture owned by the
+// TextureManager, 'id' is 0 while it is evicted.
+// A restored copy streams into 'pending_id' while
+// 'id' stays bound, and replaces it once complete
+struct ManagedTexture {
+
+	unsigned int id;
+	unsigned int pending_id;
+	unsigned int target;
+
+	vector<string> files;
+
+	int width;
+	int height;
+	int levels;
+	int base_level;
+	int last_used;
+	int serial;
+
+	long long bytes;
+	long long pending_bytes;
+
+	bool wanted;
+	bool loading;
+	bool used;
+};
+
+// a texture for the loader thread to decode,
+// 'serial' tells apart handles that were reused
+struct TextureRequest {
+
+	int handle;
+	int serial;
+	unsigned int target;
+
+	vector<string> files;
+};
+
+// a texture decoded by the loader thread with its
+// mips generated, waiting to be streamed in. 'mips'
+// is NULL if it failed to load
+struct LoadedTexture {
+
+	int handle;
+	int serial;
+
+	unsigned char* images[6];
+	bool soil[6];
+	int faces;
+
+	MipChain* mips;
+};
+
+class TextureManager {
+
+	private:
+		TextureStreamer* streamer;
+
+		unsigned int placeholder_2d;
+		unsigned int placeholder_cube;
+
+		long long budget;
+		long long resident_bytes;
+		long long evicted_bytes;
+
+		int frame;
+		int next_serial;
+
+		bool running;
+
+		vector<ManagedTexture> textures;
+
+		deque<TextureRequest> requests;
+		deque<LoadedTexture> loaded;
+
+		thread loader;
+		mutex lock;
+		condition_variable wake;
+
+		int add(unsigned int target, vector<string>& files, unsigned char** images, int width, int height);
+
+		bool upload(ManagedTexture& texture);
+		void uploadImages(ManagedTexture& texture, unsigned char** images, int width, int height);
+		void streamLevels(ManagedTexture& texture, MipChain* mips);
+		void swapPending(ManagedTexture& texture);
+		void dropMip(ManagedTexture& texture);
+		void evict(ManagedTexture& texture);
+		void loaderMain();
+
+		static bool decode(vector<string>& files, unsigned char** images, bool* soil, int* width, int* height);
+
+	public:
+		TextureManager(long long budget, TextureStreamer* streamer);
+		~TextureManager();
+
+		int load(string file);
+		int loadCube(string files[6]);
+		int loadCube(string files[6], unsigned char** images, int width, int height);
+		void release(int handle);
+
+		void bind(int handle);
+		void update();
+
+		long long getResidentBytes();
+		long long getEvictedBytes();
+
+		static unsigned char* loadImage(string file, int* width, int* height, bool* soil);
+		static void freeImage(unsigned char* image, bool soil);
+};
+
+#endif
@@ -0,0 +1,411 @@
+#include "TextureStreamer.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#define STREAM_ALIGNMENT 16
+#define STREAM_WAIT_NS 1000000000ull
+
+using namespace chrono;
+
+// cube map faces are updated through their own
+// targets, but have to be bound as a cube map
+static unsigned int _bindingTarget(unsigned int target)
+{
+	if(target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+		return GL_TEXTURE_CUBE_MAP;
+
+	return target;
+}
+
+// creates a persistently mapped pixel unpack buffer
+// used as a ring. Texel data is written straight into
+// it, and 'update' hands it to GL a few uploads at a
+// time, spending at most 'budget' milliseconds a frame
+TextureStreamer::TextureStreamer(int ring_size, double budget)
+{
+	this->ring_size = ring_size;
+	this->budget = budget;
+	this->head = 0;
+	this->bytes_uploaded = 0;
+	this->stalls = 0;
+
+	unsigned int flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &(this->buffer));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->buffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ring_size, NULL, flags);
+
+	this->mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ring_size, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if(this->mapped == NULL)
+		cout << "Failed to map texture streaming buffer" << endl;
+}
+
+// waits for every upload still in flight,
+// then unmaps and frees the ring buffer
+TextureStreamer::~TextureStreamer()
+{
+	this->flush();
+
+	while(!(this->segments.empty()))
+		this->retire(true);
+
+	while(!(this->backlog.empty()))
+	{
+		free(this->backlog.front().data);
+		this->backlog.pop_front();
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->buffer);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glDeleteBuffers(1, &(this->buffer));
+}
+
+// returns space for 'bytes' bytes of texel data in the
+// ring, for a decoder (or a copy) to write into before
+// calling 'commit'. Never waits on the GPU: returns NULL
+// if the ring is too full right now (or the request can
+// never fit), and the caller tries again later
+unsigned char* TextureStreamer::reserve(int bytes)
+{
+	if(this->mapped == NULL)
+		return NULL;
+
+	bytes = (bytes + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+	if(bytes > this->ring_size)
+		return NULL;
+
+	this->retire(false);
+
+	int offset = -1;
+	if(this->segments.empty())
+	{
+		this->head = 0;
+		offset = 0;
+	}
+	else
+	{
+		int tail = this->segments.front().offset;
+
+		if(this->head > tail)
+		{
+			if(this->ring_size - this->head >= bytes)
+				offset = this->head;
+
+			else if(tail >= bytes)
+				offset = 0;
+		}
+		else if(this->head < tail && tail - this->head >= bytes)
+			offset = this->head;
+	}
+
+	if(offset < 0)
+		return NULL;
+
+	StreamSegment segment;
+	memset(&segment, 0, sizeof(StreamSegment));
+
+	segment.offset = offset;
+	segment.size = bytes;
+
+	this->segments.push_back(segment);
+	this->head = offset + bytes;
+
+	return this->mapped + offset;
+}
+
+// queues an upload from ring memory returned by
+// 'reserve' into a region of a texture level
+void TextureStreamer::commit(unsigned char* data, unsigned int tex, unsigned int target, int level,
+							 int x, int y, int width, int height)
+{
+	int offset = (int)(data - this->mapped);
+
+	deque<StreamSegment>::iterator it;
+	for(it = this->segments.begin(); it != this->segments.end(); it ++)
+	{
+		if(it->offset != offset || it->ready)
+			continue;
+
+		it->tex = tex;
+		it->target = target;
+		it->level = level;
+		it->x = x;
+		it->y = y;
+		it->width = width;
+		it->height = height;
+		it->ready = true;
+
+		return;
+	}
+}
+
+// queues a whole RGBA8 texture level that is already
+// in client memory. Large levels are split into bands
+// of rows so no single upload takes up the ring. Bands
+// that don't fit in the ring right now (or that would
+// jump ahead of ones held back before) are copied aside
+// for 'update' to move into the ring in later frames,
+// so a full ring never blocks
+void TextureStreamer::upload(unsigned int tex, unsigned int target, int level, int width, int height,
+							 const unsigned char* data)
+{
+	if(width <= 0 || height <= 0)
+		return;
+
+	int row_bytes = width * 4;
+	if(row_bytes > this->ring_size)
+	{
+		cout << "Texture level too wide to stream (" << width << " texels)" << endl;
+		return;
+	}
+
+	int rows = (this->ring_size / 4) / row_bytes;
+
+	if(rows < 1)
+		rows = 1;
+
+	int y;
+	for(y = 0; y < height; y += rows)
+	{
+		int band = (height - y < rows ? height - y : rows);
+		int size = band * row_bytes;
+
+		unsigned char* dest = (this->backlog.empty() ? this->reserve(size) : NULL);
+
+		if(dest != NULL)
+		{
+			memcpy(dest, data + (long long)y * row_bytes, size);
+			this->commit(dest, tex, target, level, 0, y, width, band);
+
+			continue;
+		}
+
+		StreamBand held;
+		held.data = (unsigned char*)malloc(size);
+		held.size = size;
+		held.tex = tex;
+		held.target = target;
+		held.level = level;
+		held.y = y;
+		held.width = width;
+		held.height = band;
+
+		if(held.data == NULL)
+		{
+			cout << "Failed to hold back a texture upload" << endl;
+			continue;
+		}
+
+		memcpy(held.data, data + (long long)y * row_bytes, size);
+		this->backlog.push_back(held);
+		this->stalls ++;
+	}
+}
+
+// moves held back bands into the ring, oldest first,
+// while there's room and the frame's budget (counted
+// from 'start') isn't used up
+void TextureStreamer::refill(time_point<steady_clock> start)
+{
+	while(!(this->backlog.empty()))
+	{
+		duration<double, milli> elapsed = steady_clock::now() - start;
+		if(elapsed.count() >= this->budget)
+			break;
+
+		StreamBand& band = this->backlog.front();
+
+		unsigned char* dest = this->reserve(band.size);
+		if(dest == NULL)
+			break;
+
+		memcpy(dest, band.data, band.size);
+		this->commit(dest, band.tex, band.target, band.level, 0, band.y, band.width, band.height);
+
+		free(band.data);
+		this->backlog.pop_front();
+	}
+}
+
+// drops any queued uploads to a texture,
+// called before the texture is deleted
+void TextureStreamer::cancel(unsigned int tex)
+{
+	deque<StreamSegment>::iterator it;
+	for(it = this->segments.begin(); it != this->segments.end(); it ++)
+	{
+		if(it->tex == tex && !(it->submitted))
+			it->cancelled = true;
+	}
+
+	deque<StreamBand>::iterator band = this->backlog.begin();
+	while(band != this->backlog.end())
+	{
+		if(band->tex == tex)
+		{
+			free(band->data);
+			band = this->backlog.erase(band);
+		}
+		else
+			band ++;
+	}
+}
+
+// returns true if a texture still has uploads
+// that haven't been submitted yet
+bool TextureStreamer::isPending(unsigned int tex)
+{
+	deque<StreamSegment>::iterator it;
+	for(it = this->segments.begin(); it != this->segments.end(); it ++)
+	{
+		if(it->tex == tex && !(it->submitted) && !(it->cancelled))
+			return true;
+	}
+
+	deque<StreamBand>::iterator band;
+	for(band = this->backlog.begin(); band != this->backlog.end(); band ++)
+	{
+		if(band->tex == tex)
+			return true;
+	}
+	return false;
+}
+
+// issues the texture update for a segment,
+// sourcing it from the ring buffer, and fences it
+void TextureStreamer::submit(StreamSegment& segment)
+{
+	segment.submitted = true;
+
+	if(segment.cancelled)
+		return;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->buffer);
+	glBindTexture(_bindingTarget(segment.target), segment.tex);
+
+	glTexSubImage2D(segment.target, segment.level, segment.x, segment.y, segment.width, segment.height,
+					GL_RGBA, GL_UNSIGNED_BYTE, (void*)(size_t)segment.offset);
+
+	glBindTexture(_bindingTarget(segment.target), 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	this->bytes_uploaded += (long long)segment.width * segment.height * 4;
+}
+
+// frees ring space the GPU is done reading from,
+// in order. If 'wait' is set, blocks until at
+// least the oldest segment has been freed
+void TextureStreamer::retire(bool wait)
+{
+	while(!(this->segments.empty()))
+	{
+		StreamSegment& segment = this->segments.front();
+
+		if(!(segment.submitted))
+		{
+			if(!(segment.cancelled))
+				break;
+		}
+		else if(segment.fence != 0)
+		{
+			unsigned int flags = (wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0);
+			GLenum status = glClientWaitSync(segment.fence, flags, (wait ? STREAM_WAIT_NS : 0));
+
+			if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				break;
+
+			glDeleteSync(segment.fence);
+		}
+
+		this->segments.pop_front();
+		wait = false;
+	}
+}
+
+// submits every committed upload right away,
+// regardless of the frame budget. Only used on
+// shutdown, where waiting doesn't matter
+void TextureStreamer::flush()
+{
+	deque<StreamSegment>::iterator it;
+	for(it = this->segments.begin(); it != this->segments.end(); it ++)
+	{
+		if(it->submitted)
+			continue;
+
+		if(!(it->ready) && !(it->cancelled))
+			break;
+
+		this->submit(*it);
+	}
+}
+
+// called once per frame. Frees the space of finished
+// uploads, moves held back bands into it and submits
+// queued uploads in order until the frame's time budget
+// is used up (at least one goes through each frame so
+// streaming always makes progress). Never waits on the GPU
+void TextureStreamer::update()
+{
+	time_point<steady_clock> start = steady_clock::now();
+	int count = 0;
+
+	this->retire(false);
+	this->refill(start);
+
+	deque<StreamSegment>::iterator it;
+	for(it = this->segments.begin(); it != this->segments.end(); it ++)
+	{
+		if(it->submitted)
+			continue;
+
+		if(!(it->ready) && !(it->cancelled))
+			break;
+
+		duration<double, milli> elapsed = steady_clock::now() - start;
+		if(count > 0 && elapsed.count() >= this->budget)
+			break;
+
+		this->submit(*it);
+		count ++;
+	}
+
+	this->retire(false);
+}
+
+// returns the total number of bytes
+// uploaded through the ring so far
+long long TextureStreamer::getBytesUploaded()
+{
+	return this->bytes_uploaded;
+}
+
+// returns the number of committed uploads that
+// haven't been submitted yet, plus the bands still
+// held back waiting for ring space
+int TextureStreamer::getPendingUploads()
+{
+	int pending = (int)this->backlog.size();
+
+	deque<StreamSegment>::iterator it;
+	for(it = this->segments.begin(); it != this->segments.end(); it ++)
+	{
+		if(it->ready && !(it->submitted))
+			pending ++;
+	}
+	return pending;
+}
+
+// returns how many bands found the ring full
+// and were held back for a later frame
+int TextureStreamer::getStalls()
+{
+	return this->stalls;
+}
@@ -0,0 +1,90 @@
+#ifndef TEXTURESTREAMER_HPP__
+#define TEXTURESTREAMER_HPP__
+
+#include <GL/glew.h>
+
+#include <deque>
+#include <chrono>
+
+using namespace std;
+
+// a region of the ring buffer holding texel data for
+// one texture update, from the moment it is reserved
+// until the GPU has finished reading from it
+struct StreamSegment {
+
+	int offset;
+	int size;
+
+	unsigned int tex;
+	unsigned int target;
+	int level;
+	int x;
+	int y;
+	int width;
+	int height;
+
+	bool ready;
+	bool submitted;
+	bool cancelled;
+
+	GLsync fence;
+};
+
+// a band of rows 'upload' couldn't fit in the ring,
+// held in client memory until 'update' finds room
+struct StreamBand {
+
+	unsigned char* data;
+	int size;
+
+	unsigned int tex;
+	unsigned int target;
+	int level;
+	int y;
+	int width;
+	int height;
+};
+
+class TextureStreamer {
+
+	private:
+		unsigned int buffer;
+		unsigned char* mapped;
+
+		int ring_size;
+		int head;
+
+		double budget;
+
+		long long bytes_uploaded;
+		int stalls;
+
+		deque<StreamSegment> segments;
+		deque<StreamBand> backlog;
+
+		void submit(StreamSegment& segment);
+		void refill(chrono::time_point<chrono::steady_clock> start);
+		void retire(bool wait);
+		void flush();
+
+	public:
+		TextureStreamer(int ring_size, double budget);
+		~TextureStreamer();
+
+		unsigned char* reserve(int bytes);
+		void commit(unsigned char* data, unsigned int tex, unsigned int target, int level,
+					int x, int y, int width, int height);
+
+		void upload(unsigned int tex, unsigned int target, int level, int width, int height,
+					const unsigned char* data);
+		void cancel(unsigned int tex);
+		bool isPending(unsigned int tex);
+		void update();
+
+		long long getBytesUploaded();
+		int getPendingUploads();
+		int getStalls();
+};
+
+#endif
@@ -0,0 +1,418 @@
+#include "TileCache.hpp"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+// packs a page address into a single key
+// (texture ID, mip level, page x, page y)
+static unsigned long long _tileKey(int id, int mip, int x, int y)
+{
+	return ((unsigned long long)id << 48) | ((unsigned long long)mip << 32) |
+		   ((unsigned long long)y << 16) | (unsigned long long)x;
+}
+
+static int _keyID(unsigned long long key) { return (int)((key >> 48) & 0xFFFF); }
+static int _keyMip(unsigned long long key) { return (int)((key >> 32) & 0xFFFF); }
+static int _keyY(unsigned long long key) { return (int)((key >> 16) & 0xFFFF); }
+static int _keyX(unsigned long long key) { return (int)(key & 0xFFFF); }
+
+// coarser mips are requested first, so a
+// usable fallback shows up as early as possible
+static bool _coarserFirst(unsigned long long a, unsigned long long b)
+{
+	return _keyMip(a) > _keyMip(b);
+}
+
+// creates the physical page cache (a fixed size
+// texture, so VRAM use doesn't depend on how many
+// virtual textures exist or how big they are), the
+// low resolution feedback framebuffer and the
+// loader thread that reads pages from disk
+TileCache::TileCache(int fb_width, int fb_height)
+{
+	this->fb_width = fb_width;
+	this->fb_height = fb_height;
+	this->fb_index = 0;
+	this->fb_ready[0] = false;
+	this->fb_ready[1] = false;
+	this->frame = 0;
+
+	glGenTextures(1, &(this->phys_tex));
+	glBindTexture(GL_TEXTURE_2D, this->phys_tex);
+
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, CACHE_SIZE, CACHE_SIZE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &(this->fb_color));
+	glBindRenderbuffer(GL_RENDERBUFFER, this->fb_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, fb_width, fb_height);
+
+	glGenRenderbuffers(1, &(this->fb_depth));
+	glBindRenderbuffer(GL_RENDERBUFFER, this->fb_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, fb_width, fb_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &(this->fbo));
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->fb_color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->fb_depth);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cout << "Feedback framebuffer is incomplete" << endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(2, this->pbo);
+
+	int i;
+	for(i = 0; i < 2; i ++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, fb_width * fb_height * 4 * sizeof(unsigned short), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	TileSlot empty = {.key=0, .last_used=0, .used=false, .pinned=false};
+	this->slots.assign(CACHE_PAGES * CACHE_PAGES, empty);
+
+	this->running = true;
+	this->loader = thread(&TileCache::loaderMain, this);
+}
+
+// stops the loader thread and frees the cache
+// texture, feedback framebuffer and any pages
+// that were loaded but never uploaded
+TileCache::~TileCache()
+{
+	{
+		unique_lock<mutex> guard(this->lock);
+		this->running = false;
+	}
+	this->wake.notify_all();
+	this->loader.join();
+
+	while(!(this->loaded.empty()))
+	{
+		delete[] this->loaded.front().data;
+		this->loaded.pop_front();
+	}
+
+	glDeleteBuffers(2, this->pbo);
+	glDeleteFramebuffers(1, &(this->fbo));
+	glDeleteRenderbuffers(1, &(this->fb_color));
+	glDeleteRenderbuffers(1, &(this->fb_depth));
+	glDeleteTextures(1, &(this->phys_tex));
+}
+
+// adds a virtual texture to the cache and returns the
+// ID the feedback pass writes for it. The coarsest mip
+// is loaded right away and pinned, so every lookup
+// always has something to fall back on
+int TileCache::registerTexture(VirtualTexture* vtex)
+{
+	int id;
+	{
+		unique_lock<mutex> guard(this->lock);
+
+		id = (int)this->textures.size();
+		this->textures.push_back(vtex);
+	}
+	vtex->setCache(id, this->phys_tex);
+
+	int top = vtex->getNumMips() - 1;
+	if(top < 0)
+		return id;
+
+	unsigned char* data = new unsigned char[PAGE_BYTES];
+
+	int x, y;
+	for(y = 0; y < vtex->getPagesY(top); y ++)
+	{
+		for(x = 0; x < vtex->getPagesX(top); x ++)
+		{
+			int slot = this->allocSlot();
+			if(slot < 0 || !vtex->readTile(top, x, y, data))
+				continue;
+
+			this->uploadTile(slot, _tileKey(id, top, x, y), data);
+			this->slots[slot].pinned = true;
+		}
+	}
+
+	delete[] data;
+	vtex->updateIndirection();
+
+	return id;
+}
+
+// binds the feedback framebuffer. Everything drawn
+// until 'endFeedback' records which virtual pages
+// (and at which mip) are visible on screen
+void TileCache::beginFeedback()
+{
+	unsigned int clear[4] = {0, 0, 0, 0};
+
+	glGetIntegerv(GL_VIEWPORT, this->viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+	glViewport(0, 0, this->fb_width, this->fb_height);
+
+	glClearBufferuiv(GL_COLOR, 0, clear);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+// starts an asynchronous readback of the feedback
+// framebuffer into one of two pixel buffers, taking
+// turns. Each is only mapped when its turn comes round
+// again, two frames later, so the read never stalls.
+// Tiles are therefore requested for the view of two
+// frames ago: a page coming into view shows its coarser
+// fallback for at least that long before it's loaded
+void TileCache::endFeedback()
+{
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbo[this->fb_index]);
+	glReadPixels(0, 0, this->fb_width, this->fb_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	this->fb_ready[this->fb_index] = true;
+	this->fb_index ^= 1;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(this->viewport[0], this->viewport[1], this->viewport[2], this->viewport[3]);
+}
+
+// maps the feedback from two frames ago and
+// collects every page it references, along with all
+// of their ancestors so fallbacks stay resident too
+void TileCache::readFeedback(unordered_set<unsigned long long>& needed)
+{
+	if(!(this->fb_ready[this->fb_index]))
+		return;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbo[this->fb_index]);
+
+	int count = this->fb_width * this->fb_height;
+	unsigned short* pixels = (unsigned short*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+		count * 4 * sizeof(unsigned short), GL_MAP_READ_BIT);
+
+	if(pixels != NULL)
+	{
+		unsigned long long last = ~0ull;
+
+		int i;
+		for(i = 0; i < count; i ++)
+		{
+			unsigned short* p = pixels + i * 4;
+			if(p[3] == 0 || (int)p[3] > (int)this->textures.size())
+				continue;
+
+			int id = (int)p[3] - 1;
+			unsigned long long key = _tileKey(id, p[2], p[0], p[1]);
+
+			// neighbouring pixels mostly land on the same page
+			if(key == last)
+				continue;
+
+			last = key;
+
+			VirtualTexture* vtex = this->textures[id];
+
+			int mip = p[2], x = p[0], y = p[1];
+			for(; mip < vtex->getNumMips(); mip ++, x >>= 1, y >>= 1)
+			{
+				if(!(needed.insert(_tileKey(id, mip, x, y)).second))
+					break;
+			}
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	this->fb_ready[this->fb_index] = false;
+}
+
+// returns a free slot in the physical cache, evicting
+// the least recently used page if the cache is full.
+// Pinned pages and pages used this frame are never
+// evicted, returns -1 if no slot could be found
+int TileCache::allocSlot()
+{
+	int best = -1;
+
+	int i;
+	for(i = 0; i < (int)this->slots.size(); i ++)
+	{
+		TileSlot& slot = this->slots[i];
+
+		if(!slot.used)
+			return i;
+
+		if(slot.pinned || slot.last_used >= this->frame)
+			continue;
+
+		if(best < 0 || slot.last_used < this->slots[best].last_used)
+			best = i;
+	}
+
+	if(best >= 0)
+	{
+		unsigned long long key = this->slots[best].key;
+
+		this->textures[_keyID(key)]->clearResident(_keyMip(key), _keyX(key), _keyY(key));
+		this->resident.erase(key);
+		this->slots[best].used = false;
+	}
+	return best;
+}
+
+// copies a page into its slot of the physical
+// cache and points the page table at it
+void TileCache::uploadTile(int slot, unsigned long long key, unsigned char* data)
+{
+	int sx = slot % CACHE_PAGES;
+	int sy = slot / CACHE_PAGES;
+
+	glBindTexture(GL_TEXTURE_2D, this->phys_tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, sx * PAGE_SIZE, sy * PAGE_SIZE, PAGE_SIZE, PAGE_SIZE,
+		GL_RGBA, GL_UNSIGNED_BYTE, data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	this->slots[slot].key = key;
+	this->slots[slot].last_used = this->frame;
+	this->slots[slot].used = true;
+	this->slots[slot].pinned = false;
+
+	this->resident[key] = slot;
+	this->textures[_keyID(key)]->setResident(_keyMip(key), _keyX(key), _keyY(key), sx, sy);
+}
+
+// runs once per frame, before the feedback pass.
+// Reads back the feedback from two frames ago, refreshes the
+// pages still in use, queues missing pages for the
+// loader thread, uploads a bounded number of pages
+// that finished loading and rebuilds page tables
+void TileCache::update()
+{
+	this->frame ++;
+
+	unordered_set<unsigned long long> needed;
+	this->readFeedback(needed);
+
+	vector<unsigned long long> missing;
+
+	unordered_set<unsigned long long>::iterator it;
+	for(it = needed.begin(); it != needed.end(); it ++)
+	{
+		unordered_map<unsigned long long, int>::iterator found = this->resident.find(*it);
+
+		if(found != this->resident.end())
+			this->slots[found->second].last_used = this->frame;
+		else
+			missing.push_back(*it);
+	}
+	sort(missing.begin(), missing.end(), _coarserFirst);
+
+	vector<LoadedTile> finished;
+	{
+		unique_lock<mutex> guard(this->lock);
+
+		// requests the loader hasn't started on yet are stale,
+		// replace them with what this frame's feedback asked for
+		while(!(this->requests.empty()))
+		{
+			this->pending.erase(this->requests.front());
+			this->requests.pop_front();
+		}
+
+		size_t i;
+		for(i = 0; i < missing.size() && this->requests.size() < MAX_TILE_REQUESTS; i ++)
+		{
+			if(this->pending.insert(missing[i]).second)
+				this->requests.push_back(missing[i]);
+		}
+
+		while(!(this->loaded.empty()) && finished.size() < MAX_TILE_UPLOADS)
+		{
+			finished.push_back(this->loaded.front());
+			this->loaded.pop_front();
+		}
+	}
+	this->wake.notify_one();
+
+	size_t i;
+	for(i = 0; i < finished.size(); i ++)
+	{
+		LoadedTile& tile = finished[i];
+
+		if(tile.data != NULL && this->resident.find(tile.key) == this->resident.end())
+		{
+			int slot = this->allocSlot();
+			if(slot >= 0)
+				this->uploadTile(slot, tile.key, tile.data);
+		}
+		delete[] tile.data;
+	}
+
+	if(!finished.empty())
+	{
+		unique_lock<mutex> guard(this->lock);
+
+		for(i = 0; i < finished.size(); i ++)
+			this->pending.erase(finished[i].key);
+	}
+
+	for(i = 0; i < this->textures.size(); i ++)
+		this->textures[i]->updateIndirection();
+}
+
+// returns the number of pages currently
+// held in the physical cache
+int TileCache::getResidentPages()
+{
+	return (int)this->resident.size();
+}
+
+// loader thread, reads requested pages from their
+// tiled texture files and hands them back to the
+// GL thread (which does all of the uploading)
+void TileCache::loaderMain()
+{
+	for(;;)
+	{
+		unsigned long long key;
+		VirtualTexture* vtex;
+		{
+			unique_lock<mutex> guard(this->lock);
+
+			while(this->running && this->requests.empty())
+				this->wake.wait(guard);
+
+			if(!(this->running))
+				return;
+
+			key = this->requests.front();
+			this->requests.pop_front();
+
+			vtex = this->textures[_keyID(key)];
+		}
+
+		unsigned char* data = new unsigned char[PAGE_BYTES];
+		if(!vtex->readTile(_keyMip(key), _keyX(key), _keyY(key), data))
+		{
+			delete[] data;
+			data = NULL;
+		}
+
+		LoadedTile tile = {.key=key, .data=data};
+		{
+			unique_lock<mutex> guard(this->lock);
+			this->loaded.push_back(tile);
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef TILECACHE_HPP__
+#define TILECACHE_HPP__
+
+#include "VirtualTexture.hpp"
+
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+#define CACHE_PAGES 15
+#define CACHE_SIZE (CACHE_PAGES * PAGE_SIZE)
+
+#define FEEDBACK_SCALE 8
+#define MAX_TILE_UPLOADS 8
+#define MAX_TILE_REQUESTS 64
+
+using namespace std;
+
+// a slot in the physical page cache
+struct TileSlot {
+
+	unsigned long long key;
+	int last_used;
+	bool used;
+	bool pinned;
+};
+
+// a page read from disk by the loader
+// thread, waiting to be uploaded
+struct LoadedTile {
+
+	unsigned long long key;
+	unsigned char* data;
+};
+
+class TileCache {
+
+	private:
+		unsigned int phys_tex;
+		unsigned int fbo;
+		unsigned int fb_color;
+		unsigned int fb_depth;
+		unsigned int pbo[2];
+
+		int fb_width;
+		int fb_height;
+		int fb_index;
+		int viewport[4];
+		int frame;
+
+		bool fb_ready[2];
+		bool running;
+
+		vector<VirtualTexture*> textures;
+		vector<TileSlot> slots;
+
+		unordered_map<unsigned long long, int> resident;
+		unordered_set<unsigned long long> pending;
+
+		deque<unsigned long long> requests;
+		deque<LoadedTile> loaded;
+
+		thread loader;
+		mutex lock;
+		condition_variable wake;
+
+		int allocSlot();
+		void uploadTile(int slot, unsigned long long key, unsigned char* data);
+		void readFeedback(unordered_set<unsigned long long>& needed);
+		void loaderMain();
+
+	public:
+		TileCache(int fb_width, int fb_height);
+		~TileCache();
+
+		int registerTexture(VirtualTexture* vtex);
+
+		void beginFeedback();
+		void endFeedback();
+		void update();
+
+		int getResidentPages();
+};
+
+#endif
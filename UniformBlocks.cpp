@@ -0,0 +1,229 @@
+#include "UniformBlocks.hpp"
+
+#include <GL/glew.h>
+
+#include <cstring>
+
+// creates the frame, light and material uniform buffers
+// and binds each to its binding point. Binding points are
+// shared by every program, so this only happens once
+UniformBlocks::UniformBlocks()
+{
+	memset(&(this->frame), 0, sizeof(FrameBlock));
+	memset(&(this->lights), 0, sizeof(LightBlock));
+	memset(&(this->material), 0, sizeof(MaterialBlock));
+
+	this->projection = Mat4::identity();
+	this->view = Mat4::identity();
+	this->view_projection = Mat4::identity();
+	this->ring = NULL;
+
+	const void* shadows[NUM_UNIFORM_BLOCKS] = { &(this->frame), &(this->lights), &(this->material) };
+	size_t sizes[NUM_UNIFORM_BLOCKS] = { sizeof(FrameBlock), sizeof(LightBlock), sizeof(MaterialBlock) };
+
+	glGenBuffers(NUM_UNIFORM_BLOCKS, this->ubos);
+
+	int i;
+	for(i = 0; i < NUM_UNIFORM_BLOCKS; i ++)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, this->ubos[i]);
+		glBufferData(GL_UNIFORM_BUFFER, sizes[i], shadows[i], GL_DYNAMIC_DRAW);
+
+		glBindBufferBase(GL_UNIFORM_BUFFER, i, this->ubos[i]);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBlocks::~UniformBlocks()
+{
+	glDeleteBuffers(NUM_UNIFORM_BLOCKS, this->ubos);
+}
+
+// copies 'size' bytes into the CPU copy of a block at
+// 'offset', and to the GPU with a sub-range write only
+// if they differ from what's already there
+void UniformBlocks::write(int binding, void* shadow, size_t offset, const void* data, size_t size)
+{
+	char* dest = (char*)shadow + offset;
+
+	if(memcmp(dest, data, size) == 0)
+		return;
+
+	memcpy(dest, data, size);
+
+	if(this->ring != NULL)
+	{
+		this->upload(binding);
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, this->ubos[binding]);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// writes the whole CPU copy of a block into the frame
+// ring and binds it there. If the ring is full this frame
+// the block goes back to its own buffer instead
+void UniformBlocks::upload(int binding)
+{
+	const void* shadows[NUM_UNIFORM_BLOCKS] = { &(this->frame), &(this->lights), &(this->material) };
+	size_t sizes[NUM_UNIFORM_BLOCKS] = { sizeof(FrameBlock), sizeof(LightBlock), sizeof(MaterialBlock) };
+
+	if(this->ring != NULL)
+	{
+		int offset = this->ring->upload(shadows[binding], (int)sizes[binding]);
+
+		if(offset >= 0)
+		{
+			glBindBufferRange(GL_UNIFORM_BUFFER, binding, this->ring->getBuffer(), offset, sizes[binding]);
+			return;
+		}
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, this->ubos[binding]);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizes[binding], shadows[binding]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, this->ubos[binding]);
+}
+
+// moves the blocks into 'ring', a new copy written on
+// every change. Passing NULL moves them back to their
+// own buffers, which are brought up to date first
+void UniformBlocks::setFrameRing(FrameRing* ring)
+{
+	this->ring = ring;
+
+	int i;
+	for(i = 0; i < NUM_UNIFORM_BLOCKS; i ++)
+		this->upload(i);
+}
+
+// must follow the ring's 'beginFrame'. Blocks that haven't
+// changed are still bound to an older frame's partition,
+// which the ring will reuse, so each is copied forward
+void UniformBlocks::beginFrame()
+{
+	if(this->ring == NULL)
+		return;
+
+	int i;
+	for(i = 0; i < NUM_UNIFORM_BLOCKS; i ++)
+		this->upload(i);
+}
+
+// rebuilds the frame block from the projection and
+// view matrices. The camera position is where the
+// inverse view matrix takes the origin
+void UniformBlocks::updateFrame()
+{
+	this->view_projection = this->projection * this->view;
+
+	FrameBlock block;
+	Mat4 inverse = this->view.inverse();
+
+	memcpy(block.projection, this->projection.m, sizeof(block.projection));
+	memcpy(block.view, this->view.m, sizeof(block.view));
+	memcpy(block.view_projection, this->view_projection.m, sizeof(block.view_projection));
+
+	block.camera_pos[0] = inverse.m[12];
+	block.camera_pos[1] = inverse.m[13];
+	block.camera_pos[2] = inverse.m[14];
+	block.camera_pos[3] = 1.0f;
+
+	// the projection rarely changes, so it gets its own range
+	this->write(FRAME_BLOCK_BINDING, &(this->frame), 0, block.projection, sizeof(block.projection));
+	this->write(FRAME_BLOCK_BINDING, &(this->frame), offsetof(FrameBlock, view), (char*)&block + offsetof(FrameBlock, view),
+				sizeof(FrameBlock) - offsetof(FrameBlock, view));
+}
+
+// sets the projection matrix, describing the
+// window's viewport and perspective
+void UniformBlocks::setProjection(const Mat4& projection)
+{
+	this->projection = projection;
+	this->updateFrame();
+}
+
+// sets the view (camera) matrix
+void UniformBlocks::setView(const Mat4& view)
+{
+	this->view = view;
+	this->updateFrame();
+}
+
+// sets the SH irradiance coefficients (SH_NUM_COEFFS
+// RGB triples) the ambient term is evaluated from
+void UniformBlocks::setIrradiance(float* coeffs)
+{
+	float irradiance[SH_NUM_COEFFS][4];
+
+	int i;
+	for(i = 0; i < SH_NUM_COEFFS; i ++)
+	{
+		irradiance[i][0] = coeffs[i * 3];
+		irradiance[i][1] = coeffs[i * 3 + 1];
+		irradiance[i][2] = coeffs[i * 3 + 2];
+		irradiance[i][3] = 0.0f;
+	}
+
+	this->write(LIGHT_BLOCK_BINDING, &(this->lights), offsetof(LightBlock, irradiance), irradiance, sizeof(irradiance));
+}
+
+// sets the directional light's direction (pointing the
+// way it shines) and colors. Black colors turn it off
+void UniformBlocks::setSun(const Vec3& direction, const float* diffuse, const float* specular)
+{
+	Vec3 dir = direction.normalize();
+
+	float block[3][4] = {
+		{ dir.x, dir.y, dir.z, this->lights.sun_direction[3] },
+		{ diffuse[0], diffuse[1], diffuse[2], 0.0f },
+		{ specular[0], specular[1], specular[2], 0.0f }
+	};
+
+	this->write(LIGHT_BLOCK_BINDING, &(this->lights), offsetof(LightBlock, sun_direction), block, sizeof(block));
+}
+
+// sets the sun's SHADOW_CASCADES shadow matrices, the view
+// depth each reaches and the world size of its texels, and
+// turns its shadows on
+void UniformBlocks::setCascades(const Mat4* matrices, const float* splits, const float* texels)
+{
+	float enabled = 1.0f;
+	this->write(LIGHT_BLOCK_BINDING, &(this->lights), offsetof(LightBlock, sun_direction) + 3 * sizeof(float), &enabled, sizeof(float));
+
+	float block[SHADOW_CASCADES][16];
+
+	int i;
+	for(i = 0; i < SHADOW_CASCADES; i ++)
+		memcpy(block[i], matrices[i].m, sizeof(block[i]));
+
+	this->write(LIGHT_BLOCK_BINDING, &(this->lights), offsetof(LightBlock, cascade_matrices), block, sizeof(block));
+	this->write(LIGHT_BLOCK_BINDING, &(this->lights), offsetof(LightBlock, cascade_splits), splits, SHADOW_CASCADES * sizeof(float));
+	this->write(LIGHT_BLOCK_BINDING, &(this->lights), offsetof(LightBlock, cascade_texels), texels, SHADOW_CASCADES * sizeof(float));
+}
+
+// sets the material used by draws that don't
+// carry their own (see IndirectBatch)
+void UniformBlocks::setMaterial(Material* material)
+{
+	MaterialBlock block;
+	memset(&block, 0, sizeof(MaterialBlock));
+
+	memcpy(block.ambient, material->getAmbient(), 3 * sizeof(float));
+	memcpy(block.diffuse, material->getDiffuse(), 3 * sizeof(float));
+	memcpy(block.specular, material->getSpecular(), 3 * sizeof(float));
+
+	block.specular[3] = material->getShininess();
+
+	this->write(MATERIAL_BLOCK_BINDING, &(this->material), 0, &block, sizeof(MaterialBlock));
+}
+
+// returns projection * view, for building
+// model-view-projection matrices on the CPU
+const Mat4& UniformBlocks::getViewProjection()
+{
+	return this->view_projection;
+}
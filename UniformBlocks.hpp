@@ -0,0 +1,101 @@
+#ifndef UNIFORMBLOCKS_HPP__
+#define UNIFORMBLOCKS_HPP__
+
+#include "SphericalHarmonics.hpp"
+#include "VectorMath.hpp"
+#include "Material.hpp"
+#include "FrameRing.hpp"
+
+#include <cstddef>
+
+// must match the block bindings
+// declared in main.vs/main.fs
+#define FRAME_BLOCK_BINDING 0
+#define LIGHT_BLOCK_BINDING 1
+#define MATERIAL_BLOCK_BINDING 2
+#define NUM_UNIFORM_BLOCKS 3
+
+// must match cascade_count in main.fs/deferred.cs
+#define SHADOW_CASCADES 4
+
+// the blocks below are laid out by std140 rules: vec3s
+// and array elements take a full vec4 slot each
+
+struct FrameBlock {
+
+	float projection[16];
+	float view[16];
+	float view_projection[16];
+	float camera_pos[4];
+};
+
+// the point lights themselves are in a LightBuffer. The
+// sun shines along 'sun_direction', whose w is 1 when its
+// shadow cascades are in use. Each cascade's matrix takes
+// world space to its shadow map's texture space; it covers
+// view depths up to its split, and its texels are its
+// 'cascade_texels' world units across
+struct LightBlock {
+
+	float irradiance[SH_NUM_COEFFS][4];
+
+	float sun_direction[4];
+	float sun_diffuse[4];
+	float sun_specular[4];
+
+	float cascade_matrices[SHADOW_CASCADES][16];
+	float cascade_splits[SHADOW_CASCADES];
+	float cascade_texels[SHADOW_CASCADES];
+};
+
+// specular[3] is where std140 packs the shininess
+struct MaterialBlock {
+
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+};
+
+// owns the uniform buffers every shader program reads
+// its per-frame camera data, ambient light and material from.
+// Each buffer is bound to its fixed binding point once,
+// and only the bytes that actually changed get written.
+// With a frame ring, every change instead writes a fresh
+// copy of the block into the ring and binds that range
+class UniformBlocks {
+
+	private:
+		unsigned int ubos[NUM_UNIFORM_BLOCKS];
+		FrameRing* ring;
+
+		FrameBlock frame;
+		LightBlock lights;
+		MaterialBlock material;
+
+		Mat4 projection;
+		Mat4 view;
+		Mat4 view_projection;
+
+		void write(int binding, void* shadow, size_t offset, const void* data, size_t size);
+		void upload(int binding);
+		void updateFrame();
+
+	public:
+		UniformBlocks();
+		~UniformBlocks();
+
+		void setFrameRing(FrameRing* ring);
+		void beginFrame();
+
+		void setProjection(const Mat4& projection);
+		void setView(const Mat4& view);
+
+		void setIrradiance(float* coeffs);
+		void setSun(const Vec3& direction, const float* diffuse, const float* specular);
+		void setCascades(const Mat4* matrices, const float* splits, const float* texels);
+		void setMaterial(Material* material);
+
+		const Mat4& getViewProjection();
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "UniformTable.hpp"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <string>
+
+// returns the size in bytes of one
+// element of a uniform of 'type'
+static int _typeSize(unsigned int type)
+{
+	switch(type)
+	{
+		case GL_FLOAT_VEC2: return 2 * sizeof(float);
+		case GL_FLOAT_VEC3: return 3 * sizeof(float);
+		case GL_FLOAT_VEC4: return 4 * sizeof(float);
+		case GL_INT_VEC2: return 2 * sizeof(int);
+		case GL_INT_VEC3: return 3 * sizeof(int);
+		case GL_INT_VEC4: return 4 * sizeof(int);
+		case GL_FLOAT_MAT3: return 9 * sizeof(float);
+		case GL_FLOAT_MAT4: return 16 * sizeof(float);
+	}
+
+	// floats, ints, bools, unsigned ints and samplers
+	return 4;
+}
+
+static bool _slotLess(const UniformSlot& a, const UniformSlot& b)
+{
+	return a.id < b.id;
+}
+
+// reflects all active uniforms of a linked program. Array
+// uniforms are keyed by their name without the "[0]" GL
+// reports, and uniforms living in blocks are skipped
+// (see UniformBlocks). The shadow starts zeroed, which is
+// what GL initializes every uniform to
+UniformTable::UniformTable(unsigned int prog_id)
+{
+	int count = 0, max_length = 0;
+
+	glGetProgramiv(prog_id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(prog_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+	char* name = new char[max_length + 1];
+	int offset = 0;
+
+	int i;
+	for(i = 0; i < count; i ++)
+	{
+		GLsizei length = 0;
+		GLint array_size = 0;
+		GLenum type = 0;
+
+		glGetActiveUniform(prog_id, i, max_length + 1, &length, &array_size, &type, name);
+
+		int location = glGetUniformLocation(prog_id, name);
+		if(location < 0)
+			continue;
+
+		string base(name, length);
+		size_t bracket = base.find('[');
+
+		if(bracket != string::npos)
+			base = base.substr(0, bracket);
+
+		UniformSlot slot;
+		slot.id = uniformHash(base.c_str());
+		slot.location = location;
+		slot.type = type;
+		slot.count = array_size;
+		slot.offset = offset;
+		slot.size = _typeSize(type) * array_size;
+
+		offset += slot.size;
+		this->slots.push_back(slot);
+	}
+	delete[] name;
+
+	sort(this->slots.begin(), this->slots.end(), _slotLess);
+
+	for(i = 1; i < (int)this->slots.size(); i ++)
+	{
+		if(this->slots[i].id == this->slots[i - 1].id)
+			cout << "Warning: two uniforms share the hash " << this->slots[i].id << endl;
+	}
+
+	this->shadow.assign(offset, 0);
+	this->dirty.assign(this->slots.size(), false);
+}
+
+// finds a slot by binary search over the sorted IDs
+UniformSlot* UniformTable::find(unsigned int id)
+{
+	UniformSlot key;
+	key.id = id;
+
+	vector<UniformSlot>::iterator it = lower_bound(this->slots.begin(), this->slots.end(), key, _slotLess);
+
+	if(it == this->slots.end() || it->id != id)
+		return NULL;
+
+	return &(*it);
+}
+
+// records a new value for a uniform (up to the slot's
+// size), marking it dirty if it differs from the last
+// value. Returns false if the program doesn't use it
+bool UniformTable::set(unsigned int id, const void* data, int size)
+{
+	UniformSlot* slot = this->find(id);
+	if(slot == NULL)
+		return false;
+
+	if(size > slot->size)
+		size = slot->size;
+
+	char* dest = &(this->shadow[slot->offset]);
+	if(memcmp(dest, data, size) == 0)
+		return true;
+
+	memcpy(dest, data, size);
+
+	int index = (int)(slot - &(this->slots[0]));
+	if(!this->dirty[index])
+	{
+		this->dirty[index] = true;
+		this->dirty_slots.push_back(index);
+	}
+	return true;
+}
+
+// sends every changed uniform to GL, to be called
+// with the program bound right before drawing
+void UniformTable::flush()
+{
+	int i;
+	for(i = 0; i < (int)this->dirty_slots.size(); i ++)
+	{
+		UniformSlot& slot = this->slots[this->dirty_slots[i]];
+		const void* data = &(this->shadow[slot.offset]);
+
+		switch(slot.type)
+		{
+			case GL_FLOAT: glUniform1fv(slot.location, slot.count, (const float*)data); break;
+			case GL_FLOAT_VEC2: glUniform2fv(slot.location, slot.count, (const float*)data); break;
+			case GL_FLOAT_VEC3: glUniform3fv(slot.location, slot.count, (const float*)data); break;
+			case GL_FLOAT_VEC4: glUniform4fv(slot.location, slot.count, (const float*)data); break;
+			case GL_INT_VEC2: glUniform2iv(slot.location, slot.count, (const int*)data); break;
+			case GL_INT_VEC3: glUniform3iv(slot.location, slot.count, (const int*)data); break;
+			case GL_INT_VEC4: glUniform4iv(slot.location, slot.count, (const int*)data); break;
+			case GL_UNSIGNED_INT: glUniform1uiv(slot.location, slot.count, (const unsigned int*)data); break;
+			case GL_FLOAT_MAT3: glUniformMatrix3fv(slot.location, slot.count, GL_FALSE, (const float*)data); break;
+			case GL_FLOAT_MAT4: glUniformMatrix4fv(slot.location, slot.count, GL_FALSE, (const float*)data); break;
+
+			// ints, bools and samplers
+			default: glUniform1iv(slot.location, slot.count, (const int*)data); break;
+		}
+
+		this->dirty[this->dirty_slots[i]] = false;
+	}
+	this->dirty_slots.clear();
+}
+
+// returns true if the program has an active uniform 'id'
+bool UniformTable::has(unsigned int id)
+{
+	return (this->find(id) != NULL);
+}
+
+int UniformTable::getNumUniforms()
+{
+	return (int)this->slots.size();
+}
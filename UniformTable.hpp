@@ -0,0 +1,58 @@
+#ifndef UNIFORMTABLE_HPP__
+#define UNIFORMTABLE_HPP__
+
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// FNV-1a hash of a uniform's name. Usable at compile time
+// and at run time, so names given as literals can be
+// looked up without ever touching a string
+constexpr unsigned int uniformHash(const char* name, unsigned int hash = 2166136261u)
+{
+	return (*name == 0 ? hash : uniformHash(name + 1, (hash ^ (unsigned char)*name) * 16777619u));
+}
+
+// forces the hash of a literal name to be computed
+// by the compiler, for use with the Shader setters
+#define UNIFORM_ID(name) (integral_constant<unsigned int, uniformHash(name)>::value)
+
+// one active uniform found by reflection, and where
+// its value lives in the shadow copy
+struct UniformSlot {
+
+	unsigned int id;
+	int location;
+	unsigned int type;
+	int count;
+	int offset;
+	int size;
+};
+
+// every active (non-block) uniform of one program, keyed
+// by hashed name. Values are written into a shadow copy,
+// and only slots whose bytes actually changed are sent
+// to GL when the table is flushed
+class UniformTable {
+
+	private:
+		vector<UniformSlot> slots;
+		vector<char> shadow;
+
+		vector<bool> dirty;
+		vector<int> dirty_slots;
+
+		UniformSlot* find(unsigned int id);
+
+	public:
+		UniformTable(unsigned int prog_id);
+
+		bool set(unsigned int id, const void* data, int size);
+		void flush();
+
+		bool has(unsigned int id);
+		int getNumUniforms();
+};
+
+#endif
@@ -0,0 +1,475 @@
+#include "VectorMath.hpp"
+
+#include <cstring>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+Vec3::Vec3()
+{
+	this->x = 0.0f;
+	this->y = 0.0f;
+	this->z = 0.0f;
+}
+
+Vec3::Vec3(float x, float y, float z)
+{
+	this->x = x;
+	this->y = y;
+	this->z = z;
+}
+
+Vec3 Vec3::operator+(const Vec3& v) const
+{
+	return Vec3(this->x + v.x, this->y + v.y, this->z + v.z);
+}
+
+Vec3 Vec3::operator-(const Vec3& v) const
+{
+	return Vec3(this->x - v.x, this->y - v.y, this->z - v.z);
+}
+
+Vec3 Vec3::operator*(float s) const
+{
+	return Vec3(this->x * s, this->y * s, this->z * s);
+}
+
+float Vec3::dot(const Vec3& v) const
+{
+	return this->x * v.x + this->y * v.y + this->z * v.z;
+}
+
+Vec3 Vec3::cross(const Vec3& v) const
+{
+	return Vec3(this->y * v.z - this->z * v.y,
+				this->z * v.x - this->x * v.z,
+				this->x * v.y - this->y * v.x);
+}
+
+float Vec3::length() const
+{
+	return sqrtf(this->dot(*this));
+}
+
+// returns a unit length copy, or the zero
+// vector if this vector has no length
+Vec3 Vec3::normalize() const
+{
+	float len = this->length();
+	if(len == 0.0f)
+		return Vec3();
+
+	return (*this) * (1.0f / len);
+}
+
+Quat::Quat()
+{
+	this->x = 0.0f;
+	this->y = 0.0f;
+	this->z = 0.0f;
+	this->w = 1.0f;
+}
+
+Quat::Quat(float x, float y, float z, float w)
+{
+	this->x = x;
+	this->y = y;
+	this->z = z;
+	this->w = w;
+}
+
+// rotation of 'degrees' about 'axis', with the
+// same sign convention as glRotatef
+Quat Quat::axisAngle(float degrees, const Vec3& axis)
+{
+	Vec3 n = axis.normalize();
+	float half = degrees * (float)M_PI / 360.0f;
+	float s = sinf(half);
+
+	return Quat(n.x * s, n.y * s, n.z * s, cosf(half));
+}
+
+// composes two rotations, 'q' is applied first
+Quat Quat::operator*(const Quat& q) const
+{
+	return Quat(this->w * q.x + this->x * q.w + this->y * q.z - this->z * q.y,
+				this->w * q.y - this->x * q.z + this->y * q.w + this->z * q.x,
+				this->w * q.z + this->x * q.y - this->y * q.x + this->z * q.w,
+				this->w * q.w - this->x * q.x - this->y * q.y - this->z * q.z);
+}
+
+Vec3 Quat::rotate(const Vec3& v) const
+{
+	Vec3 u(this->x, this->y, this->z);
+	Vec3 t = u.cross(v) * 2.0f;
+
+	return v + t * this->w + u.cross(t);
+}
+
+Quat Quat::normalize() const
+{
+	float len = sqrtf(this->x * this->x + this->y * this->y + this->z * this->z + this->w * this->w);
+	if(len == 0.0f)
+		return Quat();
+
+	return Quat(this->x / len, this->y / len, this->z / len, this->w / len);
+}
+
+Mat4 Mat4::identity()
+{
+	Mat4 r;
+	memset(r.m, 0, sizeof(r.m));
+
+	r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+	return r;
+}
+
+// same matrix glTranslatef multiplies by
+Mat4 Mat4::translate(float x, float y, float z)
+{
+	Mat4 r = Mat4::identity();
+
+	r.m[12] = x;
+	r.m[13] = y;
+	r.m[14] = z;
+
+	return r;
+}
+
+// same matrix glRotatef multiplies by
+Mat4 Mat4::rotate(float degrees, float x, float y, float z)
+{
+	Vec3 n = Vec3(x, y, z).normalize();
+
+	float rad = degrees * (float)M_PI / 180.0f;
+	float c = cosf(rad), s = sinf(rad), t = 1.0f - c;
+
+	Mat4 r = Mat4::identity();
+
+	r.m[0] = n.x * n.x * t + c;
+	r.m[1] = n.y * n.x * t + n.z * s;
+	r.m[2] = n.x * n.z * t - n.y * s;
+
+	r.m[4] = n.x * n.y * t - n.z * s;
+	r.m[5] = n.y * n.y * t + c;
+	r.m[6] = n.y * n.z * t + n.x * s;
+
+	r.m[8] = n.x * n.z * t + n.y * s;
+	r.m[9] = n.y * n.z * t - n.x * s;
+	r.m[10] = n.z * n.z * t + c;
+
+	return r;
+}
+
+// rotation matrix of a unit quaternion
+Mat4 Mat4::fromQuat(const Quat& q)
+{
+	Mat4 r = Mat4::identity();
+
+	r.m[0] = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+	r.m[1] = 2.0f * (q.x * q.y + q.w * q.z);
+	r.m[2] = 2.0f * (q.x * q.z - q.w * q.y);
+
+	r.m[4] = 2.0f * (q.x * q.y - q.w * q.z);
+	r.m[5] = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+	r.m[6] = 2.0f * (q.y * q.z + q.w * q.x);
+
+	r.m[8] = 2.0f * (q.x * q.z + q.w * q.y);
+	r.m[9] = 2.0f * (q.y * q.z - q.w * q.x);
+	r.m[10] = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+
+	return r;
+}
+
+// same matrix gluPerspective multiplies by
+Mat4 Mat4::perspective(float fovy, float aspect, float znear, float zfar)
+{
+	float f = 1.0f / tanf(fovy * (float)M_PI / 360.0f);
+
+	Mat4 r;
+	memset(r.m, 0, sizeof(r.m));
+
+	r.m[0] = f / aspect;
+	r.m[5] = f;
+	r.m[10] = (zfar + znear) / (znear - zfar);
+	r.m[11] = -1.0f;
+	r.m[14] = (2.0f * zfar * znear) / (znear - zfar);
+
+	return r;
+}
+
+// same matrix glOrtho multiplies by
+Mat4 Mat4::ortho(float left, float right, float bottom, float top, float znear, float zfar)
+{
+	Mat4 r = Mat4::identity();
+
+	r.m[0] = 2.0f / (right - left);
+	r.m[5] = 2.0f / (top - bottom);
+	r.m[10] = -2.0f / (zfar - znear);
+
+	r.m[12] = -(right + left) / (right - left);
+	r.m[13] = -(top + bottom) / (top - bottom);
+	r.m[14] = -(zfar + znear) / (zfar - znear);
+
+	return r;
+}
+
+// same matrix gluLookAt multiplies by
+Mat4 Mat4::lookAt(const Vec3& eye, const Vec3& target, const Vec3& up)
+{
+	Vec3 f = (target - eye).normalize();
+	Vec3 s = f.cross(up).normalize();
+	Vec3 u = s.cross(f);
+
+	Mat4 r = Mat4::identity();
+
+	r.m[0] = s.x;
+	r.m[4] = s.y;
+	r.m[8] = s.z;
+
+	r.m[1] = u.x;
+	r.m[5] = u.y;
+	r.m[9] = u.z;
+
+	r.m[2] = -f.x;
+	r.m[6] = -f.y;
+	r.m[10] = -f.z;
+
+	r.m[12] = -s.dot(eye);
+	r.m[13] = -u.dot(eye);
+	r.m[14] = f.dot(eye);
+
+	return r;
+}
+
+// each column of the result is a linear combination of
+// this matrix's columns, weighted by a column of 'b'.
+// With AVX two result columns are built per register
+Mat4 Mat4::operator*(const Mat4& b) const
+{
+	Mat4 r;
+
+#if defined(__AVX__)
+	__m256 a0 = _mm256_broadcast_ps((const __m128*)(this->m));
+	__m256 a1 = _mm256_broadcast_ps((const __m128*)(this->m + 4));
+	__m256 a2 = _mm256_broadcast_ps((const __m128*)(this->m + 8));
+	__m256 a3 = _mm256_broadcast_ps((const __m128*)(this->m + 12));
+
+	int j;
+	for(j = 0; j < 16; j += 8)
+	{
+		__m256 col = _mm256_loadu_ps(b.m + j);
+
+		__m256 v = _mm256_mul_ps(a0, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(0, 0, 0, 0)));
+		v = _mm256_add_ps(v, _mm256_mul_ps(a1, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(1, 1, 1, 1))));
+		v = _mm256_add_ps(v, _mm256_mul_ps(a2, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(2, 2, 2, 2))));
+		v = _mm256_add_ps(v, _mm256_mul_ps(a3, _mm256_shuffle_ps(col, col, _MM_SHUFFLE(3, 3, 3, 3))));
+
+		_mm256_storeu_ps(r.m + j, v);
+	}
+#elif defined(__SSE__)
+	__m128 a0 = _mm_loadu_ps(this->m);
+	__m128 a1 = _mm_loadu_ps(this->m + 4);
+	__m128 a2 = _mm_loadu_ps(this->m + 8);
+	__m128 a3 = _mm_loadu_ps(this->m + 12);
+
+	int j;
+	for(j = 0; j < 16; j += 4)
+	{
+		__m128 v = _mm_mul_ps(a0, _mm_set1_ps(b.m[j]));
+		v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_set1_ps(b.m[j + 1])));
+		v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_set1_ps(b.m[j + 2])));
+		v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_set1_ps(b.m[j + 3])));
+
+		_mm_storeu_ps(r.m + j, v);
+	}
+#else
+	int i, j;
+	for(j = 0; j < 4; j ++)
+	{
+		for(i = 0; i < 4; i ++)
+		{
+			r.m[j * 4 + i] = this->m[i] * b.m[j * 4] + this->m[4 + i] * b.m[j * 4 + 1] +
+							 this->m[8 + i] * b.m[j * 4 + 2] + this->m[12 + i] * b.m[j * 4 + 3];
+		}
+	}
+#endif
+
+	return r;
+}
+
+// transforms a point (w = 1), dropping the resulting w
+Vec3 Mat4::transformPoint(const Vec3& p) const
+{
+#ifdef __SSE__
+	__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(this->m), _mm_set1_ps(p.x)), _mm_loadu_ps(this->m + 12));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(this->m + 4), _mm_set1_ps(p.y)));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(this->m + 8), _mm_set1_ps(p.z)));
+
+	float out[4];
+	_mm_storeu_ps(out, v);
+
+	return Vec3(out[0], out[1], out[2]);
+#else
+	return Vec3(this->m[0] * p.x + this->m[4] * p.y + this->m[8] * p.z + this->m[12],
+				this->m[1] * p.x + this->m[5] * p.y + this->m[9] * p.z + this->m[13],
+				this->m[2] * p.x + this->m[6] * p.y + this->m[10] * p.z + this->m[14]);
+#endif
+}
+
+// transforms a point (w = 1) and divides by the resulting
+// w, such as to take a point in normalized device
+// coordinates back through an inverse projection
+Vec3 Mat4::projectPoint(const Vec3& p) const
+{
+	const float* m = this->m;
+
+	float x = m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12];
+	float y = m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13];
+	float z = m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14];
+	float w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+
+	return Vec3(x / w, y / w, z / w);
+}
+
+Mat4 Mat4::transpose() const
+{
+	Mat4 r;
+
+#ifdef __SSE__
+	__m128 c0 = _mm_loadu_ps(this->m);
+	__m128 c1 = _mm_loadu_ps(this->m + 4);
+	__m128 c2 = _mm_loadu_ps(this->m + 8);
+	__m128 c3 = _mm_loadu_ps(this->m + 12);
+
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	_mm_storeu_ps(r.m, c0);
+	_mm_storeu_ps(r.m + 4, c1);
+	_mm_storeu_ps(r.m + 8, c2);
+	_mm_storeu_ps(r.m + 12, c3);
+#else
+	int i, j;
+	for(j = 0; j < 4; j ++)
+		for(i = 0; i < 4; i ++)
+			r.m[j * 4 + i] = this->m[i * 4 + j];
+#endif
+
+	return r;
+}
+
+// general inverse by cofactor expansion. Returns the
+// identity for a singular matrix
+Mat4 Mat4::inverse() const
+{
+	const float* a = this->m;
+	Mat4 r;
+	float* inv = r.m;
+
+	inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+	inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+	inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+	inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+	inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+	inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+	inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+	inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+	inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+	inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+	inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+	inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+	inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+	inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+	inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+	inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+	float det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+	if(det == 0.0f)
+		return Mat4::identity();
+
+	float inv_det = 1.0f / det;
+
+	int i;
+	for(i = 0; i < 16; i ++)
+		inv[i] *= inv_det;
+
+	return r;
+}
+
+// writes the column-major 3x3 matrix that transforms
+// normals, the inverse transpose of the upper 3x3
+// (its cofactor matrix over the determinant)
+void Mat4::normalMatrix(float* out) const
+{
+	Vec3 c0(this->m[0], this->m[1], this->m[2]);
+	Vec3 c1(this->m[4], this->m[5], this->m[6]);
+	Vec3 c2(this->m[8], this->m[9], this->m[10]);
+
+	Vec3 n0 = c1.cross(c2);
+	Vec3 n1 = c2.cross(c0);
+	Vec3 n2 = c0.cross(c1);
+
+	float det = c0.dot(n0);
+	float inv_det = (det != 0.0f ? 1.0f / det : 1.0f);
+
+	out[0] = n0.x * inv_det; out[1] = n0.y * inv_det; out[2] = n0.z * inv_det;
+	out[3] = n1.x * inv_det; out[4] = n1.y * inv_det; out[5] = n1.z * inv_det;
+	out[6] = n2.x * inv_det; out[7] = n2.y * inv_det; out[8] = n2.z * inv_det;
+}
+
+AABB::AABB()
+{
+}
+
+AABB::AABB(const Vec3& min, const Vec3& max)
+{
+	this->center = (min + max) * 0.5f;
+	this->extents = (max - min) * 0.5f;
+}
+
+// returns the box around this box after transforming it:
+// the center moves as a point, and each new half-size is
+// the old ones weighted by the absolute matrix entries
+AABB AABB::transform(const Mat4& m) const
+{
+	AABB r;
+	r.center = m.transformPoint(this->center);
+
+	const Vec3& e = this->extents;
+
+	r.extents.x = fabsf(m.m[0]) * e.x + fabsf(m.m[4]) * e.y + fabsf(m.m[8]) * e.z;
+	r.extents.y = fabsf(m.m[1]) * e.x + fabsf(m.m[5]) * e.y + fabsf(m.m[9]) * e.z;
+	r.extents.z = fabsf(m.m[2]) * e.x + fabsf(m.m[6]) * e.y + fabsf(m.m[10]) * e.z;
+
+	return r;
+}
+
+Sphere::Sphere()
+{
+	this->radius = 0.0f;
+}
+
+Sphere::Sphere(const Vec3& center, float radius)
+{
+	this->center = center;
+	this->radius = radius;
+}
+
+// returns the sphere after transforming it, its radius
+// grown by the largest scale along any of the axes
+Sphere Sphere::transform(const Mat4& m) const
+{
+	float sx = Vec3(m.m[0], m.m[1], m.m[2]).length();
+	float sy = Vec3(m.m[4], m.m[5], m.m[6]).length();
+	float sz = Vec3(m.m[8], m.m[9], m.m[10]).length();
+
+	float scale = fmaxf(sx, fmaxf(sy, sz));
+
+	return Sphere(m.transformPoint(this->center), this->radius * scale);
+}
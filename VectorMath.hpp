@@ -0,0 +1,88 @@
+#ifndef VECTORMATH_HPP__
+#define VECTORMATH_HPP__
+
+// small vector, quaternion and matrix types used
+// to build every transform on the CPU. Matrices
+// are column-major, the layout GL expects
+
+struct Vec3 {
+
+	float x;
+	float y;
+	float z;
+
+	Vec3();
+	Vec3(float x, float y, float z);
+
+	Vec3 operator+(const Vec3& v) const;
+	Vec3 operator-(const Vec3& v) const;
+	Vec3 operator*(float s) const;
+
+	float dot(const Vec3& v) const;
+	Vec3 cross(const Vec3& v) const;
+	float length() const;
+	Vec3 normalize() const;
+};
+
+struct Quat {
+
+	float x;
+	float y;
+	float z;
+	float w;
+
+	Quat();
+	Quat(float x, float y, float z, float w);
+
+	static Quat axisAngle(float degrees, const Vec3& axis);
+
+	Quat operator*(const Quat& q) const;
+	Vec3 rotate(const Vec3& v) const;
+	Quat normalize() const;
+};
+
+struct Mat4 {
+
+	float m[16];
+
+	static Mat4 identity();
+	static Mat4 translate(float x, float y, float z);
+	static Mat4 rotate(float degrees, float x, float y, float z);
+	static Mat4 fromQuat(const Quat& q);
+	static Mat4 perspective(float fovy, float aspect, float znear, float zfar);
+	static Mat4 ortho(float left, float right, float bottom, float top, float znear, float zfar);
+	static Mat4 lookAt(const Vec3& eye, const Vec3& target, const Vec3& up);
+
+	Mat4 operator*(const Mat4& b) const;
+	Vec3 transformPoint(const Vec3& p) const;
+	Vec3 projectPoint(const Vec3& p) const;
+
+	Mat4 transpose() const;
+	Mat4 inverse() const;
+	void normalMatrix(float* out) const;
+};
+
+// axis-aligned box, kept as its center and half-size
+struct AABB {
+
+	Vec3 center;
+	Vec3 extents;
+
+	AABB();
+	AABB(const Vec3& min, const Vec3& max);
+
+	AABB transform(const Mat4& m) const;
+};
+
+struct Sphere {
+
+	Vec3 center;
+	float radius;
+
+	Sphere();
+	Sphere(const Vec3& center, float radius);
+
+	Sphere transform(const Mat4& m) const;
+};
+
+#endif
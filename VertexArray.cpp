@@ -0,0 +1,63 @@
+#include "VertexArray.hpp"
+
+#include <GL/glew.h>
+
+// creates the VAO and records every attribute's
+// format and buffer binding from the layout
+VertexArray::VertexArray(const VertexLayout& layout)
+{
+	this->layout = layout;
+
+	glGenVertexArrays(1, &(this->vao));
+	glBindVertexArray(this->vao);
+
+	int i, j;
+	for(i = 0; i < layout.num_attribs; i ++)
+	{
+		const VertexAttrib& attrib = layout.attribs[i];
+
+		for(j = 0; j < attrib.columns; j ++)
+		{
+			glEnableVertexAttribArray(attrib.location + j);
+			glVertexAttribFormat(attrib.location + j, attrib.components, GL_FLOAT, GL_FALSE, attrib.offset + j * attrib.column_stride);
+			glVertexAttribBinding(attrib.location + j, attrib.binding);
+		}
+	}
+
+	for(i = 0; i < layout.num_bindings; i ++)
+		glVertexBindingDivisor(i, layout.bindings[i].divisor);
+
+	glBindVertexArray(0);
+}
+
+VertexArray::~VertexArray()
+{
+	glDeleteVertexArrays(1, &(this->vao));
+}
+
+// attaches a buffer to one of the layout's bindings,
+// stepped through at the binding's stride
+void VertexArray::setVertexBuffer(unsigned int binding, unsigned int buffer)
+{
+	glBindVertexArray(this->vao);
+	glBindVertexBuffer(binding, buffer, 0, this->layout.bindings[binding].stride);
+	glBindVertexArray(0);
+}
+
+// attaches the index buffer, which the VAO remembers
+void VertexArray::setIndexBuffer(unsigned int buffer)
+{
+	glBindVertexArray(this->vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	glBindVertexArray(0);
+}
+
+void VertexArray::bind()
+{
+	glBindVertexArray(this->vao);
+}
+
+void VertexArray::unbind()
+{
+	glBindVertexArray(0);
+}
@@ -0,0 +1,27 @@
+#ifndef VERTEXARRAY_HPP__
+#define VERTEXARRAY_HPP__
+
+#include "VertexLayout.hpp"
+
+// a vertex array object set up once from a VertexLayout,
+// after which drawing only takes a single bind. Buffers
+// are attached per binding and can be swapped without
+// touching the attribute formats
+class VertexArray {
+
+	private:
+		unsigned int vao;
+		VertexLayout layout;
+
+	public:
+		VertexArray(const VertexLayout& layout);
+		~VertexArray();
+
+		void setVertexBuffer(unsigned int binding, unsigned int buffer);
+		void setIndexBuffer(unsigned int buffer);
+
+		void bind();
+		void unbind();
+};
+
+#endif
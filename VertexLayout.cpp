@@ -0,0 +1,48 @@
+#include "VertexLayout.hpp"
+
+#include <map>
+
+// returns the GLSL type of an attribute
+static string _glslType(const VertexAttrib& attrib)
+{
+	if(attrib.columns > 1)
+	{
+		if(attrib.columns == attrib.components)
+			return "mat" + to_string(attrib.columns);
+
+		return "mat" + to_string(attrib.columns) + "x" + to_string(attrib.components);
+	}
+
+	if(attrib.components == 1)
+		return "float";
+
+	return "vec" + to_string(attrib.components);
+}
+
+// builds the input declarations for every attribute used
+// by any layout, each with its location spelled out, so
+// shaders don't have to repeat (and keep in sync) what
+// the layouts already say
+string declareVertexInputs()
+{
+	const VertexLayout layouts[] = { MESH_LAYOUT, INSTANCED_MESH_LAYOUT, SKYBOX_LAYOUT };
+	map<unsigned int, const VertexAttrib*> inputs;
+
+	int i, j;
+	for(i = 0; i < (int)(sizeof(layouts) / sizeof(VertexLayout)); i ++)
+	{
+		for(j = 0; j < layouts[i].num_attribs; j ++)
+			inputs[layouts[i].attribs[j].location] = &(layouts[i].attribs[j]);
+	}
+
+	string source;
+
+	map<unsigned int, const VertexAttrib*>::iterator it;
+	for(it = inputs.begin(); it != inputs.end(); it ++)
+	{
+		source += "layout(location = " + to_string(it->first) + ") in " +
+				  _glslType(*(it->second)) + " " + it->second->name + ";\n";
+	}
+
+	return source;
+}
@@ -0,0 +1,150 @@
+#ifndef VERTEXLAYOUT_HPP__
+#define VERTEXLAYOUT_HPP__
+
+#include <cstddef>
+#include <string>
+
+#define POSITION_ATTR 0
+#define TEXCOORD_2D_ATTR 1
+#define NORMAL_ATTR 2
+#define TEXCOORD_CUBE_ATTR 3
+#define INSTANCE_MODEL_ATTR 4
+#define INSTANCE_NORMAL_ATTR 8
+
+#define VERTEX_BINDING 0
+#define INSTANCE_BINDING 1
+#define MAX_VERTEX_BINDINGS 2
+
+// line in a vertex shader that's replaced by
+// the input declarations of every layout
+#define VERTEX_INPUTS_PRAGMA "#pragma vertex_inputs"
+
+using namespace std;
+
+// used to keep individual values for each
+// vertex neatly packed and organized
+struct MeshVertex {
+
+	float x;
+	float y;
+	float z;
+	float u;
+	float v;
+	float nx;
+	float ny;
+	float nz;
+};
+
+// skybox vertices carry their cube map
+// direction instead of a normal
+struct SkyboxVertex {
+
+	float x;
+	float y;
+	float z;
+	float t;
+	float u;
+	float v;
+};
+
+// per-instance vertex data: the model matrix followed by
+// the normal matrix, its columns padded out to vec4s
+struct InstanceData {
+
+	float model[16];
+	float normal[12];
+};
+
+// one shader input: 'columns' consecutive locations of
+// 'components' floats each (more than one column makes
+// it a matrix), read from the buffer at 'binding'
+struct VertexAttrib {
+
+	unsigned int location;
+	int components;
+	int columns;
+	unsigned int offset;
+	unsigned int column_stride;
+	unsigned int binding;
+	const char* name;
+};
+
+// how each buffer binding is stepped through
+struct VertexBinding {
+
+	unsigned int stride;
+	unsigned int divisor;
+};
+
+// a complete vertex format, declared once as a constant
+// and turned into both a VAO (see VertexArray) and the
+// vertex shader's input declarations
+struct VertexLayout {
+
+	const VertexAttrib* attribs;
+	int num_attribs;
+
+	const VertexBinding* bindings;
+	int num_bindings;
+};
+
+template<int A, int B>
+constexpr VertexLayout makeLayout(const VertexAttrib (&attribs)[A], const VertexBinding (&bindings)[B])
+{
+	return VertexLayout{attribs, A, bindings, B};
+}
+
+// true when every attribute reads from a declared binding
+// and stays inside that binding's stride
+constexpr bool layoutFits(const VertexLayout& layout, int i = 0)
+{
+	return i >= layout.num_attribs ||
+		(layout.attribs[i].binding < (unsigned int)layout.num_bindings &&
+		 layout.attribs[i].offset + (layout.attribs[i].columns - 1) * layout.attribs[i].column_stride +
+			layout.attribs[i].components * sizeof(float) <= layout.bindings[layout.attribs[i].binding].stride &&
+		 layoutFits(layout, i + 1));
+}
+
+constexpr VertexAttrib MESH_ATTRIBS[] = {
+	{POSITION_ATTR, 3, 1, offsetof(MeshVertex, x), 0, VERTEX_BINDING, "position"},
+	{TEXCOORD_2D_ATTR, 2, 1, offsetof(MeshVertex, u), 0, VERTEX_BINDING, "texcoord2D"},
+	{NORMAL_ATTR, 3, 1, offsetof(MeshVertex, nx), 0, VERTEX_BINDING, "normal"}
+};
+
+constexpr VertexAttrib INSTANCED_MESH_ATTRIBS[] = {
+	{POSITION_ATTR, 3, 1, offsetof(MeshVertex, x), 0, VERTEX_BINDING, "position"},
+	{TEXCOORD_2D_ATTR, 2, 1, offsetof(MeshVertex, u), 0, VERTEX_BINDING, "texcoord2D"},
+	{NORMAL_ATTR, 3, 1, offsetof(MeshVertex, nx), 0, VERTEX_BINDING, "normal"},
+	{INSTANCE_MODEL_ATTR, 4, 4, offsetof(InstanceData, model), 4 * sizeof(float), INSTANCE_BINDING, "instanceModel"},
+	{INSTANCE_NORMAL_ATTR, 3, 3, offsetof(InstanceData, normal), 4 * sizeof(float), INSTANCE_BINDING, "instanceNormal"}
+};
+
+constexpr VertexAttrib SKYBOX_ATTRIBS[] = {
+	{POSITION_ATTR, 3, 1, offsetof(SkyboxVertex, x), 0, VERTEX_BINDING, "position"},
+	{TEXCOORD_CUBE_ATTR, 3, 1, offsetof(SkyboxVertex, t), 0, VERTEX_BINDING, "texcoordCube"}
+};
+
+constexpr VertexBinding MESH_BINDINGS[] = {
+	{sizeof(MeshVertex), 0}
+};
+
+constexpr VertexBinding INSTANCED_MESH_BINDINGS[] = {
+	{sizeof(MeshVertex), 0},
+	{sizeof(InstanceData), 1}
+};
+
+constexpr VertexBinding SKYBOX_BINDINGS[] = {
+	{sizeof(SkyboxVertex), 0}
+};
+
+constexpr VertexLayout MESH_LAYOUT = makeLayout(MESH_ATTRIBS, MESH_BINDINGS);
+constexpr VertexLayout INSTANCED_MESH_LAYOUT = makeLayout(INSTANCED_MESH_ATTRIBS, INSTANCED_MESH_BINDINGS);
+constexpr VertexLayout SKYBOX_LAYOUT = makeLayout(SKYBOX_ATTRIBS, SKYBOX_BINDINGS);
+
+static_assert(layoutFits(MESH_LAYOUT), "MESH_LAYOUT reads past its vertex");
+static_assert(layoutFits(INSTANCED_MESH_LAYOUT), "INSTANCED_MESH_LAYOUT reads past its vertex");
+static_assert(layoutFits(SKYBOX_LAYOUT), "SKYBOX_LAYOUT reads past its vertex");
+
+string declareVertexInputs();
+
+#endif
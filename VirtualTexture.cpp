@@ -0,0 +1,389 @@
+#include "VirtualTexture.hpp"
+#include "MipChain.hpp"
+
+#include <SOIL/SOIL.h>
+#include <GL/glew.h>
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#define VTEX_MAGIC 0x58455456
+
+// header written at the start of every tiled
+// texture file, followed by the pages of each
+// mip level (finest first) in row-major order
+struct VTexHeader {
+
+	unsigned int magic;
+	unsigned int width;
+	unsigned int height;
+	unsigned int tile_size;
+	unsigned int border;
+	unsigned int num_mips;
+};
+
+// returns the smallest power of two that is
+// greater than or equal to 'n'
+static int _nextPowerOfTwo(int n)
+{
+	int p = 1;
+	while(p < n)
+		p <<= 1;
+
+	return p;
+}
+
+// bilinearly resamples an RGBA image to a new size,
+// used to bring arbitrary images up to the power of
+// two sizes the page pyramid needs
+static unsigned char* _resample(const unsigned char* src, int sw, int sh, int dw, int dh)
+{
+	unsigned char* dest = (unsigned char*)malloc(dw * dh * 4);
+
+	int x, y, c;
+	for(y = 0; y < dh; y ++)
+	{
+		float fy = ((float)y + 0.5f) * (float)sh / (float)dh - 0.5f;
+		if(fy < 0.0f)
+			fy = 0.0f;
+
+		int y0 = (int)fy;
+		int y1 = (y0 + 1 < sh ? y0 + 1 : y0);
+		float ty = fy - (float)y0;
+
+		for(x = 0; x < dw; x ++)
+		{
+			float fx = ((float)x + 0.5f) * (float)sw / (float)dw - 0.5f;
+			if(fx < 0.0f)
+				fx = 0.0f;
+
+			int x0 = (int)fx;
+			int x1 = (x0 + 1 < sw ? x0 + 1 : x0);
+			float tx = fx - (float)x0;
+
+			for(c = 0; c < 4; c ++)
+			{
+				float a = src[(y0 * sw + x0) * 4 + c];
+				float b = src[(y0 * sw + x1) * 4 + c];
+				float d = src[(y1 * sw + x0) * 4 + c];
+				float e = src[(y1 * sw + x1) * 4 + c];
+
+				float top = a + (b - a) * tx;
+				float bottom = d + (e - d) * tx;
+
+				dest[(y * dw + x) * 4 + c] = (unsigned char)(top + (bottom - top) * ty + 0.5f);
+			}
+		}
+	}
+	return dest;
+}
+
+// copies one page (a tile plus its border) out of a
+// mip level. Border texels wrap around the edges,
+// since model textures are sampled with GL_REPEAT
+static void _copyPage(const unsigned char* level, int w, int h, int px, int py, unsigned char* page)
+{
+	int x, y;
+	for(y = 0; y < PAGE_SIZE; y ++)
+	{
+		int sy = (((py * TILE_SIZE) + y - TILE_BORDER) % h + h) % h;
+
+		for(x = 0; x < PAGE_SIZE; x ++)
+		{
+			int sx = (((px * TILE_SIZE) + x - TILE_BORDER) % w + w) % w;
+			memcpy(page + (y * PAGE_SIZE + x) * 4, level + (sy * w + sx) * 4, 4);
+		}
+	}
+}
+
+// opens a tiled texture file and creates the
+// indirection texture that maps its virtual pages
+// to pages in the physical cache. No texel data
+// is loaded here, the TileCache streams it in
+// once the feedback pass asks for it
+VirtualTexture::VirtualTexture(string vtexfile)
+{
+	this->width = 0;
+	this->height = 0;
+	this->num_mips = 0;
+	this->indirection = 0;
+	this->physical = 0;
+	this->dirty = false;
+	this->id = -1;
+
+	this->file = fopen(vtexfile.c_str(), "rb");
+	if(this->file == NULL)
+	{
+		cout << "Failed to open virtual texture " << vtexfile << endl;
+		return;
+	}
+
+	struct VTexHeader header;
+	if(fread(&header, sizeof(struct VTexHeader), 1, this->file) != 1 || header.magic != VTEX_MAGIC ||
+	   header.tile_size != TILE_SIZE || header.border != TILE_BORDER)
+	{
+		cout << "Invalid virtual texture " << vtexfile << endl;
+
+		fclose(this->file);
+		this->file = NULL;
+
+		return;
+	}
+	this->width = (int)header.width;
+	this->height = (int)header.height;
+	this->num_mips = (int)header.num_mips;
+
+	long long base = 0;
+
+	int m;
+	for(m = 0; m < this->num_mips; m ++)
+	{
+		int count = this->getPagesX(m) * this->getPagesY(m);
+
+		this->level_base.push_back(base);
+		this->resident.push_back(vector<unsigned int>(count, 0));
+
+		base += count;
+	}
+
+	glGenTextures(1, &(this->indirection));
+	glBindTexture(GL_TEXTURE_2D, this->indirection);
+
+	glTexStorage2D(GL_TEXTURE_2D, this->num_mips, GL_RGBA8, this->getPagesX(0), this->getPagesY(0));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	this->dirty = true;
+}
+
+// closes the tiled texture file and
+// frees the indirection texture
+VirtualTexture::~VirtualTexture()
+{
+	if(this->file != NULL)
+		fclose(this->file);
+
+	if(this->indirection != 0)
+		glDeleteTextures(1, &(this->indirection));
+}
+
+// returns true if a tiled texture file has already
+// been cooked to the given path
+bool VirtualTexture::exists(string vtexfile)
+{
+	FILE* fp = fopen(vtexfile.c_str(), "rb");
+	if(fp == NULL)
+		return false;
+
+	fclose(fp);
+	return true;
+}
+
+// converts an image file into the tiled on-disk
+// format read by VirtualTexture objects. The image
+// is resampled to a square power of two size, its
+// mips are generated by a MipChain and every level
+// down to a single page is split into bordered
+// pages and written out in order
+bool VirtualTexture::cook(string imagefile, string vtexfile)
+{
+	unsigned char* image;
+	int img_width, img_height;
+
+	image = SOIL_load_image(imagefile.c_str(), &img_width, &img_height, 0, SOIL_LOAD_RGBA);
+	if(image == NULL)
+	{
+		cout << "Failed to load image " << imagefile << " for cooking" << endl;
+		return false;
+	}
+
+	int size = _nextPowerOfTwo(img_width > img_height ? img_width : img_height);
+	if(size < TILE_SIZE)
+		size = TILE_SIZE;
+
+	unsigned char* level = _resample(image, img_width, img_height, size, size);
+	SOIL_free_image_data(image);
+
+	FILE* fp = fopen(vtexfile.c_str(), "wb");
+	if(fp == NULL)
+	{
+		cout << "Failed to create virtual texture " << vtexfile << endl;
+		free(level);
+
+		return false;
+	}
+
+	struct VTexHeader header;
+	header.magic = VTEX_MAGIC;
+	header.width = size;
+	header.height = size;
+	header.tile_size = TILE_SIZE;
+	header.border = TILE_BORDER;
+	header.num_mips = 1;
+
+	int s;
+	for(s = size; s > TILE_SIZE; s /= 2)
+		header.num_mips ++;
+
+	fwrite(&header, sizeof(struct VTexHeader), 1, fp);
+
+	MipChain* mips = new MipChain(&level, 1, size, size, MIP_FILTER_KAISER, true);
+	unsigned char* page = (unsigned char*)malloc(PAGE_BYTES);
+
+	unsigned int m;
+	for(m = 0; m < header.num_mips; m ++)
+	{
+		MipLevel* mip = mips->getLevel(0, m);
+		int pages = mip->width / TILE_SIZE;
+
+		int x, y;
+		for(y = 0; y < pages; y ++)
+		{
+			for(x = 0; x < pages; x ++)
+			{
+				_copyPage(mip->data, mip->width, mip->height, x, y, page);
+				fwrite(page, PAGE_BYTES, 1, fp);
+			}
+		}
+	}
+
+	delete mips;
+
+	free(page);
+	free(level);
+	fclose(fp);
+
+	return true;
+}
+
+// reads a single page from the tiled texture file
+// into 'dest' (which must hold PAGE_BYTES bytes).
+// Called from the TileCache's loader thread
+bool VirtualTexture::readTile(int mip, int x, int y, unsigned char* dest)
+{
+	if(this->file == NULL || mip < 0 || mip >= this->num_mips)
+		return false;
+
+	long long page = this->level_base[mip] + (long long)y * this->getPagesX(mip) + x;
+	long long offset = (long long)sizeof(struct VTexHeader) + page * PAGE_BYTES;
+
+	if(fseeko64(this->file, offset, SEEK_SET) != 0)
+		return false;
+
+	return fread(dest, PAGE_BYTES, 1, this->file) == 1;
+}
+
+// called by the TileCache when this texture is
+// registered, stores the ID written by the feedback
+// pass and the physical cache texture to sample from
+void VirtualTexture::setCache(int id, unsigned int physical)
+{
+	this->id = id;
+	this->physical = physical;
+}
+
+// marks a page as resident in the given slot
+// of the physical cache
+void VirtualTexture::setResident(int mip, int x, int y, int slot_x, int slot_y)
+{
+	this->resident[mip][y * this->getPagesX(mip) + x] =
+		(unsigned int)slot_x | ((unsigned int)slot_y << 8) | ((unsigned int)mip << 16) | 0xFF000000u;
+
+	this->dirty = true;
+}
+
+// marks a page as no longer resident (after
+// its slot was given to another page)
+void VirtualTexture::clearResident(int mip, int x, int y)
+{
+	this->resident[mip][y * this->getPagesX(mip) + x] = 0;
+	this->dirty = true;
+}
+
+// rebuilds the indirection texture after pages were
+// streamed in or evicted. Pages that aren't resident
+// point to their closest resident ancestor, so lookups
+// fall back to a coarser mip instead of failing
+void VirtualTexture::updateIndirection()
+{
+	if(!(this->dirty) || this->indirection == 0)
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, this->indirection);
+
+	vector<unsigned int> parent;
+	vector<unsigned int> level;
+
+	int m;
+	for(m = this->num_mips - 1; m >= 0; m --)
+	{
+		int w = this->getPagesX(m);
+		int h = this->getPagesY(m);
+		int pw = (m + 1 < this->num_mips ? this->getPagesX(m + 1) : 1);
+		int ph = (m + 1 < this->num_mips ? this->getPagesY(m + 1) : 1);
+
+		level.assign(w * h, 0);
+
+		int x, y;
+		for(y = 0; y < h; y ++)
+		{
+			for(x = 0; x < w; x ++)
+			{
+				unsigned int entry = this->resident[m][y * w + x];
+				if(entry == 0 && !parent.empty())
+				{
+					int px = ((x >> 1) < pw ? (x >> 1) : pw - 1);
+					int py = ((y >> 1) < ph ? (y >> 1) : ph - 1);
+
+					entry = parent[py * pw + px];
+				}
+				level[y * w + x] = entry;
+			}
+		}
+
+		glTexSubImage2D(GL_TEXTURE_2D, m, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, &level[0]);
+		parent.swap(level);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	this->dirty = false;
+}
+
+// returns the texture ID of the indirection texture
+unsigned int VirtualTexture::getIndirection()
+{
+	return this->indirection;
+}
+
+// returns the texture ID of the physical page cache
+unsigned int VirtualTexture::getPhysical()
+{
+	return this->physical;
+}
+
+// returns the number of pages across a mip level
+int VirtualTexture::getPagesX(int mip)
+{
+	int pages = (this->width / TILE_SIZE) >> mip;
+	return (pages > 0 ? pages : 1);
+}
+
+// returns the number of pages down a mip level
+int VirtualTexture::getPagesY(int mip)
+{
+	int pages = (this->height / TILE_SIZE) >> mip;
+	return (pages > 0 ? pages : 1);
+}
+
+int VirtualTexture::getNumMips()
+{
+	return this->num_mips;
+}
+
+int VirtualTexture::getID()
+{
+	return this->id;
+}
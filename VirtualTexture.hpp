@@ -0,0 +1,57 @@
+#ifndef VIRTUALTEXTURE_HPP__
+#define VIRTUALTEXTURE_HPP__
+
+#include <string>
+#include <vector>
+
+#include <cstdio>
+
+#define TILE_SIZE 128
+#define TILE_BORDER 4
+#define PAGE_SIZE (TILE_SIZE + 2 * TILE_BORDER)
+#define PAGE_BYTES (PAGE_SIZE * PAGE_SIZE * 4)
+
+using namespace std;
+
+class VirtualTexture {
+
+	private:
+		FILE* file;
+
+		unsigned int indirection;
+		unsigned int physical;
+
+		int width;
+		int height;
+		int num_mips;
+		int id;
+
+		bool dirty;
+
+		vector<long long> level_base;
+		vector<vector<unsigned int> > resident;
+
+	public:
+		VirtualTexture(string vtexfile);
+		~VirtualTexture();
+
+		static bool cook(string imagefile, string vtexfile);
+		static bool exists(string vtexfile);
+
+		bool readTile(int mip, int x, int y, unsigned char* dest);
+
+		void setCache(int id, unsigned int physical);
+		void setResident(int mip, int x, int y, int slot_x, int slot_y);
+		void clearResident(int mip, int x, int y);
+		void updateIndirection();
+
+		unsigned int getIndirection();
+		unsigned int getPhysical();
+
+		int getPagesX(int mip);
+		int getPagesY(int mip);
+		int getNumMips();
+		int getID();
+};
+
+#endif
@@ -19,7 +19,27 @@
 #include <string>
 #include <chrono>
 #include <cmath>
-
+#include <cstdlib>
+
+#include "InstanceBuffer.hpp"
+#include "UniformBlocks.hpp"
+#include "GeometryBuffer.hpp"
+#include "IndirectBatch.hpp"
+#include "StaticBatch.hpp"
+#include "HiZPyramid.hpp"
+#include "OcclusionBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "TextureStreamer.hpp"
+#include "FrameRing.hpp"
+#include "FrameGraph.hpp"
+#include "DeferredRenderer.hpp"
+#include "LightClusters.hpp"
+#include "ShadowMaps.hpp"
+#include "LightBuffer.hpp"
+#include "Benchmark.hpp"
+#include "TextureManager.hpp"
+#include "VirtualTexture.hpp"
+#include "TileCache.hpp"
 #include "Material.hpp"
 #include "Camera.hpp"
 #include "Skybox.hpp"
@@ -40,6 +60,9 @@
 #define MOVE_SPEED 0.50f
 #define NUM_WALLS 161
 
+// edge of the grid cells static walls are merged by
+#define STATIC_CELL_SIZE 100.0f
+
 #define NUM_KEYS 7
 #define KEY_ESC 0
 #define KEY_Q 1
@@ -49,6 +72,36 @@
 #define KEY_S 5
 #define KEY_D 6
 
+#define UPLOAD_RING_SIZE (32 * 1024 * 1024)
+#define UPLOAD_BUDGET_MS 2.0
+#define TEXTURE_BUDGET (256ll * 1024 * 1024)
+
+// per frame, of which FRAME_RING_FRAMES are in flight
+#define FRAME_RING_SIZE (4 * 1024 * 1024)
+
+// point lights added with --lights (and by --bench-lights)
+// are spread over the arena, each reaching this far at most
+#define POINT_LIGHT_FIELD 350.0f
+#define POINT_LIGHT_HEIGHT 150.0f
+#define POINT_LIGHT_MIN_RADIUS 15.0f
+#define POINT_LIGHT_MAX_RADIUS 50.0f
+#define POINT_LIGHT_SEED 1234
+
+// the projection's near and far planes, which light
+// clusters and shadow cascades are sliced between too
+#define VIEW_NEAR 0.1f
+#define VIEW_FAR 1000.0f
+
+// with shadows on, the box circles its starting point
+// this far out, taking this many milliseconds a turn, so
+// there's a dynamic caster to follow
+#define BOX_ORBIT_RADIUS 20.0f
+#define BOX_ORBIT_PERIOD 8000.0
+
+// frames each light count is drawn for, after a few to
+// let the graph's timer queries catch up
+#define LIGHT_BENCH_FRAMES 10
+
 #define NUM_BTNS 2
 #define BTN_L 0
 #define BTN_R 1
@@ -67,21 +120,76 @@ SDL_Window* main_window;
 Camera* camera;
 Skybox* skybox;
 
+UniformBlocks* uniforms;
+
 Shader* selector;
+Shader* feedback;
 Shader* shader;
+Shader* cull_shader;
+Shader* hiz_shader;
+
+DeferredRenderer* deferred;
+LightBuffer* point_lights;
+LightClusters* clusters;
+ShadowMaps* shadows;
+int scene_lights;
+
+TextureStreamer* streamer;
+FrameRing* frame_ring;
+TextureManager* textures;
+TileCache* tiles;
+VirtualTexture* wall_vtex;
 
 Material* stone;
 Material* wood;
 
+Mat4 projection;
+
 Model* walls[NUM_WALLS];
 Model* wall;
 Model* box;
 
+InstanceBuffer* wall_instances;
+StaticBatch* static_walls;
+
+GeometryBuffer* geometry;
+IndirectBatch* scene_batch;
+RenderQueue* render_queue;
+HiZPyramid* hiz;
+OcclusionBuffer* occluders;
+FrameGraph* graph;
+int pick_target;
+int gbuffer_targets[4];
+int lit_target;
+int box_draw;
+int box_object;
+int extra_instances = 0;
+bool gpu_culling = false;
+bool occlusion_culling = false;
+bool software_occlusion = false;
+bool spatial_index = false;
+bool static_batching = false;
+bool ring_buffers = false;
+int record_threads = 0;
+bool deferred_shading = false;
+bool bench_lights = false;
+bool light_clusters = true;
+bool cast_shadows = false;
+int extra_lights = 0;
+
+// triangles and fragments drawn for the scene, read
+// back with the stats once a second. Fragments are
+// counted as shader invocations where that's supported,
+// which includes the ones later hidden by depth
+unsigned int scene_queries[2];
+unsigned int fragment_query;
+
 bool buttons[NUM_BTNS];
 bool keys[NUM_KEYS];
 
 bool running = true;
 bool picked = false;
+bool pick_requested = false;
 
 double getElapsedBobbingTime(void);
 double getElapsedGameTime(void);
@@ -92,10 +200,112 @@ bool initContext(int, int);
 
 void startGL(void);
 void runTest(void);
+
+void drawScene(Shader*);
+void renderPicking(void);
+void renderFeedback(void);
+void cullScene(void);
+void renderScene(void);
+void renderGBuffer(void);
+void buildHiZ(void);
+void retestScene(void);
+void renderLateScene(void);
+void renderLateGBuffer(void);
+void assignLights(void);
+void renderShadows(void);
+void lightScene(void);
+void compositeScene(void);
+void benchmarkLights(void);
 void cleanup(void);
 
 int main(int argc, char* argv[])
 {
+	// benchmark modes don't need a window
+	if(argc > 1 && string(argv[1]) == "--bench-png")
+	{
+		benchmarkPNG();
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "--bench-cull")
+	{
+		benchmarkCulling();
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "--bench-occlusion")
+	{
+		benchmarkOcclusion();
+		return 0;
+	}
+
+	if(argc > 1 && string(argv[1]) == "--bench-bvh")
+	{
+		benchmarkBVH();
+		return 0;
+	}
+
+	int i;
+	for(i = 1; i < argc; i ++)
+	{
+		// extra wall instances for stress testing
+		if(string(argv[i]) == "--instances" && i + 1 < argc)
+			extra_instances = atoi(argv[++ i]);
+
+		// cull in a compute shader instead of on the CPU
+		else if(string(argv[i]) == "--gpu-cull")
+			gpu_culling = true;
+
+		// also cull what the last frame's depth hides
+		else if(string(argv[i]) == "--occlusion")
+			gpu_culling = occlusion_culling = true;
+
+		// cull what the walls hide on the CPU instead
+		else if(string(argv[i]) == "--soft-occlusion")
+			software_occlusion = true;
+
+		// find what's in view through a BVH
+		else if(string(argv[i]) == "--bvh")
+			spatial_index = true;
+
+		// bake the walls into world space meshes
+		else if(string(argv[i]) == "--static-batch")
+			static_batching = true;
+
+		// write per-frame data into a persistently mapped ring
+		else if(string(argv[i]) == "--frame-ring")
+			ring_buffers = true;
+
+		// cull and record the scene on this many threads
+		else if(string(argv[i]) == "--record-threads" && i + 1 < argc)
+			record_threads = atoi(argv[++ i]);
+
+		// light each pixel once from a G-buffer
+		else if(string(argv[i]) == "--deferred")
+			deferred_shading = true;
+
+		// extra point lights with a limited reach
+		else if(string(argv[i]) == "--lights" && i + 1 < argc)
+			extra_lights = atoi(argv[++ i]);
+
+		// shade forward fragments with every light, instead
+		// of only the ones reaching their cluster
+		else if(string(argv[i]) == "--no-clusters")
+			light_clusters = false;
+
+		// a sun with cascaded shadows, and shadows
+		// from the scene's own point lights
+		else if(string(argv[i]) == "--shadows")
+			cast_shadows = true;
+
+		// time forward (with and without clusters) against
+		// deferred shading from 2 to 10,000 point lights,
+		// then exit. Needs the window
+		// and scene, unlike the other benchmarks
+		else if(string(argv[i]) == "--bench-lights")
+			bench_lights = true;
+	}
+
 	if(!initSDL())
 		return 1;
 
@@ -167,20 +377,25 @@ bool initWindow()
 }
 
 // loads all models and model textures into GL
-// objects (via texture IDs and VBOs). Sets all
-// default positions and rotations for these objects,
-// also sets up the box to be used when picking checks
-// are performed during the main loop
+// objects (via texture IDs and one shared geometry
+// buffer). Sets all default positions and rotations
+// for these objects, also sets up the box to be used
+// when picking checks are performed during the main
+// loop. Everything is then put into a single indirect
+// batch so the scene is drawn with one call
 void createObjects()
 {
-	box = new Model("res/box.obj", "res/box.png", 15.0f);
+	geometry = new GeometryBuffer();
+
+	box = new Model("res/box.obj", "res/box.png", 15.0f, textures, geometry);
 	box->moveTo(30.0f, 10.0f, 30.0f);
 	box->setUUID(1);
 
 	int i, j, index = 0;
 	float wall_scale = 50.0f;
 
-	wall = new Model("res/wall.obj", "res/wall.png", wall_scale);
+	wall = new Model("res/wall.obj", "res/wall.png", wall_scale, textures, geometry);
+	wall->setVirtualTexture(wall_vtex);
 	
 	for(i = -3; i <= 3; i ++)
 	{
@@ -225,6 +440,114 @@ void createObjects()
 			walls[index ++] = wall->clone();
 		}
 	}
+
+	wall_instances = new InstanceBuffer();
+
+	if(!static_batching)
+	{
+		for(i = 0; i < NUM_WALLS; i ++)
+			wall_instances->add(walls[i]->getTransform());
+	}
+
+	// any extra instances are laid out as a square
+	// grid of floor tiles underneath the arena
+	int side = (int)ceil(sqrt((double)extra_instances));
+
+	wall->rotateTo(0.0f, -90.0f);
+	for(i = 0; i < extra_instances; i ++)
+	{
+		float x = (float)(i % side - side / 2) * wall_scale;
+		float z = (float)(i / side - side / 2) * wall_scale;
+
+		wall->moveTo(x, -2.0f * wall_scale, z);
+		wall_instances->add(wall->getTransform());
+	}
+
+	wall_instances->upload();
+
+	scene_batch = new IndirectBatch(geometry);
+	render_queue = new RenderQueue();
+
+	box_object = scene_batch->getObjectCount();
+	box_draw = scene_batch->add(box, wood);
+	scene_batch->setDynamic(box_draw, true);
+
+	// the walls never move, so they can be merged into a
+	// few meshes up front rather than transformed each frame
+	if(static_batching)
+	{
+		static_walls = new StaticBatch(geometry, STATIC_CELL_SIZE);
+
+		for(i = 0; i < NUM_WALLS; i ++)
+			static_walls->add(wall->getMesh(), walls[i]->getTransform());
+
+		static_walls->build();
+		scene_batch->add(wall, stone, static_walls);
+
+		printf("static batch: %d walls merged into %d meshes, %lld KB\n", static_walls->getInstanceCount(),
+			static_walls->getClusterCount(), static_walls->getBakedBytes() / 1024);
+	}
+
+	if(wall_instances->getCount() > 0)
+		scene_batch->add(wall, stone, wall_instances);
+
+	if(gpu_culling)
+		scene_batch->setGpuCulling(cull_shader);
+
+	if(frame_ring != NULL)
+		scene_batch->setFrameRing(frame_ring);
+
+	scene_batch->setRecordThreads(record_threads);
+
+	if(spatial_index)
+		scene_batch->setSpatialIndex(true);
+
+	if(occlusion_culling)
+		scene_batch->setOcclusion(hiz);
+
+	// the walls hide things with the quad through their
+	// middle, rather than every side of their box
+	if(software_occlusion)
+	{
+		occluders = new OcclusionBuffer();
+		AABB wall_box = geometry->getMesh(wall->getMesh())->box;
+
+		for(i = 0; i < NUM_WALLS; i ++)
+			occluders->addQuad(wall_box, walls[i]->getTransform());
+
+		scene_batch->setOccluders(occluders);
+	}
+}
+
+// replaces all but the scene's own lights with 'count' dim
+// lights of random colors and reach, scattered over the
+// arena. The same seed always gives the same lights
+void addPointLights(int count)
+{
+	point_lights->truncate(scene_lights);
+	srand(POINT_LIGHT_SEED);
+
+	Light light(0.0f, 0.0f, 0.0f);
+
+	int i;
+	for(i = 0; i < count; i ++)
+	{
+		float* pos = light.getPos();
+
+		pos[0] = ((float)rand() / RAND_MAX - 0.5f) * POINT_LIGHT_FIELD;
+		pos[1] = ((float)rand() / RAND_MAX) * POINT_LIGHT_HEIGHT;
+		pos[2] = ((float)rand() / RAND_MAX - 0.5f) * POINT_LIGHT_FIELD;
+
+		float r = (float)rand() / RAND_MAX;
+		float g = (float)rand() / RAND_MAX;
+		float b = (float)rand() / RAND_MAX;
+
+		light.setDiffuse(0.3f * r, 0.3f * g, 0.3f * b);
+		light.setSpecular(0.3f * r, 0.3f * g, 0.3f * b);
+		light.setRadius(POINT_LIGHT_MIN_RADIUS + (POINT_LIGHT_MAX_RADIUS - POINT_LIGHT_MIN_RADIUS) * (float)rand() / RAND_MAX);
+
+		point_lights->add(&light);
+	}
 }
 
 // creates instances for all Material and Light
@@ -243,23 +566,193 @@ void createLighting()
 	wood->setSpecular(0.3f, 0.3f, 0.3f);
 
 	Light* light0 = new Light(0.0f, 50.0f, 0.0f);
-	light0->setAmbient(0.5f, 0.5f, 0.5f);
 	light0->setDiffuse(0.5f, 0.5f, 0.5f);
 	light0->setSpecular(1.0f, 1.0f, 1.0f);
 
 	Light* light1 = new Light(20.0f, 20.0f, 20.0f);
-	light1->setAmbient(0.6f, 0.6f, 0.6f);
 	light1->setDiffuse(0.4f, 0.4f, 0.4f);
 	light1->setSpecular(1.0f, 1.0f, 1.0f);
 
-	shader->begin();
-
-	shader->setLight(light0, 0);
-	shader->setLight(light1, 1);
+	uniforms->setIrradiance(skybox->getIrradiance());
 
-	shader->end();
+	// these two light everything, so they have no radius
+	point_lights = new LightBuffer();
+	point_lights->add(light0);
+	point_lights->add(light1);
+	scene_lights = point_lights->getCount();
 
 	delete light0;
+	delete light1;
+
+	addPointLights(extra_lights);
+
+	clusters = new LightClusters(WINDOW_WIDTH, WINDOW_HEIGHT);
+	clusters->setProjection(projection, VIEW_NEAR, VIEW_FAR);
+	clusters->setEnabled(light_clusters);
+
+	shadows = NULL;
+
+	if(cast_shadows)
+	{
+		Vec3 sun(-0.4f, -1.0f, -0.3f);
+		float sun_diffuse[3] = { 0.35f, 0.33f, 0.3f };
+		float sun_specular[3] = { 0.5f, 0.5f, 0.5f };
+
+		uniforms->setSun(sun, sun_diffuse, sun_specular);
+
+		shadows = new ShadowMaps(uniforms);
+		shadows->setSun(sun);
+
+		int i;
+		for(i = 0; i < scene_lights; i ++)
+			shadows->addLight(point_lights, i);
+	}
+}
+
+// creates the physical page cache for virtual textures
+// and registers the wall texture with it, cooking the
+// tiled version of the wall texture first if needed
+void createVirtualTextures()
+{
+	tiles = new TileCache(WINDOW_WIDTH / FEEDBACK_SCALE, WINDOW_HEIGHT / FEEDBACK_SCALE);
+
+	if(!VirtualTexture::exists("res/wall.vtex"))
+		VirtualTexture::cook("res/wall.png", "res/wall.vtex");
+
+	wall_vtex = new VirtualTexture("res/wall.vtex");
+	tiles->registerTexture(wall_vtex);
+
+	feedback->begin();
+	feedback->setUniformf(UNIFORM_ID(VT_BIAS_STR), -log2((float)FEEDBACK_SCALE));
+	feedback->end();
+}
+
+// describes the frame as passes over what they read and
+// write. The window's framebuffer is always an output, and
+// the picking target only is on frames a pick was asked
+// for, so the picking pass is culled on every other frame.
+// Forward shading assigns the lights to clusters first.
+// Deferred shading draws the scene into a G-buffer of
+// transient targets instead, lit by a compute pass and
+// then drawn over the skybox
+FrameGraph* createFrameGraph(bool deferred_frame)
+{
+	FrameGraph* frame_graph = new FrameGraph();
+
+	int backbuffer = frame_graph->importTexture("backbuffer", 0);
+	int feedback_target = frame_graph->importTexture("feedback", 0);
+	int draws = frame_graph->importBuffer("culled draws", 0);
+	int pyramid = frame_graph->importTexture("hiz", 0);
+	int light_lists = frame_graph->importBuffer("light clusters", 0);
+	int shadow_maps = frame_graph->importTexture("shadow maps", 0);
+
+	pick_target = frame_graph->addTexture("pick color", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA8);
+	int pick_depth = frame_graph->addTexture("pick depth", WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT24);
+
+	int pass = frame_graph->addPass("picking", renderPicking);
+	frame_graph->write(pass, pick_target, ACCESS_ATTACHMENT);
+	frame_graph->write(pass, pick_depth, ACCESS_ATTACHMENT);
+	frame_graph->read(pass, pick_target, ACCESS_COPY);
+
+	pass = frame_graph->addPass("feedback", renderFeedback);
+	frame_graph->write(pass, feedback_target, ACCESS_ATTACHMENT);
+
+	if(gpu_culling)
+	{
+		pass = frame_graph->addPass("cull", cullScene);
+		frame_graph->write(pass, draws, ACCESS_STORAGE);
+
+		if(occlusion_culling)
+			frame_graph->read(pass, pyramid, ACCESS_TEXTURE);
+	}
+
+	if(shadows != NULL)
+	{
+		pass = frame_graph->addPass("shadows", renderShadows);
+		frame_graph->write(pass, shadow_maps, ACCESS_ATTACHMENT);
+	}
+
+	// the scene's depth, which the pyramid is built from
+	int depth = backbuffer;
+	int i;
+
+	if(deferred_frame)
+	{
+		gbuffer_targets[0] = frame_graph->addTexture("albedo", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA8);
+		gbuffer_targets[1] = frame_graph->addTexture("normal", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA16F);
+		gbuffer_targets[2] = frame_graph->addTexture("material", WINDOW_WIDTH, WINDOW_HEIGHT, GL_R32UI);
+		gbuffer_targets[3] = frame_graph->addTexture("depth", WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT32F);
+		lit_target = frame_graph->addTexture("lit", WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA8);
+
+		depth = gbuffer_targets[3];
+
+		pass = frame_graph->addPass("gbuffer", renderGBuffer);
+		for(i = 0; i < 4; i ++)
+			frame_graph->write(pass, gbuffer_targets[i], ACCESS_ATTACHMENT);
+	}
+	else
+	{
+		pass = frame_graph->addPass("clusters", assignLights);
+		frame_graph->write(pass, light_lists, ACCESS_COPY);
+
+		pass = frame_graph->addPass("scene", renderScene);
+		frame_graph->read(pass, light_lists, ACCESS_STORAGE);
+		frame_graph->read(pass, shadow_maps, ACCESS_TEXTURE);
+		frame_graph->write(pass, backbuffer, ACCESS_ATTACHMENT);
+	}
+
+	if(gpu_culling)
+		frame_graph->read(pass, draws, ACCESS_INDIRECT | ACCESS_STORAGE);
+
+	if(occlusion_culling)
+	{
+		pass = frame_graph->addPass("hiz", buildHiZ);
+		frame_graph->read(pass, depth, (deferred_frame ? ACCESS_TEXTURE : ACCESS_COPY));
+		frame_graph->write(pass, pyramid, ACCESS_IMAGE);
+
+		pass = frame_graph->addPass("retest", retestScene);
+		frame_graph->read(pass, pyramid, ACCESS_TEXTURE);
+		frame_graph->read(pass, draws, ACCESS_STORAGE);
+		frame_graph->write(pass, draws, ACCESS_STORAGE);
+
+		if(deferred_frame)
+		{
+			pass = frame_graph->addPass("late gbuffer", renderLateGBuffer);
+			for(i = 0; i < 4; i ++)
+				frame_graph->write(pass, gbuffer_targets[i], ACCESS_ATTACHMENT);
+		}
+		else
+		{
+			pass = frame_graph->addPass("late scene", renderLateScene);
+			frame_graph->read(pass, light_lists, ACCESS_STORAGE);
+			frame_graph->read(pass, shadow_maps, ACCESS_TEXTURE);
+			frame_graph->write(pass, backbuffer, ACCESS_ATTACHMENT);
+		}
+
+		frame_graph->read(pass, draws, ACCESS_INDIRECT | ACCESS_STORAGE);
+	}
+
+	if(deferred_frame)
+	{
+		pass = frame_graph->addPass("lighting", lightScene);
+		for(i = 0; i < 4; i ++)
+			frame_graph->read(pass, gbuffer_targets[i], ACCESS_TEXTURE);
+		frame_graph->read(pass, shadow_maps, ACCESS_TEXTURE);
+		frame_graph->write(pass, lit_target, ACCESS_IMAGE);
+
+		pass = frame_graph->addPass("composite", compositeScene);
+		frame_graph->read(pass, lit_target, ACCESS_TEXTURE);
+		frame_graph->read(pass, gbuffer_targets[2], ACCESS_TEXTURE);
+		frame_graph->read(pass, gbuffer_targets[3], ACCESS_TEXTURE);
+		frame_graph->write(pass, backbuffer, ACCESS_ATTACHMENT);
+	}
+
+	frame_graph->compile();
+
+	printf("frame graph:\n");
+	frame_graph->print();
+
+	return frame_graph;
 }
 
 // initializes GLEW and all necessary values
@@ -289,17 +782,43 @@ void startGL()
 	glDepthFunc(GL_LEQUAL);
 	glCullFace(GL_BACK);
 
+	projection = Mat4::perspective(45.0f, (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, VIEW_NEAR, VIEW_FAR);
+
+	streamer = new TextureStreamer(UPLOAD_RING_SIZE, UPLOAD_BUDGET_MS);
+	textures = new TextureManager(TEXTURE_BUDGET, streamer);
 	camera = new Camera(0.0f, BOBBING_RATE, -10.0f);
-	shader = new Shader("res/main.vs", "res/main.fs");
-	selector = new Shader("res/picking.vs", "res/picking.fs");
+	uniforms = new UniformBlocks();
+	frame_ring = (ring_buffers ? new FrameRing(FRAME_RING_SIZE) : NULL);
+
+	if(frame_ring != NULL)
+		uniforms->setFrameRing(frame_ring);
+
+	shader = new Shader("res/main.vs", "res/main.fs", uniforms);
+	selector = new Shader("res/picking.vs", "res/picking.fs", uniforms);
+	feedback = new Shader("res/main.vs", "res/feedback.fs", uniforms);
+	cull_shader = (gpu_culling ? new Shader("res/cull.cs", uniforms) : NULL);
+	hiz_shader = (occlusion_culling ? new Shader("res/hiz.cs", uniforms) : NULL);
+	hiz = (occlusion_culling ? new HiZPyramid(WINDOW_WIDTH, WINDOW_HEIGHT, hiz_shader) : NULL);
+	deferred = (deferred_shading || bench_lights ? new DeferredRenderer(uniforms) : NULL);
+
+	glGenQueries(2, scene_queries);
+	fragment_query = (GLEW_ARB_pipeline_statistics_query ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED);
 
 	skybox = new Skybox("res/lake1_lf.png", "res/lake1_rt.png",
 						"res/lake1_up.png", "res/lake1_dn.png",
-						"res/lake1_ft.png", "res/lake1_bk.png");
+						"res/lake1_ft.png", "res/lake1_bk.png",
+						textures);
 	createLighting();
+	createVirtualTextures();
 	createObjects();
 
-	runTest();
+	if(bench_lights)
+		benchmarkLights();
+	else
+	{
+		graph = createFrameGraph(deferred_shading);
+		runTest();
+	}
 	cleanup();
 }
 
@@ -397,7 +916,7 @@ void update()
 			camera->rotate(xrel * MOUSE_SPEED, -yrel * MOUSE_SPEED);
 
 			if(fabs(xrel) + fabs(yrel) > 0.0f)
-				picked = camera->picked(box, selector, PICKING_RANGE);
+				pick_requested = true;
 		}
 	}
 
@@ -426,56 +945,272 @@ void update()
 		camera->moveTo(camera->getX(), (getElapsedBobbingTime() * BOBBING_RATE) + BOBBING_RATE, camera->getZ());
 		camera->move(dx, 0.0f, dz);
 
-		picked = camera->picked(box, selector, PICKING_RANGE);
+		pick_requested = true;
+	}
+
+	// only the box's own shadow is redrawn as it moves;
+	// everything else's stays cached
+	if(shadows != NULL)
+	{
+		double angle = getElapsedGameTime() / BOX_ORBIT_PERIOD * 2.0 * M_PI;
+
+		box->moveTo(30.0f + BOX_ORBIT_RADIUS * (float)cos(angle), 10.0f, 30.0f + BOX_ORBIT_RADIUS * (float)sin(angle));
+		scene_batch->setObject(box_object, InstanceBuffer::makeInstance(box->getTransform()));
+
+		pick_requested = true;
 	}
 }
 
-// renders all objects in the scene and finalizes checks
-// for picking, also updates world vieew and position data
-// for shaders (modelView and projection matrices)
-void render()
+// draws the box with its ID as the color into the
+// picking target, and reads back the pixel under the
+// crosshair to see if it's being looked at
+void renderPicking()
 {
-	shader->begin();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+	picked = camera->picked(box, selector, PICKING_RANGE);
+	scene_batch->setPicked(box_draw, picked);
+}
 
-	shader->setProjectionMatrix();
-	
-	glMatrixMode(GL_MODELVIEW);
- 	glLoadIdentity();
+// renders the scene at low resolution into the tile
+// cache's feedback buffer, recording which virtual
+// texture pages are visible this frame
+void renderFeedback()
+{
+	feedback->begin();
+	tiles->beginFeedback();
+
+	feedback->setProjectionMatrix(projection);
+	feedback->setCameraMatrix(camera->getViewMatrix());
 
- 	gluPerspective(45.0, (double)WINDOW_WIDTH / (double)WINDOW_HEIGHT, 0.1, 1000.0);
+	scene_batch->render(feedback);
 
-	camera->doRotate();
+	tiles->endFeedback();
+	feedback->end();
+}
+
+// culls every object in a compute shader, leaving
+// the draw commands on the GPU for the scene pass
+void cullScene()
+{
+	scene_batch->cullOnGpu(camera->getViewMatrix(), projection);
+}
+
+// draws the scene with 'program', culled on the GPU
+// or (sorted by state) on the CPU
+void drawScene(Shader* program)
+{
+	if(gpu_culling)
+		scene_batch->renderGpuCulled(program);
+	else
+	{
+		if(software_occlusion)
+			occluders->render(projection * camera->getViewMatrix());
+
+		render_queue->clear();
+		scene_batch->queue(render_queue, program, camera->getViewMatrix(), projection);
+		render_queue->sort();
+
+		scene_batch->render(program, render_queue);
+	}
+}
+
+// draws the skybox and then the scene. The scene's
+// triangle and fragment counts run until the last
+// scene pass
+void renderScene()
+{
+	shader->begin();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	shader->setProjectionMatrix(projection);
+	shader->setCameraMatrix(camera->getRotationMatrix());
 
 	shader->setTexture(TEXTURE_CUBE_ID);
-	shader->setUniformi(IS_SKYBOX_STR, 1);
+	shader->setUniformi(UNIFORM_ID(IS_SKYBOX_STR), 1);
 
 	skybox->render(shader);
 
-	camera->doTranslate();
-	shader->setCameraMatrix();
+	shader->setCameraMatrix(camera->getViewMatrix());
 
 	shader->setTexture(TEXTURE_2D_ID);
-	shader->setUniformi(IS_SKYBOX_STR, 0);
+	shader->setUniformi(UNIFORM_ID(IS_SKYBOX_STR), 0);
 
-	shader->setMaterial(wood);
+	glBeginQuery(GL_PRIMITIVES_GENERATED, scene_queries[0]);
+	glBeginQuery(fragment_query, scene_queries[1]);
 
-	if(picked)
-		shader->setUniformi("picked", 1);
+	clusters->bind();
+	point_lights->bind();
 
-	box->render(shader);
-	
-	shader->setUniformi("picked", 0);
-	shader->setMaterial(stone);
+	if(shadows != NULL)
+		shadows->bind();
+
+	drawScene(shader);
+
+	if(!occlusion_culling)
+	{
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		glEndQuery(fragment_query);
+	}
+
+	shader->end();
+}
+
+// lists the lights reaching each cluster of the view,
+// for the forward scene passes
+void assignLights()
+{
+	clusters->assign(point_lights, camera->getViewMatrix());
+}
+
+// brings the sun's cascades and the point lights' cubes
+// up to date, redrawing only what moved into them
+void renderShadows()
+{
+	shadows->render(scene_batch, point_lights, camera->getViewMatrix(), projection, VIEW_NEAR, VIEW_FAR);
+}
+
+// draws the scene's surfaces into the G-buffer, counted
+// like the forward scene pass
+void renderGBuffer()
+{
+	deferred->beginGeometry(true);
+
+	Shader* program = deferred->getGeometryShader();
+
+	program->setProjectionMatrix(projection);
+	program->setCameraMatrix(camera->getViewMatrix());
+	program->setTexture(TEXTURE_2D_ID);
+
+	glBeginQuery(GL_PRIMITIVES_GENERATED, scene_queries[0]);
+	glBeginQuery(fragment_query, scene_queries[1]);
+
+	drawScene(program);
+
+	if(!occlusion_culling)
+	{
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		glEndQuery(fragment_query);
+	}
+
+	deferred->endGeometry();
+}
+
+// builds the depth pyramid from what the scene pass drew
+// (or the G-buffer's depth). It's also the next frame's
+// "last" pyramid
+void buildHiZ()
+{
+	if(deferred_shading)
+		hiz->build(projection * camera->getViewMatrix(), graph->getTexture(gbuffer_targets[3]));
+	else
+		hiz->build(projection * camera->getViewMatrix());
+}
+
+// tests what the last frame's depth hid again against
+// the depth drawn so far, so nothing coming into view
+// pops in a frame late
+void retestScene()
+{
+	scene_batch->retestOnGpu();
+}
+
+// draws what the retest found visible
+void renderLateScene()
+{
+	shader->begin();
+
+	clusters->bind();
+	point_lights->bind();
+
+	if(shadows != NULL)
+		shadows->bind();
+
+	scene_batch->renderGpuCulled(shader);
+
+	glEndQuery(GL_PRIMITIVES_GENERATED);
+	glEndQuery(fragment_query);
+
+	shader->end();
+}
+
+// adds what the retest found visible to the G-buffer
+void renderLateGBuffer()
+{
+	deferred->beginGeometry(false);
+	scene_batch->renderGpuCulled(deferred->getGeometryShader());
+
+	glEndQuery(GL_PRIMITIVES_GENERATED);
+	glEndQuery(fragment_query);
+
+	deferred->endGeometry();
+}
+
+// the G-buffer's textures for this frame
+GBuffer getGBuffer()
+{
+	GBuffer gbuffer;
+
+	gbuffer.albedo = graph->getTexture(gbuffer_targets[0]);
+	gbuffer.normal = graph->getTexture(gbuffer_targets[1]);
+	gbuffer.material = graph->getTexture(gbuffer_targets[2]);
+	gbuffer.depth = graph->getTexture(gbuffer_targets[3]);
+
+	return gbuffer;
+}
+
+// lights the G-buffer with the scene's lights, reading
+// each pixel's material from the batch's draw records
+void lightScene()
+{
+	scene_batch->bindMaterials();
+	point_lights->bind();
+
+	if(shadows != NULL)
+		shadows->bind();
+
+	deferred->light(getGBuffer(), graph->getTexture(lit_target), WINDOW_WIDTH, WINDOW_HEIGHT,
+					camera->getViewMatrix(), projection);
+}
+
+// draws the skybox, then the lit scene over it
+void compositeScene()
+{
+	shader->begin();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	shader->setProjectionMatrix(projection);
+	shader->setCameraMatrix(camera->getRotationMatrix());
+
+	shader->setTexture(TEXTURE_CUBE_ID);
+	shader->setUniformi(UNIFORM_ID(IS_SKYBOX_STR), 1);
+
+	skybox->render(shader);
+
+	shader->setCameraMatrix(camera->getViewMatrix());
+
+	shader->setTexture(TEXTURE_2D_ID);
+	shader->setUniformi(UNIFORM_ID(IS_SKYBOX_STR), 0);
 
-	int i;
-	for(i = 0; i < NUM_WALLS; i ++)
-		walls[i]->render(shader);
-	
 	shader->end();
+
+	deferred->composite(getGBuffer(), graph->getTexture(lit_target));
+}
+
+// runs the frame graph after the per-frame streaming
+// updates, picking only if the camera moved
+void render()
+{
+	textures->update();
+	streamer->update();
+	tiles->update();
+
+	graph->setOutput(pick_target, pick_requested);
+	pick_requested = false;
+
+	graph->compile();
+	graph->execute();
+
 	SDL_GL_SwapWindow(main_window);
 }
 
@@ -521,17 +1256,188 @@ void runTest()
 		current_time = getElapsedGameTime();
 		if(current_time - start_time >= 1000.0)
 		{
-			printf("fps: %d\n", frames);
+			printf("fps: %d, textures: %lld KB resident, %lld KB evicted\n", frames,
+				textures->getResidentBytes() / 1024, textures->getEvictedBytes() / 1024);
+
+			// the GPU's count is checked against the CPU
+			// culling the same objects
+			if(gpu_culling)
+			{
+				int gpu_visible = scene_batch->getGpuVisibleCount();
+				int cpu_visible = scene_batch->countVisible(camera->getViewMatrix(), projection);
+
+				printf("objects: %d visible on the GPU, %d on the CPU (frustum only)\n", gpu_visible, cpu_visible);
+
+				if(occlusion_culling)
+					printf("occlusion: %d hidden, %d drawn after the retest\n", cpu_visible - gpu_visible,
+						scene_batch->getGpuRetestedCount());
+			}
+			else
+			{
+				printf("objects: %d visible, %d culled\n", scene_batch->getVisibleCount(), scene_batch->getCulledCount());
+				printf("draws: %d queued, state changes: %d unsorted, %d sorted, %d indirect commands\n",
+					render_queue->getCount(), render_queue->getUnsortedStateChanges(),
+					render_queue->getSortedStateChanges(), scene_batch->getCommandCount());
+
+				printf("recording: %.3f ms on %d threads\n", scene_batch->getRecordTime(),
+					(record_threads > 0 ? record_threads : 1));
+
+				// the workers test their own objects, which
+				// is timed as part of the recording
+				if(software_occlusion && record_threads > 0)
+					printf("occlusion: %d hidden, %d triangles drawn in %.3f ms\n",
+						scene_batch->getOccludedCount(), occluders->getTriangleCount(),
+						occluders->getRasterTime());
+
+				else if(software_occlusion)
+					printf("occlusion: %d hidden, %d triangles drawn in %.3f ms, tested in %.3f ms\n",
+						occluders->getOccludedCount(), occluders->getTriangleCount(),
+						occluders->getRasterTime(), occluders->getTestTime());
+			}
+
+			unsigned int triangles = 0, fragments = 0;
+			glGetQueryObjectuiv(scene_queries[0], GL_QUERY_RESULT, &triangles);
+			glGetQueryObjectuiv(scene_queries[1], GL_QUERY_RESULT, &fragments);
+
+			printf("scene: %u triangles, %u fragments\n", triangles, fragments);
+
+			printf("passes:");
+
+			int p;
+			for(p = 0; p < graph->getPassCount(); p ++)
+			{
+				if(graph->isCulled(p))
+					printf(" %s culled", graph->getPassName(p).c_str());
+				else
+					printf(" %s %.3f ms", graph->getPassName(p).c_str(), graph->getPassTime(p));
+			}
+			printf("\n");
+
+			if(deferred_shading)
+				printf("lights: %d point lights, deferred shading\n", point_lights->getCount());
+			else
+				printf("lights: %d point lights, %s forward shading, assigned in %.3f ms, %d indices, at most %d per cluster\n",
+					point_lights->getCount(), (clusters->isEnabled() ? "clustered" : "unclustered"),
+					clusters->getAssignTime(), clusters->getIndexCount(), clusters->getMaxLights());
+
+			if(shadows != NULL)
+				printf("shadows: %d static layers redrawn, %d restored from cache, %d dynamic casters\n",
+					shadows->getStaticLayers(), shadows->getRestoredLayers(), shadows->getDynamicCasters());
+
+			if(frame_ring != NULL)
+				printf("frame ring: %d KB last frame, %d KB peak, %lld KB written, %d stalls (%.3f ms), %d overflows\n",
+					frame_ring->getFrameBytes() / 1024, frame_ring->getPeakBytes() / 1024,
+					frame_ring->getBytesWritten() / 1024, frame_ring->getStalls(),
+					frame_ring->getStallTime(), frame_ring->getOverflows());
+
 			frames = 0;
 
 			start_time = getElapsedGameTime();
 		}
 
+		// picking in 'update' draws too, so the
+		// frame's ring partition covers both
+		if(frame_ring != NULL)
+		{
+			frame_ring->beginFrame();
+			uniforms->beginFrame();
+		}
+
 		update();
 		render();
+
+		if(frame_ring != NULL)
+			frame_ring->endFrame();
 	}
 }
 
+// draws the scene from where the camera starts with forward
+// shading through every light, clustered forward shading
+// and then deferred shading, at 2 to 10,000 point lights
+// (plus the scene's own). Prints each one's average frame
+// time (waited on with glFinish, without vsync) and the
+// GPU time of its passes
+void benchmarkLights()
+{
+	int counts[] = { 2, 10, 100, 1000, 10000 };
+	int num_counts = sizeof(counts) / sizeof(counts[0]);
+
+	const char* names[] = { "forward", "clustered", "deferred" };
+
+	FrameGraph* graphs[2];
+	graphs[0] = createFrameGraph(false);
+	graphs[1] = createFrameGraph(true);
+
+	SDL_GL_SetSwapInterval(0);
+
+	int i, mode, frame, p;
+
+	printf("%8s", "lights");
+	for(mode = 0; mode < 3; mode ++)
+		printf(" %9s frame ms %9s GPU ms", names[mode], names[mode]);
+	printf("\n");
+
+	for(i = 0; i < num_counts; i ++)
+	{
+		double frame_ms[3], gpu_ms[3];
+		addPointLights(counts[i]);
+
+		for(mode = 0; mode < 3; mode ++)
+		{
+			graph = graphs[(mode == 2 ? 1 : 0)];
+			deferred_shading = (mode == 2);
+			clusters->setEnabled(mode == 1);
+
+			time_point<steady_clock> start = steady_clock::now();
+			gpu_ms[mode] = 0.0;
+
+			// the first frames only fill the timer queries
+			for(frame = 0; frame < GRAPH_TIMER_FRAMES + LIGHT_BENCH_FRAMES; frame ++)
+			{
+				if(frame == GRAPH_TIMER_FRAMES)
+					start = steady_clock::now();
+
+				if(frame_ring != NULL)
+				{
+					frame_ring->beginFrame();
+					uniforms->beginFrame();
+				}
+
+				render();
+				glFinish();
+
+				if(frame_ring != NULL)
+					frame_ring->endFrame();
+
+				if(frame < GRAPH_TIMER_FRAMES)
+					continue;
+
+				for(p = 0; p < graph->getPassCount(); p ++)
+				{
+					if(!(graph->isCulled(p)))
+						gpu_ms[mode] += graph->getPassTime(p);
+				}
+			}
+
+			duration<double, milli> elapsed = steady_clock::now() - start;
+
+			frame_ms[mode] = elapsed.count() / LIGHT_BENCH_FRAMES;
+			gpu_ms[mode] /= LIGHT_BENCH_FRAMES;
+		}
+
+		printf("%8d", point_lights->getCount());
+		for(mode = 0; mode < 3; mode ++)
+			printf(" %18.3f %16.3f", frame_ms[mode], gpu_ms[mode]);
+		printf("\n");
+	}
+
+	clusters->setEnabled(light_clusters);
+
+	delete graphs[0];
+	delete graphs[1];
+	graph = NULL;
+}
+
 // clear all class instances from memory accordingly,
 // destroy SDL window and GL context
 void cleanup()
@@ -545,12 +1451,38 @@ void cleanup()
 	for(i = 0; i < NUM_WALLS; i ++)
 		delete walls[i];
 
+	delete wall_instances;
+	delete static_walls;
+	delete scene_batch;
+	delete render_queue;
+	delete geometry;
+	delete hiz;
+	delete occluders;
+	delete graph;
+	delete deferred;
+	delete point_lights;
+	delete clusters;
+	delete shadows;
+
+	glDeleteQueries(2, scene_queries);
+
+	delete tiles;
+	delete wall_vtex;
+
 	delete selector;
+	delete feedback;
+	delete cull_shader;
+	delete hiz_shader;
 	delete shader;
+	delete uniforms;
+	delete frame_ring;
 
 	delete stone;
 	delete wood;
 
+	delete textures;
+	delete streamer;
+
 	SDL_GL_DeleteContext(main_context);
 	SDL_DestroyWindow(main_window);
 	SDL_Quit();
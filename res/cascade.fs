@@ -0,0 +1,7 @@
+#version 440
+
+// the sun's cascades keep the window depth, so nothing
+// is written here and early depth testing stays on
+void main()
+{
+}
@@ -0,0 +1,23 @@
+#version 440
+
+out vec4 fragColor;
+
+// must match DEFERRED_*_ID in DeferredRenderer.hpp
+uniform sampler2D litColor;
+uniform usampler2D gMaterial;
+uniform sampler2D gDepth;
+
+// draws the lit G-buffer over the skybox, blended by the
+// albedo's alpha like the forward path, and puts its depth
+// into the window's depth buffer. Pixels nothing was drawn
+// in are left to the skybox
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+
+	if(texelFetch(gMaterial, p, 0).r == 0u)
+		discard;
+
+	fragColor = texelFetch(litColor, p, 0);
+	gl_FragDepth = texelFetch(gDepth, p, 0).r;
+}
@@ -0,0 +1,9 @@
+#version 440
+
+// a triangle covering the whole screen, made
+// from the vertex index with no buffers bound
+void main()
+{
+	vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,269 @@
+#version 440
+
+// must match CULL_GROUP_SIZE in GpuCuller.hpp
+layout(local_size_x = 256) in;
+
+// must match DrawElementsIndirectCommand in GpuCuller.hpp
+struct Command {
+
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+// must match CullObject in GpuCuller.hpp
+struct CullObject {
+
+	float cx, cy, cz;
+	int draw;
+
+	float ex, ey, ez;
+	int occluded;
+};
+
+// must match CullDraw in GpuCuller.hpp
+struct CullDraw {
+
+	uint indexCount;
+	uint firstIndex;
+	int baseVertex;
+	uint firstObject;
+
+	float maxDistance;
+	int padding[3];
+};
+
+// must match the CULL_*_BINDING values in GpuCuller.hpp
+layout(std430, binding = 0) buffer CullObjects {
+	CullObject objects[];
+};
+
+layout(std430, binding = 1) readonly buffer CullDraws {
+	CullDraw draws[];
+};
+
+layout(std430, binding = 2) buffer Commands {
+	Command commands[];
+};
+
+layout(std430, binding = 3) writeonly buffer VisibleObjects {
+	int visible[];
+};
+
+// draw records are copied word by word, so
+// this doesn't need to know their layout
+layout(std430, binding = 4) readonly buffer DrawRecords {
+	uint records[];
+};
+
+layout(std430, binding = 5) writeonly buffer CompactCommands {
+	Command compactCommands[];
+};
+
+layout(std430, binding = 6) writeonly buffer CompactRecords {
+	uint compactRecords[];
+};
+
+layout(std430, binding = 7) buffer CompactCount {
+	uint compactCount;
+};
+
+// must match the CULL_PASS_* values in GpuCuller.hpp
+const int pass_reset = 0;
+const int pass_objects = 1;
+const int pass_compact = 2;
+const int pass_continue = 3;
+const int pass_retest = 4;
+
+uniform int cull_pass;
+uniform vec4 planes[6];
+uniform vec3 eye;
+
+uniform int object_count;
+uniform int draw_count;
+uniform int record_words;
+
+// the depth pyramid (farthest depth per texel) and the
+// view-projection it was rendered with
+uniform int occlusion;
+uniform mat4 occlusion_vp;
+uniform sampler2D hiz;
+
+// starts every draw over with no instances. Its
+// objects will be written from its first slot on
+void resetDraw(uint i)
+{
+	if(i == 0u)
+		compactCount = 0u;
+
+	CullDraw draw = draws[i];
+	commands[i] = Command(draw.indexCount, 0u, draw.firstIndex, draw.baseVertex, draw.firstObject);
+}
+
+// true if the box is entirely behind a frustum
+// plane or past its draw's distance
+bool outside(vec3 center, vec3 extents, CullDraw draw)
+{
+	for(int p = 0; p < 6; p ++)
+	{
+		float d = dot(planes[p].xyz, center) + planes[p].w;
+		float r = dot(abs(planes[p].xyz), extents);
+
+		if(d + r < 0.0)
+			return true;
+	}
+
+	return (draw.maxDistance > 0.0 && distance(eye, center) - length(extents) > draw.maxDistance);
+}
+
+// true if the box's nearest point is behind the farthest
+// depth of the pyramid texels it covers. The level is
+// picked so the box's screen rectangle spans at most two
+// texels each way. Boxes reaching behind the camera or
+// off the pyramid's screen can't be tested, so they stay
+bool occluded(vec3 center, vec3 extents)
+{
+	vec3 lo = vec3(1.0e30);
+	vec3 hi = vec3(-1.0e30);
+
+	for(int c = 0; c < 8; c ++)
+	{
+		vec3 corner = center + extents * vec3((c & 1) != 0 ? 1.0 : -1.0,
+											  (c & 2) != 0 ? 1.0 : -1.0,
+											  (c & 4) != 0 ? 1.0 : -1.0);
+
+		vec4 clip = occlusion_vp * vec4(corner, 1.0);
+		if(clip.w <= 0.0)
+			return false;
+
+		vec3 ndc = clip.xyz / clip.w;
+
+		lo = min(lo, ndc);
+		hi = max(hi, ndc);
+	}
+
+	if(hi.x < -1.0 || hi.y < -1.0 || lo.x > 1.0 || lo.y > 1.0)
+		return false;
+
+	vec2 size = vec2(textureSize(hiz, 0));
+	vec2 pmin = clamp(lo.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+	vec2 pmax = clamp(hi.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+
+	vec2 extent = pmax - pmin;
+	int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+	level = min(level, textureQueryLevels(hiz) - 1);
+
+	ivec2 last = textureSize(hiz, level) - 1;
+	ivec2 t0 = min(ivec2(pmin) >> level, last);
+	ivec2 t1 = min(ivec2(pmax) >> level, last);
+
+	float farthest = max(max(texelFetch(hiz, t0, level).r, texelFetch(hiz, ivec2(t1.x, t0.y), level).r),
+						 max(texelFetch(hiz, ivec2(t0.x, t1.y), level).r, texelFetch(hiz, t1, level).r));
+
+	return (lo.z * 0.5 + 0.5 > farthest);
+}
+
+// gives an object the next slot of its draw's run of
+// the visible list, after any earlier phase's
+void addVisible(int draw, uint i)
+{
+	uint slot = atomicAdd(commands[draw].instanceCount, 1u);
+	visible[commands[draw].baseInstance + slot] = int(i);
+}
+
+// adds the object to its draw unless it's outside the
+// frustum, or hidden behind the last pyramid built, in
+// which case it's marked to be retested
+void cullObject(uint i)
+{
+	CullObject object = objects[i];
+
+	vec3 center = vec3(object.cx, object.cy, object.cz);
+	vec3 extents = vec3(object.ex, object.ey, object.ez);
+
+	int hidden = 0;
+
+	if(outside(center, extents, draws[object.draw]))
+		hidden = -1;
+	else if(occlusion != 0 && occluded(center, extents))
+		hidden = 1;
+
+	if(object.occluded != hidden)
+		objects[i].occluded = hidden;
+
+	if(hidden == 0)
+		addVisible(object.draw, i);
+}
+
+// retests an object the first phase found hidden against
+// the pyramid rebuilt from what that phase drew
+void retestObject(uint i)
+{
+	CullObject object = objects[i];
+
+	if(object.occluded != 1)
+		return;
+
+	vec3 center = vec3(object.cx, object.cy, object.cz);
+	vec3 extents = vec3(object.ex, object.ey, object.ez);
+
+	if(!occluded(center, extents))
+		addVisible(object.draw, i);
+}
+
+// starts the second phase: each draw's next run of
+// instances begins where the first phase's ended
+void continueDraw(uint i)
+{
+	if(i == 0u)
+		compactCount = 0u;
+
+	Command command = commands[i];
+
+	commands[i].baseInstance = command.baseInstance + command.instanceCount;
+	commands[i].instanceCount = 0u;
+}
+
+// packs the draws that kept any instances, with their
+// records, to the front for glMultiDrawElementsIndirectCount
+void compactDraw(uint i)
+{
+	Command command = commands[i];
+	if(command.instanceCount == 0u)
+		return;
+
+	uint slot = atomicAdd(compactCount, 1u);
+	compactCommands[slot] = command;
+
+	uint words = uint(record_words);
+
+	for(uint w = 0u; w < words; w ++)
+		compactRecords[slot * words + w] = records[i * words + w];
+}
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+
+	if(cull_pass == pass_objects || cull_pass == pass_retest)
+	{
+		if(i >= uint(object_count))
+			return;
+
+		if(cull_pass == pass_objects)
+			cullObject(i);
+		else
+			retestObject(i);
+	}
+	else if(i < uint(draw_count))
+	{
+		if(cull_pass == pass_reset)
+			resetDraw(i);
+		else if(cull_pass == pass_continue)
+			continueDraw(i);
+		else
+			compactDraw(i);
+	}
+}
@@ -0,0 +1,354 @@
+#version 440
+
+// must match DEFERRED_TILE_SIZE in DeferredRenderer.hpp
+layout(local_size_x = 16, local_size_y = 16) in;
+
+const int tile_threads = 256;
+
+struct Material {
+
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float shininess;
+};
+
+// every draw's record in draw order (see bindMaterials in
+// IndirectBatch.cpp), indexed by material ID - 1. Must
+// match DrawRecord and DRAW_FLAG_* in IndirectBatch.hpp
+struct DrawRecord {
+
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+
+	int flags;
+	int draw;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords {
+	DrawRecord draws[];
+};
+
+const int draw_flag_picked = 2;
+
+// must match LightRecord in LightBuffer.hpp
+struct LightRecord {
+
+	vec3 pos;
+	float radius;
+	vec3 diffuse;
+	int shadow;
+	vec4 specular;
+};
+
+layout(std430, binding = 3) readonly buffer LightRecords {
+	int light_count;
+	LightRecord buffer_lights[];
+};
+
+// must match SHADOW_CASCADES in UniformBlocks.hpp
+// and SHADOW_CUBE_FAR in ShadowMaps.hpp
+const int cascade_count = 4;
+const float shadow_cube_far = 1000.0;
+
+// must match the blocks in UniformBlocks.hpp
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 projMatrix;
+	mat4 viewMatrix;
+	mat4 viewProjMatrix;
+	vec4 cameraPos;
+};
+
+layout(std140, binding = 1) uniform LightBlock {
+	vec3 sh_irradiance[9];
+
+	vec4 sun_direction;
+	vec4 sun_diffuse;
+	vec4 sun_specular;
+
+	mat4 cascade_matrices[cascade_count];
+	vec4 cascade_splits;
+	vec4 cascade_texels;
+};
+
+// must match DEFERRED_*_ID in DeferredRenderer.hpp
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform usampler2D gMaterial;
+uniform sampler2D gDepth;
+
+// must match TEXTURE_SHADOW_*_ID in Shader.hpp
+uniform sampler2DArrayShadow shadowCascades;
+uniform samplerCubeArrayShadow shadowCubes;
+
+// must match DEFERRED_OUTPUT_IMAGE in DeferredRenderer.hpp
+layout(rgba8, binding = 0) uniform writeonly image2D lit;
+
+uniform mat4 inv_view_proj;
+uniform mat4 inv_projection;
+
+// the tile's depth range as float bits, which order
+// the same as the (positive) depths they hold
+shared uint tile_min;
+shared uint tile_max;
+
+// the tile's side planes in view space, facing in
+shared vec4 tile_planes[4];
+shared float tile_near;
+shared float tile_far;
+
+// the lights of the current batch touching the tile
+shared int tile_lights[tile_threads];
+shared int tile_count;
+
+// evaluates the SH irradiance for a unit normal
+vec3 irradiance(vec3 n)
+{
+	return sh_irradiance[0] * 0.282095
+		+ sh_irradiance[1] * (0.488603 * n.y)
+		+ sh_irradiance[2] * (0.488603 * n.z)
+		+ sh_irradiance[3] * (0.488603 * n.x)
+		+ sh_irradiance[4] * (1.092548 * n.x * n.y)
+		+ sh_irradiance[5] * (1.092548 * n.y * n.z)
+		+ sh_irradiance[6] * (0.315392 * (3.0 * n.z * n.z - 1.0))
+		+ sh_irradiance[7] * (1.092548 * n.x * n.z)
+		+ sh_irradiance[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+}
+
+// how much of a light reaches 'dist' away, fading smoothly
+// to nothing at its radius (0 = no falloff at all). Must
+// match res/main.fs, as must the shading and
+// shadow functions below
+float attenuate(float dist, float radius)
+{
+	if(radius <= 0.0)
+		return 1.0;
+
+	float f = clamp(1.0 - (dist * dist) / (radius * radius), 0.0, 1.0);
+	return f * f;
+}
+
+vec3 shadeDirection(vec3 lightDir, vec3 lightDiffuse, vec3 lightSpecular, vec3 norm, vec3 viewDir, Material mat)
+{
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = lightDiffuse * (diff * mat.diffuse);
+
+	vec3 reflectDir = reflect(-lightDir, norm);
+
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), mat.shininess);
+	vec3 specular = lightSpecular * (spec * mat.specular);
+
+	return diffuse + specular;
+}
+
+vec3 shadeLight(vec3 pos, vec3 lightDiffuse, vec3 lightSpecular, float radius, vec3 worldPos, vec3 norm, vec3 viewDir, Material mat)
+{
+	vec3 toLight = pos - worldPos;
+	return shadeDirection(normalize(toLight), lightDiffuse, lightSpecular, norm, viewDir, mat) * attenuate(length(toLight), radius);
+}
+
+float sunShadow(vec3 worldPos, vec3 norm, float depth)
+{
+	if(sun_direction.w == 0.0 || depth > cascade_splits[cascade_count - 1])
+		return 1.0;
+
+	int cascade = 0;
+	while(cascade < cascade_count - 1 && depth > cascade_splits[cascade])
+		cascade ++;
+
+	vec3 pos = worldPos + norm * (2.0 * cascade_texels[cascade]);
+	vec4 p = cascade_matrices[cascade] * vec4(pos, 1.0);
+
+	return texture(shadowCascades, vec4(p.xy, float(cascade), p.z - 0.0002));
+}
+
+float pointShadow(LightRecord light, vec3 worldPos, vec3 norm)
+{
+	if(light.shadow < 0)
+		return 1.0;
+
+	float far = (light.radius > 0.0 ? light.radius : shadow_cube_far);
+	vec3 toPos = worldPos - light.pos;
+	vec3 dir = toPos + norm * (0.01 * length(toPos));
+
+	return texture(shadowCubes, vec4(dir, float(light.shadow)), length(dir) / far - 0.0005);
+}
+
+// a point on the far plane in view space
+vec3 unprojectFar(vec2 ndc)
+{
+	vec4 p = inv_projection * vec4(ndc, 1.0, 1.0);
+	return p.xyz / p.w;
+}
+
+// view space z of a depth buffer value
+float viewDepth(float depth)
+{
+	vec4 p = inv_projection * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0);
+	return p.z / p.w;
+}
+
+// the plane through the eye and two far corners,
+// flipped to face the middle of the tile
+vec4 sidePlane(vec3 a, vec3 b, vec3 middle)
+{
+	vec3 n = normalize(cross(a, b));
+
+	if(dot(n, middle) < 0.0)
+		n = -n;
+
+	return vec4(n, 0.0);
+}
+
+// whether a light can reach any pixel of the tile
+bool touchesTile(LightRecord light)
+{
+	if(light.radius <= 0.0)
+		return true;
+
+	vec3 center = (viewMatrix * vec4(light.pos, 1.0)).xyz;
+
+	// view space looks down -z, so the near end
+	// of the tile's range has the larger z
+	if(center.z - light.radius > tile_near || center.z + light.radius < tile_far)
+		return false;
+
+	for(int i = 0; i < 4; i ++)
+	{
+		if(dot(tile_planes[i].xyz, center) < -light.radius)
+			return false;
+	}
+	return true;
+}
+
+// one work group per 16x16 tile. The group finds the
+// depth range of what was drawn in the tile, then goes
+// through the buffered lights 256 at a time: each thread
+// tests one against the tile's bounds, and every pixel
+// is shaded by the ones that passed. Every pixel is lit
+// once, however many surfaces were drawn over it
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(lit);
+	uint thread = gl_LocalInvocationIndex;
+
+	if(thread == 0)
+	{
+		tile_min = 0xffffffffu;
+		tile_max = 0u;
+	}
+	barrier();
+
+	bool inside = (p.x < size.x && p.y < size.y);
+	uint material = 0u;
+	float depth = 1.0;
+
+	if(inside)
+	{
+		material = texelFetch(gMaterial, p, 0).r;
+		depth = texelFetch(gDepth, p, 0).r;
+	}
+
+	bool drawn = (material != 0u);
+
+	if(drawn)
+	{
+		atomicMin(tile_min, floatBitsToUint(depth));
+		atomicMax(tile_max, floatBitsToUint(depth));
+	}
+	barrier();
+
+	if(thread == 0)
+	{
+		vec2 first = vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy);
+		vec2 last = min(first + vec2(gl_WorkGroupSize.xy), vec2(size));
+
+		vec2 lo = first / vec2(size) * 2.0 - 1.0;
+		vec2 hi = last / vec2(size) * 2.0 - 1.0;
+
+		vec3 c00 = unprojectFar(vec2(lo.x, lo.y));
+		vec3 c10 = unprojectFar(vec2(hi.x, lo.y));
+		vec3 c01 = unprojectFar(vec2(lo.x, hi.y));
+		vec3 c11 = unprojectFar(vec2(hi.x, hi.y));
+		vec3 middle = unprojectFar((lo + hi) * 0.5);
+
+		tile_planes[0] = sidePlane(c00, c01, middle);
+		tile_planes[1] = sidePlane(c10, c11, middle);
+		tile_planes[2] = sidePlane(c00, c10, middle);
+		tile_planes[3] = sidePlane(c01, c11, middle);
+
+		tile_near = viewDepth(uintBitsToFloat(tile_min));
+		tile_far = viewDepth(uintBitsToFloat(tile_max));
+	}
+	barrier();
+
+	bool empty = (tile_min > tile_max);
+
+	vec3 finalColor = vec3(0.0);
+	vec4 objectColor = vec4(0.0);
+	vec3 norm = vec3(0.0);
+	vec3 worldPos = vec3(0.0);
+	vec3 viewDir = vec3(0.0);
+	Material mat;
+	bool is_picked = false;
+
+	if(drawn)
+	{
+		DrawRecord record = draws[material - 1u];
+
+		mat.ambient = record.ambient.rgb;
+		mat.diffuse = record.diffuse.rgb;
+		mat.specular = record.specular.rgb;
+		mat.shininess = record.specular.w;
+		is_picked = ((record.flags & draw_flag_picked) != 0);
+
+		objectColor = texelFetch(gAlbedo, p, 0);
+		norm = texelFetch(gNormal, p, 0).xyz;
+
+		vec2 ndc = (vec2(p) + 0.5) / vec2(size) * 2.0 - 1.0;
+		vec4 world = inv_view_proj * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+
+		worldPos = world.xyz / world.w;
+		viewDir = normalize(cameraPos.xyz - worldPos);
+
+		finalColor = objectColor.rgb * (irradiance(norm) * mat.ambient);
+
+		float pixelDepth = -(viewMatrix * vec4(worldPos, 1.0)).z;
+
+		if(sun_diffuse.rgb != vec3(0.0) || sun_specular.rgb != vec3(0.0))
+			finalColor = finalColor + (objectColor.rgb * shadeDirection(-sun_direction.xyz, sun_diffuse.rgb, sun_specular.rgb, norm, viewDir, mat) * sunShadow(worldPos, norm, pixelDepth));
+	}
+
+	// every thread has to reach each barrier, so tiles
+	// with nothing drawn in them skip the work, not the loop
+	for(int base = 0; base < light_count; base += tile_threads)
+	{
+		if(thread == 0)
+			tile_count = 0;
+		barrier();
+
+		int index = base + int(thread);
+
+		if(!empty && index < light_count && touchesTile(buffer_lights[index]))
+			tile_lights[atomicAdd(tile_count, 1)] = index;
+		barrier();
+
+		if(drawn)
+		{
+			for(int i = 0; i < tile_count; i ++)
+			{
+				LightRecord light = buffer_lights[tile_lights[i]];
+				finalColor = finalColor + (objectColor.rgb * shadeLight(light.pos, light.diffuse, light.specular.rgb, light.radius, worldPos, norm, viewDir, mat) * pointShadow(light, worldPos, norm));
+			}
+		}
+		barrier();
+	}
+
+	if(is_picked)
+		finalColor = mix(finalColor, vec3(1.0, 0.0, 0.0), 0.75);
+
+	if(inside)
+		imageStore(lit, p, vec4(finalColor, objectColor.a));
+}
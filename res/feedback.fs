@@ -0,0 +1,63 @@
+#version 440
+
+in vec2 Texcoord2D;
+flat in int DrawIndex;
+
+out uvec4 feedback;
+
+// must match DrawRecord and DRAW_FLAG_VIRTUAL in IndirectBatch.hpp
+struct DrawRecord {
+
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+
+	int flags;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords {
+	DrawRecord draws[];
+};
+
+const int draw_flag_virtual = 1;
+const int draw_indirect = 2;
+
+uniform int draw_mode;
+uniform int is_virtual;
+uniform int vt_id;
+uniform vec2 vt_pages;
+uniform float vt_max_mip;
+uniform float vt_bias;
+
+// must match TILE_SIZE in VirtualTexture.hpp
+const float vt_tile = 128.0;
+
+// writes the virtual page (and mip level) this fragment
+// would sample, with the texture ID offset by one so a
+// cleared pixel reads as "no page". 'vt_bias' makes up
+// for the framebuffer being smaller than the window
+void main()
+{
+	bool virtual_tex = (is_virtual == 1);
+
+	if(draw_mode == draw_indirect)
+		virtual_tex = ((draws[DrawIndex].flags & draw_flag_virtual) != 0);
+
+	if(!virtual_tex)
+	{
+		feedback = uvec4(0);
+		return;
+	}
+
+	vec2 texel = Texcoord2D * vt_pages * vt_tile;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+
+	float mip = floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt_bias);
+	mip = clamp(mip, 0.0, vt_max_mip);
+
+	ivec2 pages = max(ivec2(vt_pages) >> int(mip), ivec2(1));
+	ivec2 page = min(ivec2(fract(Texcoord2D) * vec2(pages)), pages - 1);
+
+	feedback = uvec4(uvec2(page), uint(mip), uint(vt_id + 1));
+}
@@ -0,0 +1,85 @@
+#version 440
+
+in vec2 Texcoord2D;
+in vec3 TexcoordCube;
+in vec3 Normal;
+in vec3 WorldPos;
+flat in int DrawIndex;
+
+// must match the order DeferredRenderer's
+// G-buffer attachments are declared in
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec4 normal;
+layout(location = 2) out uint material;
+
+// must match DrawRecord and DRAW_FLAG_* in IndirectBatch.hpp
+struct DrawRecord {
+
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+
+	int flags;
+	int draw;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords {
+	DrawRecord draws[];
+};
+
+const int draw_flag_virtual = 1;
+
+// must match TILE_SIZE, TILE_BORDER and
+// CACHE_SIZE in VirtualTexture.hpp/TileCache.hpp
+const float vt_tile = 128.0;
+const float vt_border = 4.0;
+const float vt_cache = 2040.0;
+
+uniform vec2 vt_pages;
+uniform float vt_max_mip;
+
+uniform sampler2D tex2D;
+uniform sampler2D vtIndirection;
+uniform sampler2D vtPhysical;
+
+// looks up the page covering 'uv' in the indirection
+// texture, then samples the physical page cache at
+// the matching spot. Pages that aren't loaded yet
+// resolve to their closest resident ancestor
+vec4 sampleVirtual(vec2 uv)
+{
+	vec2 texel = uv * vt_pages * vt_tile;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+
+	float mip = floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))));
+	mip = clamp(mip, 0.0, vt_max_mip);
+
+	vec2 wrapped = fract(uv);
+	ivec2 pages = max(ivec2(vt_pages) >> int(mip), ivec2(1));
+	ivec2 page = min(ivec2(wrapped * vec2(pages)), pages - 1);
+
+	vec4 entry = texelFetch(vtIndirection, page, int(mip));
+	if(entry.a == 0.0)
+		return vec4(0.0);
+
+	vec3 e = floor(entry.rgb * 255.0 + 0.5);
+	vec2 in_page = fract(wrapped * max(vt_pages / exp2(e.z), vec2(1.0)));
+
+	vec2 phys = (e.xy * (vt_tile + 2.0 * vt_border) + vt_border + in_page * vt_tile) / vt_cache;
+	return textureLod(vtPhysical, phys, 0.0);
+}
+
+// writes what res/deferred.cs needs to light the pixel
+// later: the surface color, the normal and which draw's
+// material it has. Only indirect draws have a material
+// to point to, so those are the only ones drawn here
+void main()
+{
+	DrawRecord record = draws[DrawIndex];
+	bool virtual_tex = ((record.flags & draw_flag_virtual) != 0);
+
+	albedo = (virtual_tex ? sampleVirtual(Texcoord2D) : texture(tex2D, Texcoord2D));
+	normal = vec4(normalize(Normal), 0.0);
+	material = uint(record.draw + 1);
+}
@@ -0,0 +1,57 @@
+#version 440
+
+// must match HIZ_GROUP_SIZE in HiZPyramid.hpp
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// must match HIZ_SRC_IMAGE/HIZ_DST_IMAGE in HiZPyramid.hpp
+layout(r32f, binding = 0) uniform readonly image2D src;
+layout(r32f, binding = 1) uniform writeonly image2D dst;
+
+// the copied depth buffer, read for level 0
+uniform sampler2D depth;
+uniform int hiz_level;
+
+// farthest depth of the source texels under 'p', taking
+// in the extra row/column an odd sized source leaves over
+float farthest(ivec2 p, ivec2 dst_size)
+{
+	ivec2 src_size = imageSize(src);
+	ivec2 last = src_size - 1;
+
+	ivec2 s = p * 2;
+	ivec2 span = ivec2(2, 2);
+
+	if(p.x == dst_size.x - 1 && (src_size.x & 1) != 0)
+		span.x = 3;
+
+	if(p.y == dst_size.y - 1 && (src_size.y & 1) != 0)
+		span.y = 3;
+
+	float d = 0.0;
+
+	for(int y = 0; y < span.y; y ++)
+	{
+		for(int x = 0; x < span.x; x ++)
+			d = max(d, imageLoad(src, min(s + ivec2(x, y), last)).r);
+	}
+
+	return d;
+}
+
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(dst);
+
+	if(p.x >= size.x || p.y >= size.y)
+		return;
+
+	float d;
+
+	if(hiz_level == 0)
+		d = texelFetch(depth, p, 0).r;
+	else
+		d = farthest(p, size);
+
+	imageStore(dst, p, vec4(d));
+}
@@ -1,12 +1,12 @@
 #version 440
-#extension GL_NV_shadow_samplers_cube : enable
 
 in vec2 Texcoord2D;
 in vec3 TexcoordCube;
 in vec3 Normal;
 in vec3 WorldPos;
+flat in int DrawIndex;
 
-out vec4 gl_FragColor;
+out vec4 fragColor;
 
 struct Material {
 	
@@ -16,52 +16,275 @@ struct Material {
 	float shininess;
 };
 
-struct Light {
+// must match DrawRecord and DRAW_FLAG_* in IndirectBatch.hpp
+struct DrawRecord {
+
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+
+	int flags;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords {
+	DrawRecord draws[];
+};
+
+// must match LightRecord in LightBuffer.hpp
+struct LightRecord {
 
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
 	vec3 pos;
+	float radius;
+	vec3 diffuse;
+	int shadow;
+	vec4 specular;
 };
 
-const int max_lights = 10;
+layout(std430, binding = 3) readonly buffer LightRecords {
+	int light_count;
+	LightRecord buffer_lights[];
+};
+
+// must match ClusterHeader in LightClusters.hpp. Each
+// cluster is an (offset, count) into cluster_lights;
+// cluster_params is the tile size in pixels and the
+// scale and bias from log(view depth) to a slice
+layout(std430, binding = 4) readonly buffer ClusterRecords {
+	ivec4 cluster_grid;
+	vec4 cluster_params;
+	uvec2 clusters[];
+};
+
+layout(std430, binding = 5) readonly buffer ClusterLights {
+	int cluster_lights[];
+};
+
+const int draw_flag_virtual = 1;
+const int draw_flag_picked = 2;
+const int draw_indirect = 2;
+
+// must match SHADOW_CASCADES in UniformBlocks.hpp
+// and SHADOW_CUBE_FAR in ShadowMaps.hpp
+const int cascade_count = 4;
+const float shadow_cube_far = 1000.0;
+
+// must match TILE_SIZE, TILE_BORDER and
+// CACHE_SIZE in VirtualTexture.hpp/TileCache.hpp
+const float vt_tile = 128.0;
+const float vt_border = 4.0;
+const float vt_cache = 2040.0;
 
-uniform int num_lights;
 uniform int is_skybox;
 uniform int picked;
+uniform int draw_mode;
 
-uniform struct Light lights[max_lights];
-uniform struct Material material;
+uniform int is_virtual;
+uniform vec2 vt_pages;
+uniform float vt_max_mip;
+
+// must match the blocks in UniformBlocks.hpp
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 projMatrix;
+	mat4 viewMatrix;
+	mat4 viewProjMatrix;
+	vec4 cameraPos;
+};
+
+// sh_irradiance is the skybox irradiance / pi as
+// L2 spherical harmonics, see SphericalHarmonics.hpp.
+// sun_direction.w is 1 when the sun's cascades are in use
+layout(std140, binding = 1) uniform LightBlock {
+	vec3 sh_irradiance[9];
+
+	vec4 sun_direction;
+	vec4 sun_diffuse;
+	vec4 sun_specular;
+
+	mat4 cascade_matrices[cascade_count];
+	vec4 cascade_splits;
+	vec4 cascade_texels;
+};
+
+layout(std140, binding = 2) uniform MaterialBlock {
+	Material material;
+};
 
 uniform sampler2D tex2D;
 uniform samplerCube texCube;
+uniform sampler2D vtIndirection;
+uniform sampler2D vtPhysical;
+uniform sampler2DArrayShadow shadowCascades;
+uniform samplerCubeArrayShadow shadowCubes;
+
+// looks up the page covering 'uv' in the indirection
+// texture, then samples the physical page cache at
+// the matching spot. Pages that aren't loaded yet
+// resolve to their closest resident ancestor
+vec4 sampleVirtual(vec2 uv)
+{
+	vec2 texel = uv * vt_pages * vt_tile;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+
+	float mip = floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))));
+	mip = clamp(mip, 0.0, vt_max_mip);
+
+	vec2 wrapped = fract(uv);
+	ivec2 pages = max(ivec2(vt_pages) >> int(mip), ivec2(1));
+	ivec2 page = min(ivec2(wrapped * vec2(pages)), pages - 1);
+
+	vec4 entry = texelFetch(vtIndirection, page, int(mip));
+	if(entry.a == 0.0)
+		return vec4(0.0);
+
+	vec3 e = floor(entry.rgb * 255.0 + 0.5);
+	vec2 in_page = fract(wrapped * max(vt_pages / exp2(e.z), vec2(1.0)));
+
+	vec2 phys = (e.xy * (vt_tile + 2.0 * vt_border) + vt_border + in_page * vt_tile) / vt_cache;
+	return textureLod(vtPhysical, phys, 0.0);
+}
+
+// evaluates the SH irradiance for a unit normal
+vec3 irradiance(vec3 n)
+{
+	return sh_irradiance[0] * 0.282095
+		+ sh_irradiance[1] * (0.488603 * n.y)
+		+ sh_irradiance[2] * (0.488603 * n.z)
+		+ sh_irradiance[3] * (0.488603 * n.x)
+		+ sh_irradiance[4] * (1.092548 * n.x * n.y)
+		+ sh_irradiance[5] * (1.092548 * n.y * n.z)
+		+ sh_irradiance[6] * (0.315392 * (3.0 * n.z * n.z - 1.0))
+		+ sh_irradiance[7] * (1.092548 * n.x * n.z)
+		+ sh_irradiance[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+}
+
+// how much of a light reaches 'dist' away, fading smoothly
+// to nothing at its radius (0 = no falloff at all)
+float attenuate(float dist, float radius)
+{
+	if(radius <= 0.0)
+		return 1.0;
+
+	float f = clamp(1.0 - (dist * dist) / (radius * radius), 0.0, 1.0);
+	return f * f;
+}
+
+// the diffuse and specular light a light from 'lightDir' adds
+vec3 shadeDirection(vec3 lightDir, vec3 lightDiffuse, vec3 lightSpecular, vec3 norm, vec3 viewDir, Material mat)
+{
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = lightDiffuse * (diff * mat.diffuse);
+
+	vec3 reflectDir = reflect(-lightDir, norm); 
+
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), mat.shininess);
+	vec3 specular = lightSpecular * (spec * mat.specular); 
+
+	return diffuse + specular;
+}
+
+// the diffuse and specular light one point light adds
+vec3 shadeLight(vec3 pos, vec3 lightDiffuse, vec3 lightSpecular, float radius, vec3 norm, vec3 viewDir, Material mat)
+{
+	vec3 toLight = pos - WorldPos;
+	return shadeDirection(normalize(toLight), lightDiffuse, lightSpecular, norm, viewDir, mat) * attenuate(length(toLight), radius);
+}
+
+// how much of the sun reaches this fragment, from the
+// first cascade reaching its view depth. The point looked
+// up is pushed out along the normal by a couple of the
+// cascade's texels, so surfaces don't shadow themselves.
+// Must match res/deferred.cs, as must 'pointShadow'
+float sunShadow(vec3 norm, float depth)
+{
+	if(sun_direction.w == 0.0 || depth > cascade_splits[cascade_count - 1])
+		return 1.0;
+
+	int cascade = 0;
+	while(cascade < cascade_count - 1 && depth > cascade_splits[cascade])
+		cascade ++;
+
+	vec3 pos = WorldPos + norm * (2.0 * cascade_texels[cascade]);
+	vec4 p = cascade_matrices[cascade] * vec4(pos, 1.0);
+
+	return texture(shadowCascades, vec4(p.xy, float(cascade), p.z - 0.0002));
+}
+
+// how much of a point light with a shadow cube reaches
+// this fragment (the cube holds distances over its reach)
+float pointShadow(LightRecord light, vec3 norm)
+{
+	if(light.shadow < 0)
+		return 1.0;
+
+	float far = (light.radius > 0.0 ? light.radius : shadow_cube_far);
+	vec3 toPos = WorldPos - light.pos;
+	vec3 dir = toPos + norm * (0.01 * length(toPos));
+
+	return texture(shadowCubes, vec4(dir, float(light.shadow)), length(dir) / far - 0.0005);
+}
+
+// the cluster this fragment falls in, from its
+// screen tile and the slice its view depth is in
+int clusterIndex(float viewDepth)
+{
+	float depth = max(viewDepth, 1e-4);
+
+	ivec3 cell;
+	cell.xy = ivec2(gl_FragCoord.xy / cluster_params.xy);
+	cell.z = int(log(depth) * cluster_params.z + cluster_params.w);
+	cell = clamp(cell, ivec3(0), cluster_grid.xyz - 1);
+
+	return (cell.z * cluster_grid.y + cell.y) * cluster_grid.x + cell.x;
+}
 
 void main()
 {
-	vec3 finalColor = vec3(0.0);
-	vec3 norm = normalize(Normal);
-	vec4 objectColor = texture2D(tex2D, Texcoord2D);
-	vec4 skyboxColor = textureCube(texCube, TexcoordCube);
+	Material mat = material;
+	bool is_picked = (picked == 1);
+	bool virtual_tex = (is_virtual == 1);
 
-	for(int i = 0; i < num_lights && i < max_lights; i ++)
+	// indirect draws carry their material and
+	// flags in their draw record instead
+	if(draw_mode == draw_indirect)
 	{
-		struct Light light = lights[i];
+		DrawRecord record = draws[DrawIndex];
 
-		vec3 ambient = light.ambient * material.ambient;
-		vec3 lightDir = normalize(light.pos - WorldPos);
+		mat.ambient = record.ambient.rgb;
+		mat.diffuse = record.diffuse.rgb;
+		mat.specular = record.specular.rgb;
+		mat.shininess = record.specular.w;
 
-		float diff = max(dot(norm, lightDir), 0.0);
-		vec3 diffuse = light.diffuse * (diff * material.diffuse);
+		is_picked = ((record.flags & draw_flag_picked) != 0);
+		virtual_tex = ((record.flags & draw_flag_virtual) != 0);
+	}
+
+	vec3 norm = normalize(Normal);
+	vec4 objectColor = (virtual_tex ? sampleVirtual(Texcoord2D) : texture(tex2D, Texcoord2D));
+	vec4 skyboxColor = texture(texCube, TexcoordCube);
+
+	vec3 finalColor = objectColor.rgb * (irradiance(norm) * mat.ambient);
+
+	vec3 viewDir = normalize(cameraPos.xyz - WorldPos);
+
+	// the sun, then only the lights that can reach
+	// this fragment's cluster
+	if(is_skybox == 0)
+	{
+		float viewDepth = -(viewMatrix * vec4(WorldPos, 1.0)).z;
 
-		vec3 viewDir = normalize(-WorldPos);
-		vec3 reflectDir = reflect(-lightDir, norm); 
+		if(sun_diffuse.rgb != vec3(0.0) || sun_specular.rgb != vec3(0.0))
+			finalColor = finalColor + (objectColor.rgb * shadeDirection(-sun_direction.xyz, sun_diffuse.rgb, sun_specular.rgb, norm, viewDir, mat) * sunShadow(norm, viewDepth));
 
-		float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-		vec3 specular = light.specular * (spec * material.specular); 
+		uvec2 cluster = clusters[clusterIndex(viewDepth)];
 
-		finalColor = finalColor + (objectColor.rgb * (ambient + diffuse + specular));
+		for(uint i = 0; i < cluster.y; i ++)
+		{
+			LightRecord light = buffer_lights[cluster_lights[cluster.x + i]];
+			finalColor = finalColor + (objectColor.rgb * shadeLight(light.pos, light.diffuse, light.specular.rgb, light.radius, norm, viewDir, mat) * pointShadow(light, norm));
+		}
 	}
-	if(picked == 1)
+	if(is_picked)
 	{
 		finalColor = mix(finalColor, vec3(1.0, 0.0, 0.0), 0.75);
 	}
@@ -69,6 +292,6 @@ void main()
 	vec4 t0 = vec4(finalColor, objectColor.a);
 	vec4 t1 = vec4(skyboxColor.rgb, 1.0);
 
-	gl_FragColor = mix(t0, t1, is_skybox);
+	fragColor = mix(t0, t1, is_skybox);
 }
 
@@ -1,29 +1,78 @@
 #version 440
+#extension GL_ARB_shader_draw_parameters : require
 
-in vec2 texcoord2D;
-in vec3 texcoordCube;
-in vec3 position;
-in vec3 normal;
+#pragma vertex_inputs
 
 out vec2 Texcoord2D;
 out vec3 TexcoordCube;
 out vec3 Normal;
 out vec3 WorldPos;
+flat out int DrawIndex;
 
-uniform mat4 modelViewMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+// must match InstanceData in VertexLayout.hpp
+struct ObjectRecord {
+
+	mat4 model;
+	mat3 normal;
+};
+
+layout(std430, binding = 1) readonly buffer ObjectRecords {
+	ObjectRecord objects[];
+};
+
+// the objects being drawn this frame, in draw order.
+// Each draw's run of them starts at its base instance
+layout(std430, binding = 2) readonly buffer VisibleObjects {
+	int visible[];
+};
+
+// must match FrameBlock in UniformBlocks.hpp
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 projMatrix;
+	mat4 viewMatrix;
+	mat4 viewProjMatrix;
+	vec4 cameraPos;
+};
+
+// must match the DRAW_MODE_* values in Shader.hpp
+const int draw_single = 0;
+const int draw_instanced = 1;
+const int draw_indirect = 2;
+
+uniform mat4 modelMatrix;
+uniform mat4 mvpMatrix;
+uniform mat3 normalMatrix;
+uniform int draw_mode;
 
 void main()
 {
 	Texcoord2D = texcoord2D;
 	TexcoordCube = texcoordCube;
+	DrawIndex = gl_DrawIDARB;
 	
 	vec4 realPos = vec4(position.xyz, 1.0);
-	mat4 modelMatrix = inverse(viewMatrix) * modelViewMatrix;
-	
-	Normal = mat3(transpose(inverse(modelMatrix))) * normal;
-	WorldPos = (modelMatrix * realPos).xyz;
-	
-	gl_Position = vec4(modelViewMatrix * projMatrix * realPos);
+
+	if(draw_mode == draw_indirect)
+	{
+		ObjectRecord object = objects[visible[gl_BaseInstanceARB + gl_InstanceID]];
+
+		Normal = object.normal * normal;
+		WorldPos = (object.model * realPos).xyz;
+
+		gl_Position = viewProjMatrix * vec4(WorldPos, 1.0);
+	}
+	else if(draw_mode == draw_instanced)
+	{
+		Normal = instanceNormal * normal;
+		WorldPos = (instanceModel * realPos).xyz;
+
+		gl_Position = viewProjMatrix * vec4(WorldPos, 1.0);
+	}
+	else
+	{
+		Normal = normalMatrix * normal;
+		WorldPos = (modelMatrix * realPos).xyz;
+
+		gl_Position = mvpMatrix * realPos;
+	}
 }
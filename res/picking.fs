@@ -1,10 +1,10 @@
 #version 440
 
-out vec4 gl_FragColor;
+out vec4 fragColor;
 
 uniform int uuid;
  
 void main()
 {
-    gl_FragColor = vec4(uuid / 255.0, 0, 0, 1.0);
+    fragColor = vec4(uuid / 255.0, 0, 0, 1.0);
 }
@@ -1,16 +1,11 @@
 #version 440
 
-in vec2 texcoord2D;
-in vec3 texcoordCube;
-in vec3 position;
-in vec3 normal;
+#pragma vertex_inputs
 
-uniform mat4 modelViewMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
+uniform mat4 mvpMatrix;
 
 void main()
 {
 	vec4 realPos = vec4(position.xyz, 1.0);
-	gl_Position = vec4(modelViewMatrix * projMatrix * realPos);
+	gl_Position = mvpMatrix * realPos;
 }
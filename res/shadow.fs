@@ -0,0 +1,13 @@
+#version 440
+
+in vec3 WorldPos;
+
+// a point light's position and how far its shadows
+// reach (w). Cube shadows store the distance to the
+// light over that instead of the window depth
+uniform vec4 shadow_light;
+
+void main()
+{
+	gl_FragDepth = length(WorldPos - shadow_light.xyz) / shadow_light.w;
+}
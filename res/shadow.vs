@@ -0,0 +1,34 @@
+#version 440
+#extension GL_ARB_shader_draw_parameters : require
+
+#pragma vertex_inputs
+
+out vec3 WorldPos;
+
+// must match InstanceData in VertexLayout.hpp
+struct ObjectRecord {
+
+	mat4 model;
+	mat3 normal;
+};
+
+layout(std430, binding = 1) readonly buffer ObjectRecords {
+	ObjectRecord objects[];
+};
+
+// the objects being drawn, in draw order. Each
+// draw's run of them starts at its base instance
+layout(std430, binding = 2) readonly buffer VisibleObjects {
+	int visible[];
+};
+
+// the shadow map's view-projection matrix
+uniform mat4 shadow_matrix;
+
+void main()
+{
+	ObjectRecord object = objects[visible[gl_BaseInstanceARB + gl_InstanceID]];
+
+	WorldPos = (object.model * vec4(position.xyz, 1.0)).xyz;
+	gl_Position = shadow_matrix * vec4(WorldPos, 1.0);
+}